@@ -40,6 +40,15 @@ uniform Light u_light;
   uniform float u_clip_space_split_distances[NUM_SPLITS];
  #endif
 #endif
+#ifdef USE_CLUSTERED_LIGHTS
+ uniform mat4 u_view;
+ uniform vec3 u_cluster_dimensions; // tiles in x, tiles in y, depth slices
+ uniform vec2 u_cluster_depth_params; // slice = log(depth) * scale + bias
+ uniform vec2 u_viewport_size;
+ uniform samplerBuffer u_light_data_sampler; // (position, radius), (color, 0) for each light
+ uniform usamplerBuffer u_light_grid_sampler; // (offset, count) for each cluster
+ uniform usamplerBuffer u_light_index_sampler;
+#endif
 
 // PBR Inputs
 uniform samplerCube u_diffuse_env_sampler;
@@ -199,6 +208,58 @@ float MicrofacetDistribution(PBRInfo pbr_inputs)
 	return roughnessSq / (PI * f * f);
 }
 
+#ifdef USE_CLUSTERED_LIGHTS
+// Analytical lighting from a single light source, l is the vector from surface point to light
+vec3 GetLightContribution(PBRInfo pbr_inputs, vec3 n, vec3 v, vec3 l, vec3 radiance)
+{
+	vec3 h = normalize(l + v);
+	pbr_inputs.NdotL = clamp(dot(n, l), 0.001, 1.0);
+	pbr_inputs.NdotH = clamp(dot(n, h), 0.0, 1.0);
+	pbr_inputs.LdotH = clamp(dot(l, h), 0.0, 1.0);
+	pbr_inputs.VdotH = clamp(dot(v, h), 0.0, 1.0);
+
+	vec3 F = SpecularReflection(pbr_inputs);
+	float G = GeometricOcclusion(pbr_inputs);
+	float D = MicrofacetDistribution(pbr_inputs);
+
+	vec3 diffuse_contrib = (1.0 - F) * Diffuse(pbr_inputs);
+	vec3 spec_contrib = F * G * D / (4.0 * pbr_inputs.NdotL * pbr_inputs.NdotV);
+	return pbr_inputs.NdotL * radiance * (diffuse_contrib + spec_contrib);
+}
+// Loops only over lights binned on CPU into the fragment's cluster
+vec3 GetClusteredLightsContribution(PBRInfo pbr_inputs, vec3 n, vec3 v)
+{
+	float depth = -(u_view * vec4(fs_in.position, 1.0)).z;
+	float slice = log(max(depth, 1e-4)) * u_cluster_depth_params.x + u_cluster_depth_params.y;
+	ivec3 dimensions = ivec3(u_cluster_dimensions);
+	ivec3 cluster = ivec3(gl_FragCoord.xy / u_viewport_size * u_cluster_dimensions.xy, slice);
+	cluster = clamp(cluster, ivec3(0), dimensions - 1);
+	int cluster_index = (cluster.z * dimensions.y + cluster.y) * dimensions.x + cluster.x;
+
+	uvec2 offset_count = texelFetch(u_light_grid_sampler, cluster_index).rg;
+	vec3 color = vec3(0.0);
+	for (uint i = 0u; i < offset_count.y; ++i)
+	{
+		int light = int(texelFetch(u_light_index_sampler, int(offset_count.x + i)).r);
+		vec4 position_radius = texelFetch(u_light_data_sampler, 2 * light);
+		vec3 light_color = texelFetch(u_light_data_sampler, 2 * light + 1).rgb;
+
+		vec3 to_light = position_radius.xyz - fs_in.position;
+		float distance_sq = dot(to_light, to_light);
+		float radius_sq = position_radius.w * position_radius.w;
+		if (distance_sq >= radius_sq)
+			continue;
+		// Inverse square falloff windowed to reach zero at light radius
+		float ratio = distance_sq / radius_sq;
+		float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+		float attenuation = window * window / (distance_sq + 1.0);
+		vec3 l = to_light * inversesqrt(distance_sq);
+		color += GetLightContribution(pbr_inputs, n, v, l, light_color * attenuation);
+	}
+	return color;
+}
+#endif
+
 #ifdef USE_SHADOW
 #ifdef USE_CSM
 int GetCascadeIndex()
@@ -330,5 +391,10 @@ void main()
 	color *= visibility;
 #endif
 
+#ifdef USE_CLUSTERED_LIGHTS
+	// Point lights don't cast shadows
+	color += GetClusteredLightsContribution(pbr_inputs, n, v);
+#endif
+
 	out_color = vec4(pow(color, vec3(1.0/GAMMA)), base_color.a);
 }
\ No newline at end of file
@@ -7,9 +7,14 @@ layout(location = 2) in vec2 a_texcoord;
  layout(location = 3) in vec3 a_tangent;
  layout(location = 4) in vec3 a_binormal;
 #endif
+#ifdef USE_INSTANCING
+ layout(location = 5) in mat4 a_instance_model;
+#endif
 
 uniform mat4 u_projection_view;
-uniform mat4 u_model;
+#ifndef USE_INSTANCING
+ uniform mat4 u_model;
+#endif
 #ifdef USE_SHADOW
  #ifdef USE_CSM
   uniform mat4 u_depth_bias_projection_view[NUM_SPLITS];
@@ -39,9 +44,14 @@ out DATA
 
 void main()
 {
-	vec4 position_world = u_model * vec4(a_position, 1.0);
+#ifdef USE_INSTANCING
+	mat4 model_matrix = a_instance_model;
+#else
+	mat4 model_matrix = u_model;
+#endif
+	vec4 position_world = model_matrix * vec4(a_position, 1.0);
 
-	mat3 model = mat3(u_model);
+	mat3 model = mat3(model_matrix);
 	vec3 normal = model * a_normal;
 #ifdef USE_TANGENT
 	vec3 binormal = model * a_binormal;
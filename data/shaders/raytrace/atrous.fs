@@ -0,0 +1,85 @@
+#version 330 core
+
+#ifdef GL_core_profile
+out vec4 out_color;
+#endif
+
+in DATA
+{
+	vec2 uv;
+} fs_in;
+
+// One iteration of edge avoiding a-trous wavelet filter, same as DenoiseAtrous of the CPU tracer
+
+uniform sampler2D u_texture; // HDR radiance, original or previous iteration
+uniform sampler2D u_guide_sampler; // packed normal, packed albedo, primary hit distance
+uniform vec2 u_size; // traced area, taps outside of it are skipped
+uniform float u_step; // distance between kernel taps, doubles every iteration
+uniform float u_color_weight; // inverse squared sigmas
+uniform float u_normal_weight;
+uniform float u_albedo_weight;
+uniform float u_inv_depth_sigma; // depth difference is relative to the center depth
+
+const float kKernel[5] = float[](1.0 / 16.0, 1.0 / 4.0, 3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+const float kMinDepth = 1e-3;
+const float kMaxRadiance = 1e5;
+
+// Exp(-x) for x >= 0 as (1 - x/256)^256, the same approximation as the CPU denoiser uses
+float ExpNegative(float x)
+{
+	float y = max(1.0 - x * (1.0 / 256.0), 0.0);
+	for (int i = 0; i < 8; ++i)
+		y *= y;
+	return y;
+}
+vec3 UnpackUnorm8(float value)
+{
+	return vec3(mod(value, 256.0), mod(floor(value / 256.0), 256.0), floor(value / 65536.0)) / 255.0;
+}
+// Keeps NaN and infinite radiance of rare degenerate paths from spreading over the filter footprint
+vec3 FetchColor(ivec2 coord)
+{
+	vec3 color = texelFetch(u_texture, coord, 0).rgb;
+	return any(isnan(color)) ? vec3(0.0) : clamp(color, 0.0, kMaxRadiance);
+}
+
+void main()
+{
+	ivec2 size = ivec2(u_size);
+	ivec2 center = ivec2(gl_FragCoord.xy);
+	int tap_step = int(u_step);
+	vec3 color = FetchColor(center);
+	vec3 guide = texelFetch(u_guide_sampler, center, 0).xyz;
+	vec3 normal = UnpackUnorm8(guide.x) * 2.0 - 1.0;
+	vec3 albedo = UnpackUnorm8(guide.y);
+	float depth_weight = u_inv_depth_sigma / max(guide.z, kMinDepth);
+
+	vec3 sum = vec3(0.0);
+	float weight_sum = 0.0;
+	for (int dy = -2; dy <= 2; ++dy)
+	{
+		for (int dx = -2; dx <= 2; ++dx)
+		{
+			ivec2 coord = center + ivec2(dx, dy) * tap_step;
+			if (any(lessThan(coord, ivec2(0))) || any(greaterThanEqual(coord, size)))
+				continue;
+			vec3 tap_color = FetchColor(coord);
+			vec3 tap_guide = texelFetch(u_guide_sampler, coord, 0).xyz;
+			vec3 dc = tap_color - color;
+			vec3 dn = UnpackUnorm8(tap_guide.x) * 2.0 - 1.0 - normal;
+			vec3 da = UnpackUnorm8(tap_guide.y) - albedo;
+			float dz = (max(tap_guide.z, kMinDepth) - max(guide.z, kMinDepth)) * depth_weight;
+			float weight = kKernel[dx + 2] * kKernel[dy + 2] * ExpNegative(dot(dc, dc) * u_color_weight
+				+ dot(dn, dn) * u_normal_weight + dz * dz + dot(da, da) * u_albedo_weight);
+			sum += weight * tap_color;
+			weight_sum += weight;
+		}
+	}
+	// Center tap always has positive weight
+#ifdef GL_core_profile
+	out_color
+#else
+	gl_FragColor
+#endif
+		= vec4(sum / weight_sum, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#version 330 core
+
+#ifdef GL_core_profile
+out vec4 out_color;
+#endif
+
+in DATA
+{
+	vec2 uv;
+} fs_in;
+
+#define GAMMA 2.2
+
+uniform sampler2D u_texture; // accumulated HDR radiance
+uniform vec2 u_uv_scale; // traced area may be smaller than the texture
+uniform vec2 u_uv_max; // center of the last traced texel, keeps filtering inside traced area
+
+vec3 Uncharted2ToneMapping(vec3 color)
+{
+	float A = 0.15;
+	float B = 0.50;
+	float C = 0.10;
+	float D = 0.20;
+	float E = 0.02;
+	float F = 0.30;
+	float W = 11.2;
+	float exposure = 0.012;
+	color *= exposure;
+	color = ((color * (A * color + C * B) + D * E) / (color * (A * color + B) + D * F)) - E / F;
+	float white = ((W * (A * W + C * B) + D * E) / (W * (A * W + B) + D * F)) - E / F;
+	color /= white;
+	color = pow(color, vec3(1. / GAMMA));
+	return color;
+}
+
+void main()
+{
+	vec3 color = texture(u_texture, min(fs_in.uv * u_uv_scale, u_uv_max)).rgb;
+#ifdef GL_core_profile
+	out_color
+#else
+	gl_FragColor
+#endif
+		= vec4(Uncharted2ToneMapping(color), 1.0);
+}
\ No newline at end of file
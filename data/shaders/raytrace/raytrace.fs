@@ -22,7 +22,7 @@ struct Hit {
 	vec3 normal;
 	float t;	// solution to p=o+t*d
 	bool exists;
-	Material material;
+	int material; // index in material buffer
 };
 struct Plane {
 	vec3 normal; // (a,b,c)
@@ -40,6 +40,11 @@ struct DirectionalLight {
 	vec3 color;
 	vec3 direction;
 };
+struct TriangleRay { // per ray constants of the watertight triangle test
+	vec3 origin;
+	ivec3 k; // axis permutation making z the dominant direction axis
+	vec3 shear;
+};
 struct TracedRay {
 	Ray incident;
 	vec3 attenuation;
@@ -48,17 +53,36 @@ struct TracedRay {
 
 // Defines
 #define PI 3.14159265358979
-#define GAMMA 2.2
 // ############################################
 // Make sure that this condition is true:     |
-// 2 ^ (MAX_DEPTH + 2) - 1 <= MAX_TRACED_RAYS |
+// 2 ^ (MAX_DEPTH + 1) <= MAX_TRACED_RAYS     |
+// or MAX_DEPTH + 2 <= MAX_TRACED_RAYS for    |
+// scenes without glass, see TracedRayBudget  |
+#ifndef MAX_DEPTH
 #define MAX_DEPTH 5
+#endif
+#ifndef MAX_TRACED_RAYS
 #define MAX_TRACED_RAYS 128
+#endif
 // ############################################
 
-#define MAX_PLANES 1
-#define MAX_SPHERES 1
-#define MAX_BOXES 1
+// Scene specialized permutations have counts as constants, so their loops unroll
+#ifdef NUM_PLANES
+#define PLANE_COUNT NUM_PLANES
+#else
+#define PLANE_COUNT u_num_planes
+#endif
+#ifdef NUM_LIGHTS
+#define LIGHT_COUNT NUM_LIGHTS
+#else
+#define LIGHT_COUNT u_num_lights
+#endif
+#if defined(NUM_PLANES) || defined(NUM_LIGHTS)
+#pragma optionNV(unroll all)
+#endif
+
+// Matches Bvh::kStackSize, build keeps tree depth below it
+#define BVH_STACK_SIZE 64
 
 uniform vec3 u_eye;
 uniform vec3 u_ray00;
@@ -66,20 +90,27 @@ uniform vec3 u_ray10;
 uniform vec3 u_ray01;
 uniform vec3 u_ray11;
 
-uniform DirectionalLight u_light;
+// Progressive accumulation
+uniform sampler2D u_accumulation_sampler; // previous samples, one texel per pixel
+uniform vec2 u_jitter; // subpixel offset in UV units
+uniform float u_blend; // weight of the new sample, 1/(n+1) for n accumulated samples
 
-uniform Plane u_planes[MAX_PLANES];
-uniform Sphere u_spheres[MAX_SPHERES];
-uniform Box u_boxes[MAX_BOXES];
+// Scene is stored in texture buffers, two texels per element, see SceneBuffers
+uniform samplerBuffer u_material_sampler; // (color, f0), (type, 0)
+uniform samplerBuffer u_plane_sampler; // (normal, d), (material, 0)
+uniform samplerBuffer u_light_sampler; // (color, 0), (direction, 0)
 uniform int u_num_planes;
-uniform int u_num_spheres;
-uniform int u_num_boxes;
+uniform int u_num_lights;
+
+// Spheres and boxes are traced through BVH
+uniform samplerBuffer u_bvh_node_sampler; // (min, offset), (max, count) for each node
+uniform samplerBuffer u_bvh_primitive_sampler; // (position, radius), (0, material) for spheres; (min, -1), (max, material) for boxes;
+                                               // (position, -2), (scale, mesh root node, 0, material) for mesh instances
+uniform samplerBuffer u_triangle_sampler; // (v0, 0), (v1, 0), (v2, 0) in mesh leaf order, mesh leaves point here
+uniform int u_num_bvh_nodes;
 
 const float kEpsilon = 0.01;
-const Material kPlaneMaterial = Material(vec3(0.5, 0.4, 0.3), 0.02, 0);
-const Material kSphereMaterial = Material(vec3(0.5), 0.02, 1);
-const Material kBoxMaterial = Material(vec3(0.5, 0.9, 0.0), 0.02, 1);
-const Hit kNoHit = Hit(vec3(0.0), 1e5, false, Material(vec3(0.0), 0.0, 0));
+const Hit kNoHit = Hit(vec3(0.0), 1e5, false, 0);
 
 // Indices of refraction
 const float n_air = 1.0;
@@ -110,7 +141,19 @@ vec3 BoxNormal(const Box box, const vec3 point)
 		float(int(pc.z/size.z*bias))
 		));
 }
-Hit IntersectPlane(const Plane plane, const Ray ray, const Material material)
+Material FetchMaterial(int index)
+{
+	vec4 texel0 = texelFetch(u_material_sampler, 2 * index);
+	vec4 texel1 = texelFetch(u_material_sampler, 2 * index + 1);
+	return Material(texel0.xyz, texel0.w, int(texel1.x));
+}
+DirectionalLight FetchLight(int index)
+{
+	vec4 texel0 = texelFetch(u_light_sampler, 2 * index);
+	vec4 texel1 = texelFetch(u_light_sampler, 2 * index + 1);
+	return DirectionalLight(texel0.rgb, texel1.xyz);
+}
+Hit IntersectPlane(const Plane plane, const Ray ray, const int material)
 {
 	float dotnd = dot(plane.normal, ray.direction);
 	if (dotnd > 0.0) return kNoHit;
@@ -118,7 +161,7 @@ Hit IntersectPlane(const Plane plane, const Ray ray, const Material material)
 	float t = -(dot(ray.origin, plane.normal) + plane.d) / dotnd;
 	return Hit(plane.normal, t, true, material);
 }
-Hit IntersectSphere(const Sphere sphere, const Ray ray, const Material material)
+Hit IntersectSphere(const Sphere sphere, const Ray ray, const int material)
 {
 	vec3 op = sphere.position - ray.origin;
 	float b = dot(op, ray.direction);
@@ -133,7 +176,7 @@ Hit IntersectSphere(const Sphere sphere, const Ray ray, const Material material)
 	vec3 hit_normal = (ray.origin + t * ray.direction - sphere.position) / sphere.radius;
 	return Hit(hit_normal, t, true, material);
 }
-Hit IntersectBox(const Box box, const Ray ray, const Material material)
+Hit IntersectBox(const Box box, const Ray ray, const int material)
 {
 	vec3 tMin = (box.min - ray.origin) / ray.direction;
 	vec3 tMax = (box.max - ray.origin) / ray.direction;
@@ -149,47 +192,261 @@ Hit IntersectBox(const Box box, const Ray ray, const Material material)
 	return Hit(hit_normal, t, true, material);
 }
 
-Hit IntersectScene(Ray ray)
+// Distance to node bounds or kNoHit.t if they are missed or farther than the limit
+float IntersectBounds(int node, vec3 origin, vec3 inv_direction, float limit)
 {
-	Hit hit = kNoHit;
-	// Intersection with planes
-	for (int i = 0; i < u_num_planes; ++i)
+	vec3 node_min = texelFetch(u_bvh_node_sampler, 2 * node).xyz;
+	vec3 node_max = texelFetch(u_bvh_node_sampler, 2 * node + 1).xyz;
+	vec3 t1 = (node_min - origin) * inv_direction;
+	vec3 t2 = (node_max - origin) * inv_direction;
+	vec3 t_min = min(t1, t2);
+	vec3 t_max = max(t1, t2);
+	float t_near = max(max(max(t_min.x, t_min.y), t_min.z), 0.0);
+	float t_far = min(min(min(t_max.x, t_max.y), t_max.z), limit);
+	return (t_near <= t_far) ? t_near : kNoHit.t;
+}
+TriangleRay SetupTriangleRay(Ray ray)
+{
+	vec3 d = abs(ray.direction);
+	int kz = (d.x > d.y) ? ((d.x > d.z) ? 0 : 2) : ((d.y > d.z) ? 1 : 2);
+	int kx = (kz == 2) ? 0 : kz + 1;
+	int ky = (kx == 2) ? 0 : kx + 1;
+	// Swapping keeps winding of the sheared triangle, so both sides are hit
+	if (ray.direction[kz] < 0.0)
 	{
-		Hit cur_hit = IntersectPlane(u_planes[i], ray, kPlaneMaterial);
-		if (cur_hit.exists && cur_hit.t < hit.t)
-			hit = cur_hit;
+		int k = kx; kx = ky; ky = k;
 	}
-	// Intersection with spheres
-	for (int i = 0; i < u_num_spheres; ++i)
+	vec3 shear = vec3(ray.direction[kx] / ray.direction[kz], ray.direction[ky] / ray.direction[kz], 1.0 / ray.direction[kz]);
+	return TriangleRay(ray.origin, ivec3(kx, ky, kz), shear);
+}
+// Watertight ray triangle test [Woop et al. 2013], returns distance or kNoHit.t
+float IntersectTriangle(TriangleRay ray, vec3 v0, vec3 v1, vec3 v2, float limit)
+{
+	vec3 a = v0 - ray.origin;
+	vec3 b = v1 - ray.origin;
+	vec3 c = v2 - ray.origin;
+	// Shear and scale vertices, so the ray goes along z from the origin
+	float ax = a[ray.k.x] - ray.shear.x * a[ray.k.z];
+	float ay = a[ray.k.y] - ray.shear.y * a[ray.k.z];
+	float bx = b[ray.k.x] - ray.shear.x * b[ray.k.z];
+	float by = b[ray.k.y] - ray.shear.y * b[ray.k.z];
+	float cx = c[ray.k.x] - ray.shear.x * c[ray.k.z];
+	float cy = c[ray.k.y] - ray.shear.y * c[ray.k.z];
+	// Scaled barycentrics, edges shared by triangles are evaluated identically
+	float u = cx * by - cy * bx;
+	float v = ax * cy - ay * cx;
+	float w = bx * ay - by * ax;
+	if ((u < 0.0 || v < 0.0 || w < 0.0) && (u > 0.0 || v > 0.0 || w > 0.0))
+		return kNoHit.t;
+	float det = u + v + w;
+	if (det == 0.0)
+		return kNoHit.t;
+	float t = (u * ray.shear.z * a[ray.k.z] + v * ray.shear.z * b[ray.k.z] + w * ray.shear.z * c[ray.k.z]) / det;
+	return (t > 0.0 && t < limit) ? t : kNoHit.t;
+}
+// Traverses mesh tree in mesh space, distance and triangle are updated on closer hits
+bool TraverseMesh(Ray ray, int root, bool any_hit, inout float t, inout int triangle)
+{
+	TriangleRay triangle_ray = SetupTriangleRay(ray);
+	vec3 inv_direction = 1.0 / ray.direction;
+	if (IntersectBounds(root, ray.origin, inv_direction, t) == kNoHit.t)
+		return false;
+	bool found = false;
+	int stack[BVH_STACK_SIZE];
+	int stack_size = 0;
+	int node = root;
+	while (true)
 	{
-		Hit cur_hit = IntersectSphere(u_spheres[i], ray, kSphereMaterial);
-		if (cur_hit.exists && cur_hit.t < hit.t)
-			hit = cur_hit;
+		vec4 texel0 = texelFetch(u_bvh_node_sampler, 2 * node);
+		vec4 texel1 = texelFetch(u_bvh_node_sampler, 2 * node + 1);
+		int offset = int(texel0.w);
+		int count = int(texel1.w);
+		if (count != 0)
+		{
+			for (int i = offset; i < offset + count; ++i)
+			{
+				float cur_t = IntersectTriangle(triangle_ray,
+					texelFetch(u_triangle_sampler, 3 * i).xyz,
+					texelFetch(u_triangle_sampler, 3 * i + 1).xyz,
+					texelFetch(u_triangle_sampler, 3 * i + 2).xyz, t);
+				if (cur_t != kNoHit.t)
+				{
+					t = cur_t;
+					triangle = i;
+					found = true;
+					if (any_hit)
+						return true;
+				}
+			}
+		}
+		else
+		{
+			int near_child = node + 1;
+			int far_child = offset;
+			float near_t = IntersectBounds(near_child, ray.origin, inv_direction, t);
+			float far_t = IntersectBounds(far_child, ray.origin, inv_direction, t);
+			if (far_t < near_t)
+			{
+				int child = near_child; near_child = far_child; far_child = child;
+				float tmp = near_t; near_t = far_t; far_t = tmp;
+			}
+			if (near_t != kNoHit.t)
+			{
+				if (far_t != kNoHit.t)
+					stack[stack_size++] = far_child;
+				node = near_child;
+				continue;
+			}
+		}
+		if (stack_size == 0)
+			break;
+		node = stack[--stack_size];
+	}
+	return found;
+}
+// Updates the hit with closer triangle of the instance
+bool IntersectInstance(vec3 position, float scale, int root, int material, Ray ray, bool any_hit, inout Hit hit)
+{
+	// Uniform scale keeps directions, so only the origin and distances are transformed
+	float inv_scale = 1.0 / scale;
+	Ray mesh_ray = Ray((ray.origin - position) * inv_scale, ray.direction);
+	float t = hit.t * inv_scale;
+	int triangle = 0;
+	if (!TraverseMesh(mesh_ray, root, any_hit, t, triangle))
+		return false;
+	// Normal is computed for the closest triangle only
+	vec3 v0 = texelFetch(u_triangle_sampler, 3 * triangle).xyz;
+	vec3 v1 = texelFetch(u_triangle_sampler, 3 * triangle + 1).xyz;
+	vec3 v2 = texelFetch(u_triangle_sampler, 3 * triangle + 2).xyz;
+	hit = Hit(normalize(cross(v1 - v0, v2 - v0)), t * scale, true, material);
+	return true;
+}
+// Updates the hit with the primitive if it is closer
+bool IntersectPrimitive(int primitive, Ray ray, bool any_hit, inout Hit hit)
+{
+	vec4 texel0 = texelFetch(u_bvh_primitive_sampler, 2 * primitive);
+	vec4 texel1 = texelFetch(u_bvh_primitive_sampler, 2 * primitive + 1);
+	int material = int(texel1.w);
+	if (texel0.w < -1.5)
+		return IntersectInstance(texel0.xyz, texel1.x, int(texel1.y), material, ray, any_hit, hit);
+	Hit cur_hit;
+	if (texel0.w > 0.0)
+		cur_hit = IntersectSphere(Sphere(texel0.xyz, texel0.w), ray, material);
+	else
+		cur_hit = IntersectBox(Box(texel0.xyz, texel1.xyz), ray, material);
+	if (cur_hit.exists && cur_hit.t < hit.t)
+	{
+		hit = cur_hit;
+		return true;
 	}
-	// Intersection with boxes
-	for (int i = 0; i < u_num_boxes; ++i)
+	return false;
+}
+// Updates the hit with the closest primitive, stops at the first one when any_hit is set
+bool TraverseBvh(Ray ray, bool any_hit, inout Hit hit)
+{
+	if (u_num_bvh_nodes == 0)
+		return false;
+	vec3 inv_direction = 1.0 / ray.direction;
+	if (IntersectBounds(0, ray.origin, inv_direction, hit.t) == kNoHit.t)
+		return false;
+	bool found = false;
+	int stack[BVH_STACK_SIZE];
+	int stack_size = 0;
+	int node = 0;
+	while (true)
 	{
-		Hit cur_hit = IntersectBox(u_boxes[i], ray, kBoxMaterial);
+		vec4 texel0 = texelFetch(u_bvh_node_sampler, 2 * node);
+		vec4 texel1 = texelFetch(u_bvh_node_sampler, 2 * node + 1);
+		int offset = int(texel0.w);
+		int count = int(texel1.w);
+		if (count != 0)
+		{
+			for (int i = offset; i < offset + count; ++i)
+			{
+				if (IntersectPrimitive(i, ray, any_hit, hit))
+				{
+					found = true;
+					if (any_hit)
+						return true;
+				}
+			}
+		}
+		else
+		{
+			// Visit the nearer child first, so the farther one is likely culled by the hit distance
+			int near_child = node + 1;
+			int far_child = offset;
+			float near_t = IntersectBounds(near_child, ray.origin, inv_direction, hit.t);
+			float far_t = IntersectBounds(far_child, ray.origin, inv_direction, hit.t);
+			if (far_t < near_t)
+			{
+				int child = near_child; near_child = far_child; far_child = child;
+				float t = near_t; near_t = far_t; far_t = t;
+			}
+			if (near_t != kNoHit.t)
+			{
+				if (far_t != kNoHit.t)
+					stack[stack_size++] = far_child;
+				node = near_child;
+				continue;
+			}
+		}
+		if (stack_size == 0)
+			break;
+		node = stack[--stack_size];
+	}
+	return found;
+}
+Hit IntersectScene(Ray ray)
+{
+	Hit hit = kNoHit;
+	// Intersection with planes
+	for (int i = 0; i < PLANE_COUNT; ++i)
+	{
+		vec4 texel0 = texelFetch(u_plane_sampler, 2 * i);
+		int material = int(texelFetch(u_plane_sampler, 2 * i + 1).x);
+		Hit cur_hit = IntersectPlane(Plane(texel0.xyz, texel0.w), ray, material);
 		if (cur_hit.exists && cur_hit.t < hit.t)
 			hit = cur_hit;
 	}
+	// Intersection with spheres and boxes
+	TraverseBvh(ray, false, hit);
 	return hit;
 }
+bool IsOccluded(Ray ray)
+{
+	for (int i = 0; i < PLANE_COUNT; ++i)
+	{
+		vec4 texel0 = texelFetch(u_plane_sampler, 2 * i);
+		if (IntersectPlane(Plane(texel0.xyz, texel0.w), ray, 0).exists)
+			return true;
+	}
+	Hit hit = kNoHit;
+	return TraverseBvh(ray, true, hit);
+}
 vec3 SkyColor(vec3 d)
 {
 	float transition = pow(smoothstep(0.02, 0.5, d.y), 0.4);
 
 	vec3 sky = 2e2*mix(vec3(0.52, 0.77, 1), vec3(0.12, 0.43, 1), transition);
-	vec3 sun = u_light.color * pow(abs(dot(d, u_light.direction)), 5000.);
+	vec3 sun = vec3(0.0);
+	for (int i = 0; i < LIGHT_COUNT; ++i)
+	{
+		DirectionalLight light = FetchLight(i);
+		sun += light.color * pow(abs(dot(d, light.direction)), 5000.);
+	}
 	return sky + sun;
 }
-vec3 AccountForDirectionalLight(vec3 position, vec3 normal)
+vec3 AccountForDirectionalLights(vec3 position, vec3 normal)
 {
-	if (IntersectScene(Ray(position + kEpsilon * u_light.direction, u_light.direction)).exists == false)
+	vec3 incoming = vec3(0.0);
+	for (int i = 0; i < LIGHT_COUNT; ++i)
 	{
-		return clamp(dot(normal, u_light.direction), 0.0, 1.0) * u_light.color;
+		DirectionalLight light = FetchLight(i);
+		if (!IsOccluded(Ray(position + kEpsilon * light.direction, light.direction)))
+			incoming += clamp(dot(normal, light.direction), 0.0, 1.0) * light.color;
 	}
-	return vec3(0.0);
+	return incoming;
 }
 vec3 Radiance(Ray ray)
 {
@@ -218,17 +475,18 @@ vec3 Radiance(Ray ray)
 
 		if (hit.exists)
 		{
-			if (hit.material.type == 0)
+			Material material = FetchMaterial(hit.material);
+			if (material.type == 0)
 			{
-				float f = fresnel(hit.normal, -ray.direction, hit.material.f0);
+				float f = fresnel(hit.normal, -ray.direction, material.f0);
 
 				vec3 hit_pos = ray.origin + hit.t * ray.direction;
 
 				// Diffuse
 				vec3 incoming = vec3(0.0);
-				incoming += AccountForDirectionalLight(hit_pos, hit.normal);
+				incoming += AccountForDirectionalLights(hit_pos, hit.normal);
 
-				accumulation += (1.0 - f) * attenuation * hit.material.color * incoming;
+				accumulation += (1.0 - f) * attenuation * material.color * incoming;
 
 				// Specular: next bounce
 				if (used_rays < MAX_TRACED_RAYS - 1)
@@ -242,7 +500,7 @@ vec3 Radiance(Ray ray)
 			}
 			else
 			{
-				attenuation *= hit.material.color * 0.95;
+				attenuation *= material.color * 0.95;
 				float a = dot(hit.normal, ray.direction), ddn = abs(a);
 				float nnt = mix(n_air / n_glass, n_glass / n_air, float(a>0.0));
 				float cos2t = 1.0 - nnt * nnt * (1.0 - ddn * ddn);
@@ -293,35 +551,38 @@ vec3 Radiance(Ray ray)
 	}
 	return accumulation;
 }
-vec3 Uncharted2ToneMapping(vec3 color)
+#ifdef GUIDE_PASS
+// Packs color in [0,1] to 8 bits per channel, 24 bit integers are exact in float
+float PackUnorm8(vec3 color)
 {
-	float A = 0.15;
-	float B = 0.50;
-	float C = 0.10;
-	float D = 0.20;
-	float E = 0.02;
-	float F = 0.30;
-	float W = 11.2;
-	float exposure = 0.012;
-	color *= exposure;
-	color = ((color * (A * color + C * B) + D * E) / (color * (A * color + B) + D * F)) - E / F;
-	float white = ((W * (A * W + C * B) + D * E) / (W * (A * W + B) + D * F)) - E / F;
-	color /= white;
-	color = pow(color, vec3(1. / GAMMA));
-	return color;
+	vec3 bytes = floor(clamp(color, 0.0, 1.0) * 255.0 + 0.5);
+	return bytes.r + 256.0 * bytes.g + 65536.0 * bytes.b;
 }
-
+// Primary hit features for the denoiser: packed normal, packed albedo and distance
+vec3 PrimaryHitGuides(Ray ray)
+{
+	Hit hit = IntersectScene(ray);
+	if (!hit.exists)
+		return vec3(PackUnorm8(vec3(0.5)), 0.0, hit.t); // zero normal and albedo for sky
+	return vec3(PackUnorm8(hit.normal * 0.5 + 0.5), PackUnorm8(FetchMaterial(hit.material).color), hit.t);
+}
+#endif
 void main()
 {
 //#define USE_MSAA
 #ifndef USE_MSAA
 	// 1. Get ray from UV
-	vec3 direction = mix(mix(u_ray00, u_ray01, fs_in.uv.y), mix(u_ray10, u_ray11, fs_in.uv.y), fs_in.uv.x);
+	vec2 uv = fs_in.uv + u_jitter;
+	vec3 direction = mix(mix(u_ray00, u_ray01, uv.y), mix(u_ray10, u_ray11, uv.y), uv.x);
 	direction = normalize(direction);
 
 	// 2. Test objects for intersection
 	Ray ray = Ray(u_eye, direction);
+#ifdef GUIDE_PASS
+	vec3 color = PrimaryHitGuides(ray);
+#else
 	vec3 color = Radiance(ray);
+#endif
 #else
 	float o1 = 0.25;
 	float o2 = 0.75;
@@ -345,10 +606,18 @@ void main()
 	}
 	color *= 0.25;
 #endif
+	// 3. Blend with previous samples, first sample overwrites whatever the target had
+	if (u_blend < 1.0)
+	{
+		vec3 previous = texelFetch(u_accumulation_sampler, ivec2(gl_FragCoord.xy), 0).rgb;
+		// Single broken sample shouldn't spoil the pixel for the rest of accumulation
+		bool finite = !any(isnan(color)) && !any(isinf(color));
+		color = finite ? mix(previous, color, u_blend) : previous;
+	}
 #ifdef GL_core_profile
 	out_color
 #else
 	gl_FragColor
 #endif
-		= vec4(Uncharted2ToneMapping(color), 1.0);
+		= vec4(color, 1.0);
 }
\ No newline at end of file
@@ -8,18 +8,28 @@ struct Light {
 out vec4 out_color;
 
 uniform Light u_light;
-uniform vec3 u_color; // object color
+#ifndef USE_INSTANCING
+ uniform vec3 u_color; // object color
+#endif
 //uniform sampler2DShadow u_shadow_sampler;
 
 in DATA
 {
 	vec3 position;
 	vec3 normal;
+#ifdef USE_INSTANCING
+	vec3 color;
+#endif
 	//vec4 shadow_coord;
 } fs_in;
 
 void main()
 {
+#ifdef USE_INSTANCING
+	vec3 color = fs_in.color;
+#else
+	vec3 color = u_color;
+#endif
 	// Compute ambient term
 	vec3 ambient = vec3(0.2);
 
@@ -28,7 +38,7 @@ void main()
 	vec3 diffuse = vec3(0.0);
 	vec3 light = normalize(u_light.position - fs_in.position);
 	float lambertian = clamp(dot(light, normal), 0.0, 1.0);
-	diffuse += lambertian * u_light.color * u_color;
+	diffuse += lambertian * u_light.color * color;
 
 	// Compute total color
 	vec3 color_linear = ambient + diffuse;
@@ -2,22 +2,37 @@
 
 layout(location = 0) in vec3 a_position;
 layout(location = 1) in vec3 a_normal;
+#ifdef USE_INSTANCING
+ layout(location = 5) in mat4 a_instance_model;
+ layout(location = 9) in vec3 a_instance_color;
+#endif
 
 uniform mat4 u_projection_view;
-uniform mat4 u_model;
+#ifndef USE_INSTANCING
+ uniform mat4 u_model;
+#endif
 //uniform mat4 u_depth_bias_projection_view;
 
 out DATA
 {
 	vec3 position;
 	vec3 normal;
+#ifdef USE_INSTANCING
+	vec3 color;
+#endif
 	//vec4 shadow_coord;
 } vs_out;
 
 void main()
 {
-	vec4 position_world = u_model * vec4(a_position, 1.0);
-	mat3 model = mat3(u_model);
+#ifdef USE_INSTANCING
+	mat4 model_matrix = a_instance_model;
+	vs_out.color = a_instance_color;
+#else
+	mat4 model_matrix = u_model;
+#endif
+	vec4 position_world = model_matrix * vec4(a_position, 1.0);
+	mat3 model = mat3(model_matrix);
 
 	vs_out.position = vec3(position_world);
 	vs_out.normal = model * a_normal;
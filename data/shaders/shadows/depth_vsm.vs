@@ -1,15 +1,25 @@
 #version 330 core
 
 layout(location = 0) in vec3 a_position;
+#ifdef USE_INSTANCING
+ layout(location = 5) in mat4 a_instance_model;
+#endif
 
 uniform mat4 u_projection_view;
-uniform mat4 u_model;
+#ifndef USE_INSTANCING
+ uniform mat4 u_model;
+#endif
 
 out vec4 v_position;
 
 void main()
 {
-	vec4 position_clip = u_projection_view * u_model * vec4(a_position, 1.0);
+#ifdef USE_INSTANCING
+	mat4 model_matrix = a_instance_model;
+#else
+	mat4 model_matrix = u_model;
+#endif
+	vec4 position_clip = u_projection_view * model_matrix * vec4(a_position, 1.0);
 	v_position = position_clip;
     gl_Position = position_clip;
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "wall_data.h"
+#include "mesh_lod.h"
+#include "render_queue.h"
 
 #include "math/frustum.h"
 #include "math/matrix3.h"
@@ -12,7 +14,6 @@
 
 // Physics specific modules
 #include "common/sc_delete.h"
-#include "model/model.h"
 #include "node.h"
 #include "physics/physics_controller.h"
 #include "physics/physics_rigid_body.h"
@@ -29,7 +30,28 @@ namespace {
 	const U32 kMaxCSMSplits = 4;
 	const U32 kNumSplits = 3;
 	const float kSplitLambda = 0.5f;
+#else
+	const float kShadowOrthoSize = 10.0f;
 #endif
+
+	// Render queue key fields
+	enum RenderPass : unsigned int {
+		kShadowPass,
+		kNormalPass
+	};
+	enum ShaderId : unsigned int {
+		kShadowShader,
+		kObjectShader
+	};
+	enum MaterialId : unsigned int {
+		kMazeMaterial,
+		kBallMaterial
+	};
+	enum MeshId : unsigned int {
+		kFloorMesh,
+		kWallMesh,
+		kSphereMesh //!< sphere LOD levels follow the base one
+	};
 }
 
 /**
@@ -37,19 +59,18 @@ namespace {
  */
 class MarbleMazeApp : public scythe::OpenGlApplication
 					, public scythe::DesktopInputListener
+					, public IRenderQueueExecutor
 {
 public:
 	MarbleMazeApp()
-	: sphere_mesh_(nullptr)
-	, quad_mesh_(nullptr)
-	, floor_mesh_(nullptr)
+	: quad_mesh_(nullptr)
 	, wall_mesh_(nullptr)
-	, sphere_model_(nullptr)
-	, floor_model_(nullptr)
-	, wall_model_(nullptr)
 	, ball_node_(nullptr)
 	, floor_node_(nullptr)
 	, wall_node_(nullptr)
+	, current_pass_(kNormalPass)
+	, current_shader_(nullptr)
+	, current_mesh_(nullptr)
 	, font_(nullptr)
 	, fps_text_(nullptr)
 	, camera_distance_(10.0f)
@@ -58,6 +79,7 @@ public:
 	, cos_camera_alpha_(1.0f)
 	, sin_camera_alpha_(0.0f)
 	, light_direction_(0.825f, 0.564f, 0.0f)
+	, ball_radius_(1.0f)
 	, fov_degrees_(45.0f)
 	, z_near_(0.1f)
 	, z_far_(100.0f)
@@ -114,7 +136,7 @@ public:
 	}
 	bool Load() final
 	{
-		const float kBallRadius = 1.0f;
+		const float kBallRadius = ball_radius_;
 		const float kCS = 10.0f; // cell size
 		const float kMaterialSize = 3.0f;
 		const float kWallWidth = 1.0f;
@@ -126,17 +148,7 @@ public:
 			return false;
 
 		// Vertex formats
-		scythe::VertexFormat * object_vertex_format;
-		{
-			scythe::VertexAttribute attributes[] = {
-				scythe::VertexAttribute(scythe::VertexAttribute::kVertex, 3),
-				scythe::VertexAttribute(scythe::VertexAttribute::kNormal, 3),
-				scythe::VertexAttribute(scythe::VertexAttribute::kTexcoord, 2),
-				//scythe::VertexAttribute(scythe::VertexAttribute::kTangent, 3),
-				//scythe::VertexAttribute(scythe::VertexAttribute::kBinormal, 3)
-			};
-			renderer_->AddVertexFormat(object_vertex_format, attributes, _countof(attributes));
-		}
+		const unsigned int kObjectAttributes = StaticMesh::kNormal | StaticMesh::kTexcoord;
 		scythe::VertexFormat * quad_vertex_format;
 		{
 			scythe::VertexAttribute attributes[] = {
@@ -145,10 +157,8 @@ public:
 			renderer_->AddVertexFormat(quad_vertex_format, attributes, _countof(attributes));
 		}
 
-		// Sphere mesh
-		sphere_mesh_ = new scythe::Mesh(renderer_);
-		sphere_mesh_->CreateSphere(kBallRadius, 128, 64);
-		if (!sphere_mesh_->MakeRenderable(object_vertex_format))
+		// Sphere mesh with levels of detail
+		if (!sphere_lod_.CreateSphere(kBallRadius, 128, 64, 4, kObjectAttributes))
 			return false;
 
 		// Screen quad mesh
@@ -158,16 +168,20 @@ public:
 			return false;
 
 		// Floor mesh
-		floor_mesh_ = new scythe::Mesh(renderer_);
-		floor_mesh_->CreatePhysicalBox(kFloorSizes.x, kFloorSizes.y, kFloorSizes.z, kMaterialSize, kMaterialSize);
-		if (!floor_mesh_->MakeRenderable(object_vertex_format))
-			return false;
+		{
+			MeshData floor_data;
+			floor_data.CreatePhysicalBox(kFloorSizes.x, kFloorSizes.y, kFloorSizes.z, kMaterialSize, kMaterialSize);
+			OptimizeMesh(&floor_data);
+			if (!floor_mesh_.Create(floor_data, kObjectAttributes))
+				return false;
+		}
 
 		// Wall mesh
 		{
 			std::vector<WallData> wall_data;
 			::GetWallData(&wall_data, kCS, kFloorSizes.y, kWallWidth, kWallHeight);
 
+			// Engine mesh only defines collision shape, so it isn't uploaded
 			wall_mesh_ = new scythe::Mesh(renderer_);
 			wall_mesh_->ForceTriangles();
 			for (const auto& data : wall_data)
@@ -175,15 +189,15 @@ public:
 				// Each separate box is being put as mesh part and placed at desired position
 				wall_mesh_->CreatePhysicalBox(data.sizes.x, data.sizes.y, data.sizes.z, kMaterialSize, kMaterialSize, &data.center);
 			}
-			if (!wall_mesh_->MakeRenderable(object_vertex_format, true))
+
+			// Walls are drawn from optimized merge of the same boxes
+			MeshData wall_mesh_data;
+			::GetWallMeshData(wall_data, kMaterialSize, &wall_mesh_data);
+			OptimizeMesh(&wall_mesh_data);
+			if (!wall_render_mesh_.Create(wall_mesh_data, kObjectAttributes))
 				return false;
 		}
 
-		// Models
-		sphere_model_ = scythe::Model::Create(sphere_mesh_);
-		floor_model_ = scythe::Model::Create(floor_mesh_);
-		wall_model_ = scythe::Model::Create(wall_mesh_);
-
 		// Ball
 		{
 			const float mass = 1.0f;
@@ -192,7 +206,6 @@ public:
 
 			scythe::Node * node = scythe::Node::Create("ball");
 			node->SetTranslation(position);
-			node->SetDrawable(sphere_model_);
 			node->SetCollisionObject(scythe::PhysicsCollisionObject::kRigidBody,
 				scythe::PhysicsCollisionShape::DefineSphere(kBallRadius),
 				&params);
@@ -222,7 +235,6 @@ public:
 
 			scythe::Node * node = scythe::Node::Create("floor");
 			node->SetTranslation(position);
-			node->SetDrawable(floor_model_);
 			node->SetCollisionObject(scythe::PhysicsCollisionObject::kRigidBody,
 				scythe::PhysicsCollisionShape::DefineBox(kFloorSizes),
 				&params);
@@ -237,7 +249,6 @@ public:
 
 			scythe::Node * node = scythe::Node::Create("walls");
 			node->SetTranslation(position);
-			node->SetDrawable(wall_model_);
 			node->SetCollisionObject(scythe::PhysicsCollisionObject::kRigidBody,
 				scythe::PhysicsCollisionShape::DefineMesh(wall_mesh_),
 				&params);
@@ -352,7 +363,7 @@ public:
 #else
 		// Generate matrix for shadows
 		// Ortho matrix is used for directional light sources and perspective for spot ones.
-		scythe::Matrix4::CreateOrthographic(10.0f, 10.0f, 0.0f, 20.0f, &light_projection_matrix_);
+		scythe::Matrix4::CreateOrthographic(kShadowOrthoSize, kShadowOrthoSize, 0.0f, 20.0f, &light_projection_matrix_);
 #endif
 
 		// Finally bind constants
@@ -371,15 +382,12 @@ public:
 		{
 			SC_SAFE_RELEASE(node);
 		}
-		// Release models
-		SC_SAFE_RELEASE(wall_model_);
-		SC_SAFE_RELEASE(floor_model_);
-		SC_SAFE_RELEASE(sphere_model_);
 		// Release meshes
 		SC_SAFE_RELEASE(wall_mesh_);
-		SC_SAFE_RELEASE(floor_mesh_);
 		SC_SAFE_RELEASE(quad_mesh_);
-		SC_SAFE_RELEASE(sphere_mesh_);
+		floor_mesh_.Release();
+		wall_render_mesh_.Release();
+		sphere_lod_.Release();
 
 		scythe::PhysicsController::GetInstance()->Deinitialize();
 		scythe::PhysicsController::DestroyInstance();
@@ -567,34 +575,70 @@ public:
 		renderer_->ChangeTexture(nullptr, 1);
 		renderer_->ChangeTexture(nullptr, 0);
 	}
-	void RenderObjects(scythe::Shader * shader, bool normal_mode)
+	void BindPass(unsigned int pass) final
 	{
-		if (normal_mode)
+		current_pass_ = pass;
+	}
+	void BindShader(unsigned int shader) final
+	{
+		// Shader is bound by the pass itself along with its per pass uniforms
+		current_shader_ = (shader == kObjectShader) ? object_shader_ : object_shadow_shader_;
+	}
+	void BindMaterial(unsigned int material) final
+	{
+		// Shadow pass doesn't need textures
+		if (current_pass_ != kNormalPass)
+			return;
+		if (material == kMazeMaterial)
 			MazeTextureBinding();
-
-		// Floor
-		renderer_->PushMatrix();
-		renderer_->LoadMatrix(floor_node_->GetWorldMatrix());
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		floor_node_->GetDrawable()->Draw();
-		renderer_->PopMatrix();
-
-		// Walls
-		renderer_->PushMatrix();
-		renderer_->LoadMatrix(wall_node_->GetWorldMatrix());
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		wall_node_->GetDrawable()->Draw();
-		renderer_->PopMatrix();
-
-		if (normal_mode)
+		else if (material == kBallMaterial)
 			BallTextureBinding();
+	}
+	void BindMesh(unsigned int mesh) final
+	{
+		if (mesh == kFloorMesh)
+			current_mesh_ = &floor_mesh_;
+		else if (mesh == kWallMesh)
+			current_mesh_ = &wall_render_mesh_;
+		else
+			current_mesh_ = sphere_lod_.mesh(mesh - kSphereMesh);
+	}
+	void Draw(unsigned int item) final
+	{
+		scythe::Node * node = nodes_[item];
 
-		// Ball
 		renderer_->PushMatrix();
-		renderer_->LoadMatrix(ball_node_->GetWorldMatrix());
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		ball_node_->GetDrawable()->Draw();
+		renderer_->LoadMatrix(node->GetWorldMatrix());
+		current_shader_->UniformMatrix4fv("u_model", renderer_->model_matrix());
+		current_mesh_->Render();
 		renderer_->PopMatrix();
+	}
+	void RenderObjects(scythe::Shader * shader, const LodSelector& lod_selector, bool normal_mode)
+	{
+		const unsigned int pass = normal_mode ? kNormalPass : kShadowPass;
+		const unsigned int shader_id = (shader == object_shader_) ? kObjectShader : kShadowShader;
+
+		render_queue_.Clear();
+		for (U32 i = 0; i < static_cast<U32>(nodes_.size()); ++i)
+		{
+			scythe::Node * node = nodes_[i];
+			unsigned int mesh;
+			unsigned int material;
+			if (node == ball_node_)
+			{
+				mesh = kSphereMesh + sphere_lod_.SelectLevel(lod_selector.ProjectedSize(node->GetTranslation(), ball_radius_));
+				material = kBallMaterial;
+			}
+			else
+			{
+				mesh = (node == floor_node_) ? kFloorMesh : kWallMesh;
+				material = kMazeMaterial;
+			}
+			// Few objects are drawn with distinct states, so depth isn't used
+			render_queue_.Submit(draw_key::Make(pass, shader_id, material, mesh, 0), i);
+		}
+		render_queue_.Sort();
+		render_queue_.Execute(this);
 
 		if (normal_mode)
 			EmptyTextureBinding();
@@ -630,7 +674,9 @@ public:
 			object_shadow_shader_->Bind();
 			object_shadow_shader_->UniformMatrix4fv("u_projection_view", depth_projection_view);
 
-			RenderObjects(object_shadow_shader_, false);
+			LodSelector lod_selector;
+			lod_selector.SetOrthographic(light_ortho_heights_[i], static_cast<float>(kShadowMapSize));
+			RenderObjects(object_shadow_shader_, lod_selector, false);
 
 			object_shadow_shader_->Unbind();
 
@@ -685,7 +731,9 @@ public:
 		object_shadow_shader_->Bind();
 		object_shadow_shader_->UniformMatrix4fv("u_projection_view", depth_projection_view);
 
-		RenderObjects(object_shadow_shader_, false);
+		LodSelector lod_selector;
+		lod_selector.SetOrthographic(kShadowOrthoSize, static_cast<float>(kShadowMapSize));
+		RenderObjects(object_shadow_shader_, lod_selector, false);
 
 		object_shadow_shader_->Unbind();
 
@@ -748,7 +796,9 @@ public:
 #endif
 		object_shader_->Uniform3fv("u_camera.position", camera_position_);
 
-		RenderObjects(object_shader_, true);
+		LodSelector lod_selector;
+		lod_selector.SetPerspective(camera_position_, fov_degrees_, static_cast<float>(height_));
+		RenderObjects(object_shader_, lod_selector, true);
 	}
 	void RenderScene()
 	{
@@ -1198,6 +1248,7 @@ public:
 			float ortho_far = bounding_box.max.x - bounding_box.min.x;
 			scythe::Matrix4::CreateOrthographic(ortho_width, ortho_height, 
 				ortho_near, ortho_far, &light_projection_matrices_[i]);
+			light_ortho_heights_[i] = ortho_height;
 			// Transform center back to world space
 			scythe::Vector3 center = bounding_box.GetCenter();
 			light_basis_.TransformVector(&center);
@@ -1223,19 +1274,20 @@ public:
 private:
 	scythe::Frustum frustum_;
 
-	scythe::Mesh * sphere_mesh_;
 	scythe::Mesh * quad_mesh_;
-	scythe::Mesh * floor_mesh_;
-	scythe::Mesh * wall_mesh_;
-
-	scythe::Model * sphere_model_;
-	scythe::Model * floor_model_;
-	scythe::Model * wall_model_;
+	StaticMesh floor_mesh_;
+	scythe::Mesh * wall_mesh_; //!< collision shape source, not uploaded
+	StaticMesh wall_render_mesh_;
+	MeshLod sphere_lod_;
 
 	scythe::Node * ball_node_;
 	scythe::Node * floor_node_;
 	scythe::Node * wall_node_;
 	std::vector<scythe::Node *> nodes_;
+	RenderQueue render_queue_;
+	unsigned int current_pass_; //!< pass bound by render queue
+	scythe::Shader * current_shader_; //!< shader bound by render queue
+	const StaticMesh * current_mesh_; //!< mesh bound by render queue
 
 	scythe::Shader * text_shader_;
 	scythe::Shader * quad_shader_; // needed only to show shadow texture, should be removed
@@ -1284,6 +1336,7 @@ private:
 	scythe::Matrix4 depth_bias_projection_view_matrices_[kMaxCSMSplits];
 	scythe::Matrix4 light_projection_matrices_[kMaxCSMSplits];
 	scythe::Matrix4 light_view_matrices_[kMaxCSMSplits];
+	float light_ortho_heights_[kMaxCSMSplits]; //!< used for LOD selection in shadow pass
 	float split_distances_[kMaxCSMSplits + 1];
 	float clip_space_split_distances_[kMaxCSMSplits];
 #else
@@ -1301,6 +1354,7 @@ private:
 	float sin_camera_alpha_;
 
 	const scythe::Vector3 light_direction_; // direction to light
+	const float ball_radius_;
 	const float fov_degrees_;
 	const float z_near_;
 	const float z_far_;
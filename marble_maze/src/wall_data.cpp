@@ -1,4 +1,5 @@
 #include "wall_data.h"
+#include "mesh_data.h"
 
 void GetWallData(std::vector<WallData> * wall_data, float cell_size, float base_height, float wall_width, float wall_height)
 {
@@ -204,4 +205,13 @@ void GetWallData(std::vector<WallData> * wall_data, float cell_size, float base_
 			data.sizes.z = 0.5f * (base_data.end_x - base_data.start_x + kWallWidth);
 		}
 	}
+}
+void GetWallMeshData(const std::vector<WallData>& wall_data, float material_size, MeshData * mesh_data)
+{
+	mesh_data->Clear();
+	for (const auto& data : wall_data)
+	{
+		const float center[3] = {data.center.x, data.center.y, data.center.z};
+		mesh_data->CreatePhysicalBox(data.sizes.x, data.sizes.y, data.sizes.z, material_size, material_size, center);
+	}
 }
\ No newline at end of file
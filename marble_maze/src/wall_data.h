@@ -5,6 +5,8 @@
 
 #include <vector>
 
+class MeshData;
+
 struct WallBaseData {
 	float start_x;
 	float start_y;
@@ -17,5 +19,7 @@ struct WallData {
 };
 
 void GetWallData(std::vector<WallData> * wall_data, float cell_size, float base_height, float wall_width, float wall_height);
+//! Merges boxes of all walls into a single mesh
+void GetWallMeshData(const std::vector<WallData>& wall_data, float material_size, MeshData * mesh_data);
 
 #endif
\ No newline at end of file
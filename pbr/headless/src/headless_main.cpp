@@ -0,0 +1,78 @@
+#include "benchmarks.h"
+#include "light_grid.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/*
+Headless light grid benchmark of the PBR demo.
+Runs the same CPU binning as the B key in the demo, so it can be measured without a GPU.
+*/
+
+namespace {
+
+	struct Options {
+		unsigned int tiles_x;
+		unsigned int tiles_y;
+		unsigned int slices;
+		std::vector<unsigned int> light_counts; //!< empty means the demo set
+	};
+
+	void PrintUsage(const char * program)
+	{
+		printf("usage: %s [options]\n"
+			"  -l, --lights <n>      number of lights, may be repeated (default 1000, 2000, 5000 and 10000)\n"
+			"      --tiles-x <n>     horizontal tiles of the grid (default %u)\n"
+			"      --tiles-y <n>     vertical tiles of the grid (default %u)\n"
+			"      --slices <n>      depth slices of the grid (default %u)\n",
+			program, LightGrid::kDefaultTilesX, LightGrid::kDefaultTilesY, LightGrid::kDefaultSlices);
+	}
+	bool ParseOptions(int argc, char ** argv, Options * options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char * name = argv[i];
+			auto is = [name](const char * short_name, const char * long_name) {
+				return strcmp(name, short_name) == 0 || strcmp(name, long_name) == 0;
+			};
+			if (i + 1 >= argc)
+				return false;
+			const char * value = argv[++i];
+			if (is("-l", "--lights"))
+				options->light_counts.push_back(static_cast<unsigned int>(atoi(value)));
+			else if (strcmp(name, "--tiles-x") == 0)
+				options->tiles_x = static_cast<unsigned int>(atoi(value));
+			else if (strcmp(name, "--tiles-y") == 0)
+				options->tiles_y = static_cast<unsigned int>(atoi(value));
+			else if (strcmp(name, "--slices") == 0)
+				options->slices = static_cast<unsigned int>(atoi(value));
+			else
+				return false;
+		}
+		return options->tiles_x != 0 && options->tiles_y != 0 && options->slices != 0;
+	}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+	Options options;
+	options.tiles_x = LightGrid::kDefaultTilesX;
+	options.tiles_y = LightGrid::kDefaultTilesY;
+	options.slices = LightGrid::kDefaultSlices;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+	if (options.light_counts.empty())
+		options.light_counts = {1000, 2000, 5000, 10000};
+
+	printf("Light grid: %ux%u tiles, %u slices\n", options.tiles_x, options.tiles_y, options.slices);
+	printf("lights  build ms\n");
+	for (unsigned int num_lights : options.light_counts)
+		printf("%6u  %8.3f\n", num_lights, BenchmarkLightGrid(num_lights, options.tiles_x, options.tiles_y, options.slices));
+	return 0;
+}
\ No newline at end of file
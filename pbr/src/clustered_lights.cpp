@@ -0,0 +1,110 @@
+#include "clustered_lights.h"
+
+#include <cstring>
+
+ClusteredLights::ClusteredLights()
+: grid_(LightGrid::kDefaultTilesX, LightGrid::kDefaultTilesY, LightGrid::kDefaultSlices)
+{
+	for (int i = 0; i < kNumBuffers; ++i)
+	{
+		buffers_[i] = 0;
+		textures_[i] = 0;
+	}
+}
+ClusteredLights::~ClusteredLights()
+{
+	Release();
+}
+bool ClusteredLights::Create()
+{
+	const GLenum kFormats[kNumBuffers] = {
+		GL_RGBA32F, // light data
+		GL_RG32UI, // offset and count
+		GL_R32UI // light index
+	};
+	glGenBuffers(kNumBuffers, buffers_);
+	glGenTextures(kNumBuffers, textures_);
+	for (int i = 0; i < kNumBuffers; ++i)
+	{
+		// Buffer texture can't be attached to empty buffer storage
+		const unsigned int kZero[4] = {0, 0, 0, 0};
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers_[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(kZero), kZero, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, kFormats[i], buffers_[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+void ClusteredLights::Release()
+{
+	if (textures_[0])
+		glDeleteTextures(kNumBuffers, textures_);
+	if (buffers_[0])
+		glDeleteBuffers(kNumBuffers, buffers_);
+	for (int i = 0; i < kNumBuffers; ++i)
+	{
+		buffers_[i] = 0;
+		textures_[i] = 0;
+	}
+}
+void ClusteredLights::SetProjection(float fov_y_degrees, float aspect_ratio, float znear, float zfar)
+{
+	grid_.SetProjection(fov_y_degrees, aspect_ratio, znear, zfar);
+}
+void ClusteredLights::Update(const PointLight * lights, size_t num_lights, const scythe::Matrix4& view_matrix)
+{
+	static_assert(sizeof(scythe::Matrix4) == 16 * sizeof(float), "Matrix4 should consist of 16 floats");
+	float view[16];
+	memcpy(view, &view_matrix, sizeof(view));
+	grid_.Build(lights, num_lights, view);
+
+	light_data_.resize(num_lights * 8);
+	for (size_t i = 0; i < num_lights; ++i)
+	{
+		float * texels = &light_data_[i * 8];
+		texels[0] = lights[i].position[0];
+		texels[1] = lights[i].position[1];
+		texels[2] = lights[i].position[2];
+		texels[3] = lights[i].radius;
+		texels[4] = lights[i].color[0];
+		texels[5] = lights[i].color[1];
+		texels[6] = lights[i].color[2];
+		texels[7] = 0.0f;
+	}
+	Upload(kLightDataBuffer, light_data_.data(), light_data_.size() * sizeof(float));
+	Upload(kGridBuffer, grid_.grid().data(), grid_.grid().size() * sizeof(unsigned int));
+	Upload(kIndexBuffer, grid_.indices().data(), grid_.indices().size() * sizeof(unsigned int));
+}
+void ClusteredLights::Upload(BufferIndex index, const void * data, size_t size)
+{
+	if (size == 0)
+		return; // shader never reads the buffer then
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers_[index]);
+	glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+void ClusteredLights::BindTextures(unsigned int first_unit)
+{
+	for (unsigned int i = 0; i < kNumBuffers; ++i)
+	{
+		glActiveTexture(GL_TEXTURE0 + first_unit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+	}
+	// Renderer expects the first unit to be active
+	glActiveTexture(GL_TEXTURE0);
+}
+void ClusteredLights::UnbindTextures(unsigned int first_unit)
+{
+	for (unsigned int i = 0; i < kNumBuffers; ++i)
+	{
+		glActiveTexture(GL_TEXTURE0 + first_unit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+const LightGrid& ClusteredLights::grid() const
+{
+	return grid_;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef __CLUSTERED_LIGHTS_H__
+#define __CLUSTERED_LIGHTS_H__
+
+#include "light_grid.h"
+#include "opengl_include.h"
+
+#include "math/matrix4.h"
+#include "common/non_copyable.h"
+
+#include <vector>
+
+/**
+ * Uploads light grid to texture buffers for USE_CLUSTERED_LIGHTS shader path.
+ * Light data buffer stores two texels per light: (position, radius) and (color, 0).
+ */
+class ClusteredLights final : public scythe::NonCopyable {
+public:
+	ClusteredLights();
+	~ClusteredLights();
+
+	bool Create();
+	void Release();
+
+	void SetProjection(float fov_y_degrees, float aspect_ratio, float znear, float zfar);
+
+	//! Bins lights on CPU and uploads the result
+	void Update(const PointLight * lights, size_t num_lights, const scythe::Matrix4& view_matrix);
+
+	//! Binds texture buffers to three consecutive units starting from the first one
+	void BindTextures(unsigned int first_unit);
+	void UnbindTextures(unsigned int first_unit);
+
+	const LightGrid& grid() const;
+
+private:
+	enum BufferIndex {
+		kLightDataBuffer,
+		kGridBuffer,
+		kIndexBuffer,
+		kNumBuffers
+	};
+
+	void Upload(BufferIndex index, const void * data, size_t size);
+
+	LightGrid grid_;
+	std::vector<float> light_data_;
+	GLuint buffers_[kNumBuffers];
+	GLuint textures_[kNumBuffers];
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "benchmarks.h"
+
+#include "light_grid.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cmath>
+
+namespace {
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double ElapsedMilliseconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+} // namespace
+
+double BenchmarkLightGrid(unsigned int num_lights, unsigned int tiles_x, unsigned int tiles_y, unsigned int slices)
+{
+	const float kFov = 45.0f;
+	const float kAspectRatio = 16.0f / 9.0f;
+	const float kNear = 0.1f;
+	const float kFar = 100.0f;
+	const unsigned int kIterations = 20;
+
+	LightGrid grid(tiles_x, tiles_y, slices);
+	grid.SetProjection(kFov, kAspectRatio, kNear, kFar);
+
+	// Identity view matrix, so lights are placed in view space directly
+	const float kView[16] = {
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+	const float tan_half_y = tanf(0.5f * kFov * 3.14159265358979f / 180.0f);
+	const float tan_half_x = tan_half_y * kAspectRatio;
+
+	// Fixed seed to get comparable results between runs
+	std::mt19937 generator(12345);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> depth_distribution(1.0f, 0.5f * kFar);
+	std::uniform_real_distribution<float> radius_distribution(0.5f, 3.0f);
+	std::vector<PointLight> lights(num_lights);
+	for (auto& light : lights)
+	{
+		const float depth = depth_distribution(generator);
+		light.position[0] = unit(generator) * tan_half_x * depth;
+		light.position[1] = unit(generator) * tan_half_y * depth;
+		light.position[2] = -depth;
+		light.radius = radius_distribution(generator);
+		light.color[0] = light.color[1] = light.color[2] = 1.0f;
+	}
+
+	// First build allocates memory
+	grid.Build(lights.data(), lights.size(), kView);
+
+	const Clock::time_point start = Clock::now();
+	for (unsigned int i = 0; i < kIterations; ++i)
+		grid.Build(lights.data(), lights.size(), kView);
+	return ElapsedMilliseconds(start) / static_cast<double>(kIterations);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#ifndef __BENCHMARKS_H__
+#define __BENCHMARKS_H__
+
+/**
+ * Bins random lights spread over the view frustum with light grid of the given size.
+ * Only CPU side binning is measured, nothing is uploaded.
+ * @return Average build time in milliseconds.
+ */
+double BenchmarkLightGrid(unsigned int num_lights, unsigned int tiles_x, unsigned int tiles_y, unsigned int slices);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "light_grid.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+# define LIGHT_GRID_USE_SSE
+# include <xmmintrin.h>
+#endif
+
+LightGrid::LightGrid(unsigned int tiles_x, unsigned int tiles_y, unsigned int slices)
+: tiles_x_(tiles_x)
+, tiles_y_(tiles_y)
+, slices_(slices)
+, row_stride_((tiles_x + 3) & ~3u)
+, znear_(0.1f)
+, zfar_(100.0f)
+, depth_scale_(0.0f)
+, depth_bias_(0.0f)
+{
+}
+void LightGrid::SetProjection(float fov_y_degrees, float aspect_ratio, float znear, float zfar)
+{
+	const float kPi = 3.14159265358979f;
+	const float tan_half_y = tanf(0.5f * fov_y_degrees * kPi / 180.0f);
+	const float tan_half_x = tan_half_y * aspect_ratio;
+
+	znear_ = znear;
+	zfar_ = zfar;
+	const float log_ratio = logf(zfar / znear);
+	depth_scale_ = static_cast<float>(slices_) / log_ratio;
+	depth_bias_ = -static_cast<float>(slices_) * logf(znear) / log_ratio;
+
+	// Slice depths
+	min_z_.resize(slices_);
+	max_z_.resize(slices_);
+	for (unsigned int k = 0; k < slices_; ++k)
+	{
+		min_z_[k] = znear * powf(zfar / znear, static_cast<float>(k) / static_cast<float>(slices_));
+		max_z_[k] = znear * powf(zfar / znear, static_cast<float>(k + 1) / static_cast<float>(slices_));
+	}
+
+	// Tile side planes go through the eye, so bounds are the widest at one of slice ends
+	min_x_.assign(slices_ * row_stride_, 0.0f);
+	max_x_.assign(slices_ * row_stride_, 0.0f);
+	min_y_.resize(slices_ * tiles_y_);
+	max_y_.resize(slices_ * tiles_y_);
+	for (unsigned int k = 0; k < slices_; ++k)
+	{
+		for (unsigned int i = 0; i < row_stride_; ++i)
+		{
+			const size_t index = k * row_stride_ + i;
+			if (i >= tiles_x_)
+			{
+				// Padding clusters never intersect anything
+				min_x_[index] = 1e30f;
+				max_x_[index] = -1e30f;
+				continue;
+			}
+			const float left = (2.0f * static_cast<float>(i) / static_cast<float>(tiles_x_) - 1.0f) * tan_half_x;
+			const float right = (2.0f * static_cast<float>(i + 1) / static_cast<float>(tiles_x_) - 1.0f) * tan_half_x;
+			min_x_[index] = std::min(left * min_z_[k], left * max_z_[k]);
+			max_x_[index] = std::max(right * min_z_[k], right * max_z_[k]);
+		}
+		for (unsigned int j = 0; j < tiles_y_; ++j)
+		{
+			const size_t index = k * tiles_y_ + j;
+			const float bottom = (2.0f * static_cast<float>(j) / static_cast<float>(tiles_y_) - 1.0f) * tan_half_y;
+			const float top = (2.0f * static_cast<float>(j + 1) / static_cast<float>(tiles_y_) - 1.0f) * tan_half_y;
+			min_y_[index] = std::min(bottom * min_z_[k], bottom * max_z_[k]);
+			max_y_[index] = std::max(top * min_z_[k], top * max_z_[k]);
+		}
+	}
+}
+unsigned int LightGrid::SliceIndex(float depth) const
+{
+	const float slice = logf(depth) * depth_scale_ + depth_bias_;
+	if (slice <= 0.0f)
+		return 0;
+	return std::min(static_cast<unsigned int>(slice), slices_ - 1);
+}
+void LightGrid::AddLightToClusters(unsigned int light, float x, float y, float depth, float radius)
+{
+	const unsigned int first_slice = SliceIndex(std::max(depth - radius, znear_));
+	const unsigned int last_slice = SliceIndex(std::min(depth + radius, zfar_));
+	const float radius_sq = radius * radius;
+	for (unsigned int k = first_slice; k <= last_slice; ++k)
+	{
+		const float dz = std::max(min_z_[k] - depth, 0.0f) + std::max(depth - max_z_[k], 0.0f);
+		const float dz_sq = dz * dz;
+		for (unsigned int j = 0; j < tiles_y_; ++j)
+		{
+			const size_t row = k * tiles_y_ + j;
+			const float dy = std::max(min_y_[row] - y, 0.0f) + std::max(y - max_y_[row], 0.0f);
+			const float dyz_sq = dy * dy + dz_sq;
+			if (dyz_sq > radius_sq)
+				continue; // the whole row is out of reach
+			const float * min_x = &min_x_[k * row_stride_];
+			const float * max_x = &max_x_[k * row_stride_];
+			const unsigned int row_cluster = (k * tiles_y_ + j) * tiles_x_;
+#ifdef LIGHT_GRID_USE_SSE
+			// Sphere against 4 cluster boxes at once, only X bounds differ along the row
+			const __m128 center_x = _mm_set1_ps(x);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 threshold = _mm_set1_ps(radius_sq - dyz_sq);
+			for (unsigned int i = 0; i < row_stride_; i += 4)
+			{
+				const __m128 below = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(min_x + i), center_x), zero);
+				const __m128 above = _mm_max_ps(_mm_sub_ps(center_x, _mm_loadu_ps(max_x + i)), zero);
+				const __m128 dx = _mm_add_ps(below, above);
+				const int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx, dx), threshold));
+				if (mask == 0)
+					continue;
+				for (unsigned int lane = 0; lane < 4; ++lane)
+				{
+					if (mask & (1 << lane))
+					{
+						pairs_.push_back(row_cluster + i + lane);
+						pairs_.push_back(light);
+					}
+				}
+			}
+#else
+			for (unsigned int i = 0; i < tiles_x_; ++i)
+			{
+				const float dx = std::max(min_x[i] - x, 0.0f) + std::max(x - max_x[i], 0.0f);
+				if (dx * dx + dyz_sq <= radius_sq)
+				{
+					pairs_.push_back(row_cluster + i);
+					pairs_.push_back(light);
+				}
+			}
+#endif
+		}
+	}
+}
+void LightGrid::Build(const PointLight * lights, size_t num_lights, const float * view_matrix)
+{
+	const float * m = view_matrix;
+	pairs_.clear();
+	for (size_t n = 0; n < num_lights; ++n)
+	{
+		const PointLight& light = lights[n];
+		const float * p = light.position;
+		const float x = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+		const float y = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+		const float depth = -(m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]);
+		if (depth + light.radius < znear_ || depth - light.radius > zfar_)
+			continue;
+		AddLightToClusters(static_cast<unsigned int>(n), x, y, depth, light.radius);
+	}
+
+	// Counting sort of pairs by cluster
+	const unsigned int clusters = num_clusters();
+	grid_.assign(clusters * 2, 0);
+	for (size_t i = 0; i < pairs_.size(); i += 2)
+		++grid_[pairs_[i] * 2 + 1];
+	unsigned int offset = 0;
+	for (unsigned int c = 0; c < clusters; ++c)
+	{
+		grid_[c * 2] = offset;
+		offset += grid_[c * 2 + 1];
+	}
+	indices_.resize(offset);
+	std::vector<unsigned int> cursors(clusters);
+	for (unsigned int c = 0; c < clusters; ++c)
+		cursors[c] = grid_[c * 2];
+	for (size_t i = 0; i < pairs_.size(); i += 2)
+		indices_[cursors[pairs_[i]]++] = pairs_[i + 1];
+}
+float LightGrid::depth_scale() const
+{
+	return depth_scale_;
+}
+float LightGrid::depth_bias() const
+{
+	return depth_bias_;
+}
+unsigned int LightGrid::tiles_x() const
+{
+	return tiles_x_;
+}
+unsigned int LightGrid::tiles_y() const
+{
+	return tiles_y_;
+}
+unsigned int LightGrid::slices() const
+{
+	return slices_;
+}
+unsigned int LightGrid::num_clusters() const
+{
+	return tiles_x_ * tiles_y_ * slices_;
+}
+const std::vector<unsigned int>& LightGrid::grid() const
+{
+	return grid_;
+}
+const std::vector<unsigned int>& LightGrid::indices() const
+{
+	return indices_;
+}
\ No newline at end of file
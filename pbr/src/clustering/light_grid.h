@@ -0,0 +1,77 @@
+#ifndef __LIGHT_GRID_H__
+#define __LIGHT_GRID_H__
+
+#include <vector>
+#include <cstddef>
+
+struct PointLight {
+	float position[3]; //!< in world space
+	float radius; //!< light has no influence beyond this distance
+	float color[3]; //!< premultiplied by intensity
+};
+
+/**
+ * Clustered light grid.
+ * View frustum is divided into tiles in screen space and exponential slices in depth.
+ * Each cluster stores offset and count of its lights in the shared light index list.
+ */
+class LightGrid {
+public:
+	//! Grid size used by the demo
+	static const unsigned int kDefaultTilesX = 16;
+	static const unsigned int kDefaultTilesY = 9;
+	static const unsigned int kDefaultSlices = 24;
+
+	LightGrid(unsigned int tiles_x, unsigned int tiles_y, unsigned int slices);
+
+	//! Should be called whenever projection changes
+	void SetProjection(float fov_y_degrees, float aspect_ratio, float znear, float zfar);
+
+	/**
+	 * Assigns lights to clusters.
+	 * @param[in] view_matrix  Column major view matrix.
+	 */
+	void Build(const PointLight * lights, size_t num_lights, const float * view_matrix);
+
+	//! Slice index is log(depth) * scale + bias
+	float depth_scale() const;
+	float depth_bias() const;
+
+	unsigned int tiles_x() const;
+	unsigned int tiles_y() const;
+	unsigned int slices() const;
+	unsigned int num_clusters() const;
+
+	//! Offset and count pair for each cluster
+	const std::vector<unsigned int>& grid() const;
+	const std::vector<unsigned int>& indices() const;
+
+private:
+	unsigned int SliceIndex(float depth) const;
+	void AddLightToClusters(unsigned int light, float x, float y, float depth, float radius);
+
+	const unsigned int tiles_x_;
+	const unsigned int tiles_y_;
+	const unsigned int slices_;
+	const unsigned int row_stride_; //!< tiles_x_ rounded up to SIMD width
+
+	float znear_;
+	float zfar_;
+	float depth_scale_;
+	float depth_bias_;
+
+	// Cluster bounds in view space (depth is positive), X bounds are stored
+	// for each cluster in SoA layout, Y bounds for each row and Z bounds for each slice
+	std::vector<float> min_x_;
+	std::vector<float> max_x_;
+	std::vector<float> min_y_;
+	std::vector<float> max_y_;
+	std::vector<float> min_z_;
+	std::vector<float> max_z_;
+
+	std::vector<unsigned int> pairs_; //!< (cluster, light) pairs before sorting
+	std::vector<unsigned int> grid_;
+	std::vector<unsigned int> indices_;
+};
+
+#endif
\ No newline at end of file
@@ -1,17 +1,35 @@
+#include "instanced_mesh.h"
+#include "clustered_lights.h"
+#include "benchmarks.h"
+
 #include "model/mesh.h"
 #include "graphics/text.h"
 #include "camera.h"
 #include "math/matrix3.h"
+#include "math/constants.h"
 
 #include "declare_main.h"
 
 #include <cmath>
+#include <random>
+#include <vector>
 
 /*
 PBR shader to use in application
 */
 namespace {
 	const int kShadowMapSize = 1024;
+	const unsigned int kFirstLightUnit = 8; //!< clustered lights take units 8-10
+	const size_t kLightCounts[] = {0, 256, 1024, 4096};
+	const unsigned int kBenchmarkLightCounts[] = {1000, 2000, 5000, 10000};
+
+	//! Point lights fly around the spheres
+	struct LightOrbit {
+		float radius;
+		float height;
+		float angle;
+		float speed;
+	};
 }
 
 #define APP_NAME PbrApp
@@ -21,16 +39,19 @@ class APP_NAME : public scythe::OpenGlApplication
 {
 public:
 	APP_NAME()
-	: sphere_(nullptr)
-	, quad_(nullptr)
+	: quad_(nullptr)
 	, font_(nullptr)
 	, fps_text_(nullptr)
+	, info_text_(nullptr)
 	, camera_manager_(nullptr)
+	, light_count_index_(1)
 	, light_angle_(0.0f)
 	, light_distance_(10.0f)
 	, need_update_projection_matrix_(true)
 	, show_shadow_texture_(false)
 	{
+		for (auto& time : benchmark_times_)
+			time = 0.0;
 		SetInputListener(this);
 	}
 	const char* GetTitle() final
@@ -64,6 +85,12 @@ public:
 		object_shader_->Uniform1i("u_roughness_sampler", 5);
 		object_shader_->Uniform1i("u_metal_sampler", 6);
 		object_shader_->Uniform1i("u_shadow_sampler", 7);
+		object_shader_->Uniform1i("u_light_data_sampler", kFirstLightUnit);
+		object_shader_->Uniform1i("u_light_grid_sampler", kFirstLightUnit + 1);
+		object_shader_->Uniform1i("u_light_index_sampler", kFirstLightUnit + 2);
+		const LightGrid& grid = clustered_lights_.grid();
+		object_shader_->Uniform3f("u_cluster_dimensions", static_cast<float>(grid.tiles_x()),
+			static_cast<float>(grid.tiles_y()), static_cast<float>(grid.slices()));
 		object_shader_->Unbind();
 	}
 	void BindShaderVariables()
@@ -72,17 +99,6 @@ public:
 	bool Load() final
 	{
 		// Vertex formats
-		scythe::VertexFormat * object_vertex_format;
-		{
-			scythe::VertexAttribute attributes[] = {
-				scythe::VertexAttribute(scythe::VertexAttribute::kVertex, 3),
-				scythe::VertexAttribute(scythe::VertexAttribute::kNormal, 3),
-				scythe::VertexAttribute(scythe::VertexAttribute::kTexcoord, 2),
-				scythe::VertexAttribute(scythe::VertexAttribute::kTangent, 3),
-				scythe::VertexAttribute(scythe::VertexAttribute::kBinormal, 3)
-			};
-			renderer_->AddVertexFormat(object_vertex_format, attributes, _countof(attributes));
-		}
 		scythe::VertexFormat * quad_vertex_format;
 		{
 			scythe::VertexAttribute attributes[] = {
@@ -91,10 +107,9 @@ public:
 			renderer_->AddVertexFormat(quad_vertex_format, attributes, _countof(attributes));
 		}
 
-		// Sphere model
-		sphere_ = new scythe::Mesh(renderer_);
-		sphere_->CreateSphere(1.0f, 128, 64);
-		if (!sphere_->MakeRenderable(object_vertex_format))
+		// Sphere model with levels of detail, all instances of a level are drawn at once
+		if (!sphere_lod_.CreateSphere(1.0f, 128, 64, 4,
+			InstancedMesh::kNormal | InstancedMesh::kTexcoord | InstancedMesh::kTangentBasis))
 			return false;
 
 		// Screen quad model
@@ -106,7 +121,12 @@ public:
 		// Load shaders
 		const char* object_shader_defines[] = {
 			"USE_TANGENT",
-			"USE_SHADOW"
+			"USE_SHADOW",
+			"USE_INSTANCING",
+			"USE_CLUSTERED_LIGHTS"
+		};
+		const char* object_shadow_shader_defines[] = {
+			"USE_INSTANCING"
 		};
 		scythe::ShaderInfo object_shader_info(
 			"data/shaders/pbr/object_pbr", // base filename
@@ -117,6 +137,15 @@ public:
 			object_shader_defines, // array of defines
 			_countof(object_shader_defines) // number of defines
 			);
+		scythe::ShaderInfo object_shadow_shader_info(
+			"data/shaders/shadows/depth_vsm", // base filename
+			nullptr, // no vertex filename
+			nullptr, // no fragment filename
+			nullptr, // array of attribs
+			0, // number of attribs
+			object_shadow_shader_defines, // array of defines
+			_countof(object_shadow_shader_defines) // number of defines
+			);
 		if (!renderer_->AddShader(text_shader_, "data/shaders/text")) return false;
 		if (!renderer_->AddShader(quad_shader_, "data/shaders/quad")) return false;
 		if (!renderer_->AddShader(gui_shader_, "data/shaders/gui_colored")) return false;
@@ -125,7 +154,7 @@ public:
 		if (!renderer_->AddShader(prefilter_shader_, "data/shaders/pbr/prefilter")) return false;
 		if (!renderer_->AddShader(integrate_shader_, "data/shaders/pbr/integrate")) return false;
 		if (!renderer_->AddShader(object_shader_, object_shader_info)) return false;
-		if (!renderer_->AddShader(object_shadow_shader_, "data/shaders/shadows/depth_vsm")) return false;
+		if (!renderer_->AddShader(object_shadow_shader_, object_shadow_shader_info)) return false;
 		if (!renderer_->AddShader(blur_shader_, "data/shaders/blur")) return false;
 		
 		// Load textures
@@ -171,6 +200,14 @@ public:
 		if (!fps_text_)
 			return false;
 
+		info_text_ = scythe::DynamicText::Create(renderer_, 100);
+		if (!info_text_)
+			return false;
+
+		if (!clustered_lights_.Create())
+			return false;
+		CreateLights();
+
 		camera_manager_ = new scythe::CameraManager();
 		camera_manager_->MakeFree(scythe::Vector3(5.0f), scythe::Vector3(0.0f));
 
@@ -185,12 +222,60 @@ public:
 	{
 		if (camera_manager_)
 			delete camera_manager_;
+		if (info_text_)
+			delete info_text_;
 		if (fps_text_)
 			delete fps_text_;
 		if (quad_)
 			delete quad_;
-		if (sphere_)
-			delete sphere_;
+		sphere_lod_.Release();
+		clustered_lights_.Release();
+	}
+	void CreateLights()
+	{
+		const size_t count = kLightCounts[light_count_index_];
+		std::mt19937 generator(static_cast<unsigned int>(count));
+		std::uniform_real_distribution<float> orbit_radius(0.5f, 6.0f);
+		std::uniform_real_distribution<float> height(-1.0f, 2.5f);
+		std::uniform_real_distribution<float> angle(0.0f, 2.0f * scythe::kPi);
+		std::uniform_real_distribution<float> speed(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> radius(0.5f, 1.5f);
+		std::uniform_real_distribution<float> color(0.0f, 1.0f);
+		// Keep total energy about the same for any number of lights
+		const float intensity = count != 0 ? 2.0f * sqrtf(256.0f / static_cast<float>(count)) : 0.0f;
+		lights_.resize(count);
+		light_orbits_.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			light_orbits_[i].radius = orbit_radius(generator);
+			light_orbits_[i].height = height(generator);
+			light_orbits_[i].angle = angle(generator);
+			light_orbits_[i].speed = speed(generator);
+			lights_[i].radius = radius(generator);
+			for (int c = 0; c < 3; ++c)
+				lights_[i].color[c] = intensity * color(generator);
+		}
+	}
+	void UpdateLights(float frame_time)
+	{
+		// Orbits are centered in the middle of the spheres
+		const float kCenterX = 0.7f;
+		const float kCenterZ = 0.7f;
+		for (size_t i = 0; i < lights_.size(); ++i)
+		{
+			LightOrbit& orbit = light_orbits_[i];
+			orbit.angle += orbit.speed * frame_time;
+			lights_[i].position[0] = kCenterX + orbit.radius * cosf(orbit.angle);
+			lights_[i].position[1] = orbit.height;
+			lights_[i].position[2] = kCenterZ + orbit.radius * sinf(orbit.angle);
+		}
+		clustered_lights_.Update(lights_.data(), lights_.size(), renderer_->view_matrix());
+	}
+	void RunLightGridBenchmark()
+	{
+		const LightGrid& grid = clustered_lights_.grid();
+		for (size_t i = 0; i < _countof(kBenchmarkLightCounts); ++i)
+			benchmark_times_[i] = BenchmarkLightGrid(kBenchmarkLightCounts[i], grid.tiles_x(), grid.tiles_y(), grid.slices());
 	}
 	void Update() final
 	{
@@ -212,6 +297,8 @@ public:
 		UpdateProjectionMatrix();
 		projection_view_matrix_ = renderer_->projection_matrix() * renderer_->view_matrix();
 
+		UpdateLights(kFrameTime);
+
 		BindShaderVariables();
 	}
 	void BakeCubemaps()
@@ -288,7 +375,7 @@ public:
 
 		renderer_->EnableDepthTest();
 	}
-	void RenderObjects(scythe::Shader * shader, bool normal_mode)
+	void RenderObjects(const LodSelector& lod_selector, bool normal_mode)
 	{
 		if (normal_mode)
 		{
@@ -302,23 +389,21 @@ public:
 			renderer_->ChangeTexture(shadow_color_rt_, 7);
 		}
 	
-		renderer_->PushMatrix();
-		renderer_->Translate(scythe::Vector3(0.0f, 0.0f, 0.0f));
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		sphere_->Render();
-		renderer_->PopMatrix();
-
-		renderer_->PushMatrix();
-		renderer_->Translate(scythe::Vector3(2.0f, 0.0f, 0.0f));
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		sphere_->Render();
-		renderer_->PopMatrix();
-
-		renderer_->PushMatrix();
-		renderer_->Translate(scythe::Vector3(0.0f, 0.0f, 2.0f));
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		sphere_->Render();
-		renderer_->PopMatrix();
+		const scythe::Vector3 kSpherePositions[] = {
+			scythe::Vector3(0.0f, 0.0f, 0.0f),
+			scythe::Vector3(2.0f, 0.0f, 0.0f),
+			scythe::Vector3(0.0f, 0.0f, 2.0f)
+		};
+		const scythe::Vector3 kColor(1.0f); // material is defined by textures
+		sphere_lod_.BeginInstances();
+		for (const auto& position : kSpherePositions)
+		{
+			renderer_->PushMatrix();
+			renderer_->Translate(position);
+			sphere_lod_.AddInstance(lod_selector, position, 1.0f, renderer_->model_matrix(), kColor);
+			renderer_->PopMatrix();
+		}
+		sphere_lod_.Render();
 
 		if (normal_mode)
 		{
@@ -337,7 +422,8 @@ public:
 		// Generate matrix for shadows
 		// Ortho matrix is used for directional light sources and perspective for spot ones.
 		scythe::Matrix4 depth_projection;
-		scythe::Matrix4::CreateOrthographic(10.0f, 10.0f, 0.0f, 20.0f, &depth_projection);
+		const float kShadowOrthoSize = 10.0f;
+		scythe::Matrix4::CreateOrthographic(kShadowOrthoSize, kShadowOrthoSize, 0.0f, 20.0f, &depth_projection);
 		scythe::Matrix4 depth_projection_view = depth_projection * light_view_matrix_;
 		/*
 			Native view of bias matrix is:
@@ -360,7 +446,9 @@ public:
 		object_shadow_shader_->Bind();
 		object_shadow_shader_->UniformMatrix4fv("u_projection_view", depth_projection_view);
 
-		RenderObjects(object_shadow_shader_, false);
+		LodSelector lod_selector;
+		lod_selector.SetOrthographic(kShadowOrthoSize, static_cast<float>(kShadowMapSize));
+		RenderObjects(lod_selector, false);
 
 		object_shadow_shader_->Unbind();
 
@@ -415,8 +503,19 @@ public:
 			object_shader_->UniformMatrix4fv("u_depth_bias_projection_view", depth_bias_projection_view_matrix_);
 			object_shader_->Uniform3fv("u_camera.position", *camera_manager_->position());
 			object_shader_->Uniform3fv("u_light.direction", light_direction_);
+			object_shader_->UniformMatrix4fv("u_view", renderer_->view_matrix());
+			object_shader_->Uniform2f("u_cluster_depth_params", clustered_lights_.grid().depth_scale(),
+				clustered_lights_.grid().depth_bias());
+			object_shader_->Uniform2f("u_viewport_size", static_cast<float>(width_), static_cast<float>(height_));
+
+			// Bound before renderer changes its own textures, so the first unit stays active
+			clustered_lights_.BindTextures(kFirstLightUnit);
+
+			LodSelector lod_selector;
+			lod_selector.SetPerspective(*camera_manager_->position(), 45.0f, static_cast<float>(height_));
+			RenderObjects(lod_selector, true);
 
-			RenderObjects(object_shader_, true);
+			clustered_lights_.UnbindTextures(kFirstLightUnit);
 
 			object_shader_->Unbind();
 		}
@@ -431,6 +530,12 @@ public:
 		text_shader_->Uniform4f("u_color", 1.0f, 0.5f, 1.0f, 1.0f);
 		fps_text_->SetText(font_, 0.0f, 0.8f, 0.05f, L"fps: %.2f", GetFrameRate());
 		fps_text_->Render();
+
+		info_text_->SetText(font_, 0.0f, 0.75f, 0.05f,
+			L"lights: %u, binning 1k/2k/5k/10k: %.2f/%.2f/%.2f/%.2f ms",
+			static_cast<unsigned int>(lights_.size()),
+			benchmark_times_[0], benchmark_times_[1], benchmark_times_[2], benchmark_times_[3]);
+		info_text_->Render();
 		
 		renderer_->EnableDepthTest();
 	}
@@ -483,6 +588,15 @@ public:
 		{
 			show_shadow_texture_ = !show_shadow_texture_;
 		}
+		else if (key == scythe::PublicKey::kL)
+		{
+			light_count_index_ = (light_count_index_ + 1) % _countof(kLightCounts);
+			CreateLights();
+		}
+		else if (key == scythe::PublicKey::kB)
+		{
+			RunLightGridBenchmark();
+		}
 	}
 	void OnKeyUp(scythe::PublicKey key, int modifiers) final
 	{
@@ -513,11 +627,12 @@ public:
 			scythe::Matrix4 projection_matrix;
 			scythe::Matrix4::CreatePerspective(45.0f, aspect_ratio_, 0.1f, 100.0f, &projection_matrix);
 			renderer_->SetProjectionMatrix(projection_matrix);
+			clustered_lights_.SetProjection(45.0f, aspect_ratio_, 0.1f, 100.0f);
 		}
 	}
 	
 private:
-	scythe::Mesh * sphere_;
+	InstancedMeshLod sphere_lod_;
 	scythe::Mesh * quad_;
 
 	scythe::Shader * text_shader_;
@@ -546,7 +661,14 @@ private:
 
 	scythe::Font * font_;
 	scythe::DynamicText * fps_text_;
+	scythe::DynamicText * info_text_;
 	scythe::CameraManager * camera_manager_;
+
+	ClusteredLights clustered_lights_;
+	std::vector<PointLight> lights_;
+	std::vector<LightOrbit> light_orbits_;
+	size_t light_count_index_;
+	double benchmark_times_[_countof(kBenchmarkLightCounts)]; //!< in milliseconds
 	
 	scythe::Matrix4 projection_view_matrix_;
 	scythe::Matrix4 depth_bias_projection_view_matrix_;
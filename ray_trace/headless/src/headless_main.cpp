@@ -0,0 +1,424 @@
+#include "cpu_tracer.h"
+#include "image_writer.h"
+#include "scene_file.h"
+#include "shader_permutation.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+
+/*
+Headless CPU reference renderer of the ray trace demo.
+Used to measure tracer throughput and to compare renders against golden images.
+*/
+
+namespace {
+
+	enum PacketMode {
+		kScalarRays,
+		kPacketRays,
+		kCompareRays, //!< scalar and packet renders are timed and compared
+	};
+	//! Traced ray list size of the shader permutation the render follows
+	enum PermutationMode {
+		kGenericPermutation,
+		kScenePermutation,
+		kComparePermutations, //!< generic and scene specialized renders are timed and compared
+	};
+
+	struct Options {
+		unsigned int width;
+		unsigned int height;
+		unsigned int threads; //!< zero means hardware concurrency
+		unsigned int repeat;
+		unsigned int primitives; //!< zero means the demo scene
+		bool use_bvh;
+		PacketMode packets;
+		PermutationMode permutation;
+		unsigned int frames; //!< animated frames for refit benchmark
+		float rebuild_growth; //!< SAH cost growth that triggers rebuild of animated BVH
+		unsigned int reference_samples; //!< samples of the denoiser benchmark reference, zero to skip it
+		int max_depth;
+		float tolerance; //!< minimal PSNR in dB for golden image comparison
+		std::string scene; //!< scene file, text or binary
+		std::string save_scene; //!< binary scene output
+		std::string output;
+		std::string golden;
+	};
+
+	void PrintUsage(const char * program)
+	{
+		printf("usage: %s [options]\n"
+			"  -w, --width <n>       image width (default 640)\n"
+			"  -h, --height <n>      image height (default 480)\n"
+			"  -t, --threads <n>     number of threads, 0 for all cores (default 0)\n"
+			"  -r, --repeat <n>      number of timed renders (default 1)\n"
+			"  -d, --depth <n>       maximum bounce depth (default %d)\n"
+			"  -s, --scene <file>    load text or binary scene file instead of the demo scene\n"
+			"  -p, --primitives <n>  generated field of n spheres and boxes instead of the demo scene\n"
+			"      --save-scene <file>  write the scene in binary format\n"
+			"      --bvh <0|1>       trace through BVH (default 1)\n"
+			"      --packets <mode>  scalar, packet or both to compare throughput (default scalar)\n"
+			"      --permutation <mode>  generic, scene or both to compare ray list sizes of shader permutations\n"
+			"                        (default generic)\n"
+			"      --animate <n>     animate scene for n frames, compares BVH refit with rebuild\n"
+			"      --rebuild-growth <x>  SAH cost growth that triggers rebuild of animated BVH (default 1.5)\n"
+			"      --denoise <n>     compare denoised and accumulated images with n sample reference,\n"
+			"                        output is the denoised single sample image\n"
+			"  -o, --output <file>   write image, format by extension (.png or .ppm)\n"
+			"  -g, --golden <file>   compare with PPM image, fails below tolerance\n"
+			"      --tolerance <db>  minimal PSNR for comparison (default 40)\n",
+			program, CpuTracer::kDefaultMaxDepth);
+	}
+	bool ParseOptions(int argc, char ** argv, Options * options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char * name = argv[i];
+			auto is = [name](const char * short_name, const char * long_name) {
+				return strcmp(name, short_name) == 0 || strcmp(name, long_name) == 0;
+			};
+			if (i + 1 >= argc)
+				return false;
+			const char * value = argv[++i];
+			if (is("-w", "--width"))
+				options->width = static_cast<unsigned int>(atoi(value));
+			else if (is("-h", "--height"))
+				options->height = static_cast<unsigned int>(atoi(value));
+			else if (is("-t", "--threads"))
+				options->threads = static_cast<unsigned int>(atoi(value));
+			else if (is("-r", "--repeat"))
+				options->repeat = static_cast<unsigned int>(atoi(value));
+			else if (is("-d", "--depth"))
+				options->max_depth = atoi(value);
+			else if (is("-s", "--scene"))
+				options->scene = value;
+			else if (strcmp(name, "--save-scene") == 0)
+				options->save_scene = value;
+			else if (is("-p", "--primitives"))
+				options->primitives = static_cast<unsigned int>(atoi(value));
+			else if (strcmp(name, "--bvh") == 0)
+				options->use_bvh = atoi(value) != 0;
+			else if (strcmp(name, "--packets") == 0)
+			{
+				if (strcmp(value, "scalar") == 0)
+					options->packets = kScalarRays;
+				else if (strcmp(value, "packet") == 0)
+					options->packets = kPacketRays;
+				else if (strcmp(value, "both") == 0)
+					options->packets = kCompareRays;
+				else
+					return false;
+			}
+			else if (strcmp(name, "--permutation") == 0)
+			{
+				if (strcmp(value, "generic") == 0)
+					options->permutation = kGenericPermutation;
+				else if (strcmp(value, "scene") == 0)
+					options->permutation = kScenePermutation;
+				else if (strcmp(value, "both") == 0)
+					options->permutation = kComparePermutations;
+				else
+					return false;
+			}
+			else if (strcmp(name, "--animate") == 0)
+				options->frames = static_cast<unsigned int>(atoi(value));
+			else if (strcmp(name, "--rebuild-growth") == 0)
+				options->rebuild_growth = static_cast<float>(atof(value));
+			else if (strcmp(name, "--denoise") == 0)
+				options->reference_samples = static_cast<unsigned int>(atoi(value));
+			else if (is("-o", "--output"))
+				options->output = value;
+			else if (is("-g", "--golden"))
+				options->golden = value;
+			else if (strcmp(name, "--tolerance") == 0)
+				options->tolerance = static_cast<float>(atof(value));
+			else
+				return false;
+		}
+		return options->width != 0 && options->height != 0 && options->repeat != 0;
+	}
+	double ComputePsnr(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b)
+	{
+		double error = 0.0;
+		for (size_t i = 0; i < a.size(); ++i)
+		{
+			const double difference = static_cast<double>(a[i]) - static_cast<double>(b[i]);
+			error += difference * difference;
+		}
+		error /= static_cast<double>(a.size());
+		if (error == 0.0)
+			return INFINITY;
+		return 10.0 * log10(255.0 * 255.0 / error);
+	}
+
+	/**
+	 * Averages jittered samples like the demo accumulation does, the first one goes through pixel centers.
+	 * @return Time in ms.
+	 */
+	double Accumulate(CpuTracer * tracer, const CameraRays& camera, const Options& options,
+		unsigned int num_samples, std::vector<Vec3> * pixels, DenoiseGuides * guides)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<Vec3> sample;
+		for (unsigned int i = 0; i < num_samples; ++i)
+		{
+			if (i == 0)
+				tracer->set_jitter(0.0f, 0.0f);
+			else
+				tracer->set_jitter((Halton(i, 2) - 0.5f) / static_cast<float>(options.width),
+					(Halton(i, 3) - 0.5f) / static_cast<float>(options.height));
+			tracer->Render(camera, options.width, options.height, options.threads,
+				(i == 0) ? pixels : &sample, (i == 0) ? guides : nullptr);
+			const float blend = 1.0f / static_cast<float>(i + 1);
+			for (size_t p = 0; i != 0 && p < pixels->size(); ++p)
+				(*pixels)[p] = Mix((*pixels)[p], sample[p], blend);
+		}
+		tracer->set_jitter(0.0f, 0.0f);
+		const auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+	/**
+	 * Prints quality against time of accumulated and denoised images,
+	 * PSNR is measured after tone mapping against the reference of many samples.
+	 * Returns the denoised single sample image.
+	 */
+	void RunDenoiseBenchmark(CpuTracer * tracer, const CameraRays& camera, const Options& options,
+		std::vector<Vec3> * denoised)
+	{
+		std::vector<Vec3> reference, pixels;
+		std::vector<unsigned char> reference_rgb, rgb;
+		const double reference_time = Accumulate(tracer, camera, options, options.reference_samples, &reference, nullptr);
+		ToneMap(reference, options.width, options.height, &reference_rgb);
+		printf("Denoise reference: %u samples in %.2f ms\n", options.reference_samples, reference_time);
+		printf("samples  denoised  trace ms  denoise ms  PSNR dB\n");
+		DenoiseSettings settings;
+		for (unsigned int samples = 1; samples < options.reference_samples; samples *= 2)
+		{
+			settings.num_samples = samples;
+			DenoiseGuides guides;
+			const double trace_time = Accumulate(tracer, camera, options, samples, &pixels, &guides);
+			ToneMap(pixels, options.width, options.height, &rgb);
+			printf("%7u  %8s  %8.2f  %10s  %7.2f\n", samples, "no", trace_time, "-", ComputePsnr(rgb, reference_rgb));
+
+			const auto start = std::chrono::steady_clock::now();
+			std::vector<Vec3> filtered;
+			DenoiseAtrous(pixels, guides, options.width, options.height, settings, options.threads, &filtered);
+			const auto end = std::chrono::steady_clock::now();
+			ToneMap(filtered, options.width, options.height, &rgb);
+			printf("%7u  %8s  %8.2f  %10.2f  %7.2f\n", samples, "yes", trace_time,
+				std::chrono::duration<double, std::milli>(end - start).count(), ComputePsnr(rgb, reference_rgb));
+			if (samples == 1)
+				denoised->swap(filtered);
+		}
+	}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+	Options options;
+	options.width = 640;
+	options.height = 480;
+	options.threads = 0;
+	options.repeat = 1;
+	options.primitives = 0;
+	options.use_bvh = true;
+	options.packets = kScalarRays;
+	options.permutation = kGenericPermutation;
+	options.frames = 0;
+	options.rebuild_growth = 1.5f;
+	options.reference_samples = 0;
+	options.max_depth = CpuTracer::kDefaultMaxDepth;
+	options.tolerance = 40.0f;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	Scene scene;
+	std::string error;
+	if (!options.scene.empty())
+	{
+		const auto start = std::chrono::steady_clock::now();
+		if (!ReadSceneFile(options.scene, &scene, &error))
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		const auto end = std::chrono::steady_clock::now();
+		printf("Scene: %u materials, %u planes, %u spheres, %u boxes, %u meshes, %u instances, %u lights, loaded in %.2f ms\n",
+			static_cast<unsigned int>(scene.materials.size()), static_cast<unsigned int>(scene.planes.size()),
+			static_cast<unsigned int>(scene.spheres.size()), static_cast<unsigned int>(scene.boxes.size()),
+			static_cast<unsigned int>(scene.meshes.size()), static_cast<unsigned int>(scene.instances.size()),
+			static_cast<unsigned int>(scene.lights.size()),
+			std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	else if (options.primitives != 0)
+		CreateFieldScene(&scene, options.primitives);
+	else
+		CreateDefaultScene(&scene);
+	if (!options.save_scene.empty() && !WriteSceneBinary(options.save_scene, scene, &error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+	Bvh bvh;
+	if (options.use_bvh)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		bvh.Build(scene);
+		const auto end = std::chrono::steady_clock::now();
+		printf("BVH: %u primitives, %u triangles, %u nodes, built in %.2f ms\n",
+			bvh.num_scene_primitives(), static_cast<unsigned int>(bvh.primitives().size()) - bvh.num_scene_primitives(),
+			static_cast<unsigned int>(bvh.nodes().size()),
+			std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	if (options.frames != 0 && options.use_bvh)
+	{
+		// Same motion goes to a tree rebuilt every frame, a tree only refitted and the rendered one
+		const float kFrameStep = 1.0f / 30.0f;
+		const Scene rest = scene;
+		Bvh rebuilt, refitted;
+		refitted.Build(scene);
+		double rebuild_time = 0.0, refit_time = 0.0, update_time = 0.0;
+		unsigned int num_rebuilds = 0;
+		for (unsigned int frame = 1; frame <= options.frames; ++frame)
+		{
+			AnimateScene(rest, static_cast<float>(frame) * kFrameStep, &scene);
+			auto start = std::chrono::steady_clock::now();
+			rebuilt.Build(scene);
+			auto end = std::chrono::steady_clock::now();
+			rebuild_time += std::chrono::duration<double, std::milli>(end - start).count();
+			start = std::chrono::steady_clock::now();
+			refitted.Refit(scene);
+			end = std::chrono::steady_clock::now();
+			refit_time += std::chrono::duration<double, std::milli>(end - start).count();
+			start = std::chrono::steady_clock::now();
+			if (bvh.Update(scene, options.rebuild_growth))
+				++num_rebuilds;
+			end = std::chrono::steady_clock::now();
+			update_time += std::chrono::duration<double, std::milli>(end - start).count();
+		}
+		const double frames = static_cast<double>(options.frames);
+		printf("Animation: %u frames, average rebuild %.3f ms, refit %.3f ms (%.1fx faster)\n",
+			options.frames, rebuild_time / frames, refit_time / frames, rebuild_time / refit_time);
+		printf("SAH cost: rebuilt %.1f, refitted %.1f (%.2fx of its build)\n",
+			rebuilt.SahCost(), refitted.SahCost(), refitted.SahCost() / refitted.build_sah_cost());
+		printf("Refit with rebuild at %.2fx cost growth: %u rebuilds, average %.3f ms, SAH cost %.1f\n",
+			options.rebuild_growth, num_rebuilds, update_time / frames, bvh.SahCost());
+	}
+	CpuTracer tracer;
+	tracer.SetScene(&scene, options.use_bvh ? &bvh : nullptr);
+	tracer.set_max_depth(options.max_depth);
+
+	// Same view as the demo starts with
+	CameraRays camera;
+	const float aspect_ratio = static_cast<float>(options.width) / static_cast<float>(options.height);
+	MakeCameraRays(Vec3(5.0f), Vec3(0.0f), Vec3(0.0f, 1.0f, 0.0f), 45.0f, aspect_ratio, &camera);
+
+	// Returns the best time of repeated renders
+	auto render = [&](bool use_packets, std::vector<Vec3> * pixels) {
+		tracer.set_use_packets(use_packets);
+		double best_time = 1e30, total_time = 0.0;
+		for (unsigned int i = 0; i < options.repeat; ++i)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			tracer.Render(camera, options.width, options.height, options.threads, pixels);
+			const auto end = std::chrono::steady_clock::now();
+			const double time = std::chrono::duration<double>(end - start).count();
+			best_time = std::min(best_time, time);
+			total_time += time;
+		}
+		const double num_rays = static_cast<double>(options.width) * options.height;
+		printf("%s %ux%u, %u renders: best %.2f ms, average %.2f ms, %.2f Mrays/s (primary)\n",
+			use_packets ? "packet" : "scalar", options.width, options.height, options.repeat,
+			best_time * 1e3, total_time * 1e3 / options.repeat, num_rays / best_time * 1e-6);
+		return best_time;
+	};
+	const ShaderPermutation permutation = MakeSpecializedPermutation(scene, options.max_depth);
+	if (options.permutation != kGenericPermutation)
+	{
+		printf("Scene permutation:");
+		for (const std::string& define : MakeShaderDefines(permutation))
+			printf(" %s;", define.c_str() + strlen("#define "));
+		printf(" generic has %d traced rays\n", CpuTracer::kMaxTracedRays);
+	}
+	if (options.permutation == kScenePermutation)
+		tracer.set_max_traced_rays(permutation.max_traced_rays);
+	if (options.packets != kScalarRays)
+		printf("Packets: %u rays (%s)%s\n", CpuTracer::kPacketSize, SimdName(),
+			options.use_bvh ? "" : ", traced one by one without BVH");
+
+	std::vector<Vec3> pixels;
+	std::vector<unsigned char> rgb;
+	if (options.reference_samples > 1)
+	{
+		tracer.set_use_packets(options.packets != kScalarRays);
+		RunDenoiseBenchmark(&tracer, camera, options, &pixels);
+		ToneMap(pixels, options.width, options.height, &rgb);
+	}
+	else if (options.packets == kCompareRays)
+	{
+		// Scalar image is the reference for the packet one
+		std::vector<Vec3> scalar_pixels;
+		std::vector<unsigned char> scalar_rgb;
+		const double scalar_time = render(false, &scalar_pixels);
+		const double packet_time = render(true, &pixels);
+		ToneMap(scalar_pixels, options.width, options.height, &scalar_rgb);
+		ToneMap(pixels, options.width, options.height, &rgb);
+		printf("Packet speedup %.2fx, PSNR to scalar %.2f dB\n",
+			scalar_time / packet_time, ComputePsnr(rgb, scalar_rgb));
+	}
+	else if (options.permutation == kComparePermutations)
+	{
+		// Ray list of the scene permutation never drops a ray, so images should match
+		std::vector<Vec3> generic_pixels;
+		std::vector<unsigned char> generic_rgb;
+		const double generic_time = render(options.packets == kPacketRays, &generic_pixels);
+		tracer.set_max_traced_rays(permutation.max_traced_rays);
+		const double scene_time = render(options.packets == kPacketRays, &pixels);
+		ToneMap(generic_pixels, options.width, options.height, &generic_rgb);
+		ToneMap(pixels, options.width, options.height, &rgb);
+		printf("Scene permutation speedup %.2fx, PSNR to generic %.2f dB\n",
+			generic_time / scene_time, ComputePsnr(rgb, generic_rgb));
+	}
+	else
+	{
+		render(options.packets == kPacketRays, &pixels);
+		ToneMap(pixels, options.width, options.height, &rgb);
+	}
+	if (!options.output.empty())
+	{
+		if (!WriteImage(options.output, options.width, options.height, rgb))
+		{
+			fprintf(stderr, "failed to write '%s'\n", options.output.c_str());
+			return 1;
+		}
+	}
+	if (!options.golden.empty())
+	{
+		unsigned int width, height;
+		std::vector<unsigned char> golden;
+		if (!ReadPpm(options.golden, &width, &height, &golden))
+		{
+			fprintf(stderr, "failed to read '%s'\n", options.golden.c_str());
+			return 1;
+		}
+		if (width != options.width || height != options.height)
+		{
+			fprintf(stderr, "golden image is %ux%u\n", width, height);
+			return 1;
+		}
+		const double psnr = ComputePsnr(rgb, golden);
+		printf("PSNR %.2f dB\n", psnr);
+		if (psnr < options.tolerance)
+			return 2;
+	}
+	return 0;
+}
\ No newline at end of file
@@ -4,11 +4,46 @@
 
 #include "declare_main.h"
 
+#include "cpu_tracer.h"
+#include "denoiser.h"
+#include "image_writer.h"
+#include "scene_buffers.h"
+#include "scene_file.h"
+#include "shader_permutation.h"
+#include "resolution_controller.h"
+
 #include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
 
 /*
 The main concept of creating this application is testing ray trace.
 */
+namespace {
+	const unsigned int kFirstSceneUnit = 1; //!< scene buffers take units 1-6
+	//! Scene files go first, generated fields of that many primitives follow
+	const char * const kSceneFiles[] = {"data/scenes/default.scene", "data/scenes/gallery.scene",
+		"data/scenes/meshes.scene"};
+	const unsigned int kScenePrimitiveCounts[] = {1000, 10000, 100000};
+	//! Static view stops tracing after this many samples
+	const unsigned int kMaxAccumulatedSamples = 256;
+	//! Filter gains only on single sample frames, accumulated ones are presented as they are
+	const unsigned int kMaxDenoisedSamples = 1;
+	//! Trace resolution bounds relative to the window size
+	const float kMinResolutionScale = 0.25f;
+	const float kMaxResolutionScale = 1.0f;
+	const float kTargetFrameRates[] = {30.0f, 60.0f};
+	//! Animated BVH is rebuilt when refits make it that much more expensive to traverse
+	const float kMaxSahCostGrowth = 1.5f;
+	//! Full glass bounce tree of this depth still fits the generic ray list
+	const int kMaxTraceDepth = 6;
+	//! Traced frames per shader permutation in the benchmark
+	const unsigned int kBenchmarkFrames = 32;
+}
 
 #define APP_NAME RayTraceApp
 
@@ -18,12 +53,43 @@ class APP_NAME : public scythe::OpenGlApplication
 public:
 	APP_NAME()
 	: quad_(nullptr)
+	, guide_rt_(nullptr)
 	, font_(nullptr)
 	, fps_text_(nullptr)
+	, reference_text_(nullptr)
+	, resolution_text_(nullptr)
+	, shader_text_(nullptr)
 	, camera_manager_(nullptr)
+	, reference_time_(0.0f)
+	, generic_trace_time_(0.0f)
+	, specialized_trace_time_(0.0f)
+	, scene_index_(0)
+	, target_width_(0)
+	, target_height_(0)
+	, trace_width_(0)
+	, trace_height_(0)
+	, accumulation_index_(0)
+	, num_samples_(0)
+	, target_rate_index_(0)
+	, traced_last_frame_(false)
+	, animation_time_(0.0f)
+	, animated_(false)
+	, denoised_(false)
+	, max_depth_(CpuTracer::kDefaultMaxDepth)
+	, specialized_(true)
+	, benchmark_requested_(false)
 	, need_update_projection_matrix_(true)
 	{
 		SetInputListener(this);
+		for (int i = 0; i < 2; ++i)
+		{
+			accumulation_rts_[i] = nullptr;
+			denoise_rts_[i] = nullptr;
+		}
+		cpu_tracer_.SetScene(&scene_, &bvh_);
+		cpu_tracer_.set_use_packets(true); // images match the single ray path
+		resolution_controller_.SetBounds(kMinResolutionScale, kMaxResolutionScale);
+		resolution_controller_.SetTargetFrameTime(1.0f / kTargetFrameRates[target_rate_index_]);
 	}
 	const char* GetTitle() final
 	{
@@ -35,35 +101,174 @@ public:
 	}
 	void BindShaderConstants()
 	{
-		const scythe::Vector3 kSpherePosition(0.0f);
-
 		text_shader_->Bind();
 		text_shader_->Uniform1i("u_texture", 0);
 
-		cast_shader_->Bind();
-		// Plane
-		cast_shader_->Uniform3f("u_planes[0].normal", 0.0f, 1.0f, 0.0f);
-		cast_shader_->Uniform1f("u_planes[0].d", 1.0f); // height = -d
-		// Sphere
-		cast_shader_->Uniform3fv("u_spheres[0].position", kSpherePosition);
-		cast_shader_->Uniform1f("u_spheres[0].radius", 1.0f);
-		// Boxes
-		cast_shader_->Uniform3fv("u_boxes[0].min", scythe::Vector3(-1.0f, -1.0f, 2.5f));
-		cast_shader_->Uniform3fv("u_boxes[0].max", scythe::Vector3(1.0f, 1.0f, 3.f));
-
-		cast_shader_->Uniform1i("u_num_planes", 1);
-		cast_shader_->Uniform1i("u_num_spheres", 1);
-		cast_shader_->Uniform1i("u_num_boxes", 1);
-		// Light
-		scythe::Vector3 light_direction(1.0f, 0.5f, 0.5f);
-		light_direction.Normalize();
-		cast_shader_->Uniform3fv("u_light.color", scythe::Vector3(1e3));
-		cast_shader_->Uniform3fv("u_light.direction", light_direction);
-		cast_shader_->Unbind();
+		present_shader_->Bind();
+		present_shader_->Uniform1i("u_texture", 0);
+		present_shader_->Unbind();
+
+		// Same edge stopping parameters as the CPU denoiser
+		const DenoiseSettings settings;
+		denoise_shader_->Bind();
+		denoise_shader_->Uniform1i("u_texture", 0);
+		denoise_shader_->Uniform1i("u_guide_sampler", 1);
+		denoise_shader_->Uniform1f("u_normal_weight", 1.0f / (settings.normal_sigma * settings.normal_sigma));
+		denoise_shader_->Uniform1f("u_albedo_weight", 1.0f / (settings.albedo_sigma * settings.albedo_sigma));
+		denoise_shader_->Uniform1f("u_inv_depth_sigma", 1.0f / settings.depth_sigma);
+		denoise_shader_->Unbind();
+
+		// Shader and CPU tracer render the same scene, guide pass only takes primary hits of it
+		scythe::Shader * shaders[] = {cast_shader_, guide_shader_};
+		for (scythe::Shader * shader : shaders)
+		{
+			shader->Bind();
+			shader->Uniform1i("u_accumulation_sampler", 0);
+			shader->Uniform1i("u_bvh_node_sampler", kFirstSceneUnit + SceneBuffers::kNodeBuffer);
+			shader->Uniform1i("u_bvh_primitive_sampler", kFirstSceneUnit + SceneBuffers::kPrimitiveBuffer);
+			shader->Uniform1i("u_triangle_sampler", kFirstSceneUnit + SceneBuffers::kTriangleBuffer);
+			shader->Uniform1i("u_material_sampler", kFirstSceneUnit + SceneBuffers::kMaterialBuffer);
+			shader->Uniform1i("u_plane_sampler", kFirstSceneUnit + SceneBuffers::kPlaneBuffer);
+			shader->Uniform1i("u_light_sampler", kFirstSceneUnit + SceneBuffers::kLightBuffer);
+			shader->Uniform1i("u_num_bvh_nodes", static_cast<int>(scene_buffers_.num_nodes()));
+			shader->Uniform1i("u_num_planes", static_cast<int>(scene_buffers_.num_planes()));
+			shader->Uniform1i("u_num_lights", static_cast<int>(scene_buffers_.num_lights()));
+			shader->Unbind();
+		}
+		// Guides are written as they are, without jitter and blending
+		guide_shader_->Bind();
+		guide_shader_->Uniform2f("u_jitter", 0.0f, 0.0f);
+		guide_shader_->Uniform1f("u_blend", 1.0f);
+		guide_shader_->Unbind();
 	}
 	void BindShaderVariables()
 	{
 	}
+	bool LoadScene()
+	{
+		const unsigned int num_files = _countof(kSceneFiles);
+		if (scene_index_ < num_files)
+		{
+			std::string error;
+			if (!ReadSceneFile(kSceneFiles[scene_index_], &scene_, &error))
+			{
+				fprintf(stderr, "%s\n", error.c_str());
+				CreateDefaultScene(&scene_);
+			}
+		}
+		else
+			CreateFieldScene(&scene_, kScenePrimitiveCounts[scene_index_ - num_files]);
+		rest_scene_ = scene_;
+		animation_time_ = 0.0f;
+		bvh_.Build(scene_);
+		scene_buffers_.Update(scene_, bvh_);
+		return SelectCastShader();
+	}
+	/**
+	 * Compiles ray trace shader permutation on its first use.
+	 * @return Cached shader or null if compilation failed.
+	 */
+	scythe::Shader * GetCastShader(const ShaderPermutation& permutation)
+	{
+		auto it = cast_shaders_.find(permutation);
+		if (it != cast_shaders_.end())
+			return it->second;
+		const std::vector<std::string> defines = MakeShaderDefines(permutation);
+		std::vector<const char*> cast_shader_defines;
+		for (const std::string& define : defines)
+			cast_shader_defines.push_back(define.c_str());
+		scythe::ShaderInfo cast_shader_info(
+			"data/shaders/raytrace/raytrace", // base filename
+			nullptr, // no vertex filename
+			nullptr, // no fragment filename
+			nullptr, // array of attribs
+			0, // number of attribs
+			cast_shader_defines.data(), // array of defines
+			cast_shader_defines.size() // number of defines
+			);
+		scythe::Shader * shader = nullptr;
+		if (!renderer_->AddShader(shader, cast_shader_info))
+			return nullptr;
+		cast_shaders_[permutation] = shader;
+		return shader;
+	}
+	/**
+	 * Switches to the permutation of current scene and depth, generic one is the fallback.
+	 * CPU reference gets the same depth and ray list size.
+	 */
+	bool SelectCastShader()
+	{
+		const ShaderPermutation generic = MakeGenericPermutation(max_depth_, CpuTracer::kMaxTracedRays);
+		ShaderPermutation permutation = specialized_ ? MakeSpecializedPermutation(scene_, max_depth_) : generic;
+		scythe::Shader * shader = GetCastShader(permutation);
+		if (shader == nullptr && specialized_)
+		{
+			fprintf(stderr, "failed to compile scene specialized ray trace shader, using the generic one\n");
+			permutation = generic;
+			shader = GetCastShader(permutation);
+		}
+		if (shader == nullptr)
+			return false;
+		cast_shader_ = shader;
+		cpu_tracer_.set_max_depth(max_depth_);
+		cpu_tracer_.set_max_traced_rays(permutation.max_traced_rays);
+		BindShaderConstants();
+		BindCameraRays();
+		ResetAccumulation();
+		return true;
+	}
+	void ResetAccumulation()
+	{
+		num_samples_ = 0;
+	}
+	/**
+	 * Accumulation targets only grow, frame is traced into the window sized corner of them.
+	 * Size is rounded up to kTargetSizeStep, so dragging window border doesn't reallocate every frame,
+	 * and outgrown targets are deleted before the new ones are created.
+	 */
+	void UpdateRenderTargets()
+	{
+		const int kTargetSizeStep = 256;
+		if (width_ <= target_width_ && height_ <= target_height_)
+			return;
+		auto round_up = [kTargetSizeStep](int size) {
+			return (size + kTargetSizeStep - 1) / kTargetSizeStep * kTargetSizeStep;
+		};
+		target_width_ = std::max(target_width_, round_up(width_));
+		target_height_ = std::max(target_height_, round_up(height_));
+		DeleteRenderTargets();
+		for (int i = 0; i < 2; ++i)
+		{
+			renderer_->AddRenderTarget(accumulation_rts_[i], target_width_, target_height_, scythe::Image::Format::kRGBA32);
+			renderer_->AddRenderTarget(denoise_rts_[i], target_width_, target_height_, scythe::Image::Format::kRGBA32);
+		}
+		renderer_->AddRenderTarget(guide_rt_, target_width_, target_height_, scythe::Image::Format::kRGBA32);
+		ResetAccumulation();
+	}
+	void DeleteRenderTargets()
+	{
+		scythe::Texture ** targets[] = {&accumulation_rts_[0], &accumulation_rts_[1],
+			&denoise_rts_[0], &denoise_rts_[1], &guide_rt_};
+		for (scythe::Texture ** target : targets)
+			if (*target)
+			{
+				renderer_->DeleteTexture(*target);
+				*target = nullptr;
+			}
+	}
+	//! Traced area follows window size and controller scale
+	void UpdateTraceSize()
+	{
+		const float scale = resolution_controller_.scale();
+		const int width = std::min(width_, std::max(1, static_cast<int>(static_cast<float>(width_) * scale + 0.5f)));
+		const int height = std::min(height_, std::max(1, static_cast<int>(static_cast<float>(height_) * scale + 0.5f)));
+		if (width == trace_width_ && height == trace_height_)
+			return;
+		trace_width_ = width;
+		trace_height_ = height;
+		// Samples of the old pixel grid can't be blended with the new ones
+		ResetAccumulation();
+	}
 	bool Load() final
 	{
 		// Vertex formats
@@ -83,28 +288,61 @@ public:
 		
 		// Load shaders
 		if (!renderer_->AddShader(text_shader_, "data/shaders/text")) return false;
-		if (!renderer_->AddShader(cast_shader_, "data/shaders/raytrace/raytrace")) return false;
+		if (!renderer_->AddShader(present_shader_, "data/shaders/raytrace/present")) return false;
+		if (!renderer_->AddShader(denoise_shader_, "data/shaders/raytrace/atrous")) return false;
+		{
+			const char* guide_shader_defines[] = {
+				"GUIDE_PASS"
+			};
+			scythe::ShaderInfo guide_shader_info(
+				"data/shaders/raytrace/raytrace", // base filename
+				nullptr, // no vertex filename
+				nullptr, // no fragment filename
+				nullptr, // array of attribs
+				0, // number of attribs
+				guide_shader_defines, // array of defines
+				_countof(guide_shader_defines) // number of defines
+				);
+			if (!renderer_->AddShader(guide_shader_, guide_shader_info)) return false;
+		}
 
 		renderer_->AddFont(font_, "data/fonts/GoodDog.otf");
 		if (font_ == nullptr)
 			return false;
 
-		fps_text_ = scythe::DynamicText::Create(renderer_, 30);
+		fps_text_ = scythe::DynamicText::Create(renderer_, 60);
 		if (!fps_text_)
 			return false;
+		reference_text_ = scythe::DynamicText::Create(renderer_, 60);
+		if (!reference_text_)
+			return false;
+		resolution_text_ = scythe::DynamicText::Create(renderer_, 60);
+		if (!resolution_text_)
+			return false;
+		shader_text_ = scythe::DynamicText::Create(renderer_, 90);
+		if (!shader_text_)
+			return false;
 
 		camera_manager_ = new scythe::CameraManager();
 		camera_manager_->MakeFree(scythe::Vector3(5.0f), scythe::Vector3(0.0f));
 
-		// Finally bind constants
-		BindShaderConstants();
-		
-		return true;
+		if (!scene_buffers_.Create())
+			return false;
+
+		// Finally build the scene and compile ray trace shader for it
+		return LoadScene();
 	}
 	void Unload() final
 	{
+		scene_buffers_.Release();
 		if (camera_manager_)
 			delete camera_manager_;
+		if (shader_text_)
+			delete shader_text_;
+		if (resolution_text_)
+			delete resolution_text_;
+		if (reference_text_)
+			delete reference_text_;
 		if (fps_text_)
 			delete fps_text_;
 		if (quad_)
@@ -115,6 +353,12 @@ public:
 		const float kFrameTime = GetFrameTime();
 
 		camera_manager_->Update(kFrameTime);
+		if (animated_)
+			Animate(kFrameTime);
+
+		// Only traced frames tell how expensive the current resolution is
+		if (traced_last_frame_)
+			resolution_controller_.Update(kFrameTime);
 
 		// Update matrices
 		renderer_->SetViewMatrix(camera_manager_->view_matrix());
@@ -124,15 +368,149 @@ public:
 
 		BindShaderVariables();
 	}
-	void RenderObjects()
+	//! Moves primitives, BVH is refitted and only rebuilt once its quality degrades
+	void Animate(float frame_time)
 	{
-		renderer_->DisableDepthTest();
+		animation_time_ += frame_time;
+		AnimateScene(rest_scene_, animation_time_, &scene_);
+		if (bvh_.Update(scene_, kMaxSahCostGrowth))
+		{
+			scene_buffers_.Update(scene_, bvh_);
+			BindShaderConstants();
+		}
+		else
+			scene_buffers_.UpdateMoved(scene_, bvh_);
+		ResetAccumulation();
+	}
+	//! Adds one jittered sample to the accumulation target
+	void TraceSample()
+	{
+		traced_last_frame_ = (num_samples_ < kMaxAccumulatedSamples);
+		if (!traced_last_frame_)
+			return; // image has converged, nothing to trace until the view changes
+		const unsigned int previous = accumulation_index_;
+		accumulation_index_ = 1 - accumulation_index_;
+
+		// First sample goes through pixel centers, as without accumulation
+		float jitter_x = 0.0f;
+		float jitter_y = 0.0f;
+		if (num_samples_ != 0)
+		{
+			jitter_x = (Halton(num_samples_, 2) - 0.5f) / static_cast<float>(trace_width_);
+			jitter_y = (Halton(num_samples_, 3) - 0.5f) / static_cast<float>(trace_height_);
+		}
 
-		//renderer_->ChangeTexture(env_texture);
+		renderer_->SetViewport(trace_width_, trace_height_);
+		scene_buffers_.BindTextures(kFirstSceneUnit);
+		// Denoiser guides come from primary hits, which jitter doesn't move far
+		if (denoised_ && num_samples_ == 0)
+		{
+			renderer_->ChangeRenderTarget(guide_rt_, nullptr);
+			guide_shader_->Bind();
+			quad_->Render();
+			guide_shader_->Unbind();
+		}
+		renderer_->ChangeRenderTarget(accumulation_rts_[accumulation_index_], nullptr);
+		renderer_->ChangeTexture(accumulation_rts_[previous]);
 		cast_shader_->Bind();
+		cast_shader_->Uniform2f("u_jitter", jitter_x, jitter_y);
+		cast_shader_->Uniform1f("u_blend", 1.0f / static_cast<float>(num_samples_ + 1));
 		quad_->Render();
 		cast_shader_->Unbind();
-		//renderer_->ChangeTexture(nullptr);
+		scene_buffers_.UnbindTextures(kFirstSceneUnit);
+		renderer_->ChangeTexture(nullptr);
+		renderer_->ChangeRenderTarget(nullptr, nullptr); // back to main framebuffer
+
+		++num_samples_;
+	}
+	/**
+	 * Filters accumulated image with a-trous iterations ping-ponging between denoise targets.
+	 * Color sigma shrinks with the noise of accumulated samples, same as on CPU.
+	 * @return Target holding the result.
+	 */
+	scythe::Texture * Denoise()
+	{
+		DenoiseSettings settings;
+		settings.num_samples = num_samples_;
+		float color_sigma = settings.color_sigma
+			/ (settings.color_scale * sqrtf(static_cast<float>(std::max(settings.num_samples, 1u))));
+		scythe::Texture * input = accumulation_rts_[accumulation_index_];
+		renderer_->SetViewport(trace_width_, trace_height_);
+		renderer_->ChangeTexture(guide_rt_, 1);
+		denoise_shader_->Bind();
+		denoise_shader_->Uniform2f("u_size", static_cast<float>(trace_width_), static_cast<float>(trace_height_));
+		for (unsigned int iteration = 0; iteration < settings.iterations; ++iteration)
+		{
+			scythe::Texture * output = denoise_rts_[iteration % 2];
+			renderer_->ChangeRenderTarget(output, nullptr);
+			renderer_->ChangeTexture(input, 0);
+			denoise_shader_->Uniform1f("u_step", static_cast<float>(1 << iteration));
+			denoise_shader_->Uniform1f("u_color_weight", 1.0f / (color_sigma * color_sigma));
+			quad_->Render();
+			color_sigma *= 0.5f;
+			input = output;
+		}
+		denoise_shader_->Unbind();
+		renderer_->ChangeTexture(nullptr, 1);
+		renderer_->ChangeTexture(nullptr, 0);
+		renderer_->ChangeRenderTarget(nullptr, nullptr); // back to main framebuffer
+		return input;
+	}
+	/**
+	 * Times generic and scene specialized ray trace shaders on the same frames.
+	 * Every frame traces the first sample, so accumulation doesn't stop it.
+	 */
+	void BenchmarkCastShaders()
+	{
+		const bool specialized = specialized_;
+		const bool denoised = denoised_;
+		denoised_ = false; // guide pass would add the same time to both
+		float * times[] = {&generic_trace_time_, &specialized_trace_time_};
+		for (int i = 0; i < 2; ++i)
+		{
+			specialized_ = (i == 1);
+			if (!SelectCastShader())
+				break;
+			TraceSample(); // warm up after compilation
+			glFinish();
+			const auto start = std::chrono::steady_clock::now();
+			for (unsigned int frame = 0; frame < kBenchmarkFrames; ++frame)
+			{
+				ResetAccumulation();
+				TraceSample();
+			}
+			glFinish();
+			const auto end = std::chrono::steady_clock::now();
+			*times[i] = std::chrono::duration<float, std::milli>(end - start).count() / static_cast<float>(kBenchmarkFrames);
+		}
+		specialized_ = specialized;
+		denoised_ = denoised;
+		SelectCastShader();
+	}
+	void RenderObjects()
+	{
+		renderer_->DisableDepthTest();
+
+		TraceSample();
+		scythe::Texture * presented = accumulation_rts_[accumulation_index_];
+		if (denoised_ && num_samples_ <= kMaxDenoisedSamples)
+			presented = Denoise();
+
+		// Tone map accumulated image to the screen, upsampling it if trace resolution is lower
+		const float target_width = static_cast<float>(target_width_);
+		const float target_height = static_cast<float>(target_height_);
+		renderer_->SetViewport(width_, height_);
+		renderer_->ChangeTexture(presented);
+		present_shader_->Bind();
+		present_shader_->Uniform2f("u_uv_scale",
+			static_cast<float>(trace_width_) / target_width,
+			static_cast<float>(trace_height_) / target_height);
+		present_shader_->Uniform2f("u_uv_max",
+			(static_cast<float>(trace_width_) - 0.5f) / target_width,
+			(static_cast<float>(trace_height_) - 0.5f) / target_height);
+		quad_->Render();
+		present_shader_->Unbind();
+		renderer_->ChangeTexture(nullptr);
 
 		renderer_->EnableDepthTest();
 	}
@@ -143,8 +521,28 @@ public:
 		// Draw FPS
 		text_shader_->Bind();
 		text_shader_->Uniform4f("u_color", 1.0f, 0.5f, 1.0f, 1.0f);
-		fps_text_->SetText(font_, 0.0f, 0.8f, 0.05f, L"fps: %.2f", GetFrameRate());
+		fps_text_->SetText(font_, 0.0f, 0.8f, 0.05f, L"fps: %.2f, primitives: %u, samples: %u%ls", GetFrameRate(),
+			static_cast<unsigned int>(bvh_.primitives().size()), num_samples_, denoised_ ? L", denoised" : L"");
 		fps_text_->Render();
+		if (resolution_controller_.enabled())
+			resolution_text_->SetText(font_, 0.0f, 0.75f, 0.05f, L"scale: %.2f (%dx%d), target %.0f fps",
+				resolution_controller_.scale(), trace_width_, trace_height_, kTargetFrameRates[target_rate_index_]);
+		else
+			resolution_text_->SetText(font_, 0.0f, 0.75f, 0.05f, L"scale: %.2f (%dx%d), fixed",
+				resolution_controller_.scale(), trace_width_, trace_height_);
+		resolution_text_->Render();
+		if (reference_time_ > 0.0f)
+		{
+			reference_text_->SetText(font_, 0.0f, 0.7f, 0.05f, L"CPU reference: %.0f ms", reference_time_);
+			reference_text_->Render();
+		}
+		if (specialized_trace_time_ > 0.0f)
+			shader_text_->SetText(font_, 0.0f, 0.65f, 0.05f, L"%ls shader, depth %d, trace: generic %.2f ms, specialized %.2f ms",
+				specialized_ ? L"specialized" : L"generic", max_depth_, generic_trace_time_, specialized_trace_time_);
+		else
+			shader_text_->SetText(font_, 0.0f, 0.65f, 0.05f, L"%ls shader, depth %d",
+				specialized_ ? L"specialized" : L"generic", max_depth_);
+		shader_text_->Render();
 		text_shader_->Unbind();
 
 		renderer_->ChangeTexture(nullptr);
@@ -153,6 +551,14 @@ public:
 	}
 	void Render() final
 	{
+		UpdateRenderTargets();
+		UpdateTraceSize();
+		if (benchmark_requested_)
+		{
+			benchmark_requested_ = false;
+			BenchmarkCastShaders();
+		}
+
 		renderer_->SetViewport(width_, height_);
 		
 		renderer_->ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -178,6 +584,52 @@ public:
 		{
 			renderer_->TakeScreenshot("screenshots");
 		}
+		else if (key == scythe::PublicKey::kC)
+		{
+			RenderCpuReference();
+		}
+		else if (key == scythe::PublicKey::kR)
+		{
+			resolution_controller_.SetEnabled(!resolution_controller_.enabled());
+		}
+		else if (key == scythe::PublicKey::kT)
+		{
+			target_rate_index_ = (target_rate_index_ + 1) % _countof(kTargetFrameRates);
+			resolution_controller_.SetTargetFrameTime(1.0f / kTargetFrameRates[target_rate_index_]);
+		}
+		else if (key == scythe::PublicKey::kM)
+		{
+			animated_ = !animated_;
+		}
+		else if (key == scythe::PublicKey::kS)
+		{
+			specialized_ = !specialized_;
+			SelectCastShader();
+		}
+		else if (key == scythe::PublicKey::kB)
+		{
+			benchmark_requested_ = true;
+		}
+		else if (key == scythe::PublicKey::kMinus)
+		{
+			max_depth_ = std::max(max_depth_ - 1, 0);
+			SelectCastShader();
+		}
+		else if (key == scythe::PublicKey::kEqual)
+		{
+			max_depth_ = std::min(max_depth_ + 1, kMaxTraceDepth);
+			SelectCastShader();
+		}
+		else if (key == scythe::PublicKey::kD)
+		{
+			denoised_ = !denoised_;
+			ResetAccumulation(); // guides are rendered with the first sample
+		}
+		else if (key == scythe::PublicKey::kN)
+		{
+			scene_index_ = (scene_index_ + 1) % (_countof(kSceneFiles) + _countof(kScenePrimitiveCounts));
+			LoadScene();
+		}
 		else if (key == scythe::PublicKey::kLeft)
 		{
 			camera_manager_->RotateAroundTargetInY(0.1f);
@@ -215,6 +667,7 @@ public:
 		DesktopApplication::OnSize(w, h);
 		// To have correct perspective when resizing
 		need_update_projection_matrix_ = true;
+		ResetAccumulation();
 	}
 	void UpdateProjectionMatrix()
 	{
@@ -259,26 +712,97 @@ public:
 			inverse_view.TransformVector(scythe::Vector3(ray_eye.x, ray_eye.y, ray_eye.z), &rays[i]);
 			rays[i].Normalize();
 		}
-		cast_shader_->Bind();
-		cast_shader_->Uniform3fv("u_eye", *camera_manager_->position());
-		cast_shader_->Uniform3fv("u_ray00", rays[0]);
-		cast_shader_->Uniform3fv("u_ray10", rays[1]);
-		cast_shader_->Uniform3fv("u_ray01", rays[2]);
-		cast_shader_->Uniform3fv("u_ray11", rays[3]);
-		cast_shader_->Unbind();
+		const scythe::Vector3& eye = *camera_manager_->position();
+		CameraRays camera_rays;
+		camera_rays.eye = Vec3(eye.x, eye.y, eye.z);
+		camera_rays.ray00 = Vec3(rays[0].x, rays[0].y, rays[0].z);
+		camera_rays.ray10 = Vec3(rays[1].x, rays[1].y, rays[1].z);
+		camera_rays.ray01 = Vec3(rays[2].x, rays[2].y, rays[2].z);
+		camera_rays.ray11 = Vec3(rays[3].x, rays[3].y, rays[3].z);
+		if (camera_rays == camera_rays_)
+			return; // uniforms are up to date and accumulation goes on
+		camera_rays_ = camera_rays;
+		ResetAccumulation();
+		BindCameraRays();
+	}
+	//! Passes current rays to the shaders tracing primary rays
+	void BindCameraRays()
+	{
+		const Vec3 * vectors[] = {&camera_rays_.eye, &camera_rays_.ray00, &camera_rays_.ray10,
+			&camera_rays_.ray01, &camera_rays_.ray11};
+		const char * names[] = {"u_eye", "u_ray00", "u_ray10", "u_ray01", "u_ray11"};
+		scythe::Shader * shaders[] = {cast_shader_, guide_shader_};
+		for (scythe::Shader * shader : shaders)
+		{
+			shader->Bind();
+			for (int i = 0; i < 5; ++i)
+				shader->Uniform3fv(names[i], scythe::Vector3(vectors[i]->x, vectors[i]->y, vectors[i]->z));
+			shader->Unbind();
+		}
+	}
+	//! Renders current view on CPU with the same rays, to compare with the screenshot
+	void RenderCpuReference()
+	{
+		const unsigned int width = static_cast<unsigned int>(width_);
+		const unsigned int height = static_cast<unsigned int>(height_);
+		std::vector<Vec3> pixels;
+		std::vector<unsigned char> rgb;
+		const auto start = std::chrono::steady_clock::now();
+		cpu_tracer_.Render(camera_rays_, width, height, 0, &pixels);
+		const auto end = std::chrono::steady_clock::now();
+		ToneMap(pixels, width, height, &rgb);
+		if (WritePng("cpu_reference.png", width, height, rgb))
+			reference_time_ = std::chrono::duration<float, std::milli>(end - start).count();
 	}
 	
 private:
 	scythe::Mesh * quad_;
 
 	scythe::Shader * text_shader_;
-	scythe::Shader * cast_shader_;
+	scythe::Shader * cast_shader_; //!< permutation in use
+	scythe::Shader * present_shader_;
+	scythe::Shader * guide_shader_; //!< raytrace shader writing primary hit features
+	scythe::Shader * denoise_shader_;
+
+	scythe::Texture * accumulation_rts_[2]; //!< HDR sums, previous one is read while the other is written
+	scythe::Texture * guide_rt_; //!< packed normal, packed albedo and distance of primary hits
+	scythe::Texture * denoise_rts_[2]; //!< a-trous iterations ping-pong between these
 
 	scythe::Font * font_;
 	scythe::DynamicText * fps_text_;
+	scythe::DynamicText * reference_text_;
+	scythe::DynamicText * resolution_text_;
+	scythe::DynamicText * shader_text_;
 	scythe::CameraManager * camera_manager_;
 	
 	scythe::Matrix4 projection_view_matrix_;
+
+	Scene scene_;
+	Scene rest_scene_; //!< initial positions of animated primitives
+	Bvh bvh_;
+	SceneBuffers scene_buffers_;
+	CameraRays camera_rays_;
+	CpuTracer cpu_tracer_;
+	float reference_time_; //!< last CPU reference render time in ms
+	float generic_trace_time_; //!< average sample time of the last benchmark in ms
+	float specialized_trace_time_;
+	std::map<ShaderPermutation, scythe::Shader*> cast_shaders_; //!< compiled permutations, owned by the renderer
+	unsigned int scene_index_; //!< index in kSceneFiles followed by kScenePrimitiveCounts
+	int target_width_; //!< accumulation target size
+	int target_height_;
+	int trace_width_; //!< traced area in the corner of accumulation target
+	int trace_height_;
+	unsigned int accumulation_index_; //!< target holding the latest result
+	unsigned int num_samples_;
+	ResolutionController resolution_controller_;
+	unsigned int target_rate_index_; //!< index in kTargetFrameRates
+	bool traced_last_frame_;
+	float animation_time_;
+	bool animated_;
+	bool denoised_; //!< filters single sample frames before presenting
+	int max_depth_; //!< MAX_DEPTH of the ray trace shader
+	bool specialized_; //!< traces with the scene specialized shader permutation
+	bool benchmark_requested_; //!< benchmark runs at the start of the next frame
 	
 	bool need_update_projection_matrix_;
 };
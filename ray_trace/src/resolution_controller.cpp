@@ -0,0 +1,87 @@
+#include "resolution_controller.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+	const float kAverageWeight = 0.2f; //!< weight of the new frame in the moving average
+	const unsigned int kSettleFrames = 8; //!< frames to measure after each change
+	const float kScaleStep = 1.0f / 32.0f; //!< scale is quantized to avoid constant small changes
+	const float kHysteresis = 0.1f; //!< frame time deviation that triggers a change
+}
+
+ResolutionController::ResolutionController()
+: scale_(1.0f)
+, min_scale_(0.25f)
+, max_scale_(1.0f)
+, target_frame_time_(1.0f / 30.0f)
+, average_frame_time_(0.0f)
+, frames_since_change_(0)
+, enabled_(true)
+{
+}
+void ResolutionController::SetBounds(float min_scale, float max_scale)
+{
+	min_scale_ = std::max(kScaleStep, std::min(min_scale, max_scale));
+	max_scale_ = std::max(min_scale_, max_scale);
+	SetScale(enabled_ ? scale_ : max_scale_);
+}
+void ResolutionController::SetTargetFrameTime(float frame_time)
+{
+	target_frame_time_ = frame_time;
+	frames_since_change_ = 0;
+}
+void ResolutionController::SetEnabled(bool enabled)
+{
+	enabled_ = enabled;
+	if (!enabled_)
+		SetScale(max_scale_);
+}
+bool ResolutionController::Update(float frame_time)
+{
+	if (!enabled_)
+		return false;
+	average_frame_time_ = (average_frame_time_ == 0.0f) ? frame_time
+		: average_frame_time_ + (frame_time - average_frame_time_) * kAverageWeight;
+	if (++frames_since_change_ < kSettleFrames)
+		return false;
+	const float ratio = target_frame_time_ / average_frame_time_;
+	if (fabsf(ratio - 1.0f) < kHysteresis)
+		return false;
+	const float old_scale = scale_;
+	SetScale(scale_ * sqrtf(ratio));
+	return scale_ != old_scale;
+}
+void ResolutionController::SetScale(float scale)
+{
+	scale = std::min(std::max(scale, min_scale_), max_scale_);
+	scale = std::max(min_scale_, floorf(scale / kScaleStep + 0.5f) * kScaleStep);
+	scale = std::min(scale, max_scale_);
+	if (scale != scale_)
+	{
+		scale_ = scale;
+		// Measurements at the old scale say nothing about the new one
+		average_frame_time_ = 0.0f;
+		frames_since_change_ = 0;
+	}
+}
+float ResolutionController::scale() const
+{
+	return scale_;
+}
+float ResolutionController::min_scale() const
+{
+	return min_scale_;
+}
+float ResolutionController::max_scale() const
+{
+	return max_scale_;
+}
+float ResolutionController::target_frame_time() const
+{
+	return target_frame_time_;
+}
+bool ResolutionController::enabled() const
+{
+	return enabled_;
+}
\ No newline at end of file
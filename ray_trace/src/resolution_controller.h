@@ -0,0 +1,42 @@
+#ifndef __RESOLUTION_CONTROLLER_H__
+#define __RESOLUTION_CONTROLLER_H__
+
+/**
+ * Picks render resolution scale that keeps frame time near the target.
+ * Cost of full screen trace is proportional to pixel count, so the scale
+ * is corrected by square root of the frame time ratio.
+ */
+class ResolutionController {
+public:
+	ResolutionController();
+
+	//! Scale is a fraction of the window size along each axis
+	void SetBounds(float min_scale, float max_scale);
+	void SetTargetFrameTime(float frame_time);
+	void SetEnabled(bool enabled);
+
+	/**
+	 * Feeds frame time of a frame rendered with current scale.
+	 * @return True if the scale has changed.
+	 */
+	bool Update(float frame_time);
+
+	float scale() const;
+	float min_scale() const;
+	float max_scale() const;
+	float target_frame_time() const;
+	bool enabled() const;
+
+private:
+	void SetScale(float scale);
+
+	float scale_;
+	float min_scale_;
+	float max_scale_;
+	float target_frame_time_;
+	float average_frame_time_; //!< exponential moving average, zero before the first frame
+	unsigned int frames_since_change_;
+	bool enabled_;
+};
+
+#endif
\ No newline at end of file
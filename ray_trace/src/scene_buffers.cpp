@@ -0,0 +1,224 @@
+#include "scene_buffers.h"
+
+namespace {
+
+	void SetTexels(float * texels, const Vec3& first, float first_w, const Vec3& second, float second_w)
+	{
+		texels[0] = first.x;
+		texels[1] = first.y;
+		texels[2] = first.z;
+		texels[3] = first_w;
+		texels[4] = second.x;
+		texels[5] = second.y;
+		texels[6] = second.z;
+		texels[7] = second_w;
+	}
+
+} // namespace
+
+SceneBuffers::SceneBuffers()
+: num_nodes_(0)
+, num_planes_(0)
+, num_lights_(0)
+{
+	for (int i = 0; i < kNumBuffers; ++i)
+	{
+		buffers_[i] = 0;
+		textures_[i] = 0;
+	}
+}
+SceneBuffers::~SceneBuffers()
+{
+	Release();
+}
+bool SceneBuffers::Create()
+{
+	glGenBuffers(kNumBuffers, buffers_);
+	glGenTextures(kNumBuffers, textures_);
+	for (int i = 0; i < kNumBuffers; ++i)
+	{
+		// Buffer texture can't be attached to empty buffer storage
+		const float kZero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers_[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(kZero), kZero, GL_STATIC_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers_[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	return glGetError() == GL_NO_ERROR;
+}
+void SceneBuffers::Release()
+{
+	if (textures_[0])
+		glDeleteTextures(kNumBuffers, textures_);
+	if (buffers_[0])
+		glDeleteBuffers(kNumBuffers, buffers_);
+	for (int i = 0; i < kNumBuffers; ++i)
+	{
+		buffers_[i] = 0;
+		textures_[i] = 0;
+	}
+}
+void SceneBuffers::Update(const Scene& scene, const Bvh& bvh)
+{
+	const std::vector<BvhNode>& nodes = bvh.nodes();
+	const unsigned int num_scene_primitives = bvh.num_scene_primitives();
+	num_nodes_ = static_cast<unsigned int>(nodes.size());
+	data_[kNodeBuffer].resize(nodes.size() * 8);
+	FillNodes(bvh, nodes.size());
+	FillPrimitives(scene, bvh);
+
+	// Triangle vertices are stored in mesh leaf order, mesh after mesh
+	const std::vector<unsigned int>& primitives = bvh.primitives();
+	std::vector<float>& triangle_data = data_[kTriangleBuffer];
+	triangle_data.resize((primitives.size() - num_scene_primitives) * 12);
+	float * texels = triangle_data.data();
+	size_t first_primitive = num_scene_primitives;
+	for (const TriangleMesh& mesh : scene.meshes)
+	{
+		const size_t end = first_primitive + mesh.indices.size() / 3;
+		for (size_t i = first_primitive; i < end; ++i)
+		{
+			const unsigned int * indices = &mesh.indices[primitives[i] * 3];
+			for (int k = 0; k < 3; ++k, texels += 4)
+			{
+				const Vec3& position = mesh.positions[indices[k]];
+				texels[0] = position.x;
+				texels[1] = position.y;
+				texels[2] = position.z;
+				texels[3] = 0.0f;
+			}
+		}
+		first_primitive = end;
+	}
+
+	std::vector<float>& material_data = data_[kMaterialBuffer];
+	material_data.resize(scene.materials.size() * 8);
+	for (size_t i = 0; i < scene.materials.size(); ++i)
+	{
+		const Material& material = scene.materials[i];
+		SetTexels(&material_data[i * 8], material.color, material.f0,
+			Vec3(static_cast<float>(material.type), 0.0f, 0.0f), 0.0f);
+	}
+
+	num_planes_ = static_cast<unsigned int>(scene.planes.size());
+	std::vector<float>& plane_data = data_[kPlaneBuffer];
+	plane_data.resize(scene.planes.size() * 8);
+	for (size_t i = 0; i < scene.planes.size(); ++i)
+	{
+		const Plane& plane = scene.planes[i];
+		SetTexels(&plane_data[i * 8], plane.normal, plane.d,
+			Vec3(static_cast<float>(plane.material), 0.0f, 0.0f), 0.0f);
+	}
+
+	num_lights_ = static_cast<unsigned int>(scene.lights.size());
+	std::vector<float>& light_data = data_[kLightBuffer];
+	light_data.resize(scene.lights.size() * 8);
+	for (size_t i = 0; i < scene.lights.size(); ++i)
+	{
+		const DirectionalLight& light = scene.lights[i];
+		SetTexels(&light_data[i * 8], light.color, 0.0f, light.direction, 0.0f);
+	}
+
+	for (int i = 0; i < kNumBuffers; ++i)
+		Upload(static_cast<BufferIndex>(i), data_[i]);
+}
+void SceneBuffers::UpdateMoved(const Scene& scene, const Bvh& bvh)
+{
+	// Mesh trees are in mesh space and stay as they were uploaded
+	const size_t num_scene_nodes = bvh.num_scene_nodes();
+	FillNodes(bvh, num_scene_nodes);
+	FillPrimitives(scene, bvh);
+	if (num_scene_nodes == 0)
+		return;
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers_[kNodeBuffer]);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, num_scene_nodes * 8 * sizeof(float), data_[kNodeBuffer].data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	Upload(kPrimitiveBuffer, data_[kPrimitiveBuffer]);
+}
+void SceneBuffers::FillNodes(const Bvh& bvh, size_t num_nodes)
+{
+	// Offsets, counts and indices are stored as floats, which are exact up to 2^24
+	// Mesh leaves point to triangle buffer, which starts with the first mesh triangle
+	const std::vector<BvhNode>& nodes = bvh.nodes();
+	const unsigned int num_scene_primitives = bvh.num_scene_primitives();
+	std::vector<float>& node_data = data_[kNodeBuffer];
+	for (size_t i = 0; i < num_nodes; ++i)
+	{
+		const BvhNode& node = nodes[i];
+		const unsigned int offset = (i >= bvh.num_scene_nodes() && node.count != 0)
+			? node.offset - num_scene_primitives : node.offset;
+		SetTexels(&node_data[i * 8],
+			Vec3(node.min[0], node.min[1], node.min[2]), static_cast<float>(offset),
+			Vec3(node.max[0], node.max[1], node.max[2]), static_cast<float>(node.count));
+	}
+}
+void SceneBuffers::FillPrimitives(const Scene& scene, const Bvh& bvh)
+{
+	// Radius is positive, so negative values mark boxes and instances
+	const std::vector<unsigned int>& primitives = bvh.primitives();
+	const unsigned int num_scene_primitives = bvh.num_scene_primitives();
+	std::vector<float>& primitive_data = data_[kPrimitiveBuffer];
+	primitive_data.resize(num_scene_primitives * 8);
+	for (size_t i = 0; i < num_scene_primitives; ++i)
+	{
+		if (primitives[i] & Bvh::kInstanceFlag)
+		{
+			const MeshInstance& instance = scene.instances[primitives[i] & Bvh::kIndexMask];
+			SetTexels(&primitive_data[i * 8], instance.position, -2.0f,
+				Vec3(instance.scale, static_cast<float>(bvh.mesh_roots()[instance.mesh]), 0.0f),
+				static_cast<float>(instance.material));
+		}
+		else if (primitives[i] & Bvh::kBoxFlag)
+		{
+			const Box& box = scene.boxes[primitives[i] & Bvh::kIndexMask];
+			SetTexels(&primitive_data[i * 8], box.min, -1.0f, box.max, static_cast<float>(box.material));
+		}
+		else
+		{
+			const Sphere& sphere = scene.spheres[primitives[i]];
+			SetTexels(&primitive_data[i * 8], sphere.position, sphere.radius,
+				Vec3(0.0f), static_cast<float>(sphere.material));
+		}
+	}
+}
+void SceneBuffers::Upload(BufferIndex index, const std::vector<float>& data)
+{
+	if (data.empty())
+		return; // shader never reads the buffer then
+	glBindBuffer(GL_TEXTURE_BUFFER, buffers_[index]);
+	glBufferData(GL_TEXTURE_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+void SceneBuffers::BindTextures(unsigned int first_unit)
+{
+	for (unsigned int i = 0; i < kNumBuffers; ++i)
+	{
+		glActiveTexture(GL_TEXTURE0 + first_unit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures_[i]);
+	}
+	// Renderer expects the first unit to be active
+	glActiveTexture(GL_TEXTURE0);
+}
+void SceneBuffers::UnbindTextures(unsigned int first_unit)
+{
+	for (unsigned int i = 0; i < kNumBuffers; ++i)
+	{
+		glActiveTexture(GL_TEXTURE0 + first_unit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+unsigned int SceneBuffers::num_nodes() const
+{
+	return num_nodes_;
+}
+unsigned int SceneBuffers::num_planes() const
+{
+	return num_planes_;
+}
+unsigned int SceneBuffers::num_lights() const
+{
+	return num_lights_;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef __SCENE_BUFFERS_H__
+#define __SCENE_BUFFERS_H__
+
+#include "bvh.h"
+#include "opengl_include.h"
+
+#include "common/non_copyable.h"
+
+#include <vector>
+
+/**
+ * Uploads scene and its BVH to texture buffers for the ray trace shader, two texels per element except triangles:
+ * nodes are (min, offset), (max, count);
+ * scene primitives go in leaf order, (position, radius), (0, material) for spheres,
+ * (min, -1), (max, material) for boxes and (position, -2), (scale, root node, 0, material) for mesh instances;
+ * triangles take three texels (vertex, 0) in mesh leaf order;
+ * materials are (color, f0), (type, 0);
+ * planes are (normal, d), (material, 0);
+ * lights are (color, 0), (direction, 0).
+ */
+class SceneBuffers final : public scythe::NonCopyable {
+public:
+	SceneBuffers();
+	~SceneBuffers();
+
+	bool Create();
+	void Release();
+
+	void Update(const Scene& scene, const Bvh& bvh);
+	//! Uploads only scene tree nodes and primitives, enough after BVH refit of moved primitives
+	void UpdateMoved(const Scene& scene, const Bvh& bvh);
+
+	//! Binds texture buffers to kNumBuffers consecutive units starting from the first one
+	void BindTextures(unsigned int first_unit);
+	void UnbindTextures(unsigned int first_unit);
+
+	unsigned int num_nodes() const;
+	unsigned int num_planes() const;
+	unsigned int num_lights() const;
+
+	//! Order of texture units
+	enum BufferIndex {
+		kNodeBuffer,
+		kPrimitiveBuffer,
+		kTriangleBuffer,
+		kMaterialBuffer,
+		kPlaneBuffer,
+		kLightBuffer,
+		kNumBuffers
+	};
+
+private:
+	void FillNodes(const Bvh& bvh, size_t num_nodes);
+	void FillPrimitives(const Scene& scene, const Bvh& bvh);
+	void Upload(BufferIndex index, const std::vector<float>& data);
+
+	std::vector<float> data_[kNumBuffers];
+	unsigned int num_nodes_;
+	unsigned int num_planes_;
+	unsigned int num_lights_;
+	GLuint buffers_[kNumBuffers];
+	GLuint textures_[kNumBuffers];
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,390 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+namespace {
+
+	const unsigned int kNumBins = 16;
+	const float kTraversalCost = 1.0f; //!< relative to primitive intersection cost
+	//! Deeper nodes are split by median, which halves them and bounds total depth
+	const unsigned int kMaxSahDepth = Bvh::kStackSize / 2;
+
+	struct Bin {
+		Vec3 min;
+		Vec3 max;
+		unsigned int count;
+	};
+
+	float HalfSurfaceArea(const Vec3& min, const Vec3& max)
+	{
+		const Vec3 size = max - min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+	float HalfSurfaceArea(const BvhNode& node)
+	{
+		return HalfSurfaceArea(Vec3(node.min[0], node.min[1], node.min[2]), Vec3(node.max[0], node.max[1], node.max[2]));
+	}
+
+} // namespace
+
+Bvh::Bvh()
+: num_scene_nodes_(0)
+, num_scene_primitives_(0)
+, build_sah_cost_(0.0f)
+, num_spheres_(0)
+, num_boxes_(0)
+, num_instances_(0)
+, num_meshes_(0)
+{
+}
+void Bvh::Build(const Scene& scene)
+{
+	Clear();
+	num_spheres_ = scene.spheres.size();
+	num_boxes_ = scene.boxes.size();
+	num_instances_ = scene.instances.size();
+	num_meshes_ = scene.meshes.size();
+	std::vector<Vec3> mesh_min(scene.meshes.size(), Vec3(1e30f));
+	std::vector<Vec3> mesh_max(scene.meshes.size(), Vec3(-1e30f));
+	size_t num_triangles = 0;
+	for (size_t m = 0; m < scene.meshes.size(); ++m)
+	{
+		const TriangleMesh& mesh = scene.meshes[m];
+		for (unsigned int index : mesh.indices)
+		{
+			mesh_min[m] = Min(mesh_min[m], mesh.positions[index]);
+			mesh_max[m] = Max(mesh_max[m], mesh.positions[index]);
+		}
+		num_triangles += mesh.indices.size() / 3;
+	}
+	// Instances of empty meshes have nothing to hit
+	size_t num_instances = 0;
+	for (const MeshInstance& instance : scene.instances)
+		if (scene.meshes[instance.mesh].indices.size() >= 3)
+			++num_instances;
+	const size_t num_primitives = scene.spheres.size() + scene.boxes.size() + num_instances;
+	if (num_primitives == 0)
+		return;
+	build_primitives_.resize(num_primitives + num_triangles);
+	BuildPrimitive * primitive = build_primitives_.data();
+	for (size_t i = 0; i < scene.spheres.size(); ++i, ++primitive)
+	{
+		const Sphere& sphere = scene.spheres[i];
+		primitive->min = sphere.position - Vec3(sphere.radius);
+		primitive->max = sphere.position + Vec3(sphere.radius);
+		primitive->centroid = sphere.position;
+		primitive->reference = static_cast<unsigned int>(i);
+	}
+	for (size_t i = 0; i < scene.boxes.size(); ++i, ++primitive)
+	{
+		const Box& box = scene.boxes[i];
+		primitive->min = box.min;
+		primitive->max = box.max;
+		primitive->centroid = (box.min + box.max) * 0.5f;
+		primitive->reference = static_cast<unsigned int>(i) | kBoxFlag;
+	}
+	for (size_t i = 0; i < scene.instances.size(); ++i)
+	{
+		const MeshInstance& instance = scene.instances[i];
+		if (scene.meshes[instance.mesh].indices.size() < 3)
+			continue;
+		primitive->min = instance.position + mesh_min[instance.mesh] * instance.scale;
+		primitive->max = instance.position + mesh_max[instance.mesh] * instance.scale;
+		primitive->centroid = (primitive->min + primitive->max) * 0.5f;
+		primitive->reference = static_cast<unsigned int>(i) | kInstanceFlag;
+		++primitive;
+	}
+	for (const TriangleMesh& mesh : scene.meshes)
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3, ++primitive)
+		{
+			const Vec3& v0 = mesh.positions[mesh.indices[i]];
+			const Vec3& v1 = mesh.positions[mesh.indices[i + 1]];
+			const Vec3& v2 = mesh.positions[mesh.indices[i + 2]];
+			primitive->min = Min(Min(v0, v1), v2);
+			primitive->max = Max(Max(v0, v1), v2);
+			primitive->centroid = (primitive->min + primitive->max) * 0.5f;
+			primitive->reference = static_cast<unsigned int>(i / 3);
+		}
+
+	// Binary tree has at most 2n-1 nodes
+	nodes_.reserve((num_primitives + num_triangles) * 2);
+	BuildNode(0, static_cast<unsigned int>(num_primitives), 0);
+	num_scene_nodes_ = static_cast<unsigned int>(nodes_.size());
+	num_scene_primitives_ = static_cast<unsigned int>(num_primitives);
+	// Trees are built on disjoint ranges, so leaf offsets already point into the shared array
+	mesh_roots_.assign(scene.meshes.size(), 0);
+	unsigned int begin = num_scene_primitives_;
+	for (size_t m = 0; m < scene.meshes.size(); ++m)
+	{
+		const unsigned int end = begin + static_cast<unsigned int>(scene.meshes[m].indices.size() / 3);
+		if (end != begin)
+			mesh_roots_[m] = BuildNode(begin, end, 0);
+		begin = end;
+	}
+
+	primitives_.resize(build_primitives_.size());
+	for (size_t i = 0; i < build_primitives_.size(); ++i)
+		primitives_[i] = build_primitives_[i].reference;
+	build_primitives_.clear();
+	build_sah_cost_ = SahCost();
+}
+void Bvh::Clear()
+{
+	nodes_.clear();
+	primitives_.clear();
+	mesh_roots_.clear();
+	num_scene_nodes_ = 0;
+	num_scene_primitives_ = 0;
+	build_sah_cost_ = 0.0f;
+	num_spheres_ = 0;
+	num_boxes_ = 0;
+	num_instances_ = 0;
+	num_meshes_ = 0;
+}
+bool Bvh::Refit(const Scene& scene)
+{
+	if (scene.spheres.size() != num_spheres_ || scene.boxes.size() != num_boxes_
+		|| scene.instances.size() != num_instances_ || scene.meshes.size() != num_meshes_)
+		return false;
+	// Children always follow their parent, so reverse order visits them first
+	for (unsigned int index = num_scene_nodes_; index-- > 0; )
+	{
+		BvhNode& node = nodes_[index];
+		Vec3 min(1e30f), max(-1e30f);
+		if (node.count != 0)
+		{
+			for (unsigned int i = node.offset; i < node.offset + node.count; ++i)
+			{
+				Vec3 primitive_min, primitive_max;
+				PrimitiveBounds(scene, primitives_[i], &primitive_min, &primitive_max);
+				min = Min(min, primitive_min);
+				max = Max(max, primitive_max);
+			}
+		}
+		else
+		{
+			const BvhNode& left = nodes_[index + 1];
+			const BvhNode& right = nodes_[node.offset];
+			for (int k = 0; k < 3; ++k)
+			{
+				min[k] = std::min(left.min[k], right.min[k]);
+				max[k] = std::max(left.max[k], right.max[k]);
+			}
+		}
+		for (int k = 0; k < 3; ++k)
+		{
+			node.min[k] = min[k];
+			node.max[k] = max[k];
+		}
+	}
+	return true;
+}
+bool Bvh::Update(const Scene& scene, float max_cost_growth)
+{
+	if (Refit(scene) && SahCost() <= build_sah_cost_ * max_cost_growth)
+		return false;
+	Build(scene);
+	return true;
+}
+float Bvh::SahCost() const
+{
+	if (num_scene_nodes_ == 0)
+		return 0.0f;
+	const float root_area = HalfSurfaceArea(nodes_[0]);
+	if (root_area <= 0.0f)
+		return static_cast<float>(num_scene_primitives_);
+	// Probability of hitting a node is proportional to its area
+	float cost = 0.0f;
+	for (unsigned int index = 0; index < num_scene_nodes_; ++index)
+	{
+		const BvhNode& node = nodes_[index];
+		const float area = HalfSurfaceArea(node);
+		cost += area * ((node.count != 0) ? static_cast<float>(node.count) : kTraversalCost);
+	}
+	return cost / root_area;
+}
+float Bvh::build_sah_cost() const
+{
+	return build_sah_cost_;
+}
+unsigned int Bvh::BuildNode(unsigned int begin, unsigned int end, unsigned int depth)
+{
+	// Node is referenced by index, since children creation reallocates the array
+	const unsigned int index = static_cast<unsigned int>(nodes_.size());
+	nodes_.push_back(BvhNode());
+
+	Vec3 min(1e30f), max(-1e30f);
+	for (unsigned int i = begin; i < end; ++i)
+	{
+		min = Min(min, build_primitives_[i].min);
+		max = Max(max, build_primitives_[i].max);
+	}
+	for (int k = 0; k < 3; ++k)
+	{
+		nodes_[index].min[k] = min[k];
+		nodes_[index].max[k] = max[k];
+	}
+
+	const unsigned int split = FindSplit(begin, end, min, max, depth);
+	if (split == 0)
+	{
+		nodes_[index].offset = begin;
+		nodes_[index].count = end - begin;
+		return index;
+	}
+	BuildNode(begin, split, depth + 1);
+	const unsigned int right = BuildNode(split, end, depth + 1);
+	nodes_[index].offset = right;
+	nodes_[index].count = 0;
+	return index;
+}
+unsigned int Bvh::FindSplit(unsigned int begin, unsigned int end, const Vec3& min, const Vec3& max,
+	unsigned int depth)
+{
+	const unsigned int count = end - begin;
+	if (count == 1)
+		return 0;
+
+	Vec3 centroid_min(1e30f), centroid_max(-1e30f);
+	for (unsigned int i = begin; i < end; ++i)
+	{
+		centroid_min = Min(centroid_min, build_primitives_[i].centroid);
+		centroid_max = Max(centroid_max, build_primitives_[i].centroid);
+	}
+	const Vec3 centroid_extent = centroid_max - centroid_min;
+
+	if (depth < kMaxSahDepth)
+	{
+		int best_axis = -1;
+		unsigned int best_bin = 0;
+		float best_cost = 1e30f;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (centroid_extent[axis] <= 0.0f)
+				continue;
+			const float scale = static_cast<float>(kNumBins) / centroid_extent[axis];
+			Bin bins[kNumBins];
+			for (unsigned int b = 0; b < kNumBins; ++b)
+			{
+				bins[b].min = Vec3(1e30f);
+				bins[b].max = Vec3(-1e30f);
+				bins[b].count = 0;
+			}
+			for (unsigned int i = begin; i < end; ++i)
+			{
+				const BuildPrimitive& primitive = build_primitives_[i];
+				const unsigned int b = std::min(kNumBins - 1,
+					static_cast<unsigned int>((primitive.centroid[axis] - centroid_min[axis]) * scale));
+				bins[b].min = Min(bins[b].min, primitive.min);
+				bins[b].max = Max(bins[b].max, primitive.max);
+				++bins[b].count;
+			}
+			// Sweep from the right to get costs of right sides, then from the left
+			float right_costs[kNumBins];
+			Vec3 right_min(1e30f), right_max(-1e30f);
+			unsigned int right_count = 0;
+			for (unsigned int b = kNumBins - 1; b > 0; --b)
+			{
+				right_min = Min(right_min, bins[b].min);
+				right_max = Max(right_max, bins[b].max);
+				right_count += bins[b].count;
+				right_costs[b - 1] = (right_count != 0)
+					? static_cast<float>(right_count) * HalfSurfaceArea(right_min, right_max) : 0.0f;
+			}
+			Vec3 left_min(1e30f), left_max(-1e30f);
+			unsigned int left_count = 0;
+			for (unsigned int b = 0; b < kNumBins - 1; ++b)
+			{
+				left_min = Min(left_min, bins[b].min);
+				left_max = Max(left_max, bins[b].max);
+				left_count += bins[b].count;
+				if (left_count == 0 || left_count == count)
+					continue;
+				const float cost = static_cast<float>(left_count) * HalfSurfaceArea(left_min, left_max) + right_costs[b];
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = axis;
+					best_bin = b;
+				}
+			}
+		}
+		if (best_axis >= 0)
+		{
+			const float area = HalfSurfaceArea(min, max);
+			const float leaf_cost = static_cast<float>(count) * area;
+			const float split_cost = kTraversalCost * area + best_cost;
+			if (count <= kMaxLeafSize && leaf_cost <= split_cost)
+				return 0;
+			const float scale = static_cast<float>(kNumBins) / centroid_extent[best_axis];
+			const float axis_min = centroid_min[best_axis];
+			BuildPrimitive * middle = std::partition(&build_primitives_[begin], &build_primitives_[0] + end,
+				[=](const BuildPrimitive& primitive) {
+				const unsigned int b = std::min(kNumBins - 1,
+					static_cast<unsigned int>((primitive.centroid[best_axis] - axis_min) * scale));
+				return b <= best_bin;
+			});
+			return static_cast<unsigned int>(middle - build_primitives_.data());
+		}
+	}
+
+	// Median split along the widest centroid axis
+	if (count <= kMaxLeafSize)
+		return 0;
+	int axis = 0;
+	if (centroid_extent.y > centroid_extent[axis]) axis = 1;
+	if (centroid_extent.z > centroid_extent[axis]) axis = 2;
+	const unsigned int middle = begin + count / 2;
+	std::nth_element(&build_primitives_[begin], &build_primitives_[middle], &build_primitives_[0] + end,
+		[axis](const BuildPrimitive& a, const BuildPrimitive& b) {
+		return a.centroid[axis] < b.centroid[axis];
+	});
+	return middle;
+}
+void Bvh::PrimitiveBounds(const Scene& scene, unsigned int reference, Vec3 * min, Vec3 * max) const
+{
+	if (reference & kInstanceFlag)
+	{
+		// Mesh root bounds are the mesh bounds, instances of empty meshes are not in the tree
+		const MeshInstance& instance = scene.instances[reference & kIndexMask];
+		const BvhNode& root = nodes_[mesh_roots_[instance.mesh]];
+		*min = instance.position + Vec3(root.min[0], root.min[1], root.min[2]) * instance.scale;
+		*max = instance.position + Vec3(root.max[0], root.max[1], root.max[2]) * instance.scale;
+	}
+	else if (reference & kBoxFlag)
+	{
+		const Box& box = scene.boxes[reference & kIndexMask];
+		*min = box.min;
+		*max = box.max;
+	}
+	else
+	{
+		const Sphere& sphere = scene.spheres[reference];
+		*min = sphere.position - Vec3(sphere.radius);
+		*max = sphere.position + Vec3(sphere.radius);
+	}
+}
+bool Bvh::empty() const
+{
+	return nodes_.empty();
+}
+const std::vector<BvhNode>& Bvh::nodes() const
+{
+	return nodes_;
+}
+const std::vector<unsigned int>& Bvh::primitives() const
+{
+	return primitives_;
+}
+const std::vector<unsigned int>& Bvh::mesh_roots() const
+{
+	return mesh_roots_;
+}
+unsigned int Bvh::num_scene_nodes() const
+{
+	return num_scene_nodes_;
+}
+unsigned int Bvh::num_scene_primitives() const
+{
+	return num_scene_primitives_;
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include "scene.h"
+
+#include <vector>
+
+/**
+ * Flattened BVH node, children of interior node are the next node and node at offset.
+ * Layout matches two RGBA texels, so nodes are uploaded to texture buffer as they are.
+ */
+struct BvhNode {
+	float min[3];
+	unsigned int offset; //!< right child for interior nodes, first primitive for leaves
+	float max[3];
+	unsigned int count; //!< number of primitives in leaf, zero for interior nodes
+};
+
+static_assert(sizeof(BvhNode) == 32, "BVH node should have no padding");
+
+/**
+ * Two level bounding volume hierarchy, built with binned SAH.
+ * Scene tree starts at node zero and holds spheres, boxes and mesh instances,
+ * planes are infinite and stay out of the tree.
+ * Every scene mesh gets its own tree over triangles, mesh trees follow the scene one
+ * in the same node and primitive arrays, so instances of a mesh share it.
+ * Leaf primitives are referenced via primitives list: box and instance indices are marked
+ * with flags, mesh leaves hold triangle indices.
+ * Moving spheres, boxes and instances are handled by refitting scene tree bounds,
+ * mesh trees are in mesh space and never change.
+ */
+class Bvh {
+public:
+	static const unsigned int kBoxFlag = 0x80000000u;
+	static const unsigned int kInstanceFlag = 0x40000000u;
+	static const unsigned int kIndexMask = 0x3FFFFFFFu;
+	static const unsigned int kMaxLeafSize = 8;
+	//! Build keeps tree depth below this, so traversal stack never overflows
+	static const unsigned int kStackSize = 64;
+
+	Bvh();
+
+	void Build(const Scene& scene);
+	void Clear();
+	/**
+	 * Recomputes scene tree bounds bottom-up for moved primitives, topology stays the same.
+	 * @return False if primitives were added or removed since the build, tree should be rebuilt then.
+	 */
+	bool Refit(const Scene& scene);
+	/**
+	 * Refits the tree and rebuilds it when the SAH cost has grown more than max_cost_growth
+	 * times since the last build, as refitted nodes start to overlap.
+	 * @return True if the tree was rebuilt.
+	 */
+	bool Update(const Scene& scene, float max_cost_growth);
+	//! Expected scene tree traversal cost per ray, in primitive intersections
+	float SahCost() const;
+	float build_sah_cost() const; //!< cost right after the last build
+
+	bool empty() const;
+	const std::vector<BvhNode>& nodes() const;
+	const std::vector<unsigned int>& primitives() const;
+	//! Root node of every scene mesh tree, zero for meshes without triangles
+	const std::vector<unsigned int>& mesh_roots() const;
+	unsigned int num_scene_nodes() const; //!< mesh trees start after scene tree nodes
+	unsigned int num_scene_primitives() const; //!< mesh triangles start after scene primitives
+
+private:
+	struct BuildPrimitive {
+		Vec3 min;
+		Vec3 max;
+		Vec3 centroid;
+		unsigned int reference;
+	};
+
+	unsigned int BuildNode(unsigned int begin, unsigned int end, unsigned int depth);
+	//! Returns split position in primitives or zero when leaf is cheaper
+	unsigned int FindSplit(unsigned int begin, unsigned int end, const Vec3& min, const Vec3& max,
+		unsigned int depth);
+	void PrimitiveBounds(const Scene& scene, unsigned int reference, Vec3 * min, Vec3 * max) const;
+
+	std::vector<BuildPrimitive> build_primitives_;
+	std::vector<BvhNode> nodes_;
+	std::vector<unsigned int> primitives_;
+	std::vector<unsigned int> mesh_roots_;
+	unsigned int num_scene_nodes_;
+	unsigned int num_scene_primitives_;
+	float build_sah_cost_;
+	// Scene sizes at build time, refit is valid only while they stay the same
+	size_t num_spheres_;
+	size_t num_boxes_;
+	size_t num_instances_;
+	size_t num_meshes_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef __CAMERA_RAYS_H__
+#define __CAMERA_RAYS_H__
+
+#include "vec3.h"
+
+/**
+ * Camera as the ray trace shader sees it: eye position and normalized world space
+ * directions through the screen corners (u_ray00, u_ray10, u_ray01, u_ray11).
+ */
+struct CameraRays {
+	Vec3 eye;
+	Vec3 ray00; //!< bottom left
+	Vec3 ray10; //!< bottom right
+	Vec3 ray01; //!< top left
+	Vec3 ray11; //!< top right
+
+	//! Ray direction for screen UV in [0; 1], bilinear like in the shader
+	Vec3 Direction(float u, float v) const
+	{
+		return Normalize(Mix(Mix(ray00, ray01, v), Mix(ray10, ray11, v), u));
+	}
+	//! Exact comparison, any change of view invalidates accumulated samples
+	bool operator ==(const CameraRays& other) const
+	{
+		return eye == other.eye && ray00 == other.ray00 && ray10 == other.ray10
+			&& ray01 == other.ray01 && ray11 == other.ray11;
+	}
+	bool operator !=(const CameraRays& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+/**
+ * Computes corner rays for look-at camera, matches RayTraceApp::UpdateRays
+ * for perspective projection with the same vertical field of view.
+ */
+inline void MakeCameraRays(const Vec3& eye, const Vec3& target, const Vec3& up,
+	float fov_y_degrees, float aspect_ratio, CameraRays * rays)
+{
+	const float kPi = 3.14159265358979f;
+	const float tan_half_y = tanf(0.5f * fov_y_degrees * kPi / 180.0f);
+	const float tan_half_x = tan_half_y * aspect_ratio;
+	const Vec3 forward = Normalize(target - eye);
+	const Vec3 right = Normalize(Cross(forward, up));
+	const Vec3 camera_up = Cross(right, forward);
+	rays->eye = eye;
+	rays->ray00 = Normalize(forward - right * tan_half_x - camera_up * tan_half_y);
+	rays->ray10 = Normalize(forward + right * tan_half_x - camera_up * tan_half_y);
+	rays->ray01 = Normalize(forward - right * tan_half_x + camera_up * tan_half_y);
+	rays->ray11 = Normalize(forward + right * tan_half_x + camera_up * tan_half_y);
+}
+
+//! Radical inverse, low discrepancy sequence for subpixel jitter
+inline float Halton(unsigned int index, unsigned int base)
+{
+	float result = 0.0f;
+	float fraction = 1.0f;
+	while (index > 0)
+	{
+		fraction /= static_cast<float>(base);
+		result += fraction * static_cast<float>(index % base);
+		index /= base;
+	}
+	return result;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,931 @@
+#include "cpu_tracer.h"
+#include "parallel_tiles.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+	const float kEpsilon = 0.01f;
+	const float kNoHitDistance = 1e5f;
+	const unsigned int kTileSize = 32;
+	// Pixel footprint of a packet, 4x2 for 8 lanes and 2x2 for 4 lanes
+	const unsigned int kPacketWidth = (CpuTracer::kPacketSize == 8) ? 4 : 2;
+	const unsigned int kPacketHeight = CpuTracer::kPacketSize / kPacketWidth;
+
+	// Indices of refraction
+	const float kAirIndex = 1.0f;
+	const float kGlassIndex = 1.51714f;
+	// Fresnel reflectance at normal incidence
+	const float kR0 = ((kAirIndex - kGlassIndex) * (kAirIndex - kGlassIndex))
+		/ ((kAirIndex + kGlassIndex) * (kAirIndex + kGlassIndex));
+
+	struct TracedRay {
+		Ray incident;
+		Vec3 attenuation;
+		int depth;
+	};
+	//! Per ray constants of the watertight triangle test
+	struct TriangleRay {
+		Vec3 origin;
+		int k[3]; //!< axis permutation making z the dominant direction axis
+		Vec3 shear;
+	};
+
+	Hit NoHit()
+	{
+		Hit hit;
+		hit.t = kNoHitDistance;
+		hit.exists = false;
+		hit.material = nullptr;
+		return hit;
+	}
+	Hit MakeHit(const Vec3& normal, float t, const Material * material)
+	{
+		Hit hit;
+		hit.normal = normal;
+		hit.t = t;
+		hit.exists = true;
+		hit.material = material;
+		return hit;
+	}
+	float Pow5(float x)
+	{
+		const float x2 = x * x;
+		return x2 * x2 * x;
+	}
+	float Clamp(float x, float min_value, float max_value)
+	{
+		return std::min(std::max(x, min_value), max_value);
+	}
+	float Sign(float x)
+	{
+		return (x > 0.0f) ? 1.0f : ((x < 0.0f) ? -1.0f : 0.0f);
+	}
+	float SmoothStep(float edge0, float edge1, float x)
+	{
+		const float t = Clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+		return t * t * (3.0f - 2.0f * t);
+	}
+	// Schlick approximation
+	float Fresnel(const Vec3& h, const Vec3& v, float f0)
+	{
+		return Pow5(1.0f - Clamp(Dot(h, v), 0.0f, 1.0f)) * (1.0f - f0) + f0;
+	}
+	Vec3 BoxNormal(const Box& box, const Vec3& point)
+	{
+		const Vec3 center = (box.max + box.min) * 0.5f;
+		const Vec3 size = (box.max - box.min) * 0.5f;
+		const Vec3 pc = point - center;
+		const float bias = 1.0001f;
+		// Truncation towards zero picks the face axis, as int() in the shader does
+		return Normalize(Vec3(
+			static_cast<float>(static_cast<int>(pc.x / size.x * bias)),
+			static_cast<float>(static_cast<int>(pc.y / size.y * bias)),
+			static_cast<float>(static_cast<int>(pc.z / size.z * bias))
+			));
+	}
+	Hit IntersectPlane(const Plane& plane, const Ray& ray, const Material * material)
+	{
+		const float dotnd = Dot(plane.normal, ray.direction);
+		if (dotnd > 0.0f) return NoHit();
+
+		const float t = -(Dot(ray.origin, plane.normal) + plane.d) / dotnd;
+		return MakeHit(plane.normal, t, material);
+	}
+	Hit IntersectSphere(const Sphere& sphere, const Ray& ray, const Material * material)
+	{
+		const Vec3 op = sphere.position - ray.origin;
+		const float b = Dot(op, ray.direction);
+		float det = b * b - Dot(op, op) + sphere.radius * sphere.radius;
+		if (det < 0.0f) return NoHit();
+
+		det = sqrtf(det);
+		float t = b - det;
+		if (t < 0.0f) t = b + det;
+		if (t < 0.0f) return NoHit();
+
+		const Vec3 hit_normal = (ray.origin + t * ray.direction - sphere.position) / sphere.radius;
+		return MakeHit(hit_normal, t, material);
+	}
+	Hit IntersectBox(const Box& box, const Ray& ray, const Material * material)
+	{
+		const Vec3 t_min = (box.min - ray.origin) / ray.direction;
+		const Vec3 t_max = (box.max - ray.origin) / ray.direction;
+		const Vec3 t1 = Min(t_min, t_max);
+		const Vec3 t2 = Max(t_min, t_max);
+		const float t_near = std::max(std::max(t1.x, t1.y), t1.z);
+		const float t_far = std::min(std::min(t2.x, t2.y), t2.z);
+		if (!(t_near > 0.0f && t_near < t_far))
+			return NoHit();
+		const float t = (t_near > 0.0f) ? t_near : t_far;
+		const Vec3 hit_pos = ray.origin + ray.direction * t;
+		return MakeHit(BoxNormal(box, hit_pos), t, material);
+	}
+	TriangleRay SetupTriangleRay(const Ray& ray)
+	{
+		const float dx = fabsf(ray.direction.x);
+		const float dy = fabsf(ray.direction.y);
+		const float dz = fabsf(ray.direction.z);
+		const int kz = (dx > dy) ? ((dx > dz) ? 0 : 2) : ((dy > dz) ? 1 : 2);
+		int kx = (kz == 2) ? 0 : kz + 1;
+		int ky = (kx == 2) ? 0 : kx + 1;
+		// Swapping keeps winding of the sheared triangle, so both sides are hit
+		if (ray.direction[kz] < 0.0f)
+			std::swap(kx, ky);
+		TriangleRay triangle_ray;
+		triangle_ray.origin = ray.origin;
+		triangle_ray.k[0] = kx;
+		triangle_ray.k[1] = ky;
+		triangle_ray.k[2] = kz;
+		triangle_ray.shear = Vec3(ray.direction[kx] / ray.direction[kz],
+			ray.direction[ky] / ray.direction[kz], 1.0f / ray.direction[kz]);
+		return triangle_ray;
+	}
+	//! Watertight ray triangle test [Woop et al. 2013], returns distance or kNoHitDistance
+	float IntersectTriangle(const TriangleRay& ray, const Vec3& v0, const Vec3& v1, const Vec3& v2, float limit)
+	{
+		const Vec3 a = v0 - ray.origin;
+		const Vec3 b = v1 - ray.origin;
+		const Vec3 c = v2 - ray.origin;
+		const int kx = ray.k[0], ky = ray.k[1], kz = ray.k[2];
+		// Shear and scale vertices, so the ray goes along z from the origin
+		const float ax = a[kx] - ray.shear.x * a[kz];
+		const float ay = a[ky] - ray.shear.y * a[kz];
+		const float bx = b[kx] - ray.shear.x * b[kz];
+		const float by = b[ky] - ray.shear.y * b[kz];
+		const float cx = c[kx] - ray.shear.x * c[kz];
+		const float cy = c[ky] - ray.shear.y * c[kz];
+		// Scaled barycentrics, edges shared by triangles are evaluated identically
+		const float u = cx * by - cy * bx;
+		const float v = ax * cy - ay * cx;
+		const float w = bx * ay - by * ax;
+		if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+			return kNoHitDistance;
+		const float det = u + v + w;
+		if (det == 0.0f)
+			return kNoHitDistance;
+		const float t = (u * ray.shear.z * a[kz] + v * ray.shear.z * b[kz] + w * ray.shear.z * c[kz]) / det;
+		return (t > 0.0f && t < limit) ? t : kNoHitDistance;
+	}
+	//! Distance to the node bounds or kNoHitDistance if they are missed or farther than the limit
+	float IntersectBounds(const BvhNode& node, const Vec3& origin, const Vec3& inv_direction, float limit)
+	{
+		float t_near = 0.0f;
+		float t_far = limit;
+		for (int k = 0; k < 3; ++k)
+		{
+			const float t1 = (node.min[k] - origin[k]) * inv_direction[k];
+			const float t2 = (node.max[k] - origin[k]) * inv_direction[k];
+			t_near = fmaxf(t_near, fminf(t1, t2));
+			t_far = fminf(t_far, fmaxf(t1, t2));
+		}
+		return (t_near <= t_far) ? t_near : kNoHitDistance;
+	}
+	/**
+	 * Node bounds against all lanes of the SoA packet, returns mask of lanes entering the node.
+	 * Operand order makes NaN of 0*inf select the previous interval end, as fminf and fmaxf do,
+	 * otherwise the interval only gets wider, so no node visited by a single ray is culled.
+	 */
+	unsigned int IntersectBounds(const BvhNode& node, const SimdFloat * origin, const SimdFloat * inv_direction,
+		const SimdFloat& limit, SimdFloat * t_near_out)
+	{
+		SimdFloat t_near = SimdFloat::Broadcast(0.0f);
+		SimdFloat t_far = limit;
+		for (int k = 0; k < 3; ++k)
+		{
+			const SimdFloat t1 = (SimdFloat::Broadcast(node.min[k]) - origin[k]) * inv_direction[k];
+			const SimdFloat t2 = (SimdFloat::Broadcast(node.max[k]) - origin[k]) * inv_direction[k];
+			t_near = Max(Min(t1, t2), t_near);
+			t_far = Min(Max(t1, t2), t_far);
+		}
+		*t_near_out = t_near;
+		return LessEqual(t_near, t_far);
+	}
+	//! Smallest distance of lanes in the mask, kNoHitDistance for empty mask
+	float NearestLane(const SimdFloat& t, unsigned int mask)
+	{
+		if (mask == 0)
+			return kNoHitDistance;
+		float values[CpuTracer::kPacketSize];
+		t.Store(values);
+		float nearest = kNoHitDistance;
+		for (unsigned int lane = 0; lane < CpuTracer::kPacketSize; ++lane)
+			if (mask & (1u << lane))
+				nearest = std::min(nearest, values[lane]);
+		return nearest;
+	}
+	Vec3 Uncharted2ToneMapping(Vec3 color)
+	{
+		const float A = 0.15f;
+		const float B = 0.50f;
+		const float C = 0.10f;
+		const float D = 0.20f;
+		const float E = 0.02f;
+		const float F = 0.30f;
+		const float W = 11.2f;
+		const float exposure = 0.012f;
+		const float gamma = 2.2f;
+		color *= exposure;
+		for (int i = 0; i < 3; ++i)
+		{
+			const float x = color[i];
+			color[i] = ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+		}
+		const float white = ((W * (A * W + C * B) + D * E) / (W * (A * W + B) + D * F)) - E / F;
+		for (int i = 0; i < 3; ++i)
+			color[i] = powf(color[i] / white, 1.0f / gamma);
+		return color;
+	}
+	unsigned char ToByte(float value)
+	{
+		return static_cast<unsigned char>(Clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+	void WriteGuides(const Hit& hit, size_t index, DenoiseGuides * guides)
+	{
+		guides->normals[index] = hit.exists ? hit.normal : Vec3(0.0f);
+		guides->depths[index] = hit.t;
+		guides->albedos[index] = hit.exists ? hit.material->color : Vec3(0.0f);
+	}
+
+} // namespace
+
+CpuTracer::CpuTracer()
+: scene_(nullptr)
+, bvh_(nullptr)
+, max_depth_(kDefaultMaxDepth)
+, max_traced_rays_(kMaxTracedRays)
+, use_packets_(false)
+, jitter_x_(0.0f)
+, jitter_y_(0.0f)
+{
+}
+void CpuTracer::SetScene(const Scene * scene, const Bvh * bvh)
+{
+	scene_ = scene;
+	bvh_ = bvh;
+}
+void CpuTracer::set_max_depth(int max_depth)
+{
+	max_depth_ = max_depth;
+}
+int CpuTracer::max_depth() const
+{
+	return max_depth_;
+}
+void CpuTracer::set_max_traced_rays(int max_traced_rays)
+{
+	max_traced_rays_ = std::max(1, std::min(max_traced_rays, kMaxTracedRays));
+}
+int CpuTracer::max_traced_rays() const
+{
+	return max_traced_rays_;
+}
+void CpuTracer::set_use_packets(bool use_packets)
+{
+	use_packets_ = use_packets;
+}
+bool CpuTracer::use_packets() const
+{
+	return use_packets_;
+}
+void CpuTracer::set_jitter(float x, float y)
+{
+	jitter_x_ = x;
+	jitter_y_ = y;
+}
+Hit CpuTracer::IntersectScene(const Ray& ray) const
+{
+	Hit hit = NoHit();
+	// Intersection with planes
+	for (const Plane& plane : scene_->planes)
+	{
+		Hit cur_hit = IntersectPlane(plane, ray, &scene_->materials[plane.material]);
+		if (cur_hit.exists && cur_hit.t < hit.t)
+			hit = cur_hit;
+	}
+	if (bvh_)
+	{
+		TraverseBvh(ray, false, &hit);
+		return hit;
+	}
+	// Intersection with spheres
+	for (const Sphere& sphere : scene_->spheres)
+	{
+		Hit cur_hit = IntersectSphere(sphere, ray, &scene_->materials[sphere.material]);
+		if (cur_hit.exists && cur_hit.t < hit.t)
+			hit = cur_hit;
+	}
+	// Intersection with boxes
+	for (const Box& box : scene_->boxes)
+	{
+		Hit cur_hit = IntersectBox(box, ray, &scene_->materials[box.material]);
+		if (cur_hit.exists && cur_hit.t < hit.t)
+			hit = cur_hit;
+	}
+	// Intersection with meshes
+	for (const MeshInstance& instance : scene_->instances)
+		IntersectInstance(instance, ray, false, &hit);
+	return hit;
+}
+bool CpuTracer::IsOccluded(const Ray& ray) const
+{
+	if (!bvh_)
+		return IntersectScene(ray).exists;
+	for (const Plane& plane : scene_->planes)
+		if (IntersectPlane(plane, ray, nullptr).exists)
+			return true;
+	Hit hit = NoHit();
+	return TraverseBvh(ray, true, &hit);
+}
+void CpuTracer::IntersectPacket(const Ray * rays, unsigned int active, Hit * hits) const
+{
+	for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+	{
+		if (!(active & (1u << lane)))
+			continue;
+		if (!bvh_)
+		{
+			hits[lane] = IntersectScene(rays[lane]);
+			continue;
+		}
+		hits[lane] = NoHit();
+		for (const Plane& plane : scene_->planes)
+		{
+			Hit cur_hit = IntersectPlane(plane, rays[lane], &scene_->materials[plane.material]);
+			if (cur_hit.exists && cur_hit.t < hits[lane].t)
+				hits[lane] = cur_hit;
+		}
+	}
+	if (bvh_)
+		TraversePacket(rays, active, false, hits);
+}
+unsigned int CpuTracer::OccludedPacket(const Ray * rays, unsigned int active) const
+{
+	unsigned int occluded = 0;
+	Hit hits[kPacketSize];
+	for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+	{
+		const unsigned int bit = 1u << lane;
+		hits[lane] = NoHit();
+		if (!(active & bit))
+			continue;
+		if (!bvh_)
+		{
+			if (IsOccluded(rays[lane]))
+				occluded |= bit;
+			continue;
+		}
+		for (const Plane& plane : scene_->planes)
+			if (IntersectPlane(plane, rays[lane], nullptr).exists)
+			{
+				occluded |= bit;
+				break;
+			}
+	}
+	active &= ~occluded;
+	if (bvh_ && active != 0)
+		occluded |= TraversePacket(rays, active, true, hits);
+	return occluded;
+}
+bool CpuTracer::TraverseBvh(const Ray& ray, bool any_hit, Hit * hit) const
+{
+	const std::vector<BvhNode>& nodes = bvh_->nodes();
+	if (nodes.empty())
+		return false;
+	const unsigned int * primitives = bvh_->primitives().data();
+	const Vec3 inv_direction = Vec3(1.0f) / ray.direction;
+	bool found = false;
+
+	unsigned int stack[Bvh::kStackSize];
+	unsigned int stack_size = 0;
+	unsigned int index = 0;
+	if (IntersectBounds(nodes[0], ray.origin, inv_direction, hit->t) == kNoHitDistance)
+		return false;
+	for (;;)
+	{
+		const BvhNode& node = nodes[index];
+		if (node.count != 0)
+		{
+			for (unsigned int i = node.offset; i < node.offset + node.count; ++i)
+			{
+				if (IntersectPrimitive(primitives[i], ray, any_hit, hit))
+				{
+					found = true;
+					if (any_hit)
+						return true;
+				}
+			}
+		}
+		else
+		{
+			// Visit the nearer child first, so the farther one is likely culled by the hit distance
+			unsigned int near_child = index + 1;
+			unsigned int far_child = node.offset;
+			float near_t = IntersectBounds(nodes[near_child], ray.origin, inv_direction, hit->t);
+			float far_t = IntersectBounds(nodes[far_child], ray.origin, inv_direction, hit->t);
+			if (far_t < near_t)
+			{
+				std::swap(near_child, far_child);
+				std::swap(near_t, far_t);
+			}
+			if (near_t != kNoHitDistance)
+			{
+				if (far_t != kNoHitDistance)
+					stack[stack_size++] = far_child;
+				index = near_child;
+				continue;
+			}
+		}
+		if (stack_size == 0)
+			break;
+		index = stack[--stack_size];
+	}
+	return found;
+}
+unsigned int CpuTracer::TraversePacket(const Ray * rays, unsigned int active, bool any_hit, Hit * hits) const
+{
+	const std::vector<BvhNode>& nodes = bvh_->nodes();
+	if (nodes.empty())
+		return 0;
+	const unsigned int * primitives = bvh_->primitives().data();
+
+	// Structure of arrays layout, one SIMD register per component
+	float origins[3][kPacketSize];
+	float inv_directions[3][kPacketSize];
+	float limits[kPacketSize];
+	for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+	{
+		const Vec3 inv_direction = Vec3(1.0f) / rays[lane].direction;
+		for (int k = 0; k < 3; ++k)
+		{
+			origins[k][lane] = rays[lane].origin[k];
+			inv_directions[k][lane] = inv_direction[k];
+		}
+		limits[lane] = hits[lane].t;
+	}
+	SimdFloat origin[3], inv_direction[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		origin[k] = SimdFloat::Load(origins[k]);
+		inv_direction[k] = SimdFloat::Load(inv_directions[k]);
+	}
+	SimdFloat limit = SimdFloat::Load(limits);
+	unsigned int found = 0;
+
+	// Nodes are pushed with lanes which entered them
+	struct StackEntry {
+		unsigned int index;
+		unsigned int mask;
+	};
+	StackEntry stack[Bvh::kStackSize];
+	unsigned int stack_size = 0;
+	unsigned int index = 0;
+	SimdFloat t_near;
+	unsigned int mask = IntersectBounds(nodes[0], origin, inv_direction, limit, &t_near) & active;
+	if (mask == 0)
+		return 0;
+	for (;;)
+	{
+		const BvhNode& node = nodes[index];
+		if (node.count != 0)
+		{
+			// Primitives are tested lane by lane, so hits match the single ray traversal
+			for (unsigned int i = node.offset; i < node.offset + node.count; ++i)
+				for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+				{
+					const unsigned int bit = 1u << lane;
+					if ((mask & bit) && IntersectPrimitive(primitives[i], rays[lane], any_hit, &hits[lane]))
+					{
+						found |= bit;
+						limits[lane] = hits[lane].t;
+						// Occluded lanes are done
+						if (any_hit)
+						{
+							mask &= ~bit;
+							active &= ~bit;
+						}
+					}
+				}
+			if (active == 0)
+				break;
+			limit = SimdFloat::Load(limits);
+		}
+		else
+		{
+			// Visit the child nearer to the packet first
+			unsigned int near_child = index + 1;
+			unsigned int far_child = node.offset;
+			SimdFloat near_t, far_t;
+			unsigned int near_mask = IntersectBounds(nodes[near_child], origin, inv_direction, limit, &near_t) & mask;
+			unsigned int far_mask = IntersectBounds(nodes[far_child], origin, inv_direction, limit, &far_t) & mask;
+			if (NearestLane(far_t, far_mask) < NearestLane(near_t, near_mask))
+			{
+				std::swap(near_child, far_child);
+				std::swap(near_mask, far_mask);
+			}
+			if (near_mask != 0)
+			{
+				if (far_mask != 0)
+					stack[stack_size++] = StackEntry{far_child, far_mask};
+				index = near_child;
+				mask = near_mask;
+				continue;
+			}
+		}
+		// Skip nodes of lanes which became occluded
+		do
+		{
+			if (stack_size == 0)
+				return found;
+			--stack_size;
+			index = stack[stack_size].index;
+			mask = stack[stack_size].mask & active;
+		}
+		while (mask == 0);
+	}
+	return found;
+}
+bool CpuTracer::IntersectPrimitive(unsigned int reference, const Ray& ray, bool any_hit, Hit * hit) const
+{
+	if (reference & Bvh::kInstanceFlag)
+		return IntersectInstance(scene_->instances[reference & Bvh::kIndexMask], ray, any_hit, hit);
+	Hit cur_hit;
+	if (reference & Bvh::kBoxFlag)
+	{
+		const Box& box = scene_->boxes[reference & Bvh::kIndexMask];
+		cur_hit = IntersectBox(box, ray, &scene_->materials[box.material]);
+	}
+	else
+	{
+		const Sphere& sphere = scene_->spheres[reference];
+		cur_hit = IntersectSphere(sphere, ray, &scene_->materials[sphere.material]);
+	}
+	if (!(cur_hit.exists && cur_hit.t < hit->t))
+		return false;
+	*hit = cur_hit;
+	return true;
+}
+bool CpuTracer::IntersectInstance(const MeshInstance& instance, const Ray& ray, bool any_hit, Hit * hit) const
+{
+	const TriangleMesh& mesh = scene_->meshes[instance.mesh];
+	// Uniform scale keeps directions, so only the origin and distances are transformed
+	const float inv_scale = 1.0f / instance.scale;
+	Ray mesh_ray;
+	mesh_ray.origin = (ray.origin - instance.position) * inv_scale;
+	mesh_ray.direction = ray.direction;
+	float t = hit->t * inv_scale;
+	unsigned int triangle = 0;
+	bool found = false;
+	if (bvh_)
+	{
+		const unsigned int root = bvh_->mesh_roots()[instance.mesh];
+		found = (root != 0) && TraverseMesh(mesh_ray, mesh, root, any_hit, &t, &triangle);
+	}
+	else
+	{
+		const TriangleRay triangle_ray = SetupTriangleRay(mesh_ray);
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			const float cur_t = IntersectTriangle(triangle_ray, mesh.positions[mesh.indices[i]],
+				mesh.positions[mesh.indices[i + 1]], mesh.positions[mesh.indices[i + 2]], t);
+			if (cur_t != kNoHitDistance)
+			{
+				t = cur_t;
+				triangle = static_cast<unsigned int>(i / 3);
+				found = true;
+			}
+		}
+	}
+	if (!found)
+		return false;
+	// Normal is computed for the closest triangle only
+	const unsigned int * indices = &mesh.indices[triangle * 3];
+	const Vec3& v0 = mesh.positions[indices[0]];
+	const Vec3& v1 = mesh.positions[indices[1]];
+	const Vec3& v2 = mesh.positions[indices[2]];
+	*hit = MakeHit(Normalize(Cross(v1 - v0, v2 - v0)), t * instance.scale, &scene_->materials[instance.material]);
+	return true;
+}
+bool CpuTracer::TraverseMesh(const Ray& ray, const TriangleMesh& mesh, unsigned int root, bool any_hit,
+	float * t, unsigned int * triangle) const
+{
+	const std::vector<BvhNode>& nodes = bvh_->nodes();
+	const unsigned int * primitives = bvh_->primitives().data();
+	const TriangleRay triangle_ray = SetupTriangleRay(ray);
+	const Vec3 inv_direction = Vec3(1.0f) / ray.direction;
+	bool found = false;
+
+	unsigned int stack[Bvh::kStackSize];
+	unsigned int stack_size = 0;
+	unsigned int index = root;
+	if (IntersectBounds(nodes[root], ray.origin, inv_direction, *t) == kNoHitDistance)
+		return false;
+	for (;;)
+	{
+		const BvhNode& node = nodes[index];
+		if (node.count != 0)
+		{
+			for (unsigned int i = node.offset; i < node.offset + node.count; ++i)
+			{
+				const unsigned int * indices = &mesh.indices[primitives[i] * 3];
+				const float cur_t = IntersectTriangle(triangle_ray, mesh.positions[indices[0]],
+					mesh.positions[indices[1]], mesh.positions[indices[2]], *t);
+				if (cur_t != kNoHitDistance)
+				{
+					*t = cur_t;
+					*triangle = primitives[i];
+					found = true;
+					if (any_hit)
+						return true;
+				}
+			}
+		}
+		else
+		{
+			unsigned int near_child = index + 1;
+			unsigned int far_child = node.offset;
+			float near_t = IntersectBounds(nodes[near_child], ray.origin, inv_direction, *t);
+			float far_t = IntersectBounds(nodes[far_child], ray.origin, inv_direction, *t);
+			if (far_t < near_t)
+			{
+				std::swap(near_child, far_child);
+				std::swap(near_t, far_t);
+			}
+			if (near_t != kNoHitDistance)
+			{
+				if (far_t != kNoHitDistance)
+					stack[stack_size++] = far_child;
+				index = near_child;
+				continue;
+			}
+		}
+		if (stack_size == 0)
+			break;
+		index = stack[--stack_size];
+	}
+	return found;
+}
+Vec3 CpuTracer::SkyColor(const Vec3& d) const
+{
+	const float transition = powf(SmoothStep(0.02f, 0.5f, d.y), 0.4f);
+
+	const Vec3 sky = 2e2f * Mix(Vec3(0.52f, 0.77f, 1.0f), Vec3(0.12f, 0.43f, 1.0f), transition);
+	Vec3 sun(0.0f);
+	for (const DirectionalLight& light : scene_->lights)
+		sun += light.color * powf(fabsf(Dot(d, light.direction)), 5000.0f);
+	return sky + sun;
+}
+Vec3 CpuTracer::AccountForDirectionalLights(const Vec3& position, const Vec3& normal) const
+{
+	Vec3 incoming(0.0f);
+	for (const DirectionalLight& light : scene_->lights)
+	{
+		Ray shadow_ray;
+		shadow_ray.origin = position + kEpsilon * light.direction;
+		shadow_ray.direction = light.direction;
+		if (!IsOccluded(shadow_ray))
+			incoming += Clamp(Dot(normal, light.direction), 0.0f, 1.0f) * light.color;
+	}
+	return incoming;
+}
+Vec3 CpuTracer::Radiance(const Ray& primary_ray) const
+{
+	return Radiance(primary_ray, nullptr, nullptr);
+}
+void CpuTracer::RadiancePacket(const Ray * rays, unsigned int active, Vec3 * radiance, Hit * hits) const
+{
+	IntersectPacket(rays, active, hits);
+
+	// Shadow rays of opaque primary hits go towards the same light, so they stay coherent
+	Vec3 hit_positions[kPacketSize];
+	Vec3 incoming[kPacketSize];
+	unsigned int opaque = 0;
+	for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+	{
+		incoming[lane] = Vec3(0.0f);
+		if ((active & (1u << lane)) && hits[lane].exists && hits[lane].material->type == kOpaqueMaterial)
+		{
+			hit_positions[lane] = rays[lane].origin + hits[lane].t * rays[lane].direction;
+			opaque |= 1u << lane;
+		}
+		else
+			hit_positions[lane] = rays[lane].origin; // inactive lanes still need finite values
+	}
+	if (opaque != 0)
+	{
+		for (const DirectionalLight& light : scene_->lights)
+		{
+			Ray shadow_rays[kPacketSize];
+			for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+			{
+				shadow_rays[lane].origin = hit_positions[lane] + kEpsilon * light.direction;
+				shadow_rays[lane].direction = light.direction;
+			}
+			const unsigned int lit = opaque & ~OccludedPacket(shadow_rays, opaque);
+			for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+				if (lit & (1u << lane))
+					incoming[lane] += Clamp(Dot(hits[lane].normal, light.direction), 0.0f, 1.0f) * light.color;
+		}
+	}
+	for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+		if (active & (1u << lane))
+			radiance[lane] = Radiance(rays[lane], &hits[lane], &incoming[lane]);
+}
+Vec3 CpuTracer::Radiance(const Ray& primary_ray, const Hit * primary_hit, const Vec3 * primary_incoming) const
+{
+	Vec3 accumulation(0.0f);
+
+	// Rays are traced breadth first like in the shader, so running out of slots
+	// drops the same deep bounces on both sides, only max_traced_rays_ slots are used
+	TracedRay traced_rays[kMaxTracedRays];
+	int current_ray = 0;
+	int used_rays = 1;
+	traced_rays[0].incident = primary_ray;
+	traced_rays[0].attenuation = Vec3(1.0f);
+	traced_rays[0].depth = 0;
+
+	while (current_ray < used_rays)
+	{
+		// Extract ray
+		const Ray ray = traced_rays[current_ray].incident;
+		Vec3 attenuation = traced_rays[current_ray].attenuation;
+		const int depth = traced_rays[current_ray].depth;
+		const bool is_primary = (current_ray == 0);
+		++current_ray;
+		if (depth > max_depth_)
+			break;
+
+		const Hit hit = (is_primary && primary_hit) ? *primary_hit : IntersectScene(ray);
+
+		if (hit.exists)
+		{
+			const Material& material = *hit.material;
+			if (material.type == kOpaqueMaterial)
+			{
+				const float f = Fresnel(hit.normal, -ray.direction, material.f0);
+
+				const Vec3 hit_pos = ray.origin + hit.t * ray.direction;
+
+				// Diffuse
+				const Vec3 incoming = (is_primary && primary_incoming) ? *primary_incoming
+					: AccountForDirectionalLights(hit_pos, hit.normal);
+
+				accumulation += (1.0f - f) * attenuation * material.color * incoming;
+
+				// Specular: next bounce
+				if (used_rays < max_traced_rays_ - 1)
+				{
+					const Vec3 d = Reflect(ray.direction, hit.normal);
+					traced_rays[used_rays].incident = Ray{hit_pos + kEpsilon * d, d};
+					traced_rays[used_rays].attenuation = attenuation * f;
+					traced_rays[used_rays].depth = depth + 1;
+					++used_rays;
+				}
+			}
+			else
+			{
+				attenuation *= material.color * 0.95f;
+				const float a = Dot(hit.normal, ray.direction), ddn = fabsf(a);
+				const float nnt = (a > 0.0f) ? kGlassIndex / kAirIndex : kAirIndex / kGlassIndex;
+				const float cos2t = 1.0f - nnt * nnt * (1.0f - ddn * ddn);
+				if (cos2t > 0.0f)
+				{
+					const Vec3 tdir = Normalize(ray.direction * nnt + Sign(a) * hit.normal * (sqrtf(cos2t) - ddn * nnt));
+					const float c = 1.0f - ((a > 0.0f) ? Dot(tdir, hit.normal) : ddn);
+					const float re = kR0 + (1.0f - kR0) * Pow5(c);
+
+					// Store rays value
+					if (used_rays < max_traced_rays_ - 2)
+					{
+						const Vec3 hit_pos = ray.origin + hit.t * ray.direction;
+						const Vec3 d = Reflect(ray.direction, hit.normal);
+						traced_rays[used_rays].incident = Ray{hit_pos + kEpsilon * d, d};
+						traced_rays[used_rays].attenuation = attenuation * re;
+						traced_rays[used_rays].depth = depth + 1;
+						++used_rays;
+						traced_rays[used_rays].incident = Ray{hit_pos + kEpsilon * tdir, tdir};
+						traced_rays[used_rays].attenuation = attenuation * (1.0f - re);
+						traced_rays[used_rays].depth = depth + 1;
+						++used_rays;
+					}
+				}
+				else
+				{
+					// Total internal reflection
+					if (used_rays < max_traced_rays_ - 1)
+					{
+						const Vec3 d = Reflect(ray.direction, hit.normal);
+						traced_rays[used_rays].incident = Ray{ray.origin + hit.t * ray.direction + kEpsilon * d, d};
+						traced_rays[used_rays].attenuation = attenuation;
+						traced_rays[used_rays].depth = depth + 1;
+						++used_rays;
+					}
+				}
+			}
+		}
+		else
+		{
+			accumulation += attenuation * SkyColor(ray.direction);
+		}
+		if (current_ray == max_traced_rays_)
+		{
+			// Same guard as in the shader
+			return Vec3(1e5f);
+		}
+	}
+	return accumulation;
+}
+void CpuTracer::Render(const CameraRays& camera, unsigned int width, unsigned int height,
+	unsigned int num_threads, std::vector<Vec3> * pixels, DenoiseGuides * guides) const
+{
+	const size_t size = static_cast<size_t>(width) * height;
+	pixels->resize(size);
+	if (guides)
+	{
+		guides->normals.resize(size);
+		guides->depths.resize(size);
+		guides->albedos.resize(size);
+	}
+	Vec3 * output = pixels->data();
+	const float inv_width = 1.0f / static_cast<float>(width);
+	const float inv_height = 1.0f / static_cast<float>(height);
+	if (use_packets_ && bvh_)
+	{
+		ParallelForTiles(width, height, kTileSize, num_threads,
+			[&](unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) {
+			Ray rays[kPacketSize];
+			Vec3 radiance[kPacketSize];
+			Hit hits[kPacketSize];
+			for (unsigned int py = y0; py < y1; py += kPacketHeight)
+				for (unsigned int px = x0; px < x1; px += kPacketWidth)
+				{
+					// Lanes outside of the tile repeat the first ray and are masked out
+					unsigned int active = 0;
+					for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+					{
+						unsigned int x = px + lane % kPacketWidth;
+						unsigned int y = py + lane / kPacketWidth;
+						if (x < x1 && y < y1)
+							active |= 1u << lane;
+						else
+						{
+							x = px;
+							y = py;
+						}
+						const float u = (static_cast<float>(x) + 0.5f) * inv_width + jitter_x_;
+						const float v = (static_cast<float>(y) + 0.5f) * inv_height + jitter_y_;
+						rays[lane] = Ray{camera.eye, camera.Direction(u, v)};
+					}
+					RadiancePacket(rays, active, radiance, hits);
+					for (unsigned int lane = 0; lane < kPacketSize; ++lane)
+						if (active & (1u << lane))
+						{
+							const unsigned int x = px + lane % kPacketWidth;
+							const unsigned int y = py + lane / kPacketWidth;
+							const size_t index = static_cast<size_t>(y) * width + x;
+							output[index] = radiance[lane];
+							if (guides)
+								WriteGuides(hits[lane], index, guides);
+						}
+				}
+		});
+		return;
+	}
+	ParallelForTiles(width, height, kTileSize, num_threads,
+		[&](unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y)
+		{
+			// Fragment centers, as fs_in.uv + u_jitter in the shader
+			const float v = (static_cast<float>(y) + 0.5f) * inv_height + jitter_y_;
+			for (unsigned int x = x0; x < x1; ++x)
+			{
+				const float u = (static_cast<float>(x) + 0.5f) * inv_width + jitter_x_;
+				const Ray ray{camera.eye, camera.Direction(u, v)};
+				const Hit hit = IntersectScene(ray);
+				const size_t index = static_cast<size_t>(y) * width + x;
+				output[index] = Radiance(ray, &hit, nullptr);
+				if (guides)
+					WriteGuides(hit, index, guides);
+			}
+		}
+	});
+}
+void ToneMap(const std::vector<Vec3>& pixels, unsigned int width, unsigned int height,
+	std::vector<unsigned char> * rgb)
+{
+	rgb->resize(static_cast<size_t>(width) * height * 3);
+	unsigned char * out = rgb->data();
+	for (unsigned int y = 0; y < height; ++y)
+	{
+		// Images are stored from top to bottom
+		const Vec3 * row = &pixels[static_cast<size_t>(height - 1 - y) * width];
+		for (unsigned int x = 0; x < width; ++x)
+		{
+			const Vec3 color = Uncharted2ToneMapping(row[x]);
+			*out++ = ToByte(color.x);
+			*out++ = ToByte(color.y);
+			*out++ = ToByte(color.z);
+		}
+	}
+}
\ No newline at end of file
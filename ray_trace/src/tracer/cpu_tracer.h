@@ -0,0 +1,110 @@
+#ifndef __CPU_TRACER_H__
+#define __CPU_TRACER_H__
+
+#include "scene.h"
+#include "bvh.h"
+#include "camera_rays.h"
+#include "denoiser.h"
+#include "simd_float.h"
+
+#include <vector>
+
+struct Ray {
+	Vec3 origin;
+	Vec3 direction;
+};
+struct Hit {
+	Vec3 normal;
+	float t; //!< solution to p=o+t*d
+	bool exists;
+	const Material * material;
+};
+
+/**
+ * CPU reference implementation of raytrace.fs.
+ * Intersection, shading and the bounce tree follow the shader step by step,
+ * so images of both should match up to floating point differences.
+ */
+class CpuTracer {
+public:
+	static const int kDefaultMaxDepth = 5; //!< MAX_DEPTH of the shader
+	static const int kMaxTracedRays = 128; //!< MAX_TRACED_RAYS of the generic shader
+	static const unsigned int kPacketSize = SimdFloat::kWidth; //!< rays in a packet
+
+	CpuTracer();
+
+	/**
+	 * Scene and BVH should outlive the tracer.
+	 * Without BVH every ray is tested against every primitive, as the original shader did.
+	 */
+	void SetScene(const Scene * scene, const Bvh * bvh = nullptr);
+	void set_max_depth(int max_depth);
+	int max_depth() const;
+	//! Traced ray list size as MAX_TRACED_RAYS of a shader permutation, clamped to kMaxTracedRays
+	void set_max_traced_rays(int max_traced_rays);
+	int max_traced_rays() const;
+	//! Render traces coherent rays of neighbouring pixels in packets, requires BVH
+	void set_use_packets(bool use_packets);
+	bool use_packets() const;
+	//! Offset of rays from pixel centers in screen UV, as u_jitter of the shader
+	void set_jitter(float x, float y);
+
+	Hit IntersectScene(const Ray& ray) const;
+	//! Any hit query for shadow rays, stops at the first found intersection
+	bool IsOccluded(const Ray& ray) const;
+	Vec3 Radiance(const Ray& ray) const;
+
+	/**
+	 * Packet versions of IntersectScene and IsOccluded for up to kPacketSize rays.
+	 * Lanes are selected by bits of the active mask, other lanes are left untouched.
+	 * Without BVH lanes are traced one by one.
+	 */
+	void IntersectPacket(const Ray * rays, unsigned int active, Hit * hits) const;
+	//! Returns mask of occluded lanes
+	unsigned int OccludedPacket(const Ray * rays, unsigned int active) const;
+	//! Radiance of active lanes, primary hits and their shadow rays are traced as packets, hits are returned too
+	void RadiancePacket(const Ray * rays, unsigned int active, Vec3 * radiance, Hit * hits) const;
+
+	/**
+	 * Traces one ray per pixel through pixel centers shifted by jitter.
+	 * @param[out] pixels  HDR radiance, rows go from bottom to top like in GL.
+	 * @param[in] num_threads  Zero means hardware concurrency.
+	 * @param[out] guides  Optional primary hit features for the denoiser.
+	 */
+	void Render(const CameraRays& camera, unsigned int width, unsigned int height,
+		unsigned int num_threads, std::vector<Vec3> * pixels, DenoiseGuides * guides = nullptr) const;
+
+private:
+	//! Traverses BVH updating the hit, returns on the first hit when any_hit is set
+	bool TraverseBvh(const Ray& ray, bool any_hit, Hit * hit) const;
+	//! Packet version of TraverseBvh, returns mask of lanes with closer hits
+	unsigned int TraversePacket(const Ray * rays, unsigned int active, bool any_hit, Hit * hits) const;
+	//! Tests referenced BVH primitive, the hit is updated if closer
+	bool IntersectPrimitive(unsigned int reference, const Ray& ray, bool any_hit, Hit * hit) const;
+	//! Updates the hit with closer triangle of the instance, returns whether it was found
+	bool IntersectInstance(const MeshInstance& instance, const Ray& ray, bool any_hit, Hit * hit) const;
+	//! Traverses mesh tree in mesh space, distance and triangle index are updated on closer hits
+	bool TraverseMesh(const Ray& ray, const TriangleMesh& mesh, unsigned int root, bool any_hit,
+		float * t, unsigned int * triangle) const;
+	Vec3 SkyColor(const Vec3& direction) const;
+	Vec3 AccountForDirectionalLights(const Vec3& position, const Vec3& normal) const;
+	//! Optional primary hit and its direct lighting are used instead of tracing them again
+	Vec3 Radiance(const Ray& primary_ray, const Hit * primary_hit, const Vec3 * primary_incoming) const;
+
+	const Scene * scene_;
+	const Bvh * bvh_;
+	int max_depth_;
+	int max_traced_rays_;
+	bool use_packets_;
+	float jitter_x_;
+	float jitter_y_;
+};
+
+/**
+ * Applies the shader tone mapping and converts to 8 bit RGB.
+ * Output rows go from top to bottom, as image files expect.
+ */
+void ToneMap(const std::vector<Vec3>& pixels, unsigned int width, unsigned int height,
+	std::vector<unsigned char> * rgb);
+
+#endif
\ No newline at end of file
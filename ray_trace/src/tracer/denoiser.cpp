@@ -0,0 +1,243 @@
+#include "denoiser.h"
+#include "parallel_tiles.h"
+#include "simd_float.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+	const unsigned int kTileSize = 32;
+	const int kRadius = 2; //!< kernel is 5x5
+	const float kKernel[2 * kRadius + 1] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+	const float kMinDepth = 1e-3f;
+	const float kMaxRadiance = 1e5f; //!< same as the ray budget guard of the tracer
+
+	//! Image as separate planes of floats, so neighbouring pixels load into one SIMD register
+	struct Planes {
+		std::vector<float> normal[3];
+		std::vector<float> depth;
+		std::vector<float> albedo[3];
+	};
+
+	//! Keeps NaN and infinite radiance of rare degenerate paths from spreading over the filter footprint
+	float SanitizeRadiance(float value)
+	{
+		return (value >= 0.0f) ? std::min(value, kMaxRadiance) : 0.0f;
+	}
+
+	/**
+	 * Exp(-x) for x >= 0 as (1 - x/256)^256, accurate enough for weights
+	 * and needs nothing beyond multiplication, so SIMD and scalar paths compute the same.
+	 */
+	float ExpNegative(float x)
+	{
+		float y = std::max(1.0f - x * (1.0f / 256.0f), 0.0f);
+		for (int i = 0; i < 8; ++i)
+			y *= y;
+		return y;
+	}
+	SimdFloat ExpNegative(const SimdFloat& x)
+	{
+		SimdFloat y = Max(SimdFloat::Broadcast(1.0f) - x * SimdFloat::Broadcast(1.0f / 256.0f), SimdFloat::Broadcast(0.0f));
+		for (int i = 0; i < 8; ++i)
+			y = y * y;
+		return y;
+	}
+
+	//! Per iteration constants
+	struct Pass {
+		unsigned int width;
+		unsigned int height;
+		int step;
+		float color_weight; //!< inverse squared sigmas
+		float normal_weight;
+		float albedo_weight;
+		float inv_depth_sigma;
+	};
+
+	void FilterPixel(const Pass& pass, const Planes& planes, const std::vector<float> * input,
+		std::vector<float> * output, unsigned int x, unsigned int y)
+	{
+		const size_t center = static_cast<size_t>(y) * pass.width + x;
+		float c[3], n[3], a[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			c[k] = input[k][center];
+			n[k] = planes.normal[k][center];
+			a[k] = planes.albedo[k][center];
+		}
+		const float depth = planes.depth[center];
+		const float depth_weight = pass.inv_depth_sigma / depth;
+		float sum[3] = {0.0f, 0.0f, 0.0f};
+		float weight_sum = 0.0f;
+		for (int dy = -kRadius; dy <= kRadius; ++dy)
+		{
+			const int qy = static_cast<int>(y) + dy * pass.step;
+			if (qy < 0 || qy >= static_cast<int>(pass.height))
+				continue;
+			for (int dx = -kRadius; dx <= kRadius; ++dx)
+			{
+				const int qx = static_cast<int>(x) + dx * pass.step;
+				if (qx < 0 || qx >= static_cast<int>(pass.width))
+					continue;
+				const size_t q = static_cast<size_t>(qy) * pass.width + static_cast<size_t>(qx);
+				float color_distance = 0.0f, normal_distance = 0.0f, albedo_distance = 0.0f;
+				for (int k = 0; k < 3; ++k)
+				{
+					const float dc = input[k][q] - c[k];
+					const float dn = planes.normal[k][q] - n[k];
+					const float da = planes.albedo[k][q] - a[k];
+					color_distance += dc * dc;
+					normal_distance += dn * dn;
+					albedo_distance += da * da;
+				}
+				// Depth difference is relative to the center depth
+				const float dz = (planes.depth[q] - depth) * depth_weight;
+				const float weight = kKernel[dx + kRadius] * kKernel[dy + kRadius] * ExpNegative(
+					color_distance * pass.color_weight + normal_distance * pass.normal_weight
+					+ dz * dz + albedo_distance * pass.albedo_weight);
+				for (int k = 0; k < 3; ++k)
+					sum[k] += weight * input[k][q];
+				weight_sum += weight;
+			}
+		}
+		// Center tap always has positive weight
+		for (int k = 0; k < 3; ++k)
+			output[k][center] = sum[k] / weight_sum;
+	}
+	//! Same as FilterPixel for SimdFloat::kWidth pixels of a row, all horizontal taps should be inside
+	void FilterPixels(const Pass& pass, const Planes& planes, const std::vector<float> * input,
+		std::vector<float> * output, unsigned int x, unsigned int y)
+	{
+		const size_t center = static_cast<size_t>(y) * pass.width + x;
+		SimdFloat c[3], n[3], a[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			c[k] = SimdFloat::Load(&input[k][center]);
+			n[k] = SimdFloat::Load(&planes.normal[k][center]);
+			a[k] = SimdFloat::Load(&planes.albedo[k][center]);
+		}
+		const SimdFloat depth = SimdFloat::Load(&planes.depth[center]);
+		const SimdFloat depth_weight = SimdFloat::Broadcast(pass.inv_depth_sigma) / depth;
+		const SimdFloat color_weight = SimdFloat::Broadcast(pass.color_weight);
+		const SimdFloat normal_weight = SimdFloat::Broadcast(pass.normal_weight);
+		const SimdFloat albedo_weight = SimdFloat::Broadcast(pass.albedo_weight);
+		SimdFloat sum[3];
+		for (int k = 0; k < 3; ++k)
+			sum[k] = SimdFloat::Broadcast(0.0f);
+		SimdFloat weight_sum = SimdFloat::Broadcast(0.0f);
+		for (int dy = -kRadius; dy <= kRadius; ++dy)
+		{
+			const int qy = static_cast<int>(y) + dy * pass.step;
+			if (qy < 0 || qy >= static_cast<int>(pass.height))
+				continue;
+			for (int dx = -kRadius; dx <= kRadius; ++dx)
+			{
+				const size_t q = static_cast<size_t>(qy) * pass.width + static_cast<size_t>(static_cast<int>(x) + dx * pass.step);
+				SimdFloat qc[3];
+				SimdFloat color_distance = SimdFloat::Broadcast(0.0f);
+				SimdFloat normal_distance = color_distance, albedo_distance = color_distance;
+				for (int k = 0; k < 3; ++k)
+				{
+					qc[k] = SimdFloat::Load(&input[k][q]);
+					const SimdFloat dc = qc[k] - c[k];
+					const SimdFloat dn = SimdFloat::Load(&planes.normal[k][q]) - n[k];
+					const SimdFloat da = SimdFloat::Load(&planes.albedo[k][q]) - a[k];
+					color_distance = color_distance + dc * dc;
+					normal_distance = normal_distance + dn * dn;
+					albedo_distance = albedo_distance + da * da;
+				}
+				const SimdFloat dz = (SimdFloat::Load(&planes.depth[q]) - depth) * depth_weight;
+				const SimdFloat weight = SimdFloat::Broadcast(kKernel[dx + kRadius] * kKernel[dy + kRadius]) * ExpNegative(
+					color_distance * color_weight + normal_distance * normal_weight
+					+ dz * dz + albedo_distance * albedo_weight);
+				for (int k = 0; k < 3; ++k)
+					sum[k] = sum[k] + weight * qc[k];
+				weight_sum = weight_sum + weight;
+			}
+		}
+		for (int k = 0; k < 3; ++k)
+			(sum[k] / weight_sum).Store(&output[k][center]);
+	}
+
+} // namespace
+
+DenoiseSettings::DenoiseSettings()
+: iterations(1)
+, num_samples(1)
+, color_scale(0.012f)
+, color_sigma(1.0f)
+, normal_sigma(0.02f)
+, depth_sigma(0.005f)
+, albedo_sigma(0.01f)
+{
+}
+void DenoiseAtrous(const std::vector<Vec3>& pixels, const DenoiseGuides& guides,
+	unsigned int width, unsigned int height, const DenoiseSettings& settings,
+	unsigned int num_threads, std::vector<Vec3> * output)
+{
+	const size_t size = static_cast<size_t>(width) * height;
+	Planes planes;
+	std::vector<float> colors[2][3];
+	for (int k = 0; k < 3; ++k)
+	{
+		colors[0][k].resize(size);
+		colors[1][k].resize(size);
+		planes.normal[k].resize(size);
+		planes.albedo[k].resize(size);
+	}
+	planes.depth.resize(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			colors[0][k][i] = SanitizeRadiance(pixels[i][k]);
+			planes.normal[k][i] = guides.normals[i][k];
+			planes.albedo[k][i] = guides.albedos[i][k];
+		}
+		planes.depth[i] = std::max(guides.depths[i], kMinDepth);
+	}
+
+	Pass pass;
+	pass.width = width;
+	pass.height = height;
+	pass.normal_weight = 1.0f / (settings.normal_sigma * settings.normal_sigma);
+	pass.albedo_weight = 1.0f / (settings.albedo_sigma * settings.albedo_sigma);
+	pass.inv_depth_sigma = 1.0f / settings.depth_sigma;
+	float color_sigma = settings.color_sigma
+		/ (settings.color_scale * sqrtf(static_cast<float>(std::max(settings.num_samples, 1u))));
+	unsigned int current = 0;
+	for (unsigned int iteration = 0; iteration < settings.iterations; ++iteration)
+	{
+		pass.step = 1 << iteration;
+		pass.color_weight = 1.0f / (color_sigma * color_sigma);
+		color_sigma *= 0.5f;
+		const std::vector<float> * input = colors[current];
+		std::vector<float> * result = colors[1 - current];
+		// Groups of pixels go through SIMD when none of their taps crosses left or right border
+		const unsigned int margin = static_cast<unsigned int>(kRadius * pass.step);
+		ParallelForTiles(width, height, kTileSize, num_threads,
+			[&](unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) {
+			for (unsigned int y = y0; y < y1; ++y)
+			{
+				unsigned int x = x0;
+				for (; x < x1; ++x)
+				{
+					if (x >= margin && x + SimdFloat::kWidth <= x1 && x + SimdFloat::kWidth + margin <= width)
+					{
+						FilterPixels(pass, planes, input, result, x, y);
+						x += SimdFloat::kWidth - 1;
+					}
+					else
+						FilterPixel(pass, planes, input, result, x, y);
+				}
+			}
+		});
+		current = 1 - current;
+	}
+
+	output->resize(size);
+	for (size_t i = 0; i < size; ++i)
+		(*output)[i] = Vec3(colors[current][0][i], colors[current][1][i], colors[current][2][i]);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef __DENOISER_H__
+#define __DENOISER_H__
+
+#include "vec3.h"
+
+#include <vector>
+
+//! Features of primary hits, one per pixel, which tell the denoiser where edges are
+struct DenoiseGuides {
+	std::vector<Vec3> normals; //!< zero for sky
+	std::vector<float> depths; //!< primary hit distance, large for sky
+	std::vector<Vec3> albedos; //!< material color, zero for sky
+};
+
+/**
+ * Edge stopping parameters, larger sigma lets more of the neighbourhood through.
+ * Defaults match the denoise shader of the demo. They are tight, because error of
+ * the Whitted tracer is edge aliasing rather than noise, and any blur of it loses to accumulation.
+ */
+struct DenoiseSettings {
+	DenoiseSettings();
+
+	unsigned int iterations; //!< filter footprint doubles every iteration
+	unsigned int num_samples; //!< accumulated samples, color sigma shrinks with their noise
+	float color_scale; //!< radiance is scaled to exposed range before color differences
+	float color_sigma; //!< halved every iteration, as the image gets smoother
+	float normal_sigma;
+	float depth_sigma; //!< relative to the center pixel depth
+	float albedo_sigma;
+};
+
+/**
+ * Edge avoiding a-trous wavelet filter [Dammertz et al. 2010].
+ * Every iteration applies the 5x5 B3 spline kernel with holes of growing step,
+ * weighted by color, normal, depth and albedo differences to the center pixel.
+ * Rows are processed in SIMD groups of neighbouring pixels, tiles are split between threads.
+ * @param[in] num_threads  Zero means hardware concurrency.
+ */
+void DenoiseAtrous(const std::vector<Vec3>& pixels, const DenoiseGuides& guides,
+	unsigned int width, unsigned int height, const DenoiseSettings& settings,
+	unsigned int num_threads, std::vector<Vec3> * output);
+
+#endif
\ No newline at end of file
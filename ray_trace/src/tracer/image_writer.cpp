@@ -0,0 +1,172 @@
+#include "image_writer.h"
+
+#include <fstream>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+
+namespace {
+
+	const size_t kMaxStoredBlock = 65535;
+
+	std::uint32_t Crc32(const unsigned char * data, size_t size, std::uint32_t crc)
+	{
+		static std::uint32_t table[256] = {0};
+		if (table[1] == 0)
+		{
+			for (std::uint32_t n = 0; n < 256; ++n)
+			{
+				std::uint32_t c = n;
+				for (int k = 0; k < 8; ++k)
+					c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+				table[n] = c;
+			}
+		}
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i)
+			crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+	void PutUint32(std::vector<unsigned char> * buffer, std::uint32_t value)
+	{
+		buffer->push_back(static_cast<unsigned char>(value >> 24));
+		buffer->push_back(static_cast<unsigned char>(value >> 16));
+		buffer->push_back(static_cast<unsigned char>(value >> 8));
+		buffer->push_back(static_cast<unsigned char>(value));
+	}
+	void WriteChunk(std::ofstream& file, const char * type, const std::vector<unsigned char>& data)
+	{
+		std::vector<unsigned char> chunk;
+		chunk.reserve(data.size() + 12);
+		PutUint32(&chunk, static_cast<std::uint32_t>(data.size()));
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		// CRC covers type and data
+		PutUint32(&chunk, Crc32(chunk.data() + 4, chunk.size() - 4, 0));
+		file.write(reinterpret_cast<const char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+	}
+	bool HasExtension(const std::string& filename, const char * extension)
+	{
+		const size_t dot = filename.rfind('.');
+		if (dot == std::string::npos)
+			return false;
+		std::string actual = filename.substr(dot + 1);
+		for (char& c : actual)
+			c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+		return actual == extension;
+	}
+	// Skips whitespace and comments of PPM header
+	bool ReadPpmValue(std::ifstream& file, unsigned int * value)
+	{
+		for (;;)
+		{
+			const int c = file.peek();
+			if (c == '#')
+			{
+				std::string comment;
+				std::getline(file, comment);
+			}
+			else if (c != EOF && isspace(c))
+				file.get();
+			else
+				break;
+		}
+		return static_cast<bool>(file >> *value);
+	}
+
+} // namespace
+
+bool WritePpm(const std::string& filename, unsigned int width, unsigned int height,
+	const std::vector<unsigned char>& rgb)
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write(reinterpret_cast<const char *>(rgb.data()), static_cast<std::streamsize>(width) * height * 3);
+	return static_cast<bool>(file);
+}
+bool WritePng(const std::string& filename, unsigned int width, unsigned int height,
+	const std::vector<unsigned char>& rgb)
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+	static const unsigned char kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	file.write(reinterpret_cast<const char *>(kSignature), sizeof(kSignature));
+
+	std::vector<unsigned char> header;
+	PutUint32(&header, width);
+	PutUint32(&header, height);
+	header.push_back(8); // bit depth
+	header.push_back(2); // truecolor
+	header.push_back(0); // deflate
+	header.push_back(0); // adaptive filtering
+	header.push_back(0); // no interlace
+	WriteChunk(file, "IHDR", header);
+
+	// Scanlines with filter type none
+	const size_t row_size = static_cast<size_t>(width) * 3;
+	std::vector<unsigned char> raw;
+	raw.reserve((row_size + 1) * height);
+	for (unsigned int y = 0; y < height; ++y)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), rgb.begin() + y * row_size, rgb.begin() + (y + 1) * row_size);
+	}
+
+	// Zlib stream of stored blocks
+	std::vector<unsigned char> data;
+	data.reserve(raw.size() + raw.size() / kMaxStoredBlock * 5 + 16);
+	data.push_back(0x78);
+	data.push_back(0x01);
+	std::uint32_t adler_a = 1, adler_b = 0;
+	size_t offset = 0;
+	do
+	{
+		const size_t size = std::min(raw.size() - offset, kMaxStoredBlock);
+		const bool last = (offset + size == raw.size());
+		data.push_back(last ? 1 : 0);
+		data.push_back(static_cast<unsigned char>(size));
+		data.push_back(static_cast<unsigned char>(size >> 8));
+		data.push_back(static_cast<unsigned char>(~size));
+		data.push_back(static_cast<unsigned char>(~size >> 8));
+		for (size_t i = offset; i < offset + size; ++i)
+		{
+			adler_a = (adler_a + raw[i]) % 65521;
+			adler_b = (adler_b + adler_a) % 65521;
+		}
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+		offset += size;
+	}
+	while (offset < raw.size());
+	PutUint32(&data, (adler_b << 16) | adler_a);
+	WriteChunk(file, "IDAT", data);
+	WriteChunk(file, "IEND", std::vector<unsigned char>());
+	return static_cast<bool>(file);
+}
+bool WriteImage(const std::string& filename, unsigned int width, unsigned int height,
+	const std::vector<unsigned char>& rgb)
+{
+	if (HasExtension(filename, "png"))
+		return WritePng(filename, width, height, rgb);
+	return WritePpm(filename, width, height, rgb);
+}
+bool ReadPpm(const std::string& filename, unsigned int * width, unsigned int * height,
+	std::vector<unsigned char> * rgb)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+	char magic[2];
+	if (!file.read(magic, 2) || magic[0] != 'P' || magic[1] != '6')
+		return false;
+	unsigned int max_value;
+	if (!ReadPpmValue(file, width) || !ReadPpmValue(file, height) || !ReadPpmValue(file, &max_value)
+		|| max_value != 255)
+		return false;
+	file.get(); // single whitespace before data
+	rgb->resize(static_cast<size_t>(*width) * *height * 3);
+	file.read(reinterpret_cast<char *>(rgb->data()), static_cast<std::streamsize>(rgb->size()));
+	return static_cast<bool>(file);
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef __IMAGE_WRITER_H__
+#define __IMAGE_WRITER_H__
+
+#include <string>
+#include <vector>
+
+/**
+ * 8 bit RGB image files for the CPU tracer output, rows go from top to bottom.
+ * PNG is written with uncompressed deflate blocks, so no zlib is needed.
+ */
+bool WritePpm(const std::string& filename, unsigned int width, unsigned int height,
+	const std::vector<unsigned char>& rgb);
+bool WritePng(const std::string& filename, unsigned int width, unsigned int height,
+	const std::vector<unsigned char>& rgb);
+//! Picks format by extension, PPM is the default
+bool WriteImage(const std::string& filename, unsigned int width, unsigned int height,
+	const std::vector<unsigned char>& rgb);
+
+//! Reads binary PPM (P6) with 8 bit samples, used for golden image comparison
+bool ReadPpm(const std::string& filename, unsigned int * width, unsigned int * height,
+	std::vector<unsigned char> * rgb);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+: data_(nullptr)
+, size_(0)
+#ifdef _WIN32
+, file_(INVALID_HANDLE_VALUE)
+, mapping_(nullptr)
+#endif
+{
+}
+MappedFile::~MappedFile()
+{
+	Close();
+}
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+#ifdef _WIN32
+	file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_ == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_, &file_size))
+	{
+		Close();
+		return false;
+	}
+	size_ = static_cast<size_t>(file_size.QuadPart);
+	if (size_ == 0)
+		return true; // empty files can't be mapped
+	mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping_)
+	{
+		Close();
+		return false;
+	}
+	data_ = static_cast<const unsigned char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+	if (!data_)
+	{
+		Close();
+		return false;
+	}
+	return true;
+#else
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	size_ = static_cast<size_t>(file_stat.st_size);
+	if (size_ == 0)
+	{
+		close(fd);
+		return true; // empty files can't be mapped
+	}
+	void * address = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // mapping holds its own reference to the file
+	if (address == MAP_FAILED)
+	{
+		size_ = 0;
+		return false;
+	}
+	data_ = static_cast<const unsigned char *>(address);
+	return true;
+#endif
+}
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data_)
+		UnmapViewOfFile(data_);
+	if (mapping_)
+		CloseHandle(mapping_);
+	if (file_ != INVALID_HANDLE_VALUE)
+		CloseHandle(file_);
+	mapping_ = nullptr;
+	file_ = INVALID_HANDLE_VALUE;
+#else
+	if (data_)
+		munmap(const_cast<unsigned char *>(data_), size_);
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
+const unsigned char * MappedFile::data() const
+{
+	return data_;
+}
+size_t MappedFile::size() const
+{
+	return size_;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <string>
+#include <cstddef>
+
+/**
+ * Read only view of a whole file mapped into memory.
+ * Mapping is page aligned, so binary records may be used in place.
+ */
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator =(const MappedFile&) = delete;
+
+	bool Open(const std::string& filename);
+	void Close();
+
+	const unsigned char * data() const; //!< null for empty files
+	size_t size() const;
+
+private:
+	const unsigned char * data_;
+	size_t size_;
+#ifdef _WIN32
+	void * file_; //!< file and mapping handles
+	void * mapping_;
+#endif
+};
+
+#endif
\ No newline at end of file
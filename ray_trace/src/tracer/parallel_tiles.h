@@ -0,0 +1,47 @@
+#ifndef __PARALLEL_TILES_H__
+#define __PARALLEL_TILES_H__
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Calls function(x0, y0, x1, y1) for every tile of the image from a pool of threads.
+ * Tiles are taken from shared counter, so threads that got cheap tiles take more of them.
+ * Zero number of threads means hardware concurrency.
+ */
+template <class Function>
+void ParallelForTiles(unsigned int width, unsigned int height, unsigned int tile_size,
+	unsigned int num_threads, Function function)
+{
+	const unsigned int tiles_x = (width + tile_size - 1) / tile_size;
+	const unsigned int tiles_y = (height + tile_size - 1) / tile_size;
+	const unsigned int num_tiles = tiles_x * tiles_y;
+	if (num_threads == 0)
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	num_threads = std::min(num_threads, std::max(num_tiles, 1u));
+
+	std::atomic<unsigned int> next_tile(0);
+	auto worker = [&]() {
+		for (;;)
+		{
+			const unsigned int tile = next_tile.fetch_add(1);
+			if (tile >= num_tiles)
+				break;
+			const unsigned int x0 = (tile % tiles_x) * tile_size;
+			const unsigned int y0 = (tile / tiles_x) * tile_size;
+			function(x0, y0, std::min(x0 + tile_size, width), std::min(y0 + tile_size, height));
+		}
+	};
+	// Calling thread works too
+	std::vector<std::thread> threads;
+	threads.reserve(num_threads - 1);
+	for (unsigned int i = 1; i < num_threads; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "scene.h"
+#include "mesh_data.h"
+
+#include <cmath>
+
+namespace {
+
+	// Small deterministic generator, so generated scenes are the same on every platform
+	class Random {
+	public:
+		explicit Random(unsigned int seed)
+		: state_(seed)
+		{
+		}
+		float Next()
+		{
+			state_ = state_ * 1664525u + 1013904223u;
+			return static_cast<float>(state_ >> 8) * (1.0f / 16777216.0f);
+		}
+	private:
+		unsigned int state_;
+	};
+
+	//! Orbits the point around the vertical axis and bounces it, speed depends on the index
+	Vec3 AnimatePoint(const Vec3& point, unsigned int index, float time)
+	{
+		const float golden_fraction = 0.618034f;
+		const float phase = static_cast<float>(index) * golden_fraction;
+		const float angle = (0.05f + 0.25f * (phase - floorf(phase))) * time;
+		const float cos_angle = cosf(angle);
+		const float sin_angle = sinf(angle);
+		return Vec3(point.x * cos_angle - point.z * sin_angle,
+			point.y + 0.5f * fabsf(sinf(3.0f * time + phase)),
+			point.x * sin_angle + point.z * cos_angle);
+	}
+
+} // namespace
+
+unsigned int AddMesh(const MeshData& data, Scene * scene)
+{
+	scene->meshes.push_back(TriangleMesh());
+	TriangleMesh& mesh = scene->meshes.back();
+	mesh.positions.reserve(data.vertices.size());
+	for (const MeshVertex& vertex : data.vertices)
+		mesh.positions.push_back(Vec3(vertex.position[0], vertex.position[1], vertex.position[2]));
+	mesh.indices = data.indices;
+	return static_cast<unsigned int>(scene->meshes.size() - 1);
+}
+void CreateDefaultScene(Scene * scene)
+{
+	scene->materials.clear();
+	scene->materials.push_back(Material{Vec3(0.5f, 0.4f, 0.3f), 0.02f, kOpaqueMaterial});
+	scene->materials.push_back(Material{Vec3(0.5f), 0.02f, kGlassMaterial});
+	scene->materials.push_back(Material{Vec3(0.5f, 0.9f, 0.0f), 0.02f, kGlassMaterial});
+	scene->planes.assign(1, Plane{Vec3(0.0f, 1.0f, 0.0f), 1.0f, 0});
+	scene->spheres.assign(1, Sphere{Vec3(0.0f), 1.0f, 1});
+	scene->boxes.assign(1, Box{Vec3(-1.0f, -1.0f, 2.5f), Vec3(1.0f, 1.0f, 3.0f), 2});
+	scene->meshes.clear();
+	scene->instances.clear();
+	scene->lights.assign(1, DirectionalLight{Vec3(1e3f), Normalize(Vec3(1.0f, 0.5f, 0.5f))});
+}
+void CreateFieldScene(Scene * scene, unsigned int num_primitives)
+{
+	CreateDefaultScene(scene);
+	// Boxes keep the glass of the default scene
+	const unsigned int box_material = scene->boxes.front().material;
+	scene->spheres.clear();
+	scene->boxes.clear();
+	// Opaque spheres keep bounce count sane with thousands of objects
+	const unsigned int sphere_material = static_cast<unsigned int>(scene->materials.size());
+	scene->materials.push_back(Material{Vec3(0.8f, 0.3f, 0.2f), 0.04f, kOpaqueMaterial});
+
+	const float kGround = -1.0f; // plane height
+	const float kSpacing = 1.5f;
+	const unsigned int side = static_cast<unsigned int>(ceilf(sqrtf(static_cast<float>(num_primitives))));
+	const float half_extent = 0.5f * kSpacing * static_cast<float>(side);
+	Random random(num_primitives);
+	for (unsigned int i = 0; i < num_primitives; ++i)
+	{
+		const float x = (static_cast<float>(i % side) + random.Next()) * kSpacing - half_extent;
+		const float z = (static_cast<float>(i / side) + random.Next()) * kSpacing - half_extent;
+		const float size = 0.15f + 0.35f * random.Next();
+		if (random.Next() < 0.5f)
+		{
+			scene->spheres.push_back(Sphere{Vec3(x, kGround + size, z), size, sphere_material});
+		}
+		else
+		{
+			const float height = size * (1.0f + 2.0f * random.Next());
+			scene->boxes.push_back(Box{Vec3(x - size, kGround, z - size), Vec3(x + size, kGround + height, z + size), box_material});
+		}
+	}
+}
+void AnimateScene(const Scene& rest, float time, Scene * scene)
+{
+	unsigned int index = 0;
+	for (size_t i = 0; i < rest.spheres.size(); ++i, ++index)
+		scene->spheres[i].position = AnimatePoint(rest.spheres[i].position, index, time);
+	for (size_t i = 0; i < rest.boxes.size(); ++i, ++index)
+	{
+		// Boxes are translated by their centers and stay axis aligned
+		const Box& box = rest.boxes[i];
+		const Vec3 center = (box.min + box.max) * 0.5f;
+		const Vec3 offset = AnimatePoint(center, index, time) - center;
+		scene->boxes[i].min = box.min + offset;
+		scene->boxes[i].max = box.max + offset;
+	}
+	for (size_t i = 0; i < rest.instances.size(); ++i, ++index)
+		scene->instances[i].position = AnimatePoint(rest.instances[i].position, index, time);
+}
\ No newline at end of file
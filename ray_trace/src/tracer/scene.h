@@ -0,0 +1,88 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include "vec3.h"
+
+#include <vector>
+
+class MeshData;
+
+/**
+ * Scene model of raytrace.fs, structures follow the shader ones.
+ */
+enum MaterialType : int {
+	kOpaqueMaterial = 0, //!< diffuse with fresnel reflection
+	kGlassMaterial = 1 //!< reflection and refraction
+};
+
+struct Material {
+	Vec3 color; //!< diffuse color
+	float f0; //!< specular color (monochrome)
+	int type; //!< MaterialType
+};
+struct Plane {
+	Vec3 normal; //!< (a,b,c)
+	float d; //!< solution to dot(n,p)+d=0
+	unsigned int material; //!< index in scene materials
+};
+struct Sphere {
+	Vec3 position;
+	float radius;
+	unsigned int material;
+};
+struct Box {
+	Vec3 min;
+	Vec3 max;
+	unsigned int material;
+};
+/**
+ * Indexed triangle list in object space, counter-clockwise triangles face outside.
+ * Closed meshes may have glass material, since refraction relies on normal orientation.
+ */
+struct TriangleMesh {
+	std::vector<Vec3> positions;
+	std::vector<unsigned int> indices; //!< three per triangle
+};
+//! Mesh placed in the scene, scale is uniform so normals need no transform
+struct MeshInstance {
+	Vec3 position;
+	float scale;
+	unsigned int mesh; //!< index in scene meshes
+	unsigned int material;
+};
+struct DirectionalLight {
+	Vec3 color;
+	Vec3 direction; //!< towards the light
+};
+
+struct Scene {
+	std::vector<Material> materials;
+	std::vector<Plane> planes;
+	std::vector<Sphere> spheres;
+	std::vector<Box> boxes;
+	std::vector<TriangleMesh> meshes;
+	std::vector<MeshInstance> instances;
+	std::vector<DirectionalLight> lights; //!< each one lights the scene and adds a sun to the sky
+};
+
+/**
+ * Adds triangles of the mesh data to the scene meshes, other vertex attributes are dropped.
+ * @return Index of the new mesh.
+ */
+unsigned int AddMesh(const MeshData& data, Scene * scene);
+
+//! Scene that the demo has always shown: ground plane, glass sphere and glass box
+void CreateDefaultScene(Scene * scene);
+/**
+ * Ground plane with spheres and boxes of varying size scattered on a square field,
+ * used to stress acceleration structures. Layout depends only on the count.
+ */
+void CreateFieldScene(Scene * scene, unsigned int num_primitives);
+/**
+ * Moves spheres, boxes and mesh instances of the rest scene along orbits around the vertical axis
+ * with bouncing, orbit speeds differ, so primitives drift apart from their initial neighbours.
+ * Scene should be a copy of the rest scene, only positions are written.
+ */
+void AnimateScene(const Scene& rest, float time, Scene * scene);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,515 @@
+#include "scene_file.h"
+#include "mapped_file.h"
+#include "mesh_data.h"
+
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+	const std::uint32_t kRecordSizes = static_cast<std::uint32_t>(
+		sizeof(scene_file::MaterialRecord) + sizeof(scene_file::PlaneRecord) + sizeof(scene_file::SphereRecord)
+		+ sizeof(scene_file::BoxRecord) + sizeof(scene_file::MeshRecord) + sizeof(scene_file::InstanceRecord)
+		+ sizeof(scene_file::LightRecord));
+	//! Limit of slices times loops of generated sphere meshes, keeps bad input from exhausting memory
+	const std::int64_t kMaxSphereSegments = 1 << 20;
+
+	std::string Format(const char * format, ...)
+	{
+		char buffer[256];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+		return buffer;
+	}
+	bool ReadVector(std::istringstream& stream, Vec3 * vector)
+	{
+		return static_cast<bool>(stream >> vector->x >> vector->y >> vector->z);
+	}
+	size_t AlignOffset(size_t offset)
+	{
+		return (offset + sizeof(std::uint64_t) - 1) & ~(sizeof(std::uint64_t) - 1);
+	}
+	Vec3 ToVec3(const float * values)
+	{
+		return Vec3(values[0], values[1], values[2]);
+	}
+	void FromVec3(const Vec3& vector, float * values)
+	{
+		values[0] = vector.x;
+		values[1] = vector.y;
+		values[2] = vector.z;
+	}
+
+	bool ParseText(const char * data, size_t size, const std::string& filename, Scene * scene, std::string * error)
+	{
+		*scene = Scene();
+		std::unordered_map<std::string, unsigned int> material_indices;
+		std::unordered_map<std::string, unsigned int> mesh_indices;
+		std::vector<MeshData> meshes; //!< converted after parsing, since shapes may be appended to them
+		unsigned int line_number = 0;
+		const char * end = data + size;
+		while (data < end)
+		{
+			const char * line_end = static_cast<const char *>(memchr(data, '\n', static_cast<size_t>(end - data)));
+			if (!line_end)
+				line_end = end;
+			std::string line(data, line_end);
+			data = line_end + 1;
+			++line_number;
+
+			const size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.resize(comment);
+			std::istringstream stream(line);
+			std::string keyword;
+			if (!(stream >> keyword))
+				continue; // empty line
+
+			// Primitives and instances end with material name
+			bool parsed = false;
+			std::string material_name;
+			if (keyword == "material")
+			{
+				Material material;
+				std::string name, type;
+				parsed = (stream >> name) && ReadVector(stream, &material.color) && (stream >> material.f0 >> type);
+				if (parsed)
+				{
+					if (type == "opaque")
+						material.type = kOpaqueMaterial;
+					else if (type == "glass")
+						material.type = kGlassMaterial;
+					else
+					{
+						*error = Format("%s:%u: unknown material type '%s'", filename.c_str(), line_number, type.c_str());
+						return false;
+					}
+					if (!material_indices.emplace(name, static_cast<unsigned int>(scene->materials.size())).second)
+					{
+						*error = Format("%s:%u: material '%s' is already defined", filename.c_str(), line_number, name.c_str());
+						return false;
+					}
+					scene->materials.push_back(material);
+				}
+			}
+			else if (keyword == "plane")
+			{
+				Plane plane;
+				parsed = ReadVector(stream, &plane.normal) && (stream >> plane.d >> material_name)
+					&& Dot(plane.normal, plane.normal) > 0.0f;
+				if (parsed)
+				{
+					// Plane equation is scaled with the normal
+					const float length = Length(plane.normal);
+					plane.normal = plane.normal / length;
+					plane.d /= length;
+					scene->planes.push_back(plane);
+				}
+			}
+			else if (keyword == "sphere")
+			{
+				Sphere sphere;
+				parsed = ReadVector(stream, &sphere.position) && (stream >> sphere.radius >> material_name)
+					&& sphere.radius > 0.0f;
+				if (parsed)
+					scene->spheres.push_back(sphere);
+			}
+			else if (keyword == "box")
+			{
+				Box box;
+				parsed = ReadVector(stream, &box.min) && ReadVector(stream, &box.max) && (stream >> material_name)
+					&& box.min.x < box.max.x && box.min.y < box.max.y && box.min.z < box.max.z;
+				if (parsed)
+					scene->boxes.push_back(box);
+			}
+			else if (keyword == "mesh")
+			{
+				std::string name, shape;
+				parsed = static_cast<bool>(stream >> name >> shape);
+				if (parsed)
+				{
+					auto it = mesh_indices.emplace(name, static_cast<unsigned int>(meshes.size())).first;
+					if (it->second == meshes.size())
+						meshes.push_back(MeshData());
+					MeshData& mesh = meshes[it->second];
+					if (shape == "sphere")
+					{
+						// Counts are read signed, unsigned extraction silently wraps negative numbers
+						float radius;
+						int slices, loops;
+						parsed = (stream >> radius >> slices >> loops) && radius > 0.0f && slices >= 3 && loops >= 2
+							&& static_cast<std::int64_t>(slices) * loops <= kMaxSphereSegments;
+						if (parsed)
+							mesh.CreateSphere(radius, static_cast<unsigned int>(slices), static_cast<unsigned int>(loops));
+					}
+					else if (shape == "box")
+					{
+						Vec3 size, center;
+						parsed = ReadVector(stream, &size) && ReadVector(stream, &center)
+							&& size.x > 0.0f && size.y > 0.0f && size.z > 0.0f;
+						if (parsed)
+						{
+							const float center_values[3] = {center.x, center.y, center.z};
+							mesh.CreatePhysicalBox(size.x, size.y, size.z, 1.0f, 1.0f, center_values);
+						}
+					}
+					else if (shape == "tetrahedron")
+						mesh.CreateTetrahedron();
+					else
+					{
+						*error = Format("%s:%u: unknown mesh shape '%s'", filename.c_str(), line_number, shape.c_str());
+						return false;
+					}
+				}
+			}
+			else if (keyword == "instance")
+			{
+				MeshInstance instance;
+				std::string mesh_name;
+				parsed = (stream >> mesh_name) && ReadVector(stream, &instance.position)
+					&& (stream >> instance.scale >> material_name) && instance.scale > 0.0f;
+				if (parsed)
+				{
+					auto it = mesh_indices.find(mesh_name);
+					if (it == mesh_indices.end())
+					{
+						*error = Format("%s:%u: unknown mesh '%s'", filename.c_str(), line_number, mesh_name.c_str());
+						return false;
+					}
+					instance.mesh = it->second;
+					scene->instances.push_back(instance);
+				}
+			}
+			else if (keyword == "light")
+			{
+				DirectionalLight light;
+				parsed = ReadVector(stream, &light.color) && ReadVector(stream, &light.direction)
+					&& Dot(light.direction, light.direction) > 0.0f;
+				if (parsed)
+				{
+					light.direction = Normalize(light.direction);
+					scene->lights.push_back(light);
+				}
+			}
+			else
+			{
+				*error = Format("%s:%u: unknown statement '%s'", filename.c_str(), line_number, keyword.c_str());
+				return false;
+			}
+			std::string extra;
+			if (!parsed || (stream >> extra))
+			{
+				*error = Format("%s:%u: invalid %s", filename.c_str(), line_number, keyword.c_str());
+				return false;
+			}
+			if (material_name.empty())
+				continue;
+			auto it = material_indices.find(material_name);
+			if (it == material_indices.end())
+			{
+				*error = Format("%s:%u: unknown material '%s'", filename.c_str(), line_number, material_name.c_str());
+				return false;
+			}
+			if (keyword == "plane")
+				scene->planes.back().material = it->second;
+			else if (keyword == "sphere")
+				scene->spheres.back().material = it->second;
+			else if (keyword == "box")
+				scene->boxes.back().material = it->second;
+			else
+				scene->instances.back().material = it->second;
+		}
+		for (const MeshData& mesh : meshes)
+			AddMesh(mesh, scene);
+		return true;
+	}
+	bool ParseBinary(const unsigned char * data, size_t size, const std::string& filename, Scene * scene, std::string * error)
+	{
+		using namespace scene_file;
+		if (size < sizeof(Header))
+		{
+			*error = Format("'%s' is not a binary scene", filename.c_str());
+			return false;
+		}
+		const Header * header = reinterpret_cast<const Header *>(data);
+		if (header->magic != kMagic)
+		{
+			*error = Format("'%s' is not a binary scene", filename.c_str());
+			return false;
+		}
+		if (header->version != kVersion || header->record_sizes != kRecordSizes)
+		{
+			*error = Format("unsupported scene version %u", header->version);
+			return false;
+		}
+		// Written without sums, offsets near 2^64 would wrap them past the size check
+		auto is_valid_range = [size](std::uint64_t offset, std::uint32_t count, size_t record_size, size_t alignment) {
+			return offset >= sizeof(Header) && (offset % alignment) == 0 && offset <= size
+				&& count <= (size - offset) / record_size;
+		};
+		if (!is_valid_range(header->materials_offset, header->num_materials, sizeof(MaterialRecord), alignof(MaterialRecord))
+			|| !is_valid_range(header->planes_offset, header->num_planes, sizeof(PlaneRecord), alignof(PlaneRecord))
+			|| !is_valid_range(header->spheres_offset, header->num_spheres, sizeof(SphereRecord), alignof(SphereRecord))
+			|| !is_valid_range(header->boxes_offset, header->num_boxes, sizeof(BoxRecord), alignof(BoxRecord))
+			|| !is_valid_range(header->meshes_offset, header->num_meshes, sizeof(MeshRecord), alignof(MeshRecord))
+			|| !is_valid_range(header->instances_offset, header->num_instances, sizeof(InstanceRecord), alignof(InstanceRecord))
+			|| !is_valid_range(header->lights_offset, header->num_lights, sizeof(LightRecord), alignof(LightRecord))
+			|| !is_valid_range(header->positions_offset, header->num_positions, sizeof(float) * 3, alignof(float))
+			|| !is_valid_range(header->indices_offset, header->num_indices, sizeof(std::uint32_t), alignof(std::uint32_t)))
+		{
+			*error = Format("'%s' is truncated", filename.c_str());
+			return false;
+		}
+		const MaterialRecord * materials = reinterpret_cast<const MaterialRecord *>(data + header->materials_offset);
+		const PlaneRecord * planes = reinterpret_cast<const PlaneRecord *>(data + header->planes_offset);
+		const SphereRecord * spheres = reinterpret_cast<const SphereRecord *>(data + header->spheres_offset);
+		const BoxRecord * boxes = reinterpret_cast<const BoxRecord *>(data + header->boxes_offset);
+		const MeshRecord * meshes = reinterpret_cast<const MeshRecord *>(data + header->meshes_offset);
+		const InstanceRecord * instances = reinterpret_cast<const InstanceRecord *>(data + header->instances_offset);
+		const LightRecord * lights = reinterpret_cast<const LightRecord *>(data + header->lights_offset);
+		const float * positions = reinterpret_cast<const float *>(data + header->positions_offset);
+		const std::uint32_t * indices = reinterpret_cast<const std::uint32_t *>(data + header->indices_offset);
+
+		// Shader indexes materials without checks, so every reference is validated here
+		for (std::uint32_t i = 0; i < header->num_materials; ++i)
+			if (materials[i].type > kGlassMaterial)
+			{
+				*error = Format("invalid material record %u", i);
+				return false;
+			}
+		const std::uint32_t num_materials = header->num_materials;
+		for (std::uint32_t i = 0; i < header->num_planes; ++i)
+			if (planes[i].material >= num_materials || !(Dot(ToVec3(planes[i].normal), ToVec3(planes[i].normal)) > 0.0f))
+			{
+				*error = Format("invalid plane record %u", i);
+				return false;
+			}
+		for (std::uint32_t i = 0; i < header->num_spheres; ++i)
+			if (spheres[i].material >= num_materials || !(spheres[i].radius > 0.0f))
+			{
+				*error = Format("invalid sphere record %u", i);
+				return false;
+			}
+		for (std::uint32_t i = 0; i < header->num_boxes; ++i)
+			if (boxes[i].material >= num_materials || !(boxes[i].min[0] < boxes[i].max[0])
+				|| !(boxes[i].min[1] < boxes[i].max[1]) || !(boxes[i].min[2] < boxes[i].max[2]))
+			{
+				*error = Format("invalid box record %u", i);
+				return false;
+			}
+		for (std::uint32_t i = 0; i < header->num_meshes; ++i)
+		{
+			const MeshRecord& mesh = meshes[i];
+			bool is_valid = static_cast<std::uint64_t>(mesh.first_position) + mesh.num_positions <= header->num_positions
+				&& static_cast<std::uint64_t>(mesh.first_index) + mesh.num_indices <= header->num_indices
+				&& (mesh.num_indices % 3) == 0;
+			for (std::uint32_t k = 0; is_valid && k < mesh.num_indices; ++k)
+				is_valid = indices[mesh.first_index + k] < mesh.num_positions;
+			if (!is_valid)
+			{
+				*error = Format("invalid mesh record %u", i);
+				return false;
+			}
+		}
+		for (std::uint32_t i = 0; i < header->num_instances; ++i)
+			if (instances[i].mesh >= header->num_meshes || instances[i].material >= num_materials
+				|| !(instances[i].scale > 0.0f))
+			{
+				*error = Format("invalid instance record %u", i);
+				return false;
+			}
+
+		scene->materials.resize(header->num_materials);
+		for (std::uint32_t i = 0; i < header->num_materials; ++i)
+			scene->materials[i] = Material{ToVec3(materials[i].color), materials[i].f0, static_cast<int>(materials[i].type)};
+		scene->planes.resize(header->num_planes);
+		for (std::uint32_t i = 0; i < header->num_planes; ++i)
+			scene->planes[i] = Plane{ToVec3(planes[i].normal), planes[i].d, planes[i].material};
+		scene->spheres.resize(header->num_spheres);
+		for (std::uint32_t i = 0; i < header->num_spheres; ++i)
+			scene->spheres[i] = Sphere{ToVec3(spheres[i].position), spheres[i].radius, spheres[i].material};
+		scene->boxes.resize(header->num_boxes);
+		for (std::uint32_t i = 0; i < header->num_boxes; ++i)
+			scene->boxes[i] = Box{ToVec3(boxes[i].min), ToVec3(boxes[i].max), boxes[i].material};
+		scene->meshes.resize(header->num_meshes);
+		for (std::uint32_t i = 0; i < header->num_meshes; ++i)
+		{
+			const MeshRecord& record = meshes[i];
+			TriangleMesh& mesh = scene->meshes[i];
+			mesh.positions.resize(record.num_positions);
+			for (std::uint32_t k = 0; k < record.num_positions; ++k)
+				mesh.positions[k] = ToVec3(positions + (record.first_position + k) * 3);
+			mesh.indices.assign(indices + record.first_index, indices + record.first_index + record.num_indices);
+		}
+		scene->instances.resize(header->num_instances);
+		for (std::uint32_t i = 0; i < header->num_instances; ++i)
+			scene->instances[i] = MeshInstance{ToVec3(instances[i].position), instances[i].scale,
+				instances[i].mesh, instances[i].material};
+		scene->lights.resize(header->num_lights);
+		for (std::uint32_t i = 0; i < header->num_lights; ++i)
+			scene->lights[i] = DirectionalLight{ToVec3(lights[i].color), ToVec3(lights[i].direction)};
+		return true;
+	}
+
+} // namespace
+
+bool ReadSceneText(const std::string& filename, Scene * scene, std::string * error)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		*error = Format("can't open '%s'", filename.c_str());
+		return false;
+	}
+	return ParseText(reinterpret_cast<const char *>(file.data()), file.size(), filename, scene, error);
+}
+bool ReadSceneBinary(const std::string& filename, Scene * scene, std::string * error)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		*error = Format("can't open '%s'", filename.c_str());
+		return false;
+	}
+	return ParseBinary(file.data(), file.size(), filename, scene, error);
+}
+bool WriteSceneBinary(const std::string& filename, const Scene& scene, std::string * error)
+{
+	using namespace scene_file;
+	const size_t materials_offset = AlignOffset(sizeof(Header));
+	const size_t planes_offset = AlignOffset(materials_offset + scene.materials.size() * sizeof(MaterialRecord));
+	const size_t spheres_offset = AlignOffset(planes_offset + scene.planes.size() * sizeof(PlaneRecord));
+	size_t num_positions = 0, num_indices = 0;
+	for (const TriangleMesh& mesh : scene.meshes)
+	{
+		num_positions += mesh.positions.size();
+		num_indices += mesh.indices.size();
+	}
+	const size_t boxes_offset = AlignOffset(spheres_offset + scene.spheres.size() * sizeof(SphereRecord));
+	const size_t meshes_offset = AlignOffset(boxes_offset + scene.boxes.size() * sizeof(BoxRecord));
+	const size_t instances_offset = AlignOffset(meshes_offset + scene.meshes.size() * sizeof(MeshRecord));
+	const size_t lights_offset = AlignOffset(instances_offset + scene.instances.size() * sizeof(InstanceRecord));
+	const size_t positions_offset = AlignOffset(lights_offset + scene.lights.size() * sizeof(LightRecord));
+	const size_t indices_offset = AlignOffset(positions_offset + num_positions * sizeof(float) * 3);
+	const size_t size = indices_offset + num_indices * sizeof(std::uint32_t);
+	std::vector<std::uint64_t> image(AlignOffset(size) / sizeof(std::uint64_t), 0); // 8 byte elements keep records aligned
+	unsigned char * data = reinterpret_cast<unsigned char *>(image.data());
+
+	Header * header = reinterpret_cast<Header *>(data);
+	header->magic = kMagic;
+	header->version = kVersion;
+	header->num_materials = static_cast<std::uint32_t>(scene.materials.size());
+	header->num_planes = static_cast<std::uint32_t>(scene.planes.size());
+	header->num_spheres = static_cast<std::uint32_t>(scene.spheres.size());
+	header->num_boxes = static_cast<std::uint32_t>(scene.boxes.size());
+	header->num_meshes = static_cast<std::uint32_t>(scene.meshes.size());
+	header->num_instances = static_cast<std::uint32_t>(scene.instances.size());
+	header->num_lights = static_cast<std::uint32_t>(scene.lights.size());
+	header->num_positions = static_cast<std::uint32_t>(num_positions);
+	header->num_indices = static_cast<std::uint32_t>(num_indices);
+	header->record_sizes = kRecordSizes;
+	header->materials_offset = materials_offset;
+	header->planes_offset = planes_offset;
+	header->spheres_offset = spheres_offset;
+	header->boxes_offset = boxes_offset;
+	header->meshes_offset = meshes_offset;
+	header->instances_offset = instances_offset;
+	header->lights_offset = lights_offset;
+	header->positions_offset = positions_offset;
+	header->indices_offset = indices_offset;
+
+	MaterialRecord * materials = reinterpret_cast<MaterialRecord *>(data + materials_offset);
+	for (size_t i = 0; i < scene.materials.size(); ++i)
+	{
+		FromVec3(scene.materials[i].color, materials[i].color);
+		materials[i].f0 = scene.materials[i].f0;
+		materials[i].type = static_cast<std::uint32_t>(scene.materials[i].type);
+	}
+	PlaneRecord * planes = reinterpret_cast<PlaneRecord *>(data + planes_offset);
+	for (size_t i = 0; i < scene.planes.size(); ++i)
+	{
+		FromVec3(scene.planes[i].normal, planes[i].normal);
+		planes[i].d = scene.planes[i].d;
+		planes[i].material = scene.planes[i].material;
+	}
+	SphereRecord * spheres = reinterpret_cast<SphereRecord *>(data + spheres_offset);
+	for (size_t i = 0; i < scene.spheres.size(); ++i)
+	{
+		FromVec3(scene.spheres[i].position, spheres[i].position);
+		spheres[i].radius = scene.spheres[i].radius;
+		spheres[i].material = scene.spheres[i].material;
+	}
+	BoxRecord * boxes = reinterpret_cast<BoxRecord *>(data + boxes_offset);
+	for (size_t i = 0; i < scene.boxes.size(); ++i)
+	{
+		FromVec3(scene.boxes[i].min, boxes[i].min);
+		FromVec3(scene.boxes[i].max, boxes[i].max);
+		boxes[i].material = scene.boxes[i].material;
+	}
+	MeshRecord * meshes = reinterpret_cast<MeshRecord *>(data + meshes_offset);
+	float * positions = reinterpret_cast<float *>(data + positions_offset);
+	std::uint32_t * indices = reinterpret_cast<std::uint32_t *>(data + indices_offset);
+	std::uint32_t first_position = 0, first_index = 0;
+	for (size_t i = 0; i < scene.meshes.size(); ++i)
+	{
+		const TriangleMesh& mesh = scene.meshes[i];
+		meshes[i].first_position = first_position;
+		meshes[i].num_positions = static_cast<std::uint32_t>(mesh.positions.size());
+		meshes[i].first_index = first_index;
+		meshes[i].num_indices = static_cast<std::uint32_t>(mesh.indices.size());
+		for (const Vec3& position : mesh.positions)
+			FromVec3(position, positions + (first_position++) * 3);
+		for (unsigned int index : mesh.indices)
+			indices[first_index++] = index;
+	}
+	InstanceRecord * instances = reinterpret_cast<InstanceRecord *>(data + instances_offset);
+	for (size_t i = 0; i < scene.instances.size(); ++i)
+	{
+		FromVec3(scene.instances[i].position, instances[i].position);
+		instances[i].scale = scene.instances[i].scale;
+		instances[i].mesh = scene.instances[i].mesh;
+		instances[i].material = scene.instances[i].material;
+	}
+	LightRecord * lights = reinterpret_cast<LightRecord *>(data + lights_offset);
+	for (size_t i = 0; i < scene.lights.size(); ++i)
+	{
+		FromVec3(scene.lights[i].color, lights[i].color);
+		FromVec3(scene.lights[i].direction, lights[i].direction);
+	}
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		*error = Format("can't open '%s' for writing", filename.c_str());
+		return false;
+	}
+	file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+	if (!file)
+	{
+		*error = Format("failed to write '%s'", filename.c_str());
+		return false;
+	}
+	return true;
+}
+bool ReadSceneFile(const std::string& filename, Scene * scene, std::string * error)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		*error = Format("can't open '%s'", filename.c_str());
+		return false;
+	}
+	std::uint32_t magic = 0;
+	if (file.size() >= sizeof(magic))
+		memcpy(&magic, file.data(), sizeof(magic));
+	if (magic == scene_file::kMagic)
+		return ParseBinary(file.data(), file.size(), filename, scene, error);
+	return ParseText(reinterpret_cast<const char *>(file.data()), file.size(), filename, scene, error);
+}
\ No newline at end of file
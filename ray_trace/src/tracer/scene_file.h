@@ -0,0 +1,121 @@
+#ifndef __SCENE_FILE_H__
+#define __SCENE_FILE_H__
+
+#include "scene.h"
+
+#include <string>
+#include <cstdint>
+
+/**
+ * Binary scene layout, all values are little endian and naturally aligned,
+ * so the file can be mapped into memory and records used in place:
+ * header | materials | planes | spheres | boxes | meshes | instances | lights | positions | indices.
+ * Meshes refer to ranges of the shared position and index arrays, indices are relative to the mesh range.
+ */
+namespace scene_file {
+
+	const std::uint32_t kMagic = 0x4E435352; //!< 'RSCN'
+	const std::uint32_t kVersion = 2;
+
+	struct Header {
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t num_materials;
+		std::uint32_t num_planes;
+		std::uint32_t num_spheres;
+		std::uint32_t num_boxes;
+		std::uint32_t num_meshes;
+		std::uint32_t num_instances;
+		std::uint32_t num_lights;
+		std::uint32_t num_positions; //!< total of all meshes
+		std::uint32_t num_indices;
+		std::uint32_t record_sizes; //!< sum of record sizes, guards against layout changes without version bump
+		std::uint64_t materials_offset; //!< in bytes from the beginning of file
+		std::uint64_t planes_offset;
+		std::uint64_t spheres_offset;
+		std::uint64_t boxes_offset;
+		std::uint64_t meshes_offset;
+		std::uint64_t instances_offset;
+		std::uint64_t lights_offset;
+		std::uint64_t positions_offset; //!< three floats per position
+		std::uint64_t indices_offset; //!< 32 bit indices, three per triangle
+	};
+
+	struct MaterialRecord {
+		float color[3];
+		float f0;
+		std::uint32_t type; //!< MaterialType
+	};
+
+	struct PlaneRecord {
+		float normal[3];
+		float d;
+		std::uint32_t material; //!< index in material records
+	};
+
+	struct SphereRecord {
+		float position[3];
+		float radius;
+		std::uint32_t material;
+	};
+
+	struct BoxRecord {
+		float min[3];
+		float max[3];
+		std::uint32_t material;
+	};
+
+	struct MeshRecord {
+		std::uint32_t first_position;
+		std::uint32_t num_positions;
+		std::uint32_t first_index;
+		std::uint32_t num_indices;
+	};
+
+	struct InstanceRecord {
+		float position[3];
+		float scale;
+		std::uint32_t mesh; //!< index in mesh records
+		std::uint32_t material;
+	};
+
+	struct LightRecord {
+		float color[3];
+		float direction[3]; //!< towards the light, normalized
+	};
+
+	static_assert(sizeof(Header) == 120, "Scene header should have no padding");
+	static_assert(sizeof(MaterialRecord) == 20, "Material record should have no padding");
+	static_assert(sizeof(PlaneRecord) == 20, "Plane record should have no padding");
+	static_assert(sizeof(SphereRecord) == 20, "Sphere record should have no padding");
+	static_assert(sizeof(BoxRecord) == 28, "Box record should have no padding");
+	static_assert(sizeof(MeshRecord) == 16, "Mesh record should have no padding");
+	static_assert(sizeof(InstanceRecord) == 24, "Instance record should have no padding");
+	static_assert(sizeof(LightRecord) == 24, "Light record should have no padding");
+
+} // namespace scene_file
+
+/**
+ * Text scene format, one statement per line, '#' starts a comment:
+ *   material <name> <r> <g> <b> <f0> <opaque|glass>
+ *   plane <nx> <ny> <nz> <d> <material name>
+ *   sphere <x> <y> <z> <radius> <material name>
+ *   box <min x> <min y> <min z> <max x> <max y> <max z> <material name>
+ *   mesh <name> sphere <radius> <slices> <loops>
+ *   mesh <name> box <half x> <half y> <half z> <center x> <center y> <center z>
+ *   mesh <name> tetrahedron
+ *   instance <mesh name> <x> <y> <z> <scale> <material name>
+ *   light <r> <g> <b> <dx> <dy> <dz>
+ * Mesh shapes are generated by MeshData, statements with the same mesh name are merged into one mesh.
+ * Materials and meshes should be declared before use, normals and light directions are normalized.
+ */
+bool ReadSceneText(const std::string& filename, Scene * scene, std::string * error);
+
+//! Maps the binary file, records are validated before the scene is filled
+bool ReadSceneBinary(const std::string& filename, Scene * scene, std::string * error);
+bool WriteSceneBinary(const std::string& filename, const Scene& scene, std::string * error);
+
+//! Reads binary or text scene depending on the file magic
+bool ReadSceneFile(const std::string& filename, Scene * scene, std::string * error);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include "shader_permutation.h"
+
+#include <tuple>
+
+bool ShaderPermutation::operator <(const ShaderPermutation& other) const
+{
+	return std::tie(num_planes, num_lights, max_depth, max_traced_rays)
+		< std::tie(other.num_planes, other.num_lights, other.max_depth, other.max_traced_rays);
+}
+bool ShaderPermutation::operator ==(const ShaderPermutation& other) const
+{
+	return num_planes == other.num_planes && num_lights == other.num_lights
+		&& max_depth == other.max_depth && max_traced_rays == other.max_traced_rays;
+}
+int TracedRayBudget(const Scene& scene, int max_depth)
+{
+	bool has_glass = false;
+	for (const Material& material : scene.materials)
+		has_glass = has_glass || (material.type == kGlassMaterial);
+	// Spawning checks keep one free slot per spawned ray, so the last bounce needs one more
+	if (has_glass)
+		return 2 << max_depth;
+	return max_depth + 2;
+}
+ShaderPermutation MakeGenericPermutation(int max_depth, int max_traced_rays)
+{
+	ShaderPermutation permutation;
+	permutation.num_planes = -1;
+	permutation.num_lights = -1;
+	permutation.max_depth = max_depth;
+	permutation.max_traced_rays = max_traced_rays;
+	return permutation;
+}
+ShaderPermutation MakeSpecializedPermutation(const Scene& scene, int max_depth)
+{
+	ShaderPermutation permutation;
+	permutation.num_planes = static_cast<int>(scene.planes.size());
+	permutation.num_lights = static_cast<int>(scene.lights.size());
+	permutation.max_depth = max_depth;
+	permutation.max_traced_rays = TracedRayBudget(scene, max_depth);
+	return permutation;
+}
+std::vector<std::string> MakeShaderDefines(const ShaderPermutation& permutation)
+{
+	std::vector<std::string> defines;
+	defines.push_back("#define MAX_DEPTH " + std::to_string(permutation.max_depth));
+	defines.push_back("#define MAX_TRACED_RAYS " + std::to_string(permutation.max_traced_rays));
+	if (permutation.num_planes >= 0)
+		defines.push_back("#define NUM_PLANES " + std::to_string(permutation.num_planes));
+	if (permutation.num_lights >= 0)
+		defines.push_back("#define NUM_LIGHTS " + std::to_string(permutation.num_lights));
+	return defines;
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef __SHADER_PERMUTATION_H__
+#define __SHADER_PERMUTATION_H__
+
+#include "scene.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Compile time configuration of raytrace.fs.
+ * Generic permutation reads plane and light counts from uniforms and sizes ray list for the deepest tree,
+ * scene specialized one has the counts as constants, so the loops unroll, and ray list as small as
+ * the scene bounce tree allows. Both render the same image.
+ */
+struct ShaderPermutation {
+	int num_planes; //!< -1 for generic u_num_planes loop
+	int num_lights; //!< -1 for generic u_num_lights loop
+	int max_depth; //!< MAX_DEPTH
+	int max_traced_rays; //!< MAX_TRACED_RAYS
+
+	//! Order for permutation caches
+	bool operator <(const ShaderPermutation& other) const;
+	bool operator ==(const ShaderPermutation& other) const;
+};
+
+/**
+ * Traced ray list size that never drops a ray of the bounce tree up to max_depth.
+ * Rays are processed breadth first, so without glass the tree is a chain of max_depth + 1 rays,
+ * with glass every bounce may split in two.
+ */
+int TracedRayBudget(const Scene& scene, int max_depth);
+
+ShaderPermutation MakeGenericPermutation(int max_depth, int max_traced_rays);
+ShaderPermutation MakeSpecializedPermutation(const Scene& scene, int max_depth);
+
+//! Defines for ShaderInfo, in "#define NAME value" form
+std::vector<std::string> MakeShaderDefines(const ShaderPermutation& permutation);
+
+#endif
\ No newline at end of file
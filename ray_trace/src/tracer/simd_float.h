@@ -0,0 +1,140 @@
+#ifndef __SIMD_FLOAT_H__
+#define __SIMD_FLOAT_H__
+
+#if defined(__AVX2__)
+# define TRACER_USE_AVX2
+# include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+# define TRACER_USE_SSE
+# include <xmmintrin.h>
+#endif
+
+/**
+ * Minimal vector of floats for ray packets: 8 lanes with AVX2, 4 lanes with SSE
+ * and 4 lanes of plain floats otherwise. Comparisons return lane masks as integer bits.
+ * Min and max follow SSE semantics, the second operand is returned for NaN.
+ */
+struct SimdFloat {
+#if defined(TRACER_USE_AVX2)
+	static const unsigned int kWidth = 8;
+	__m256 value;
+
+	static SimdFloat Load(const float * data) { return SimdFloat{_mm256_loadu_ps(data)}; }
+	static SimdFloat Broadcast(float x) { return SimdFloat{_mm256_set1_ps(x)}; }
+	void Store(float * data) const { _mm256_storeu_ps(data, value); }
+	friend SimdFloat operator +(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm256_add_ps(a.value, b.value)}; }
+	friend SimdFloat operator -(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm256_sub_ps(a.value, b.value)}; }
+	friend SimdFloat operator *(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm256_mul_ps(a.value, b.value)}; }
+	friend SimdFloat operator /(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm256_div_ps(a.value, b.value)}; }
+	friend SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm256_min_ps(a.value, b.value)}; }
+	friend SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm256_max_ps(a.value, b.value)}; }
+	friend unsigned int LessEqual(const SimdFloat& a, const SimdFloat& b)
+	{
+		return static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(a.value, b.value, _CMP_LE_OQ)));
+	}
+#elif defined(TRACER_USE_SSE)
+	static const unsigned int kWidth = 4;
+	__m128 value;
+
+	static SimdFloat Load(const float * data) { return SimdFloat{_mm_loadu_ps(data)}; }
+	static SimdFloat Broadcast(float x) { return SimdFloat{_mm_set1_ps(x)}; }
+	void Store(float * data) const { _mm_storeu_ps(data, value); }
+	friend SimdFloat operator +(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm_add_ps(a.value, b.value)}; }
+	friend SimdFloat operator -(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm_sub_ps(a.value, b.value)}; }
+	friend SimdFloat operator *(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm_mul_ps(a.value, b.value)}; }
+	friend SimdFloat operator /(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm_div_ps(a.value, b.value)}; }
+	friend SimdFloat Min(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm_min_ps(a.value, b.value)}; }
+	friend SimdFloat Max(const SimdFloat& a, const SimdFloat& b) { return SimdFloat{_mm_max_ps(a.value, b.value)}; }
+	friend unsigned int LessEqual(const SimdFloat& a, const SimdFloat& b)
+	{
+		return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(a.value, b.value)));
+	}
+#else
+	static const unsigned int kWidth = 4;
+	float value[kWidth];
+
+	static SimdFloat Load(const float * data)
+	{
+		SimdFloat result;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			result.value[i] = data[i];
+		return result;
+	}
+	static SimdFloat Broadcast(float x)
+	{
+		SimdFloat result;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			result.value[i] = x;
+		return result;
+	}
+	void Store(float * data) const
+	{
+		for (unsigned int i = 0; i < kWidth; ++i)
+			data[i] = value[i];
+	}
+	friend SimdFloat operator +(const SimdFloat& a, const SimdFloat& b)
+	{
+		SimdFloat result;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			result.value[i] = a.value[i] + b.value[i];
+		return result;
+	}
+	friend SimdFloat operator -(const SimdFloat& a, const SimdFloat& b)
+	{
+		SimdFloat result;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			result.value[i] = a.value[i] - b.value[i];
+		return result;
+	}
+	friend SimdFloat operator *(const SimdFloat& a, const SimdFloat& b)
+	{
+		SimdFloat result;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			result.value[i] = a.value[i] * b.value[i];
+		return result;
+	}
+	friend SimdFloat operator /(const SimdFloat& a, const SimdFloat& b)
+	{
+		SimdFloat result;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			result.value[i] = a.value[i] / b.value[i];
+		return result;
+	}
+	friend SimdFloat Min(const SimdFloat& a, const SimdFloat& b)
+	{
+		SimdFloat result;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			result.value[i] = (a.value[i] < b.value[i]) ? a.value[i] : b.value[i];
+		return result;
+	}
+	friend SimdFloat Max(const SimdFloat& a, const SimdFloat& b)
+	{
+		SimdFloat result;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			result.value[i] = (a.value[i] > b.value[i]) ? a.value[i] : b.value[i];
+		return result;
+	}
+	friend unsigned int LessEqual(const SimdFloat& a, const SimdFloat& b)
+	{
+		unsigned int mask = 0;
+		for (unsigned int i = 0; i < kWidth; ++i)
+			if (a.value[i] <= b.value[i])
+				mask |= 1u << i;
+		return mask;
+	}
+#endif
+};
+
+//! Name of the instruction set used by SimdFloat
+inline const char * SimdName()
+{
+#if defined(TRACER_USE_AVX2)
+	return "AVX2";
+#elif defined(TRACER_USE_SSE)
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,122 @@
+#ifndef __VEC3_H__
+#define __VEC3_H__
+
+#include <cmath>
+
+/**
+ * Minimal 3 component vector for CPU tracer.
+ * Tracer doesn't depend on the engine, so it can be built headless.
+ */
+struct Vec3 {
+	float x, y, z;
+
+	Vec3()
+	: x(0.0f), y(0.0f), z(0.0f)
+	{
+	}
+	explicit Vec3(float value)
+	: x(value), y(value), z(value)
+	{
+	}
+	Vec3(float x, float y, float z)
+	: x(x), y(y), z(z)
+	{
+	}
+
+	float operator [](int i) const
+	{
+		return (&x)[i];
+	}
+	float& operator [](int i)
+	{
+		return (&x)[i];
+	}
+	Vec3 operator -() const
+	{
+		return Vec3(-x, -y, -z);
+	}
+	Vec3& operator +=(const Vec3& v)
+	{
+		x += v.x; y += v.y; z += v.z;
+		return *this;
+	}
+	Vec3& operator *=(const Vec3& v)
+	{
+		x *= v.x; y *= v.y; z *= v.z;
+		return *this;
+	}
+	Vec3& operator *=(float s)
+	{
+		x *= s; y *= s; z *= s;
+		return *this;
+	}
+	bool operator ==(const Vec3& v) const
+	{
+		return x == v.x && y == v.y && z == v.z;
+	}
+};
+
+inline Vec3 operator +(const Vec3& a, const Vec3& b)
+{
+	return Vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+inline Vec3 operator -(const Vec3& a, const Vec3& b)
+{
+	return Vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+inline Vec3 operator *(const Vec3& a, const Vec3& b)
+{
+	return Vec3(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+inline Vec3 operator /(const Vec3& a, const Vec3& b)
+{
+	return Vec3(a.x / b.x, a.y / b.y, a.z / b.z);
+}
+inline Vec3 operator *(const Vec3& a, float s)
+{
+	return Vec3(a.x * s, a.y * s, a.z * s);
+}
+inline Vec3 operator *(float s, const Vec3& a)
+{
+	return Vec3(a.x * s, a.y * s, a.z * s);
+}
+inline Vec3 operator /(const Vec3& a, float s)
+{
+	return a * (1.0f / s);
+}
+inline float Dot(const Vec3& a, const Vec3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline Vec3 Cross(const Vec3& a, const Vec3& b)
+{
+	return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+inline float Length(const Vec3& v)
+{
+	return sqrtf(Dot(v, v));
+}
+inline Vec3 Normalize(const Vec3& v)
+{
+	return v / Length(v);
+}
+inline Vec3 Min(const Vec3& a, const Vec3& b)
+{
+	return Vec3(fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z));
+}
+inline Vec3 Max(const Vec3& a, const Vec3& b)
+{
+	return Vec3(fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z));
+}
+//! Same as GLSL mix
+inline Vec3 Mix(const Vec3& a, const Vec3& b, float t)
+{
+	return a + (b - a) * t;
+}
+//! Same as GLSL reflect, normal should be normalized
+inline Vec3 Reflect(const Vec3& d, const Vec3& n)
+{
+	return d - n * (2.0f * Dot(n, d));
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef __BENCHMARK_RUNNER_H__
+#define __BENCHMARK_RUNNER_H__
+
+/**
+ * Benchmark runner class interface.
+ * Benchmarks are started from console or command channel and report their results to command output.
+ */
+class IBenchmarkRunner {
+public:
+	virtual ~IBenchmarkRunner() = default;
+
+	virtual void BenchmarkRenderQueue(float draw_count) = 0;
+	virtual void BenchmarkHullShapes(float body_count) = 0;
+	virtual void BenchmarkThreadScaling(float body_count) = 0;
+	virtual void BenchmarkBroadphases(float body_count) = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "benchmarks.h"
+
+#include "physics_world.h"
+#include "render_queue.h"
+#include "mesh_data.h"
+#include "common/string_format.h"
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cmath>
+
+namespace {
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double ElapsedMilliseconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	class CountingExecutor final : public IRenderQueueExecutor {
+	public:
+		CountingExecutor()
+		: checksum_(0)
+		{
+		}
+		void BindPass(unsigned int pass) final
+		{
+			checksum_ += pass;
+		}
+		void BindShader(unsigned int shader) final
+		{
+			checksum_ += shader;
+		}
+		void BindMaterial(unsigned int material) final
+		{
+			checksum_ += material;
+		}
+		void BindMesh(unsigned int mesh) final
+		{
+			checksum_ += mesh;
+		}
+		void Draw(unsigned int item) final
+		{
+			checksum_ += item;
+		}
+		unsigned int checksum() const
+		{
+			return checksum_;
+		}
+
+	private:
+		unsigned int checksum_; //!< prevents calls from being optimized out
+	};
+
+	//! Returns average step time in milliseconds
+	double MeasureTetrahedraStep(unsigned int body_count, bool use_hull, const MeshData& tetra_data)
+	{
+		const unsigned int kNumSteps = 240;
+		const float kTimeStep = 1.0f / 60.0f;
+		const float kSpacing = 1.5f;
+
+		PhysicsWorld world;
+		if (!world.Initialize())
+			return 0.0;
+		world.CreateRigidBody(world.AcquireBoxShape(scythe::Vector3(100.0f, 1.0f, 100.0f)), 0.0f,
+			scythe::Vector3(0.0f, -1.0f, 0.0f));
+
+		// Single layer grid, so bodies collide with the ground and their neighbours
+		const unsigned int side = static_cast<unsigned int>(ceilf(sqrtf(static_cast<float>(body_count))));
+		const float offset = 0.5f * kSpacing * static_cast<float>(side);
+		const scythe::Vector3 scale(0.5f);
+		for (unsigned int i = 0; i < body_count; ++i)
+		{
+			const scythe::Vector3 position(
+				kSpacing * static_cast<float>(i % side) - offset,
+				2.0f + 0.1f * static_cast<float>(i % 7),
+				kSpacing * static_cast<float>(i / side) - offset);
+			btCollisionShape * shape = use_hull
+				? world.AcquireHullShape(tetra_data, scale)
+				: world.AcquireMeshShape(tetra_data, scale);
+			world.CreateRigidBody(shape, 1.0f, position);
+		}
+
+		const Clock::time_point start = Clock::now();
+		for (unsigned int i = 0; i < kNumSteps; ++i)
+			world.Update(kTimeStep);
+		return ElapsedMilliseconds(start) / static_cast<double>(kNumSteps);
+	}
+
+	//! Returns average step time in milliseconds
+	double MeasurePilesStep(unsigned int body_count)
+	{
+		const unsigned int kNumSteps = 180;
+		const unsigned int kPileHeight = 8;
+		const float kTimeStep = 1.0f / 60.0f;
+		const float kExtent = 0.5f;
+		const float kPileSpacing = 4.0f;
+
+		PhysicsWorld world;
+		if (!world.Initialize())
+			return 0.0;
+		world.CreateRigidBody(world.AcquireBoxShape(scythe::Vector3(500.0f, 1.0f, 500.0f)), 0.0f,
+			scythe::Vector3(0.0f, -1.0f, 0.0f));
+
+		// Piles are far enough from each other to form separate islands,
+		// boxes are shifted a bit, so piles topple and keep solver busy
+		const unsigned int num_piles = (body_count + kPileHeight - 1) / kPileHeight;
+		const unsigned int side = static_cast<unsigned int>(ceilf(sqrtf(static_cast<float>(num_piles))));
+		const float offset = 0.5f * kPileSpacing * static_cast<float>(side);
+		std::mt19937 generator(body_count);
+		std::uniform_real_distribution<float> shift_distribution(-0.3f, 0.3f);
+		std::vector<scythe::Vector3> positions;
+		positions.reserve(body_count);
+		for (unsigned int i = 0; i < body_count; ++i)
+		{
+			const unsigned int pile = i / kPileHeight;
+			const unsigned int level = i % kPileHeight;
+			positions.push_back(scythe::Vector3(
+				kPileSpacing * static_cast<float>(pile % side) - offset + shift_distribution(generator),
+				kExtent + 2.1f * kExtent * static_cast<float>(level),
+				kPileSpacing * static_cast<float>(pile / side) - offset + shift_distribution(generator)));
+		}
+		std::vector<btRigidBody *> bodies(body_count);
+		world.CreateRigidBodies(world.AcquireBoxShape(scythe::Vector3(kExtent)), 1.0f,
+			positions.data(), positions.size(), bodies.data());
+
+		const Clock::time_point start = Clock::now();
+		for (unsigned int i = 0; i < kNumSteps; ++i)
+			world.Update(kTimeStep);
+		return ElapsedMilliseconds(start) / static_cast<double>(kNumSteps);
+	}
+
+	enum BroadphaseScene : unsigned int {
+		kMazeScene, //!< long thin corridor
+		kPilesScene, //!< dense piles
+		kScatteredScene, //!< wide sparse area
+		kNumScenes
+	};
+	const char * const kSceneNames[kNumScenes] = {"maze", "piles", "scattered"};
+
+	//! Scene is seeded by body count, so every broadphase gets identical one
+	void BuildBroadphaseScene(BroadphaseScene scene, unsigned int body_count, PhysicsWorld * world)
+	{
+		const unsigned int kPileHeight = 8;
+		const float kRadius = 0.3f;
+
+		world->CreateRigidBody(world->AcquireBoxShape(scythe::Vector3(500.0f, 1.0f, 500.0f)), 0.0f,
+			scythe::Vector3(0.0f, -1.0f, 0.0f));
+
+		std::mt19937 generator(body_count);
+		std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+		const unsigned int num_piles = (body_count + kPileHeight - 1) / kPileHeight;
+		const unsigned int side = static_cast<unsigned int>(ceilf(sqrtf(static_cast<float>(num_piles))));
+		const float maze_height = 0.5f + static_cast<float>(body_count) / 500.0f;
+		std::vector<scythe::Vector3> positions;
+		positions.reserve(body_count);
+		for (unsigned int i = 0; i < body_count; ++i)
+		{
+			switch (scene)
+			{
+			case kMazeScene:
+				positions.push_back(scythe::Vector3(
+					-100.0f + 200.0f * distribution(generator),
+					0.5f + maze_height * distribution(generator),
+					-1.0f + 2.0f * distribution(generator)));
+				break;
+			case kPilesScene:
+			{
+				const unsigned int pile = i / kPileHeight;
+				const float offset = 0.75f * static_cast<float>(side);
+				positions.push_back(scythe::Vector3(
+					1.5f * static_cast<float>(pile % side) - offset + 0.2f * distribution(generator),
+					kRadius + 2.1f * kRadius * static_cast<float>(i % kPileHeight),
+					1.5f * static_cast<float>(pile / side) - offset + 0.2f * distribution(generator)));
+				break;
+			}
+			default:
+				positions.push_back(scythe::Vector3(
+					-400.0f + 800.0f * distribution(generator),
+					1.0f + 20.0f * distribution(generator),
+					-400.0f + 800.0f * distribution(generator)));
+				break;
+			}
+		}
+		std::vector<btRigidBody *> bodies(body_count);
+		world->CreateRigidBodies(world->AcquireSphereShape(kRadius), 1.0f,
+			positions.data(), positions.size(), bodies.data());
+	}
+
+	std::string FormatStatistics(const char * name, const RenderQueueStatistics& statistics)
+	{
+		return scythe::string_format("%s: shaders %u, materials %u, meshes %u\n", name,
+			statistics.shader_changes, statistics.material_changes, statistics.mesh_changes);
+	}
+
+} // namespace
+
+std::string BenchmarkRenderQueue(unsigned int draw_count)
+{
+	// Scene composition typical for demos: few shaders, dozens of materials and meshes
+	const unsigned int kNumShaders = 4;
+	const unsigned int kNumMaterials = 64;
+	const unsigned int kNumMeshes = 32;
+	const float kFarDistance = 100.0f;
+
+	std::mt19937 generator(draw_count);
+	std::uniform_real_distribution<float> distance_distribution(0.0f, kFarDistance);
+
+	RenderQueue queue;
+	queue.Reserve(draw_count);
+	for (unsigned int i = 0; i < draw_count; ++i)
+	{
+		const DrawKey key = draw_key::Make(0,
+			generator() % kNumShaders,
+			generator() % kNumMaterials,
+			generator() % kNumMeshes,
+			draw_key::QuantizeDepth(distance_distribution(generator), kFarDistance));
+		queue.Submit(key, i);
+	}
+	std::vector<DrawKey> keys(draw_count);
+	for (unsigned int i = 0; i < draw_count; ++i)
+		keys[i] = queue.key(i);
+
+	CountingExecutor executor;
+	const RenderQueueStatistics unsorted_statistics = queue.Execute(&executor);
+
+	Clock::time_point start = Clock::now();
+	queue.Sort();
+	const double radix_time = ElapsedMilliseconds(start);
+
+	start = Clock::now();
+	std::sort(keys.begin(), keys.end());
+	const double std_sort_time = ElapsedMilliseconds(start);
+
+	start = Clock::now();
+	const RenderQueueStatistics sorted_statistics = queue.Execute(&executor);
+	const double execute_time = ElapsedMilliseconds(start);
+
+	std::string report = scythe::string_format("draws: %u (checksum %u)\n", draw_count, executor.checksum());
+	report += scythe::string_format("radix sort: %.3f ms, std::sort: %.3f ms\n", radix_time, std_sort_time);
+	report += scythe::string_format("execute: %.3f ms\n", execute_time);
+	report += FormatStatistics("unsorted", unsorted_statistics);
+	report += FormatStatistics("sorted", sorted_statistics);
+	return report;
+}
+std::string BenchmarkHullShapes(unsigned int body_count)
+{
+	MeshData tetra_data;
+	tetra_data.CreateTetrahedron();
+
+	const double mesh_time = MeasureTetrahedraStep(body_count, false, tetra_data);
+	const double hull_time = MeasureTetrahedraStep(body_count, true, tetra_data);
+
+	std::string report = scythe::string_format("tetrahedra: %u\n", body_count);
+	report += scythe::string_format("mesh shape: %.3f ms per step\n", mesh_time);
+	report += scythe::string_format("hull shape: %.3f ms per step\n", hull_time);
+	return report;
+}
+std::string BenchmarkThreadScaling(unsigned int body_count)
+{
+	const unsigned int max_threads = PhysicsWorld::max_threads();
+	const unsigned int previous_threads = PhysicsWorld::num_threads();
+
+	// Thread counts double up to the maximum, which is always measured
+	std::vector<unsigned int> thread_counts;
+	for (unsigned int count = 1; count < max_threads; count *= 2)
+		thread_counts.push_back(count);
+	thread_counts.push_back(max_threads);
+
+	std::string report = scythe::string_format("boxes: %u, max threads: %u\n", body_count, max_threads);
+	double single_thread_time = 0.0;
+	for (unsigned int count : thread_counts)
+	{
+		PhysicsWorld::SetNumThreads(count);
+		const double time = MeasurePilesStep(body_count);
+		if (count == 1)
+			single_thread_time = time;
+		report += scythe::string_format("threads %u: %.3f ms per step, speedup %.2f\n", count, time,
+			(time > 0.0) ? single_thread_time / time : 0.0);
+	}
+	PhysicsWorld::SetNumThreads(previous_threads);
+	if (max_threads == 1)
+		report += "multithreading is off, Bullet should be built with BT_THREADSAFE\n";
+	return report;
+}
+std::string BenchmarkBroadphases(unsigned int body_count)
+{
+	const unsigned int kNumSteps = 120;
+	const unsigned int kMaxSimpleBodies = 4096;
+	const float kTimeStep = 1.0f / 60.0f;
+
+	std::string report = scythe::string_format("spheres: %u\n", body_count);
+	for (unsigned int scene = 0; scene < kNumScenes; ++scene)
+		for (unsigned int type = 0; type < PhysicsWorld::kNumBroadphases; ++type)
+		{
+			const PhysicsWorld::Broadphase broadphase = static_cast<PhysicsWorld::Broadphase>(type);
+			if (broadphase == PhysicsWorld::kSimpleBroadphase && body_count > kMaxSimpleBodies)
+				continue; // quadratic, would take too long
+			PhysicsWorld world;
+			if (!world.Initialize(broadphase))
+				continue;
+			BuildBroadphaseScene(static_cast<BroadphaseScene>(scene), body_count, &world);
+
+			const Clock::time_point start = Clock::now();
+			for (unsigned int i = 0; i < kNumSteps; ++i)
+				world.Update(kTimeStep);
+			const double time = ElapsedMilliseconds(start) / static_cast<double>(kNumSteps);
+			report += scythe::string_format("%s, %s: %.3f ms per step, %u pairs\n", kSceneNames[scene],
+				PhysicsWorld::GetBroadphaseName(broadphase), time, world.num_overlapping_pairs());
+		}
+	return report;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef __BENCHMARKS_H__
+#define __BENCHMARKS_H__
+
+#include <string>
+
+/**
+ * Sorts random draws with render queue and counts state changes before and after sorting.
+ * Execution uses counting executor, so only CPU side cost is measured.
+ * @return Report lines separated by new line character.
+ */
+std::string BenchmarkRenderQueue(unsigned int draw_count);
+
+/**
+ * Drops tetrahedra onto the ground and measures physics step time
+ * with convex triangle mesh shapes and with convex hull shapes.
+ * @return Report lines separated by new line character.
+ */
+std::string BenchmarkHullShapes(unsigned int body_count);
+
+/**
+ * Steps the same scene of independent box piles with 1 to N physics threads.
+ * Thread count that was set before is restored afterwards.
+ * @return Report lines separated by new line character.
+ */
+std::string BenchmarkThreadScaling(unsigned int body_count);
+
+/**
+ * Runs seeded maze, piles and scattered sphere scenes through each broadphase
+ * and reports step time and number of overlapping pairs.
+ * @return Report lines separated by new line character.
+ */
+std::string BenchmarkBroadphases(unsigned int body_count);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "command_channel.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <windows.h>
+#else
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <poll.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <cerrno>
+#endif
+
+namespace {
+	const int kPollTimeout = 10; //!< in milliseconds
+	const size_t kReadBufferSize = 4096;
+#ifdef MSG_NOSIGNAL
+	const int kSendFlags = MSG_NOSIGNAL; //!< closed client shouldn't kill the process
+#else
+	const int kSendFlags = 0;
+#endif
+}
+
+CommandChannel::CommandChannel()
+: running_(false)
+, use_stdin_(false)
+, listen_fd_(-1)
+, next_client_id_(kStdinClient + 1)
+{
+}
+CommandChannel::~CommandChannel()
+{
+	Close();
+}
+bool CommandChannel::OpenStdin()
+{
+	if (thread_.joinable())
+		return false;
+	use_stdin_ = true;
+	Start();
+	return true;
+}
+bool CommandChannel::OpenSocket(const std::string& path)
+{
+#ifdef _WIN32
+	return false;
+#else
+	if (thread_.joinable())
+		return false;
+	sockaddr_un address;
+	if (path.size() >= sizeof(address.sun_path))
+		return false;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, path.c_str(), path.size());
+
+	listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd_ < 0)
+		return false;
+	unlink(path.c_str()); // socket file may remain from previous run
+	if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+		listen(listen_fd_, 4) != 0)
+	{
+		close(listen_fd_);
+		listen_fd_ = -1;
+		return false;
+	}
+	socket_path_ = path;
+	Start();
+	return true;
+#endif
+}
+void CommandChannel::Start()
+{
+	running_ = true;
+	thread_ = std::thread(&CommandChannel::ThreadFunction, this);
+}
+void CommandChannel::Close()
+{
+	// Thread may have stopped by itself at the end of input
+	if (!thread_.joinable())
+		return;
+	// Channel thread never blocks longer than poll timeout, so it is always joined
+	running_ = false;
+	thread_.join();
+	CloseClients();
+#ifndef _WIN32
+	if (listen_fd_ >= 0)
+	{
+		close(listen_fd_);
+		listen_fd_ = -1;
+		unlink(socket_path_.c_str());
+	}
+#endif
+	use_stdin_ = false;
+}
+bool CommandChannel::is_open() const
+{
+	return running_;
+}
+void CommandChannel::Receive(std::vector<Command> * commands)
+{
+	commands->clear();
+	std::lock_guard<std::mutex> lock(mutex_);
+	commands->swap(incoming_);
+}
+void CommandChannel::Reply(unsigned int client, const std::string& text)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	outgoing_.push_back(Command{client, text});
+}
+void CommandChannel::QueueLines(unsigned int client, std::string * buffer)
+{
+	size_t start = 0;
+	size_t end;
+	std::lock_guard<std::mutex> lock(mutex_);
+	while ((end = buffer->find('\n', start)) != std::string::npos)
+	{
+		std::string line = buffer->substr(start, end - start);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (!line.empty())
+			incoming_.push_back(Command{client, line});
+		start = end + 1;
+	}
+	buffer->erase(0, start);
+}
+void CommandChannel::ThreadFunction()
+{
+	while (running_)
+	{
+		if (use_stdin_)
+			ReadStdin();
+		else
+			PollSocket();
+		FlushReplies();
+	}
+}
+#ifdef _WIN32
+void CommandChannel::ReadStdin()
+{
+	// Reads are issued only when input is available, blocking one would keep Close from joining
+	HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+	char buffer[kReadBufferSize];
+	DWORD size = 0;
+	const DWORD type = GetFileType(input);
+	if (type == FILE_TYPE_PIPE)
+	{
+		DWORD available = 0;
+		if (!PeekNamedPipe(input, nullptr, 0, nullptr, &available, nullptr))
+		{
+			// Broken pipe is the end of input
+			use_stdin_ = false;
+			return;
+		}
+		if (available == 0)
+		{
+			Sleep(kPollTimeout);
+			return;
+		}
+		if (!ReadFile(input, buffer, std::min<DWORD>(available, sizeof(buffer)), &size, nullptr) || size == 0)
+		{
+			use_stdin_ = false;
+			return;
+		}
+	}
+	else if (type == FILE_TYPE_CHAR)
+	{
+		// Console handle is signaled by any input event, line is assembled from key presses
+		if (WaitForSingleObject(input, kPollTimeout) != WAIT_OBJECT_0)
+			return;
+		INPUT_RECORD records[64];
+		DWORD count = 0;
+		if (!ReadConsoleInputA(input, records, 64, &count))
+		{
+			use_stdin_ = false;
+			return;
+		}
+		for (DWORD i = 0; i < count; ++i)
+		{
+			const KEY_EVENT_RECORD& key = records[i].Event.KeyEvent;
+			if (records[i].EventType != KEY_EVENT || !key.bKeyDown || key.uChar.AsciiChar == 0)
+				continue;
+			const char c = (key.uChar.AsciiChar == '\r') ? '\n' : key.uChar.AsciiChar;
+			if (c == '\b')
+			{
+				if (!stdin_buffer_.empty() && stdin_buffer_.back() != '\n')
+				{
+					stdin_buffer_.pop_back();
+					std::cout << "\b \b";
+				}
+				continue;
+			}
+			std::cout << c; // echo is off when reading input events
+			stdin_buffer_ += c;
+		}
+		std::cout.flush();
+		QueueLines(kStdinClient, &stdin_buffer_);
+		return;
+	}
+	else if (!ReadFile(input, buffer, sizeof(buffer), &size, nullptr) || size == 0)
+	{
+		// Redirected file never blocks
+		use_stdin_ = false;
+		return;
+	}
+	stdin_buffer_.append(buffer, static_cast<size_t>(size));
+	QueueLines(kStdinClient, &stdin_buffer_);
+}
+void CommandChannel::PollSocket()
+{
+	// Stdin has been closed, just wait for replies
+	Sleep(kPollTimeout);
+}
+void CommandChannel::FlushReplies()
+{
+	std::vector<Command> replies;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		replies.swap(outgoing_);
+	}
+	for (const auto& reply : replies)
+		std::cout << reply.text;
+	std::cout.flush();
+}
+void CommandChannel::CloseClients()
+{
+}
+#else
+void CommandChannel::ReadStdin()
+{
+	pollfd descriptor = {STDIN_FILENO, POLLIN, 0};
+	if (poll(&descriptor, 1, kPollTimeout) <= 0)
+		return;
+	char buffer[kReadBufferSize];
+	const ssize_t size = read(STDIN_FILENO, buffer, sizeof(buffer));
+	if (size <= 0)
+	{
+		// End of input, replies are still flushed while channel is open
+		use_stdin_ = false;
+		return;
+	}
+	stdin_buffer_.append(buffer, static_cast<size_t>(size));
+	QueueLines(kStdinClient, &stdin_buffer_);
+}
+void CommandChannel::PollSocket()
+{
+	if (listen_fd_ < 0)
+	{
+		// Stdin has been closed, just wait for replies
+		std::this_thread::sleep_for(std::chrono::milliseconds(kPollTimeout));
+		return;
+	}
+	std::vector<pollfd> descriptors;
+	descriptors.push_back(pollfd{listen_fd_, POLLIN, 0});
+	for (const auto& client : clients_)
+		descriptors.push_back(pollfd{client.fd, POLLIN, 0});
+	if (poll(descriptors.data(), static_cast<nfds_t>(descriptors.size()), kPollTimeout) <= 0)
+		return;
+
+	// Read from clients first, because accepted ones are appended to the list
+	char buffer[kReadBufferSize];
+	for (size_t i = clients_.size(); i-- > 0; )
+	{
+		if (!(descriptors[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+			continue;
+		Client& client = clients_[i];
+		const ssize_t size = read(client.fd, buffer, sizeof(buffer));
+		if (size <= 0)
+		{
+			close(client.fd);
+			clients_.erase(clients_.begin() + i);
+			continue;
+		}
+		client.buffer.append(buffer, static_cast<size_t>(size));
+		QueueLines(client.id, &client.buffer);
+	}
+	if (descriptors[0].revents & POLLIN)
+	{
+		const int fd = accept(listen_fd_, nullptr, nullptr);
+		if (fd < 0)
+			return;
+		// Replies are sent without blocking, stalled client can't hold the channel thread
+		const int flags = fcntl(fd, F_GETFL, 0);
+		if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+		{
+			close(fd);
+			return;
+		}
+		clients_.push_back(Client{next_client_id_++, fd, std::string()});
+	}
+}
+void CommandChannel::FlushReplies()
+{
+	std::vector<Command> replies;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		replies.swap(outgoing_);
+	}
+	for (const auto& reply : replies)
+	{
+		if (reply.client == kStdinClient)
+		{
+			std::cout << reply.text;
+			continue;
+		}
+		for (size_t i = 0; i < clients_.size(); ++i)
+		{
+			const Client& client = clients_[i];
+			if (client.id != reply.client)
+				continue;
+			// Client that doesn't read its replies fills the socket buffer and is dropped
+			size_t written = 0;
+			while (written < reply.text.size())
+			{
+				const ssize_t size = send(client.fd, reply.text.data() + written, reply.text.size() - written, kSendFlags);
+				if (size < 0 && errno == EINTR)
+					continue;
+				if (size <= 0)
+					break;
+				written += static_cast<size_t>(size);
+			}
+			if (written < reply.text.size())
+			{
+				close(client.fd);
+				clients_.erase(clients_.begin() + i);
+			}
+			break;
+		}
+	}
+	std::cout.flush();
+}
+void CommandChannel::CloseClients()
+{
+	for (const auto& client : clients_)
+		close(client.fd);
+	clients_.clear();
+}
+#endif
\ No newline at end of file
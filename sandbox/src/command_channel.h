@@ -0,0 +1,72 @@
+#ifndef __COMMAND_CHANNEL_H__
+#define __COMMAND_CHANNEL_H__
+
+#include "common/non_copyable.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+/**
+ * Local command channel to drive the sandbox without console UI.
+ * Commands are newline separated and come either from stdin or from clients of
+ * UNIX domain socket (not available on Windows). Input and output are handled on
+ * a separate thread, main thread takes all received commands once per frame.
+ */
+class CommandChannel final : public scythe::NonCopyable {
+public:
+	struct Command {
+		unsigned int client; //!< reply destination
+		std::string text;
+	};
+
+	CommandChannel();
+	~CommandChannel();
+
+	bool OpenStdin();
+	bool OpenSocket(const std::string& path);
+	void Close();
+
+	bool is_open() const;
+
+	//! Moves commands received since the previous call
+	void Receive(std::vector<Command> * commands);
+	//! Reply is sent as is, it should end with new line
+	void Reply(unsigned int client, const std::string& text);
+
+private:
+	struct Client {
+		unsigned int id;
+		int fd;
+		std::string buffer; //!< incomplete line
+	};
+
+	void Start();
+	void ThreadFunction();
+	void ReadStdin();
+	void PollSocket();
+	//! Splits buffer into complete lines and queues them as commands
+	void QueueLines(unsigned int client, std::string * buffer);
+	void FlushReplies();
+	void CloseClients();
+
+	static const unsigned int kStdinClient = 0;
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::atomic<bool> running_;
+	std::vector<Command> incoming_;
+	std::vector<Command> outgoing_;
+
+	// Used by channel thread only
+	bool use_stdin_;
+	int listen_fd_;
+	std::string socket_path_;
+	std::vector<Client> clients_;
+	unsigned int next_client_id_;
+	std::string stdin_buffer_;
+};
+
+#endif
\ No newline at end of file
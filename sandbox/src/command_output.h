@@ -0,0 +1,50 @@
+#ifndef __COMMAND_OUTPUT_H__
+#define __COMMAND_OUTPUT_H__
+
+#include <string>
+
+/**
+ * Output of the command being executed.
+ * Console functions return nothing, so they report results and errors here
+ * and the caller passes them on to console, script report or channel reply.
+ */
+class CommandOutput {
+public:
+	void Clear()
+	{
+		text_.clear();
+		error_.clear();
+	}
+	//! Appends text as separate line
+	void Print(const std::string& text)
+	{
+		if (!text_.empty() && text_.back() != '\n')
+			text_ += '\n';
+		text_ += text;
+	}
+	//! Marks command as failed, the first error is kept
+	void Fail(const std::string& message)
+	{
+		if (error_.empty())
+			error_ = message;
+	}
+
+	bool failed() const
+	{
+		return !error_.empty();
+	}
+	const std::string& text() const
+	{
+		return text_;
+	}
+	const std::string& error() const
+	{
+		return error_;
+	}
+
+private:
+	std::string text_;
+	std::string error_;
+};
+
+#endif
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "console.h"
 
-#include "script.h"
+#include "parser.h"
 
 static inline void WideToAnsi(const std::wstring& wide_string, std::string& ansi_string)
 {
@@ -21,10 +21,24 @@ Console::Console(scythe::Renderer * renderer, scythe::Font * font,
 Console::~Console()
 {
 }
-void Console::set_parser(console_script::Parser * parser)
+void Console::set_parser(Parser * parser)
 {
 	parser_ = parser;
 }
+void Console::Print(const std::string& text)
+{
+	std::wstring wide_string;
+	size_t start = 0;
+	while (start < text.size())
+	{
+		size_t end = text.find('\n', start);
+		if (end == std::string::npos)
+			end = text.size();
+		AnsiToWide(text.substr(start, end - start), wide_string);
+		AddString(wide_string);
+		start = end + 1;
+	}
+}
 void Console::RecognizeString()
 {
 	if (parser_)
@@ -32,19 +46,9 @@ void Console::RecognizeString()
 		// Transform input from wide to ansi
 		std::string result_string;
 		std::string ansi_string;
-		std::wstring wide_string;
 		WideToAnsi(input_string(), ansi_string);
-		if (parser_->Evaluate(ansi_string, &result_string))
-		{
-			// Print result string
-			AnsiToWide(result_string, wide_string);
-			AddString(wide_string);
-		}
-		else
-		{
-			// Transform error message from ansi to wide
-			AnsiToWide(parser_->error(), wide_string);
-			AddString(wide_string);
-		}
+		// Result and error message are printed the same way
+		parser_->Execute(ansi_string, &result_string);
+		Print(result_string);
 	}
 }
\ No newline at end of file
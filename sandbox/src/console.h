@@ -3,9 +3,9 @@
 
 #include "ui/console.h"
 
-namespace console_script {
-	class Parser;
-}
+#include <string>
+
+class Parser;
 
 class Console final : public scythe::Console {
 public:
@@ -15,7 +15,10 @@ public:
 			float bottom, float text_height, float velocity, float aspect_ratio);
 	~Console();
 
-	void set_parser(console_script::Parser * parser);
+	void set_parser(Parser * parser);
+
+	//! Prints multiline text, each line is added as separate string
+	void Print(const std::string& text);
 
 protected:
 
@@ -24,7 +27,7 @@ protected:
 private:
 
 	// Console doesn't own the parser instance
-	console_script::Parser * parser_;
+	Parser * parser_;
 };
 
 #endif
\ No newline at end of file
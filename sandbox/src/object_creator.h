@@ -14,6 +14,20 @@ public:
 	virtual void CreateBox(float pos_x, float pos_y, float pos_z,
 		float extent_x, float extent_y, float extent_z,
 		float color_x, float color_y, float color_z, float mass) = 0;
+
+	// Batch creators, position is the center of the lowest layer
+	virtual void CreateSphereGrid(float pos_x, float pos_y, float pos_z,
+		float count_x, float count_y, float count_z, float radius, float mass) = 0;
+
+	virtual void CreateBoxPyramid(float pos_x, float pos_y, float pos_z,
+		float base_count, float extent, float mass) = 0;
+
+	virtual void CreateBoxStack(float pos_x, float pos_y, float pos_z,
+		float count, float extent, float mass) = 0;
+
+	//! Random spheres inside the box
+	virtual void CreateSphereRain(float min_x, float min_y, float min_z,
+		float max_x, float max_y, float max_z, float count, float radius, float mass) = 0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include "object_pool.h"
+
+#include "btBulletDynamicsCommon.h"
+
+#include <algorithm>
+#include <cstring>
+
+ObjectPool::ObjectPool()
+: structure_changed_(false)
+, free_slot_(kInvalidSlot)
+{
+}
+void ObjectPool::Reserve(size_t count)
+{
+	transforms_.reserve(count);
+	positions_.reserve(count);
+	scales_.reserve(count);
+	colors_.reserve(count);
+	mesh_ids_.reserve(count);
+	radii_.reserve(count);
+	bodies_.reserve(count);
+	slot_indices_.reserve(count);
+	dirty_flags_.reserve(count);
+	slots_.reserve(count);
+}
+void ObjectPool::Clear()
+{
+	// Slots are kept, so outstanding handles become stale
+	while (!empty())
+		Remove(HandleOf(size() - 1));
+}
+ObjectHandle ObjectPool::Add(btRigidBody * body, const scythe::Vector3& scale, const scythe::Vector3& color,
+	unsigned int mesh_id, float radius)
+{
+	unsigned int slot;
+	if (free_slot_ != kInvalidSlot)
+	{
+		slot = free_slot_;
+		free_slot_ = slots_[slot].index;
+	}
+	else
+	{
+		slot = static_cast<unsigned int>(slots_.size());
+		slots_.push_back(Slot{0, 0});
+	}
+	const size_t index = size();
+	slots_[slot].index = static_cast<unsigned int>(index);
+
+	transforms_.push_back(scythe::Matrix4());
+	positions_.push_back(scythe::Vector3(0.0f));
+	scales_.push_back(scale);
+	colors_.push_back(color);
+	mesh_ids_.push_back(mesh_id);
+	radii_.push_back(radius);
+	bodies_.push_back(body);
+	slot_indices_.push_back(slot);
+	dirty_flags_.push_back(0);
+	UpdateTransform(index);
+	body->setUserIndex(static_cast<int>(slot));
+	structure_changed_ = true;
+
+	return ObjectHandle{slot, slots_[slot].generation};
+}
+bool ObjectPool::Remove(ObjectHandle handle)
+{
+	if (!IsValid(handle))
+		return false;
+	const size_t index = slots_[handle.index].index;
+	const size_t last = size() - 1;
+	if (index != last)
+	{
+		transforms_[index] = transforms_[last];
+		positions_[index] = positions_[last];
+		scales_[index] = scales_[last];
+		colors_[index] = colors_[last];
+		mesh_ids_[index] = mesh_ids_[last];
+		radii_[index] = radii_[last];
+		bodies_[index] = bodies_[last];
+		slot_indices_[index] = slot_indices_[last];
+		dirty_flags_[index] = dirty_flags_[last];
+		slots_[slot_indices_[index]].index = static_cast<unsigned int>(index);
+	}
+	transforms_.pop_back();
+	positions_.pop_back();
+	scales_.pop_back();
+	colors_.pop_back();
+	mesh_ids_.pop_back();
+	radii_.pop_back();
+	bodies_.pop_back();
+	slot_indices_.pop_back();
+	dirty_flags_.pop_back();
+	structure_changed_ = true;
+
+	Slot& slot = slots_[handle.index];
+	++slot.generation;
+	slot.index = free_slot_;
+	free_slot_ = handle.index;
+	return true;
+}
+bool ObjectPool::IsValid(ObjectHandle handle) const
+{
+	return handle.index < slots_.size()
+		&& slots_[handle.index].generation == handle.generation;
+}
+size_t ObjectPool::IndexOf(ObjectHandle handle) const
+{
+	return slots_[handle.index].index;
+}
+ObjectHandle ObjectPool::HandleOf(size_t index) const
+{
+	const unsigned int slot = slot_indices_[index];
+	return ObjectHandle{slot, slots_[slot].generation};
+}
+void ObjectPool::UpdateTransform(size_t index)
+{
+	static_assert(sizeof(scythe::Matrix4) == 16 * sizeof(float), "Matrix4 should consist of 16 floats");
+	btTransform transform;
+	bodies_[index]->getMotionState()->getWorldTransform(transform);
+
+	// Column major matrix with scale applied to basis vectors
+	btScalar matrix[16];
+	transform.getOpenGLMatrix(matrix);
+	const scythe::Vector3& scale = scales_[index];
+	float columns[16];
+	for (int i = 0; i < 4; ++i)
+	{
+		columns[i     ] = static_cast<float>(matrix[i     ]) * scale.x;
+		columns[i +  4] = static_cast<float>(matrix[i +  4]) * scale.y;
+		columns[i +  8] = static_cast<float>(matrix[i +  8]) * scale.z;
+		columns[i + 12] = static_cast<float>(matrix[i + 12]);
+	}
+	memcpy(&transforms_[index], columns, sizeof(columns));
+	positions_[index].Set(columns[12], columns[13], columns[14]);
+}
+void ObjectPool::MarkDirty(size_t index)
+{
+	if (dirty_flags_[index])
+		return;
+	dirty_flags_[index] = 1;
+	dirty_indices_.push_back(static_cast<unsigned int>(index));
+}
+void ObjectPool::SyncTransforms()
+{
+	for (size_t i = 0; i < bodies_.size(); ++i)
+	{
+		UpdateTransform(i);
+		MarkDirty(i);
+	}
+}
+void ObjectPool::SyncTransforms(const std::vector<btRigidBody *>& moved_bodies)
+{
+	for (btRigidBody * body : moved_bodies)
+	{
+		const unsigned int slot = static_cast<unsigned int>(body->getUserIndex());
+		if (slot >= slots_.size())
+			continue;
+		const size_t index = slots_[slot].index;
+		if (index >= bodies_.size() || bodies_[index] != body)
+			continue; // free slot or body of another pool
+		UpdateTransform(index);
+		MarkDirty(index);
+	}
+}
+const std::vector<unsigned int>& ObjectPool::dirty_indices() const
+{
+	return dirty_indices_;
+}
+bool ObjectPool::structure_changed() const
+{
+	return structure_changed_;
+}
+void ObjectPool::ClearDirty()
+{
+	// Dense indices in the list are meaningless after removals
+	if (structure_changed_)
+		std::fill(dirty_flags_.begin(), dirty_flags_.end(), 0);
+	else
+		for (unsigned int index : dirty_indices_)
+			dirty_flags_[index] = 0;
+	dirty_indices_.clear();
+	structure_changed_ = false;
+}
+size_t ObjectPool::size() const
+{
+	return bodies_.size();
+}
+bool ObjectPool::empty() const
+{
+	return bodies_.empty();
+}
+const std::vector<scythe::Matrix4>& ObjectPool::transforms() const
+{
+	return transforms_;
+}
+const std::vector<scythe::Vector3>& ObjectPool::positions() const
+{
+	return positions_;
+}
+const std::vector<scythe::Vector3>& ObjectPool::scales() const
+{
+	return scales_;
+}
+const std::vector<scythe::Vector3>& ObjectPool::colors() const
+{
+	return colors_;
+}
+const std::vector<unsigned int>& ObjectPool::mesh_ids() const
+{
+	return mesh_ids_;
+}
+const std::vector<float>& ObjectPool::radii() const
+{
+	return radii_;
+}
+const std::vector<btRigidBody *>& ObjectPool::bodies() const
+{
+	return bodies_;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef __OBJECT_POOL_H__
+#define __OBJECT_POOL_H__
+
+#include "math/matrix4.h"
+#include "math/vector3.h"
+
+#include <vector>
+
+class btRigidBody;
+
+/**
+ * Stable reference to pooled object.
+ * Slot generation is increased on removal, so handles to removed objects become stale.
+ */
+struct ObjectHandle {
+	unsigned int index; //!< slot index
+	unsigned int generation;
+};
+
+/**
+ * Object storage in structure of arrays layout.
+ * Live objects are densely packed in all arrays, so render and physics sync loops
+ * go linearly through memory. Removal moves the last object into the freed place.
+ * Pool doesn't own rigid bodies.
+ */
+class ObjectPool {
+public:
+	ObjectPool();
+
+	void Reserve(size_t count);
+	void Clear();
+
+	//! Radius is used for LOD selection
+	ObjectHandle Add(btRigidBody * body, const scythe::Vector3& scale, const scythe::Vector3& color,
+		unsigned int mesh_id, float radius);
+	//! Returns false for stale handle, O(1)
+	bool Remove(ObjectHandle handle);
+	bool IsValid(ObjectHandle handle) const;
+	//! Dense index of the object, handle should be valid
+	size_t IndexOf(ObjectHandle handle) const;
+	ObjectHandle HandleOf(size_t index) const;
+
+	//! Copies all rigid bodies transforms into render transforms
+	void SyncTransforms();
+	/**
+	 * Copies transforms of moved bodies only and marks them dirty.
+	 * Bodies of other pools or without pool slot are skipped.
+	 */
+	void SyncTransforms(const std::vector<btRigidBody *>& moved_bodies);
+
+	//! Dense indices of objects synced since the last ClearDirty, valid unless structure changed
+	const std::vector<unsigned int>& dirty_indices() const;
+	//! Objects were added or removed since the last ClearDirty, so dense indices have changed
+	bool structure_changed() const;
+	void ClearDirty();
+
+	size_t size() const;
+	bool empty() const;
+
+	const std::vector<scythe::Matrix4>& transforms() const; //!< world matrices with scale
+	const std::vector<scythe::Vector3>& positions() const;
+	const std::vector<scythe::Vector3>& scales() const;
+	const std::vector<scythe::Vector3>& colors() const;
+	const std::vector<unsigned int>& mesh_ids() const;
+	const std::vector<float>& radii() const;
+	const std::vector<btRigidBody *>& bodies() const;
+
+private:
+	struct Slot {
+		unsigned int index; //!< dense index for live slot or next free slot otherwise
+		unsigned int generation;
+	};
+
+	void UpdateTransform(size_t index);
+	void MarkDirty(size_t index);
+
+	static const unsigned int kInvalidSlot = ~0u;
+
+	// Dense arrays
+	std::vector<scythe::Matrix4> transforms_;
+	std::vector<scythe::Vector3> positions_;
+	std::vector<scythe::Vector3> scales_;
+	std::vector<scythe::Vector3> colors_;
+	std::vector<unsigned int> mesh_ids_;
+	std::vector<float> radii_;
+	std::vector<btRigidBody *> bodies_;
+	std::vector<unsigned int> slot_indices_; //!< slot of each dense object
+	std::vector<unsigned char> dirty_flags_; //!< avoids duplicates in dirty indices
+
+	std::vector<unsigned int> dirty_indices_;
+	bool structure_changed_;
+
+	std::vector<Slot> slots_;
+	unsigned int free_slot_; //!< head of free slots list
+};
+
+#endif
\ No newline at end of file
@@ -1,8 +1,29 @@
 #include "parser.h"
 
-Parser::Parser(IObjectCreator * object_creator)
+namespace {
+	//! Returns true if command starts with the word and extracts trimmed argument after it
+	bool ParseFileCommand(const std::string& command, const std::string& word, std::string * filename)
+	{
+		if (command.compare(0, word.size(), word) != 0
+			|| command.size() == word.size() || command[word.size()] != ' ')
+			return false;
+		const size_t first = command.find_first_not_of(' ', word.size());
+		const size_t last = command.find_last_not_of(" \r\n");
+		*filename = (first != std::string::npos)
+			? command.substr(first, last - first + 1) : std::string();
+		return true;
+	}
+}
+
+Parser::Parser(IObjectCreator * object_creator, IBenchmarkRunner * benchmark_runner, ISnapshotStorage * snapshot_storage,
+	IPhysicsSettings * physics_settings)
 : parser_()
+, output_()
+, script_runner_(&parser_, &output_)
 , object_creator_(object_creator)
+, benchmark_runner_(benchmark_runner)
+, snapshot_storage_(snapshot_storage)
+, physics_settings_(physics_settings)
 {
 	SetupFunctions();
 }
@@ -14,8 +35,50 @@ console_script::Parser * Parser::object()
 {
 	return &parser_;
 }
+ScriptRunner * Parser::script_runner()
+{
+	return &script_runner_;
+}
+CommandOutput * Parser::output()
+{
+	return &output_;
+}
+bool Parser::Execute(const std::string& command, std::string * result)
+{
+	std::string filename;
+	if (ParseFileCommand(command, "exec", &filename))
+		return script_runner_.Execute(filename, result);
+	if (ParseFileCommand(command, "save", &filename))
+		return snapshot_storage_->SaveSnapshot(filename, result);
+	if (ParseFileCommand(command, "load", &filename))
+		return snapshot_storage_->LoadSnapshot(filename, result);
+	output_.Clear();
+	if (!parser_.Evaluate(command, result))
+	{
+		*result = parser_.error();
+		return false;
+	}
+	if (output_.failed())
+	{
+		*result = output_.error();
+		return false;
+	}
+	if (!output_.text().empty())
+		*result = output_.text();
+	return true;
+}
 void Parser::SetupFunctions()
 {
-	parser_.AddClassFunction("CreateSphere", &IObjectCreator::CreateSphere, object_creator_);
-	parser_.AddClassFunction("CreateBox", &IObjectCreator::CreateBox, object_creator_);
+	AddFunction("CreateSphere", &IObjectCreator::CreateSphere, object_creator_);
+	AddFunction("CreateBox", &IObjectCreator::CreateBox, object_creator_);
+	AddFunction("CreateSphereGrid", &IObjectCreator::CreateSphereGrid, object_creator_);
+	AddFunction("CreateBoxPyramid", &IObjectCreator::CreateBoxPyramid, object_creator_);
+	AddFunction("CreateBoxStack", &IObjectCreator::CreateBoxStack, object_creator_);
+	AddFunction("CreateSphereRain", &IObjectCreator::CreateSphereRain, object_creator_);
+	AddFunction("BenchmarkRenderQueue", &IBenchmarkRunner::BenchmarkRenderQueue, benchmark_runner_);
+	AddFunction("BenchmarkHullShapes", &IBenchmarkRunner::BenchmarkHullShapes, benchmark_runner_);
+	AddFunction("BenchmarkThreadScaling", &IBenchmarkRunner::BenchmarkThreadScaling, benchmark_runner_);
+	AddFunction("BenchmarkBroadphases", &IBenchmarkRunner::BenchmarkBroadphases, benchmark_runner_);
+	AddFunction("SetPhysicsThreads", &IPhysicsSettings::SetPhysicsThreads, physics_settings_);
+	AddFunction("SetBroadphase", &IPhysicsSettings::SetBroadphase, physics_settings_);
 }
\ No newline at end of file
@@ -2,28 +2,63 @@
 #define __PARSER_H__
 
 #include "object_creator.h"
+#include "benchmark_runner.h"
+#include "snapshot_storage.h"
+#include "physics_settings.h"
+#include "script_runner.h"
+#include "command_output.h"
 
 #include "common/non_copyable.h"
 
 #include "script.h"
 
+#include <string>
+
 /**
  * Wrapper for console_script::Parser class.
  * Initializes all the necessary functions.
  */
 class Parser final : public scythe::NonCopyable {
 public:
-	Parser(IObjectCreator * object_creator);
+	Parser(IObjectCreator * object_creator, IBenchmarkRunner * benchmark_runner, ISnapshotStorage * snapshot_storage,
+		IPhysicsSettings * physics_settings);
 	~Parser();
 
 	console_script::Parser * object();
+	ScriptRunner * script_runner();
+	//! Functions report their results and errors here, output is cleared before each command
+	CommandOutput * output();
+
+	/**
+	 * Executes single command, 'exec <file>' runs script file,
+	 * 'save <file>' and 'load <file>' store and restore world snapshot.
+	 * @param[out] result  Result or error message, including output of called functions.
+	 */
+	bool Execute(const std::string& command, std::string * result);
 
 protected:
 	void SetupFunctions();
 
 private:
+	//! Registers function for console parser and for compiled scripts at once
+	template <class Class, class... Args>
+	void AddFunction(const char * name, void (Class::*function)(Args...), Class * object);
+
 	console_script::Parser parser_;
+	CommandOutput output_;
+	ScriptRunner script_runner_;
 	IObjectCreator * object_creator_;
+	IBenchmarkRunner * benchmark_runner_;
+	ISnapshotStorage * snapshot_storage_;
+	IPhysicsSettings * physics_settings_;
 };
 
+template <class Class, class... Args>
+void Parser::AddFunction(const char * name, void (Class::*function)(Args...), Class * object)
+{
+	parser_.AddClassFunction(name, function, object);
+	// Script files call the same function without parsing each time
+	script_runner_.AddClassCommand(name, function, object);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef __PHYSICS_SETTINGS_H__
+#define __PHYSICS_SETTINGS_H__
+
+/**
+ * Physics settings interface.
+ * Settings are changed from console and apply to the sandbox world.
+ */
+class IPhysicsSettings {
+public:
+	virtual ~IPhysicsSettings() = default;
+
+	virtual void SetPhysicsThreads(float count) = 0;
+	//! Type is PhysicsWorld::Broadphase value
+	virtual void SetBroadphase(float type) = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,425 @@
+#include "physics_world.h"
+
+#include "mesh_data.h"
+#include "convex_hull.h"
+
+#include "btBulletDynamicsCommon.h"
+#ifdef BT_THREADSAFE
+# include "LinearMath/btThreads.h"
+# include "BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h"
+# include "BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h"
+#endif
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+	/**
+	 * Motion state that reports transform updates to the world.
+	 * Motion states are synchronized on the stepping thread, so no locking is needed.
+	 */
+	class TrackedMotionState final : public btDefaultMotionState {
+	public:
+		TrackedMotionState(const btTransform& transform, std::vector<btRigidBody *> * moved_bodies)
+		: btDefaultMotionState(transform)
+		, moved_bodies_(moved_bodies)
+		, body_(nullptr)
+		{
+		}
+		void setWorldTransform(const btTransform& transform) final
+		{
+			btDefaultMotionState::setWorldTransform(transform);
+			moved_bodies_->push_back(body_);
+		}
+		void set_body(btRigidBody * body)
+		{
+			body_ = body;
+		}
+
+	private:
+		std::vector<btRigidBody *> * moved_bodies_;
+		btRigidBody * body_;
+	};
+
+	btBroadphaseInterface * CreateBroadphase(PhysicsWorld::Broadphase broadphase)
+	{
+		// Sweep and prune quantizes AABBs inside fixed bounds, bodies outside them are clamped
+		const btScalar kWorldHalfSize = 1000.0f;
+		const unsigned int kMaxHandles = 1u << 18;
+		switch (broadphase)
+		{
+		case PhysicsWorld::kSweepAndPruneBroadphase:
+			return new bt32BitAxisSweep3(btVector3(-kWorldHalfSize, -kWorldHalfSize, -kWorldHalfSize),
+				btVector3(kWorldHalfSize, kWorldHalfSize, kWorldHalfSize), kMaxHandles);
+		case PhysicsWorld::kSimpleBroadphase:
+			return new btSimpleBroadphase(static_cast<int>(kMaxHandles));
+		default:
+			return new btDbvtBroadphase();
+		}
+	}
+
+#ifdef BT_THREADSAFE
+	btITaskScheduler * CreateTaskScheduler()
+	{
+		// Default scheduler is null when Bullet has no threading backend
+		btITaskScheduler * scheduler = btCreateDefaultTaskScheduler();
+		if (!scheduler)
+			scheduler = btGetSequentialTaskScheduler();
+		btSetTaskScheduler(scheduler);
+		return scheduler;
+	}
+	//! Scheduler is global in Bullet, so it's created once for all worlds
+	btITaskScheduler * GetTaskScheduler()
+	{
+		static btITaskScheduler * scheduler = CreateTaskScheduler();
+		return scheduler;
+	}
+#endif
+}
+
+PhysicsWorld::PhysicsWorld()
+: collision_configuration_(nullptr)
+, dispatcher_(nullptr)
+, broadphase_(nullptr)
+, solver_(nullptr)
+, world_(nullptr)
+, broadphase_type_(kDynamicTreeBroadphase)
+{
+}
+PhysicsWorld::~PhysicsWorld()
+{
+	Deinitialize();
+}
+bool PhysicsWorld::Initialize(Broadphase broadphase)
+{
+	broadphase_type_ = broadphase;
+	collision_configuration_ = new btDefaultCollisionConfiguration();
+	broadphase_ = CreateBroadphase(broadphase);
+#ifdef BT_THREADSAFE
+	// Each scheduler thread gets its own solver for islands
+	dispatcher_ = new btCollisionDispatcherMt(collision_configuration_);
+	solver_ = new btConstraintSolverPoolMt(GetTaskScheduler()->getMaxNumThreads());
+#else
+	dispatcher_ = new btCollisionDispatcher(collision_configuration_);
+	solver_ = new btSequentialImpulseConstraintSolver();
+#endif
+	CreateDynamicsWorld();
+	return true;
+}
+void PhysicsWorld::Deinitialize()
+{
+	if (world_)
+		DeleteDynamicsWorld();
+	shapes_.Clear();
+	if (solver_)
+	{
+		delete solver_;
+		solver_ = nullptr;
+	}
+	if (broadphase_)
+	{
+		delete broadphase_;
+		broadphase_ = nullptr;
+	}
+	if (dispatcher_)
+	{
+		delete dispatcher_;
+		dispatcher_ = nullptr;
+	}
+	if (collision_configuration_)
+	{
+		delete collision_configuration_;
+		collision_configuration_ = nullptr;
+	}
+}
+void PhysicsWorld::Update(float sec)
+{
+	moved_bodies_.clear();
+	world_->stepSimulation(sec);
+}
+const std::vector<btRigidBody *>& PhysicsWorld::moved_bodies() const
+{
+	return moved_bodies_;
+}
+void PhysicsWorld::SetBroadphase(Broadphase broadphase)
+{
+	if (broadphase == broadphase_type_)
+		return;
+	btBroadphaseInterface * new_broadphase = CreateBroadphase(broadphase);
+
+	// Same as removing and adding bodies back, but without linear searches in world arrays
+	btAlignedObjectArray<btCollisionObject *>& objects = world_->getCollisionObjectArray();
+	for (int i = 0; i < objects.size(); ++i)
+	{
+		btCollisionObject * object = objects[i];
+		btBroadphaseProxy * proxy = object->getBroadphaseHandle();
+		const int group = proxy->m_collisionFilterGroup;
+		const int mask = proxy->m_collisionFilterMask;
+		broadphase_->getOverlappingPairCache()->cleanProxyFromPairs(proxy, dispatcher_);
+		broadphase_->destroyProxy(proxy, dispatcher_);
+
+		btVector3 aabb_min, aabb_max;
+		object->getCollisionShape()->getAabb(object->getWorldTransform(), aabb_min, aabb_max);
+		object->setBroadphaseHandle(new_broadphase->createProxy(aabb_min, aabb_max,
+			object->getCollisionShape()->getShapeType(), object, group, mask, dispatcher_));
+	}
+	world_->setBroadphase(new_broadphase);
+	delete broadphase_;
+	broadphase_ = new_broadphase;
+	broadphase_type_ = broadphase;
+}
+PhysicsWorld::Broadphase PhysicsWorld::broadphase() const
+{
+	return broadphase_type_;
+}
+const char * PhysicsWorld::GetBroadphaseName(Broadphase broadphase)
+{
+	switch (broadphase)
+	{
+	case kDynamicTreeBroadphase:
+		return "dynamic tree";
+	case kSweepAndPruneBroadphase:
+		return "sweep and prune";
+	case kSimpleBroadphase:
+		return "simple";
+	default:
+		return "unknown";
+	}
+}
+unsigned int PhysicsWorld::num_overlapping_pairs() const
+{
+	return static_cast<unsigned int>(broadphase_->getOverlappingPairCache()->getNumOverlappingPairs());
+}
+void PhysicsWorld::SetNumThreads(unsigned int count)
+{
+#ifdef BT_THREADSAFE
+	btITaskScheduler * scheduler = GetTaskScheduler();
+	scheduler->setNumThreads(static_cast<int>(std::max(1u, std::min(count, max_threads()))));
+#else
+	(void)count;
+#endif
+}
+unsigned int PhysicsWorld::num_threads()
+{
+#ifdef BT_THREADSAFE
+	return static_cast<unsigned int>(GetTaskScheduler()->getNumThreads());
+#else
+	return 1;
+#endif
+}
+unsigned int PhysicsWorld::max_threads()
+{
+#ifdef BT_THREADSAFE
+	// Scheduler maximum is a compile time limit, so hardware is the real one
+	const unsigned int scheduler_threads = static_cast<unsigned int>(GetTaskScheduler()->getMaxNumThreads());
+	const unsigned int hardware_threads = std::thread::hardware_concurrency();
+	return std::max(1u, (hardware_threads != 0) ? std::min(scheduler_threads, hardware_threads) : scheduler_threads);
+#else
+	return 1;
+#endif
+}
+btCollisionShape * PhysicsWorld::AcquireSphereShape(float radius)
+{
+	const ShapeCache::Key key = {ShapeCache::kSphere, nullptr, {radius, 0.0f, 0.0f, 0.0f}};
+	return shapes_.Acquire(key, [radius]() -> btCollisionShape * {
+		return new btSphereShape(radius);
+	});
+}
+btCollisionShape * PhysicsWorld::AcquireBoxShape(const scythe::Vector3& half_extents)
+{
+	const ShapeCache::Key key = {ShapeCache::kBox, nullptr, {half_extents.x, half_extents.y, half_extents.z, 0.0f}};
+	return shapes_.Acquire(key, [&half_extents]() -> btCollisionShape * {
+		return new btBoxShape(btVector3(half_extents.x, half_extents.y, half_extents.z));
+	});
+}
+btCollisionShape * PhysicsWorld::AcquireMeshShape(const MeshData& data, const scythe::Vector3& scale)
+{
+	const ShapeCache::Key key = {ShapeCache::kConvexMesh, &data, {scale.x, scale.y, scale.z, 0.0f}};
+	btTriangleMesh * mesh = nullptr;
+	btCollisionShape * shape = shapes_.Acquire(key, [&data, &scale, &mesh]() -> btCollisionShape * {
+		mesh = new btTriangleMesh();
+		for (size_t i = 0; i + 2 < data.indices.size(); i += 3)
+		{
+			const float * p0 = data.vertices[data.indices[i    ]].position;
+			const float * p1 = data.vertices[data.indices[i + 1]].position;
+			const float * p2 = data.vertices[data.indices[i + 2]].position;
+			mesh->addTriangle(
+				btVector3(p0[0], p0[1], p0[2]),
+				btVector3(p1[0], p1[1], p1[2]),
+				btVector3(p2[0], p2[1], p2[2]));
+		}
+		btCollisionShape * mesh_shape = new btConvexTriangleMeshShape(mesh);
+		mesh_shape->setLocalScaling(btVector3(scale.x, scale.y, scale.z));
+		return mesh_shape;
+	});
+	if (mesh)
+		shapes_.AttachMesh(shape, mesh);
+	return shape;
+}
+btCollisionShape * PhysicsWorld::AcquireHullShape(const MeshData& data, const scythe::Vector3& scale, unsigned int max_vertices)
+{
+	const ShapeCache::Key key = {ShapeCache::kConvexHull, &data,
+		{scale.x, scale.y, scale.z, static_cast<float>(max_vertices)}};
+	return shapes_.Acquire(key, [&data, &scale, max_vertices]() -> btCollisionShape * {
+		ConvexHull hull;
+		ComputeConvexHull(data, max_vertices, &hull);
+		btConvexHullShape * hull_shape = new btConvexHullShape();
+		for (unsigned int index : hull.vertices())
+		{
+			const float * p = data.vertices[index].position;
+			hull_shape->addPoint(btVector3(p[0], p[1], p[2]), false);
+		}
+		hull_shape->recalcLocalAabb();
+		hull_shape->setLocalScaling(btVector3(scale.x, scale.y, scale.z));
+		return hull_shape;
+	});
+}
+btCollisionShape * PhysicsWorld::AcquireShape(const ShapeCache::Key& key)
+{
+	const scythe::Vector3 scale(key.params[0], key.params[1], key.params[2]);
+	switch (key.type)
+	{
+	case ShapeCache::kSphere:
+		return AcquireSphereShape(key.params[0]);
+	case ShapeCache::kBox:
+		return AcquireBoxShape(scale);
+	case ShapeCache::kConvexMesh:
+		return AcquireMeshShape(*static_cast<const MeshData *>(key.source), scale);
+	case ShapeCache::kConvexHull:
+		return AcquireHullShape(*static_cast<const MeshData *>(key.source), scale,
+			static_cast<unsigned int>(key.params[3]));
+	}
+	return nullptr;
+}
+void PhysicsWorld::AddShapeReferences(btCollisionShape * shape, unsigned int count)
+{
+	shapes_.AddReferences(shape, count);
+}
+void PhysicsWorld::ReleaseShape(btCollisionShape * shape)
+{
+	shapes_.Release(shape);
+}
+bool PhysicsWorld::GetShapeKey(const btCollisionShape * shape, ShapeCache::Key * key) const
+{
+	return shapes_.GetKey(shape, key);
+}
+btRigidBody * PhysicsWorld::CreateRigidBody(btCollisionShape * shape, float mass, const scythe::Vector3& position)
+{
+	btTransform transform;
+	transform.setIdentity();
+	transform.setOrigin(btVector3(position.x, position.y, position.z));
+	return CreateRigidBody(shape, mass, transform);
+}
+btRigidBody * PhysicsWorld::CreateRigidBody(btCollisionShape * shape, float mass, const btTransform& transform)
+{
+	btVector3 local_inertia(0.0f, 0.0f, 0.0f);
+	if (mass != 0.0f)
+		shape->calculateLocalInertia(mass, local_inertia);
+
+	TrackedMotionState * motion_state = new TrackedMotionState(transform, &moved_bodies_);
+	btRigidBody::btRigidBodyConstructionInfo info(mass, motion_state, shape, local_inertia);
+	btRigidBody * body = new btRigidBody(info);
+	motion_state->set_body(body);
+	world_->addRigidBody(body);
+	return body;
+}
+void PhysicsWorld::CreateRigidBodies(btCollisionShape * shape, float mass, const scythe::Vector3 * positions,
+	size_t count, btRigidBody ** bodies)
+{
+	if (count == 0)
+	{
+		shapes_.Release(shape);
+		return;
+	}
+	shapes_.AddReferences(shape, static_cast<unsigned int>(count - 1));
+
+	btVector3 local_inertia(0.0f, 0.0f, 0.0f);
+	if (mass != 0.0f)
+		shape->calculateLocalInertia(mass, local_inertia);
+
+	ReserveBodies(count);
+
+	btTransform transform;
+	transform.setIdentity();
+	for (size_t i = 0; i < count; ++i)
+	{
+		transform.setOrigin(btVector3(positions[i].x, positions[i].y, positions[i].z));
+		TrackedMotionState * motion_state = new TrackedMotionState(transform, &moved_bodies_);
+		btRigidBody::btRigidBodyConstructionInfo info(mass, motion_state, shape, local_inertia);
+		bodies[i] = new btRigidBody(info);
+		motion_state->set_body(bodies[i]);
+		world_->addRigidBody(bodies[i]);
+	}
+}
+void PhysicsWorld::DestroyRigidBody(btRigidBody * body)
+{
+	// Moved bodies are consumed right after the step, so stale list is just dropped
+	moved_bodies_.clear();
+	world_->removeRigidBody(body);
+	shapes_.Release(body->getCollisionShape());
+	delete body->getMotionState();
+	delete body;
+}
+void PhysicsWorld::DestroyAllRigidBodies()
+{
+	DeleteDynamicsWorld();
+	// Proxies of deleted bodies go away with the old broadphase
+	delete broadphase_;
+	broadphase_ = CreateBroadphase(broadphase_type_);
+	CreateDynamicsWorld();
+}
+void PhysicsWorld::ReserveBodies(size_t count)
+{
+	btAlignedObjectArray<btCollisionObject *>& objects = world_->getCollisionObjectArray();
+	objects.reserve(objects.size() + static_cast<int>(count));
+}
+const ShapeCacheStatistics& PhysicsWorld::shape_statistics() const
+{
+	return shapes_.statistics();
+}
+btDiscreteDynamicsWorld * PhysicsWorld::world() const
+{
+	return world_;
+}
+void PhysicsWorld::CreateDynamicsWorld()
+{
+#ifdef BT_THREADSAFE
+	btConstraintSolverPoolMt * solver_pool = static_cast<btConstraintSolverPoolMt *>(solver_);
+# if BT_BULLET_VERSION >= 288
+	world_ = new btDiscreteDynamicsWorldMt(dispatcher_, broadphase_, solver_pool, nullptr, collision_configuration_);
+# else
+	world_ = new btDiscreteDynamicsWorldMt(dispatcher_, broadphase_, solver_pool, collision_configuration_);
+# endif
+#else
+	world_ = new btDiscreteDynamicsWorld(dispatcher_, broadphase_, solver_, collision_configuration_);
+#endif
+	world_->setGravity(btVector3(0.0f, -9.8f, 0.0f));
+}
+void PhysicsWorld::DeleteDynamicsWorld()
+{
+	moved_bodies_.clear();
+
+	// Collision algorithms and their manifolds are returned to dispatcher pools
+	btOverlappingPairCache * pair_cache = broadphase_->getOverlappingPairCache();
+	btBroadphasePairArray& pairs = pair_cache->getOverlappingPairArray();
+	for (int i = 0; i < pairs.size(); ++i)
+		pair_cache->cleanOverlappingPair(pairs[i], dispatcher_);
+
+	// Bodies are deleted along with the world instead of being removed one by one,
+	// since each removal searches world arrays linearly. Detached bodies are skipped
+	// by world destructor, their proxies stay in broadphase.
+	const btAlignedObjectArray<btCollisionObject *> objects = world_->getCollisionObjectArray();
+	for (int i = 0; i < objects.size(); ++i)
+		objects[i]->setBroadphaseHandle(nullptr);
+	delete world_;
+	world_ = nullptr;
+	for (int i = objects.size() - 1; i >= 0; --i)
+	{
+		btRigidBody * body = btRigidBody::upcast(objects[i]);
+		if (!body)
+			continue;
+		shapes_.Release(body->getCollisionShape());
+		delete body->getMotionState();
+		delete body;
+	}
+}
\ No newline at end of file
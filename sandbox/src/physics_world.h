@@ -0,0 +1,120 @@
+#ifndef __PHYSICS_WORLD_H__
+#define __PHYSICS_WORLD_H__
+
+#include "shape_cache.h"
+
+#include "common/non_copyable.h"
+#include "math/vector3.h"
+
+#include <vector>
+
+struct MeshData;
+
+class btCollisionShape;
+class btRigidBody;
+class btTransform;
+class btDefaultCollisionConfiguration;
+class btCollisionDispatcher;
+class btBroadphaseInterface;
+class btConstraintSolver;
+class btDiscreteDynamicsWorld;
+
+/**
+ * Bullet dynamics world owned by the sandbox.
+ * Bodies are referenced by object pool directly, so no scene graph is involved.
+ * When Bullet is built with BT_THREADSAFE, narrowphase and island solving run on
+ * Bullet's task scheduler threads.
+ */
+class PhysicsWorld final : public scythe::NonCopyable {
+public:
+	enum Broadphase : unsigned int {
+		kDynamicTreeBroadphase, //!< incremental AABB tree, good default for moving bodies
+		kSweepAndPruneBroadphase, //!< sorted axis lists inside fixed world bounds
+		kSimpleBroadphase, //!< brute force pair test, reference for small scenes
+		kNumBroadphases
+	};
+
+	PhysicsWorld();
+	~PhysicsWorld();
+
+	bool Initialize(Broadphase broadphase = kDynamicTreeBroadphase);
+	void Deinitialize();
+
+	void Update(float sec);
+	/**
+	 * Bodies whose motion states were updated by the last Update.
+	 * Bullet updates motion states of active bodies only, so sleeping ones never get here.
+	 * List is cleared when any body is destroyed.
+	 */
+	const std::vector<btRigidBody *>& moved_bodies() const;
+
+	/**
+	 * Replaces broadphase keeping all the bodies and their states.
+	 * Bodies get new proxies, so overlapping pairs are found again on the next step.
+	 */
+	void SetBroadphase(Broadphase broadphase);
+	Broadphase broadphase() const;
+	static const char * GetBroadphaseName(Broadphase broadphase);
+	//! Overlapping pairs found by broadphase on the last step
+	unsigned int num_overlapping_pairs() const;
+
+	//! Task scheduler is shared by all worlds, count is clamped to [1; max_threads]
+	static void SetNumThreads(unsigned int count);
+	static unsigned int num_threads();
+	//! Is one when multithreading isn't compiled in
+	static unsigned int max_threads();
+
+	//! Shapes are shared between bodies with equal parameters, body takes the acquired reference
+	btCollisionShape * AcquireSphereShape(float radius);
+	btCollisionShape * AcquireBoxShape(const scythe::Vector3& half_extents);
+	//! Mesh data is identified by its address and should outlive the shape
+	btCollisionShape * AcquireMeshShape(const MeshData& data, const scythe::Vector3& scale);
+	//! Convex hull of mesh vertices, zero max vertices keeps all hull vertices
+	btCollisionShape * AcquireHullShape(const MeshData& data, const scythe::Vector3& scale, unsigned int max_vertices = 0);
+
+	//! Acquires shape by cache key, mesh shapes expect key source to be MeshData
+	btCollisionShape * AcquireShape(const ShapeCache::Key& key);
+	void AddShapeReferences(btCollisionShape * shape, unsigned int count);
+	void ReleaseShape(btCollisionShape * shape);
+	//! Returns false for shapes that weren't acquired from the world
+	bool GetShapeKey(const btCollisionShape * shape, ShapeCache::Key * key) const;
+
+	//! Zero mass makes static body
+	btRigidBody * CreateRigidBody(btCollisionShape * shape, float mass, const scythe::Vector3& position);
+	btRigidBody * CreateRigidBody(btCollisionShape * shape, float mass, const btTransform& transform);
+	/**
+	 * Creates bodies with the same shape and mass in one batch.
+	 * Inertia is computed once and world storage is reserved up front.
+	 * Shape reference acquired by the caller is shared by all the bodies.
+	 */
+	void CreateRigidBodies(btCollisionShape * shape, float mass, const scythe::Vector3 * positions,
+		size_t count, btRigidBody ** bodies);
+	//! Also releases body's shape reference
+	void DestroyRigidBody(btRigidBody * body);
+	//! Destroys all the bodies by rebuilding the world, linear in body count
+	void DestroyAllRigidBodies();
+	//! Reserves world storage for additional bodies
+	void ReserveBodies(size_t count);
+
+	const ShapeCacheStatistics& shape_statistics() const;
+
+	btDiscreteDynamicsWorld * world() const;
+
+private:
+	//! Creates world on top of existing dispatcher, broadphase and solver
+	void CreateDynamicsWorld();
+	//! Deletes world together with all its bodies
+	void DeleteDynamicsWorld();
+
+	btDefaultCollisionConfiguration * collision_configuration_;
+	btCollisionDispatcher * dispatcher_;
+	btBroadphaseInterface * broadphase_;
+	btConstraintSolver * solver_; //!< solver pool in multithreaded mode
+	btDiscreteDynamicsWorld * world_;
+
+	Broadphase broadphase_type_;
+	ShapeCache shapes_;
+	std::vector<btRigidBody *> moved_bodies_;
+};
+
+#endif
\ No newline at end of file
@@ -7,41 +7,86 @@
  * [-] 3. Add mesh-based physical objects (tetrahedron as example).
  */
 
-#include "object.h"
+#include "object_pool.h"
+#include "physics_world.h"
+#include "world_snapshot.h"
 #include "parser.h"
 #include "console.h"
+#include "command_channel.h"
+#include "benchmarks.h"
+#include "mesh_lod.h"
+#include "instanced_mesh.h"
+#include "render_queue.h"
 
-#include "model/mesh.h"
 #include "graphics/text.h"
 #include "math/constants.h"
-
-// Physics specific modules
-#include "common/sc_delete.h"
-#include "model/model.h"
-#include "node.h"
-#include "physics/physics_controller.h"
-#include "physics/physics_rigid_body.h"
+#include "common/string_format.h"
 
 #include "declare_main.h"
 
 #include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+	//! Mesh identifiers for render queue, sphere LOD levels follow the base sphere one
+	enum MeshId : unsigned int {
+		kBoxMesh,
+		kTetrahedronMesh,
+		kSphereMesh
+	};
+	const float kFarPlane = 100.0f;
+
+	//! Smooth color gradient for batches, t is in [0; 1]
+	scythe::Vector3 GradientColor(float t)
+	{
+		return scythe::Vector3(
+			0.5f + 0.5f * cosf(2.0f * scythe::kPi * t),
+			0.5f + 0.5f * cosf(2.0f * scythe::kPi * (t + 0.33f)),
+			0.5f + 0.5f * cosf(2.0f * scythe::kPi * (t + 0.67f)));
+	}
+	//! Where object instance is stored, list is mesh identifier with sphere level added
+	struct InstanceLocation {
+		unsigned int list;
+		unsigned int index;
+	};
+	//! Maximal number of objects (or benchmark items) a single command may create
+	const unsigned int kMaxObjectCount = 1u << 20;
+	//! Whole part of count argument, NaN and negative values give zero
+	double CountArgument(float value)
+	{
+		return (value > 0.0f) ? floor(static_cast<double>(value)) : 0.0;
+	}
+	//! Count argument clamped to kMaxObjectCount, so the conversion is always defined
+	unsigned int ToCount(float value)
+	{
+		return static_cast<unsigned int>(std::min(CountArgument(value), static_cast<double>(kMaxObjectCount)));
+	}
+}
 
 class SandboxApp : public scythe::OpenGlApplication
 				 , public scythe::DesktopInputListener
 				 , public IObjectCreator
+				 , public IBenchmarkRunner
+				 , public ISnapshotStorage
+				 , public IPhysicsSettings
+				 , public IRenderQueueExecutor
 {
 public:
 	SandboxApp()
-	: sphere_mesh_(nullptr)
-	, box_mesh_(nullptr)
-	, tetra_mesh_(nullptr)
-	, sphere_model_(nullptr)
-	, box_model_(nullptr)
-	, tetra_model_(nullptr)
-	, font_(nullptr)
+	: font_(nullptr)
 	, fps_text_(nullptr)
+	, stats_text_(nullptr)
 	, parser_(nullptr)
 	, console_(nullptr)
+	, fov_degrees_(90.0f)
+	, current_mesh_(nullptr)
+	, instances_height_(0)
+	, use_instancing_(true)
 	{
 		SetInputListener(this);
 	}
@@ -59,49 +104,48 @@ public:
 
 		object_shader_->Bind();
 		object_shader_->Uniform3fv("u_light.color", kLightColor);
-		object_shader_->Unbind();
+
+		object_instanced_shader_->Bind();
+		object_instanced_shader_->Uniform3fv("u_light.color", kLightColor);
+		object_instanced_shader_->Unbind();
 	}
 	void BindShaderVariables()
 	{
 		object_shader_->Bind();
 		object_shader_->Uniform3fv("u_light.position", light_position_);
-		object_shader_->Unbind();
+
+		object_instanced_shader_->Bind();
+		object_instanced_shader_->Uniform3fv("u_light.position", light_position_);
+		object_instanced_shader_->Unbind();
+	}
+	ObjectHandle CreateSphere(const scythe::Vector3& position, float radius, const scythe::Vector3& color, float mass)
+	{
+		btRigidBody * body = physics_world_.CreateRigidBody(physics_world_.AcquireSphereShape(radius), mass, position);
+		return objects_.Add(body, scythe::Vector3(radius), color, kSphereMesh, radius);
+	}
+	ObjectHandle CreateBox(const scythe::Vector3& position, const scythe::Vector3& extents, const scythe::Vector3& color, float mass)
+	{
+		// Cube mesh has unit half size, so extents are half sizes
+		btRigidBody * body = physics_world_.CreateRigidBody(physics_world_.AcquireBoxShape(extents), mass, position);
+		return objects_.Add(body, extents, color, kBoxMesh, 0.0f);
+	}
+	ObjectHandle CreateTetrahedron(const scythe::Vector3& position, float scale, const scythe::Vector3& color, float mass)
+	{
+		const scythe::Vector3 scales(scale);
+		btRigidBody * body = physics_world_.CreateRigidBody(physics_world_.AcquireHullShape(tetra_data_, scales), mass, position);
+		return objects_.Add(body, scales, color, kTetrahedronMesh, 0.0f);
+	}
+	void DestroyObject(ObjectHandle handle)
+	{
+		if (!objects_.IsValid(handle))
+			return;
+		physics_world_.DestroyRigidBody(objects_.bodies()[objects_.IndexOf(handle)]);
+		objects_.Remove(handle);
 	}
-	void CreateSphere(const scythe::Vector3& position, float radius, const scythe::Vector3& color, float mass)
-	{
-		scythe::PhysicsRigidBody::Parameters params(mass);
-		scythe::Node * node = scythe::Node::Create("sphere");
-		node->SetTranslation(position);
-		node->SetScale(radius);
-		node->SetDrawable(sphere_model_);
-		node->SetCollisionObject(scythe::PhysicsCollisionObject::kRigidBody,
-			scythe::PhysicsCollisionShape::DefineSphere(radius),
-			&params);
-		objects_.push_back(Object(node, color));
-	}
-	void CreateBox(const scythe::Vector3& position, const scythe::Vector3& extents, const scythe::Vector3& color, float mass)
-	{
-		scythe::PhysicsRigidBody::Parameters params(mass);
-		scythe::Node * node = scythe::Node::Create("box");
-		node->SetTranslation(position);
-		node->SetScale(extents);
-		node->SetDrawable(box_model_);
-		node->SetCollisionObject(scythe::PhysicsCollisionObject::kRigidBody,
-			scythe::PhysicsCollisionShape::DefineBox(extents),
-			&params);
-		objects_.push_back(Object(node, color));
-	}
-	void CreateTetrahedron(const scythe::Vector3& position, float scale, const scythe::Vector3& color, float mass)
-	{
-		scythe::PhysicsRigidBody::Parameters params(mass);
-		scythe::Node * node = scythe::Node::Create("tetrahedron");
-		node->SetTranslation(position);
-		node->SetScale(scale);
-		node->SetDrawable(tetra_model_);
-		node->SetCollisionObject(scythe::PhysicsCollisionObject::kRigidBody,
-			scythe::PhysicsCollisionShape::DefineMesh(tetra_mesh_),
-			&params);
-		objects_.push_back(Object(node, color));
+	void DestroyAllObjects()
+	{
+		physics_world_.DestroyAllRigidBodies();
+		objects_.Clear();
 	}
 	void CreateSphere(float pos_x, float pos_y, float pos_z, float radius,
 		float color_x, float color_y, float color_z, float mass) final
@@ -115,53 +159,229 @@ public:
 		CreateBox(scythe::Vector3(pos_x, pos_y, pos_z), scythe::Vector3(extent_x, extent_y, extent_z),
 			scythe::Vector3(color_x, color_y, color_z), mass);
 	}
-	bool Load() final
+	//! Creates objects from spawn positions and colors with a single shape
+	void SpawnBatch(btCollisionShape * shape, float mass, const scythe::Vector3& scale,
+		unsigned int mesh_id, float radius)
 	{
-		scythe::PhysicsController::CreateInstance();
-		if (!scythe::PhysicsController::GetInstance()->Initialize())
-			return false;
-
-		// Vertex formats
-		scythe::VertexFormat * object_vertex_format;
+		const size_t count = spawn_positions_.size();
+		spawn_bodies_.resize(count);
+		physics_world_.CreateRigidBodies(shape, mass, spawn_positions_.data(), count, spawn_bodies_.data());
+		objects_.Reserve(objects_.size() + count);
+		for (size_t i = 0; i < count; ++i)
+			objects_.Add(spawn_bodies_[i], scale, spawn_colors_[i], mesh_id, radius);
+		spawn_positions_.clear();
+		spawn_colors_.clear();
+	}
+	//! Fails command if it would create more than kMaxObjectCount objects
+	bool CheckObjectCount(const char * command, double count)
+	{
+		if (count <= static_cast<double>(kMaxObjectCount))
+			return true;
+		parser_->output()->Fail(scythe::string_format("%s: %.0f objects exceed the limit of %u",
+			command, count, kMaxObjectCount));
+		return false;
+	}
+	void CreateSphereGrid(float pos_x, float pos_y, float pos_z,
+		float count_x, float count_y, float count_z, float radius, float mass) final
+	{
+		if (!CheckObjectCount("CreateSphereGrid", CountArgument(count_x) * CountArgument(count_y) * CountArgument(count_z)))
+			return;
+		const unsigned int nx = ToCount(count_x);
+		const unsigned int ny = ToCount(count_y);
+		const unsigned int nz = ToCount(count_z);
+		const float spacing = 2.2f * radius;
+		const float offset_x = 0.5f * spacing * static_cast<float>(nx - 1);
+		const float offset_z = 0.5f * spacing * static_cast<float>(nz - 1);
+		spawn_positions_.reserve(nx * ny * nz);
+		spawn_colors_.reserve(nx * ny * nz);
+		for (unsigned int j = 0; j < ny; ++j)
+			for (unsigned int k = 0; k < nz; ++k)
+				for (unsigned int i = 0; i < nx; ++i)
+				{
+					spawn_positions_.push_back(scythe::Vector3(
+						pos_x + spacing * static_cast<float>(i) - offset_x,
+						pos_y + spacing * static_cast<float>(j),
+						pos_z + spacing * static_cast<float>(k) - offset_z));
+					spawn_colors_.push_back(GradientColor(static_cast<float>(j) / static_cast<float>(ny)));
+				}
+		SpawnBatch(physics_world_.AcquireSphereShape(radius), mass, scythe::Vector3(radius), kSphereMesh, radius);
+	}
+	void CreateBoxPyramid(float pos_x, float pos_y, float pos_z,
+		float base_count, float extent, float mass) final
+	{
+		const double base_argument = CountArgument(base_count);
+		if (!CheckObjectCount("CreateBoxPyramid", base_argument * (base_argument + 1.0) * (2.0 * base_argument + 1.0) / 6.0))
+			return;
+		const unsigned int base = ToCount(base_count);
+		const float size = 2.0f * extent;
+		spawn_positions_.reserve(base * (base + 1) * (2 * base + 1) / 6);
+		spawn_colors_.reserve(base * (base + 1) * (2 * base + 1) / 6);
+		// Each layer is a square one box smaller than the previous one
+		for (unsigned int layer = 0; layer < base; ++layer)
 		{
-			scythe::VertexAttribute attributes[] = {
-				scythe::VertexAttribute(scythe::VertexAttribute::kVertex, 3),
-				scythe::VertexAttribute(scythe::VertexAttribute::kNormal, 3)
-			};
-			renderer_->AddVertexFormat(object_vertex_format, attributes, _countof(attributes));
+			const unsigned int side = base - layer;
+			const float offset = 0.5f * size * static_cast<float>(side - 1);
+			for (unsigned int k = 0; k < side; ++k)
+				for (unsigned int i = 0; i < side; ++i)
+				{
+					spawn_positions_.push_back(scythe::Vector3(
+						pos_x + size * static_cast<float>(i) - offset,
+						pos_y + extent + size * static_cast<float>(layer),
+						pos_z + size * static_cast<float>(k) - offset));
+					spawn_colors_.push_back(GradientColor(static_cast<float>(layer) / static_cast<float>(base)));
+				}
 		}
-
-		// Sphere mesh
-		sphere_mesh_ = new scythe::Mesh(renderer_);
-		sphere_mesh_->CreateSphere(1.0f, 128, 64);
-		if (!sphere_mesh_->MakeRenderable(object_vertex_format))
+		SpawnBatch(physics_world_.AcquireBoxShape(scythe::Vector3(extent)), mass, scythe::Vector3(extent), kBoxMesh, 0.0f);
+	}
+	void CreateBoxStack(float pos_x, float pos_y, float pos_z,
+		float count, float extent, float mass) final
+	{
+		if (!CheckObjectCount("CreateBoxStack", CountArgument(count)))
+			return;
+		const unsigned int height = ToCount(count);
+		spawn_positions_.reserve(height);
+		spawn_colors_.reserve(height);
+		for (unsigned int i = 0; i < height; ++i)
+		{
+			spawn_positions_.push_back(scythe::Vector3(pos_x, pos_y + extent * static_cast<float>(2 * i + 1), pos_z));
+			spawn_colors_.push_back(GradientColor(static_cast<float>(i) / static_cast<float>(height)));
+		}
+		SpawnBatch(physics_world_.AcquireBoxShape(scythe::Vector3(extent)), mass, scythe::Vector3(extent), kBoxMesh, 0.0f);
+	}
+	void CreateSphereRain(float min_x, float min_y, float min_z,
+		float max_x, float max_y, float max_z, float count, float radius, float mass) final
+	{
+		if (!CheckObjectCount("CreateSphereRain", CountArgument(count)))
+			return;
+		const unsigned int num_spheres = ToCount(count);
+		std::mt19937 generator(num_spheres);
+		std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+		spawn_positions_.reserve(num_spheres);
+		spawn_colors_.reserve(num_spheres);
+		for (unsigned int i = 0; i < num_spheres; ++i)
+		{
+			spawn_positions_.push_back(scythe::Vector3(
+				min_x + (max_x - min_x) * distribution(generator),
+				min_y + (max_y - min_y) * distribution(generator),
+				min_z + (max_z - min_z) * distribution(generator)));
+			spawn_colors_.push_back(GradientColor(distribution(generator)));
+		}
+		SpawnBatch(physics_world_.AcquireSphereShape(radius), mass, scythe::Vector3(radius), kSphereMesh, radius);
+	}
+	void BenchmarkRenderQueue(float draw_count) final
+	{
+		if (CheckObjectCount("BenchmarkRenderQueue", CountArgument(draw_count)))
+			parser_->output()->Print(::BenchmarkRenderQueue(ToCount(draw_count)));
+	}
+	void BenchmarkHullShapes(float body_count) final
+	{
+		if (CheckObjectCount("BenchmarkHullShapes", CountArgument(body_count)))
+			parser_->output()->Print(::BenchmarkHullShapes(ToCount(body_count)));
+	}
+	void BenchmarkThreadScaling(float body_count) final
+	{
+		if (CheckObjectCount("BenchmarkThreadScaling", CountArgument(body_count)))
+			parser_->output()->Print(::BenchmarkThreadScaling(ToCount(body_count)));
+	}
+	void BenchmarkBroadphases(float body_count) final
+	{
+		if (CheckObjectCount("BenchmarkBroadphases", CountArgument(body_count)))
+			parser_->output()->Print(::BenchmarkBroadphases(ToCount(body_count)));
+	}
+	void SetBroadphase(float type) final
+	{
+		const unsigned int index = std::min(ToCount(type), static_cast<unsigned int>(PhysicsWorld::kNumBroadphases) - 1);
+		physics_world_.SetBroadphase(static_cast<PhysicsWorld::Broadphase>(index));
+		parser_->output()->Print(scythe::string_format("broadphase: %s",
+			PhysicsWorld::GetBroadphaseName(physics_world_.broadphase())));
+	}
+	void SetPhysicsThreads(float count) final
+	{
+		PhysicsWorld::SetNumThreads(ToCount(count));
+		parser_->output()->Print(scythe::string_format("physics threads: %u of %u",
+			PhysicsWorld::num_threads(), PhysicsWorld::max_threads()));
+	}
+	bool SaveSnapshot(const std::string& filename, std::string * result) final
+	{
+		const MeshData * mesh_sources[] = {&tetra_data_};
+		world_snapshot_.Capture(objects_, physics_world_, mesh_sources, _countof(mesh_sources));
+		if (!world_snapshot_.Save(filename, result))
 			return false;
-
-		// Box mesh
-		box_mesh_ = new scythe::Mesh(renderer_);
-		box_mesh_->CreateCube();
-		if (!box_mesh_->MakeRenderable(object_vertex_format))
+		*result = scythe::string_format("saved %u objects, %u bytes",
+			static_cast<unsigned int>(world_snapshot_.num_objects()), static_cast<unsigned int>(world_snapshot_.size()));
+		return true;
+	}
+	bool LoadSnapshot(const std::string& filename, std::string * result) final
+	{
+		const MeshData * mesh_sources[] = {&tetra_data_};
+		typedef std::chrono::high_resolution_clock Clock;
+		// Current scene is kept if file is invalid
+		if (!world_snapshot_.Load(filename, _countof(mesh_sources), result))
+			return false;
+		const Clock::time_point clear_start = Clock::now();
+		DestroyAllObjects();
+		const Clock::time_point restore_start = Clock::now();
+		world_snapshot_.Restore(&physics_world_, &objects_, mesh_sources, _countof(mesh_sources));
+		const Clock::time_point restore_end = Clock::now();
+		const double clear_time = std::chrono::duration<double, std::milli>(restore_start - clear_start).count();
+		const double restore_time = std::chrono::duration<double, std::milli>(restore_end - restore_start).count();
+		*result = scythe::string_format("loaded %u objects in %.3f ms, previous scene cleared in %.3f ms",
+			static_cast<unsigned int>(world_snapshot_.num_objects()), restore_time, clear_time);
+		return true;
+	}
+	bool Load() final
+	{
+		if (!physics_world_.Initialize())
 			return false;
 
-		// Tetrahedron mesh
-		tetra_mesh_ = new scythe::Mesh(renderer_);
-		tetra_mesh_->CreateTetrahedron();
-		if (!tetra_mesh_->MakeRenderable(object_vertex_format, true))
+		// Sphere mesh with levels of detail
+		if (!sphere_lod_.CreateSphere(1.0f, 128, 64, 4, StaticMesh::kNormal))
 			return false;
 
-		// Models
-		sphere_model_ = scythe::Model::Create(sphere_mesh_);
-		box_model_ = scythe::Model::Create(box_mesh_);
-		tetra_model_ = scythe::Model::Create(tetra_mesh_);
+		// Box and tetrahedron meshes
+		{
+			MeshData box_data;
+			box_data.CreateCube();
+			OptimizeMesh(&box_data);
+			if (!box_mesh_.Create(box_data, StaticMesh::kNormal))
+				return false;
+			if (!instanced_box_.Create(box_data, InstancedMesh::kNormal))
+				return false;
+
+			// Tetrahedron data is also used for physical shapes
+			tetra_data_.CreateTetrahedron();
+			OptimizeMesh(&tetra_data_);
+			if (!tetra_mesh_.Create(tetra_data_, StaticMesh::kNormal))
+				return false;
+			if (!instanced_tetra_.Create(tetra_data_, InstancedMesh::kNormal))
+				return false;
+		}
 
-		// Nodes
+		// Instanced meshes
+		if (!instanced_sphere_lod_.CreateSphere(1.0f, 128, 64, 4, InstancedMesh::kNormal))
+			return false;
+
+		// Objects
 		CreateBox(scythe::Vector3(0.0f, 0.0f, 0.0f), scythe::Vector3(5.0f, 1.0f, 5.0f), scythe::Vector3(0.1f, 1.0f, 0.2f), 0.0f);
 		CreateSphere(scythe::Vector3(0.0f, 3.0f, 0.0f), 2.0f, scythe::Vector3(1.0f, 0.0f, 0.0f), 0.1f);
 		CreateSphere(scythe::Vector3(0.5f, 5.0f, 0.5f), 1.0f, scythe::Vector3(0.8f, 0.0f, 0.5f), 0.2f);
 		CreateTetrahedron(scythe::Vector3(1.5f, 4.0f, 0.5f), 1.0f, scythe::Vector3(0.2f, 0.0f, 1.0f), 0.2f);
 		
 		// Load shaders
+		const char* object_instanced_shader_defines[] = {
+			"USE_INSTANCING"
+		};
+		scythe::ShaderInfo object_instanced_shader_info(
+			"data/shaders/sandbox/object", // base filename
+			nullptr, // no vertex filename
+			nullptr, // no fragment filename
+			nullptr, // array of attribs
+			0, // number of attribs
+			object_instanced_shader_defines, // array of defines
+			_countof(object_instanced_shader_defines) // number of defines
+			);
 		if (!renderer_->AddShader(object_shader_, "data/shaders/sandbox/object")) return false;
+		if (!renderer_->AddShader(object_instanced_shader_, object_instanced_shader_info)) return false;
 		if (!renderer_->AddShader(text_shader_, "data/shaders/text")) return false;
 		if (!renderer_->AddShader(gui_shader_, "data/shaders/gui_colored")) return false;
 
@@ -173,22 +393,37 @@ public:
 		if (!fps_text_)
 			return false;
 
+		stats_text_ = scythe::DynamicText::Create(renderer_, 80);
+		if (!stats_text_)
+			return false;
+
 		// Create parser
-		parser_ = new Parser(this);
+		parser_ = new Parser(this, this, this, this);
 
 		// Create console
 		console_ = new Console(renderer_, font_, gui_shader_, text_shader_,
 			0.6f, 0.05f, 0.6f, aspect_ratio_);
-		console_->set_parser(parser_->object());
+		console_->set_parser(parser_);
+
+		// SANDBOX_COMMANDS is either 'stdin' or UNIX socket path
+		const char * channel = getenv("SANDBOX_COMMANDS");
+		if (channel && *channel)
+		{
+			const bool opened = (strcmp(channel, "stdin") == 0)
+				? command_channel_.OpenStdin()
+				: command_channel_.OpenSocket(channel);
+			console_->Print(scythe::string_format("command channel %s: %s", channel, opened ? "opened" : "failed"));
+		}
 
 		// Matrices setup
 		scythe::Matrix4 projection;
-		scythe::Matrix4::CreatePerspective(90.0f, aspect_ratio_, 0.1f, 100.0f, &projection);
+		scythe::Matrix4::CreatePerspective(fov_degrees_, aspect_ratio_, 0.1f, kFarPlane, &projection);
 		renderer_->SetProjectionMatrix(projection);
 
-		scythe::Vector3 eye(10.0f, 5.0f, 0.0f), target(0.0f, 0.0f, 0.0f);
+		scythe::Vector3 target(0.0f, 0.0f, 0.0f);
+		eye_position_.Set(10.0f, 5.0f, 0.0f);
 		scythe::Matrix4 view_matrix;
-		scythe::Matrix4::CreateLookAt(eye, target, scythe::Vector3::UnitY(), &view_matrix);
+		scythe::Matrix4::CreateLookAt(eye_position_, target, scythe::Vector3::UnitY(), &view_matrix);
 		renderer_->SetViewMatrix(view_matrix);
 
 		projection_view_matrix_ = renderer_->projection_matrix() * renderer_->view_matrix();
@@ -203,22 +438,25 @@ public:
 	}
 	void Unload() final
 	{
+		command_channel_.Close();
 		if (console_)
 			delete console_;
 		if (parser_)
 			delete parser_;
+		if (stats_text_)
+			delete stats_text_;
 		if (fps_text_)
 			delete fps_text_;
-		objects_.clear(); // release nodes
-		SC_SAFE_RELEASE(tetra_model_);
-		SC_SAFE_RELEASE(box_model_);
-		SC_SAFE_RELEASE(sphere_model_);
-		SC_SAFE_RELEASE(tetra_mesh_);
-		SC_SAFE_RELEASE(box_mesh_);
-		SC_SAFE_RELEASE(sphere_mesh_);
-
-		scythe::PhysicsController::GetInstance()->Deinitialize();
-		scythe::PhysicsController::DestroyInstance();
+		// Bodies are deleted with the world
+		objects_.Clear();
+		tetra_mesh_.Release();
+		box_mesh_.Release();
+		sphere_lod_.Release();
+		instanced_tetra_.Release();
+		instanced_box_.Release();
+		instanced_sphere_lod_.Release();
+
+		physics_world_.Deinitialize();
 	}
 	void Update() final
 	{
@@ -226,35 +464,225 @@ public:
 
 		const float kFrameTime = GetFrameTime();
 		console_->Update(kFrameTime);
+
+		ProcessChannelCommands();
+	}
+	/**
+	 * Executes all commands received since the previous frame.
+	 * Each reply is header line 'ok|error <time> ms', result lines and a line with single dot.
+	 * Batch ends with 'batch <count> <time> ms' line to each client that sent commands.
+	 */
+	void ProcessChannelCommands()
+	{
+		if (!command_channel_.is_open())
+			return;
+		command_channel_.Receive(&channel_commands_);
+		if (channel_commands_.empty())
+			return;
+
+		typedef std::chrono::high_resolution_clock Clock;
+		const Clock::time_point batch_start = Clock::now();
+		std::string result;
+		for (const auto& command : channel_commands_)
+		{
+			const Clock::time_point start = Clock::now();
+			const bool succeeded = parser_->Execute(command.text, &result);
+			const double time = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			std::string reply = scythe::string_format("%s %.3f ms\n", succeeded ? "ok" : "error", time);
+			if (!result.empty())
+			{
+				reply += result;
+				if (result.back() != '\n')
+					reply += '\n';
+			}
+			reply += ".\n";
+			command_channel_.Reply(command.client, reply);
+		}
+		const double batch_time = std::chrono::duration<double, std::milli>(Clock::now() - batch_start).count();
+
+		// Summary goes once to every client of the batch
+		std::vector<unsigned int> clients;
+		for (const auto& command : channel_commands_)
+			if (std::find(clients.begin(), clients.end(), command.client) == clients.end())
+				clients.push_back(command.client);
+		for (unsigned int client : clients)
+			command_channel_.Reply(client, scythe::string_format("batch %u %.3f ms\n",
+				static_cast<unsigned int>(channel_commands_.size()), batch_time));
 	}
 	void UpdatePhysics(float sec) final
 	{
-		scythe::PhysicsController::GetInstance()->Update(sec);
+		physics_world_.Update(sec);
+		objects_.SyncTransforms(physics_world_.moved_bodies());
+	}
+	void BindPass(unsigned int) final
+	{
+		// Objects are drawn in a single pass
 	}
-	void RenderNode(scythe::Node * node, const scythe::Vector3& color)
+	void BindShader(unsigned int) final
+	{
+		// There is a single object shader for now
+		object_shader_->Bind();
+		object_shader_->UniformMatrix4fv("u_projection_view", projection_view_matrix_);
+	}
+	void BindMaterial(unsigned int) final
+	{
+		// Objects differ only by color, which is set per draw
+	}
+	void BindMesh(unsigned int mesh) final
+	{
+		if (mesh == kBoxMesh)
+			current_mesh_ = &box_mesh_;
+		else if (mesh == kTetrahedronMesh)
+			current_mesh_ = &tetra_mesh_;
+		else
+			current_mesh_ = sphere_lod_.mesh(mesh - kSphereMesh);
+	}
+	void Draw(unsigned int item) final
 	{
 		renderer_->PushMatrix();
-		renderer_->LoadMatrix(node->GetWorldMatrix());
+		renderer_->LoadMatrix(objects_.transforms()[item]);
 
 		object_shader_->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		object_shader_->Uniform3fv("u_color", color);
-		
-		node->GetDrawable()->Draw();
-		
+		object_shader_->Uniform3fv("u_color", objects_.colors()[item]);
+
+		current_mesh_->Render();
+
 		renderer_->PopMatrix();
 	}
 	void RenderObjects()
 	{
-		object_shader_->Bind();
-		object_shader_->UniformMatrix4fv("u_projection_view", projection_view_matrix_);
+		LodSelector lod_selector;
+		lod_selector.SetPerspective(eye_position_, fov_degrees_, static_cast<float>(height_));
 
-		for (auto& object : objects_)
+		const std::vector<scythe::Vector3>& positions = objects_.positions();
+		const std::vector<unsigned int>& mesh_ids = objects_.mesh_ids();
+		const std::vector<float>& radii = objects_.radii();
+
+		render_queue_.Clear();
+		for (size_t i = 0; i < objects_.size(); ++i)
 		{
-			RenderNode(object.node(), object.color());
+			const scythe::Vector3& position = positions[i];
+			unsigned int mesh = mesh_ids[i];
+			if (mesh == kSphereMesh)
+				mesh += sphere_lod_.SelectLevel(lod_selector.ProjectedSize(position, radii[i]));
+			const float dx = position.x - eye_position_.x;
+			const float dy = position.y - eye_position_.y;
+			const float dz = position.z - eye_position_.z;
+			const float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+			render_queue_.Submit(draw_key::Make(0, 0, 0, mesh, draw_key::QuantizeDepth(distance, kFarPlane)),
+				static_cast<unsigned int>(i));
 		}
+		render_queue_.Sort();
+		render_queue_.Execute(this);
 
 		object_shader_->Unbind();
 	}
+	//! Collects instances of all objects and uploads them
+	void RebuildInstances(const LodSelector& lod_selector)
+	{
+		box_instances_.clear();
+		tetra_instances_.clear();
+		instanced_sphere_lod_.BeginInstances();
+		instance_locations_.resize(objects_.size());
+		const std::vector<scythe::Matrix4>& transforms = objects_.transforms();
+		const std::vector<scythe::Vector3>& positions = objects_.positions();
+		const std::vector<scythe::Vector3>& colors = objects_.colors();
+		const std::vector<unsigned int>& mesh_ids = objects_.mesh_ids();
+		const std::vector<float>& radii = objects_.radii();
+		InstanceData instance;
+		for (size_t i = 0; i < objects_.size(); ++i)
+		{
+			MakeInstance(transforms[i], colors[i], &instance);
+			InstanceLocation& location = instance_locations_[i];
+			if (mesh_ids[i] == kSphereMesh)
+			{
+				const U32 level = instanced_sphere_lod_.SelectLevel(lod_selector.ProjectedSize(positions[i], radii[i]));
+				location.list = kSphereMesh + level;
+				location.index = static_cast<unsigned int>(instanced_sphere_lod_.num_instances(level));
+				instanced_sphere_lod_.AddInstance(level, instance);
+			}
+			else if (mesh_ids[i] == kBoxMesh)
+			{
+				location.list = kBoxMesh;
+				location.index = static_cast<unsigned int>(box_instances_.size());
+				box_instances_.push_back(instance);
+			}
+			else
+			{
+				location.list = kTetrahedronMesh;
+				location.index = static_cast<unsigned int>(tetra_instances_.size());
+				tetra_instances_.push_back(instance);
+			}
+		}
+		instanced_box_.SetInstances(box_instances_);
+		instanced_tetra_.SetInstances(tetra_instances_);
+		instanced_sphere_lod_.Upload();
+	}
+	/**
+	 * Rewrites instances of dirty objects and uploads only changed ranges.
+	 * Returns false when a sphere changes its level, so instances should be rebuilt.
+	 */
+	bool UpdateDirtyInstances(const LodSelector& lod_selector)
+	{
+		const std::vector<scythe::Matrix4>& transforms = objects_.transforms();
+		const std::vector<scythe::Vector3>& positions = objects_.positions();
+		const std::vector<scythe::Vector3>& colors = objects_.colors();
+		const std::vector<float>& radii = objects_.radii();
+		size_t box_first = box_instances_.size(), box_last = 0;
+		size_t tetra_first = tetra_instances_.size(), tetra_last = 0;
+		InstanceData instance;
+		for (unsigned int i : objects_.dirty_indices())
+		{
+			const InstanceLocation& location = instance_locations_[i];
+			MakeInstance(transforms[i], colors[i], &instance);
+			if (location.list >= kSphereMesh)
+			{
+				const U32 level = instanced_sphere_lod_.SelectLevel(lod_selector.ProjectedSize(positions[i], radii[i]));
+				if (kSphereMesh + level != location.list)
+					return false;
+				instanced_sphere_lod_.SetInstance(level, location.index, instance);
+			}
+			else if (location.list == kBoxMesh)
+			{
+				box_instances_[location.index] = instance;
+				box_first = std::min<size_t>(box_first, location.index);
+				box_last = std::max<size_t>(box_last, location.index + 1);
+			}
+			else
+			{
+				tetra_instances_[location.index] = instance;
+				tetra_first = std::min<size_t>(tetra_first, location.index);
+				tetra_last = std::max<size_t>(tetra_last, location.index + 1);
+			}
+		}
+		if (box_first < box_last)
+			instanced_box_.UpdateInstances(box_instances_.data(), box_first, box_last - box_first);
+		if (tetra_first < tetra_last)
+			instanced_tetra_.UpdateInstances(tetra_instances_.data(), tetra_first, tetra_last - tetra_first);
+		instanced_sphere_lod_.UploadDirty();
+		return true;
+	}
+	void RenderObjectsInstanced()
+	{
+		LodSelector lod_selector;
+		lod_selector.SetPerspective(eye_position_, fov_degrees_, static_cast<float>(height_));
+
+		// Settled objects aren't dirty, so their instances are neither rebuilt nor uploaded
+		if (objects_.structure_changed() || instances_height_ != height_ || !UpdateDirtyInstances(lod_selector))
+			RebuildInstances(lod_selector);
+		instances_height_ = height_;
+		objects_.ClearDirty();
+
+		// One draw call per mesh
+		object_instanced_shader_->Bind();
+		object_instanced_shader_->UniformMatrix4fv("u_projection_view", projection_view_matrix_);
+
+		instanced_box_.Render();
+		instanced_tetra_.Render();
+		instanced_sphere_lod_.Draw();
+
+		object_instanced_shader_->Unbind();
+	}
 	void RenderInterface()
 	{
 		renderer_->DisableDepthTest();
@@ -266,6 +694,12 @@ public:
 		fps_text_->SetText(font_, 0.0f, 0.8f, 0.05f, L"fps: %.2f", GetFrameRate());
 		fps_text_->Render();
 
+		const ShapeCacheStatistics& shapes = physics_world_.shape_statistics();
+		stats_text_->SetText(font_, 0.0f, 0.75f, 0.05f, L"objects: %u, shapes: %u, shape hits: %u, threads: %u",
+			static_cast<unsigned int>(objects_.size()), static_cast<unsigned int>(shapes.shapes),
+			static_cast<unsigned int>(shapes.hits), PhysicsWorld::num_threads());
+		stats_text_->Render();
+
 		// Draw console
 		console_->Render();
 		
@@ -278,7 +712,10 @@ public:
 		renderer_->ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		renderer_->ClearColorAndDepthBuffers();
 		
-		RenderObjects();
+		if (use_instancing_)
+			RenderObjectsInstanced();
+		else
+			RenderObjects();
 
 		RenderInterface();
 	}
@@ -302,6 +739,10 @@ public:
 			{
 				ToggleFullscreen();
 			}
+			else if (key == scythe::PublicKey::kI)
+			{
+				use_instancing_ = !use_instancing_;
+			}
 			else if (key == scythe::PublicKey::kEscape)
 			{
 				DesktopApplication::Terminate();
@@ -335,28 +776,47 @@ public:
 	}
 	
 private:
-	scythe::Mesh * sphere_mesh_;
-	scythe::Mesh * box_mesh_;
-	scythe::Mesh * tetra_mesh_;
-
-	scythe::Model * sphere_model_;
-	scythe::Model * box_model_;
-	scythe::Model * tetra_model_;
+	MeshLod sphere_lod_;
+	StaticMesh box_mesh_;
+	StaticMesh tetra_mesh_;
+	MeshData tetra_data_;
 
 	scythe::Shader * object_shader_;
+	scythe::Shader * object_instanced_shader_;
 	scythe::Shader * text_shader_;
 	scythe::Shader * gui_shader_;
 
 	scythe::Font * font_;
 	scythe::DynamicText * fps_text_;
+	scythe::DynamicText * stats_text_;
 	Parser * parser_;
 	Console * console_;
+	CommandChannel command_channel_;
+	std::vector<CommandChannel::Command> channel_commands_;
 	
 	scythe::Matrix4 projection_view_matrix_;
 
+	scythe::Vector3 eye_position_;
 	scythe::Vector3 light_position_;
-
-	std::vector<Object> objects_;
+	const float fov_degrees_;
+
+	PhysicsWorld physics_world_;
+	ObjectPool objects_;
+	std::vector<scythe::Vector3> spawn_positions_; //!< batch creation scratch buffers
+	std::vector<scythe::Vector3> spawn_colors_;
+	std::vector<btRigidBody *> spawn_bodies_;
+	WorldSnapshot world_snapshot_;
+	RenderQueue render_queue_;
+	const StaticMesh * current_mesh_; //!< mesh bound by render queue
+
+	InstancedMeshLod instanced_sphere_lod_;
+	InstancedMesh instanced_box_;
+	InstancedMesh instanced_tetra_;
+	std::vector<InstanceData> box_instances_;
+	std::vector<InstanceData> tetra_instances_;
+	std::vector<InstanceLocation> instance_locations_; //!< for each object
+	int instances_height_; //!< sphere levels depend on viewport height
+	bool use_instancing_; //!< render queue path is used otherwise
 };
 
 DECLARE_MAIN(SandboxApp);
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include "script_runner.h"
+#include "command_output.h"
+
+#include "common/string_format.h"
+
+#include "script.h"
+
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+
+namespace {
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double ElapsedMilliseconds(const Clock::time_point& start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	void SkipSpaces(const std::string& text, size_t * position)
+	{
+		while (*position < text.size() && isspace(static_cast<unsigned char>(text[*position])))
+			++*position;
+	}
+	/**
+	 * Reads decimal number: optional minus, digits and optional fraction.
+	 * Console parser reads nothing else as a number, so exponents, hex, inf and nan
+	 * are left to it and fail the same way in scripts and console.
+	 */
+	bool ParseNumber(const std::string& text, size_t * position, float * value)
+	{
+		size_t end = *position;
+		if (end < text.size() && text[end] == '-')
+			++end;
+		const size_t digits_begin = end;
+		while (end < text.size() && isdigit(static_cast<unsigned char>(text[end])))
+			++end;
+		size_t num_digits = end - digits_begin;
+		if (end < text.size() && text[end] == '.')
+		{
+			const size_t fraction_begin = ++end;
+			while (end < text.size() && isdigit(static_cast<unsigned char>(text[end])))
+				++end;
+			num_digits += end - fraction_begin;
+		}
+		if (num_digits == 0)
+			return false;
+		*value = strtof(text.substr(*position, end - *position).c_str(), nullptr);
+		*position = end;
+		return true;
+	}
+	bool IsBlank(const std::string& text)
+	{
+		return text.find_first_not_of(" \t\r\n") == std::string::npos;
+	}
+	std::uint64_t HashContents(const std::string& text)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : text)
+		{
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+} // namespace
+
+ScriptRunner::ScriptRunner(console_script::Parser * parser, CommandOutput * output)
+: parser_(parser)
+, output_(output)
+{
+}
+void ScriptRunner::AddCommand(const char * name, unsigned int num_args, const Command& command)
+{
+	command_indices_[name] = static_cast<unsigned int>(commands_.size());
+	commands_.push_back(CommandInfo{command, num_args});
+	// Already compiled scripts may have evaluated this command by name
+	cache_.clear();
+}
+void ScriptRunner::ClearCache()
+{
+	cache_.clear();
+}
+bool ScriptRunner::CompileStatement(const std::string& statement, unsigned int line, Program * program) const
+{
+	// Name(number, number, ...)
+	size_t position = 0;
+	SkipSpaces(statement, &position);
+	const size_t name_begin = position;
+	while (position < statement.size() &&
+		(isalnum(static_cast<unsigned char>(statement[position])) || statement[position] == '_'))
+		++position;
+	auto it = command_indices_.find(statement.substr(name_begin, position - name_begin));
+	if (it == command_indices_.end())
+		return false;
+	SkipSpaces(statement, &position);
+	if (position >= statement.size() || statement[position] != '(')
+		return false;
+	++position;
+
+	const size_t first = program->args.size();
+	SkipSpaces(statement, &position);
+	if (position < statement.size() && statement[position] == ')')
+		++position;
+	else
+	{
+		for (;;)
+		{
+			float value;
+			SkipSpaces(statement, &position);
+			if (!ParseNumber(statement, &position, &value))
+			{
+				program->args.resize(first);
+				return false;
+			}
+			program->args.push_back(value);
+			SkipSpaces(statement, &position);
+			if (position < statement.size() && statement[position] == ',')
+			{
+				++position;
+				continue;
+			}
+			if (position < statement.size() && statement[position] == ')')
+			{
+				++position;
+				break;
+			}
+			program->args.resize(first);
+			return false;
+		}
+	}
+	SkipSpaces(statement, &position);
+	if (position != statement.size() || program->args.size() - first != commands_[it->second].num_args)
+	{
+		program->args.resize(first);
+		return false;
+	}
+	program->instructions.push_back(Instruction{it->second, static_cast<unsigned int>(first), line});
+	return true;
+}
+bool ScriptRunner::Compile(const std::string& source, Program * program, std::string * error) const
+{
+	program->instructions.clear();
+	program->args.clear();
+	program->statements.clear();
+
+	std::string statement;
+	unsigned int line = 1;
+	unsigned int statement_line = 1;
+	unsigned int depth = 0; //!< bracket nesting outside of literals
+	bool in_literal = false;
+	for (size_t i = 0; i <= source.size(); ++i)
+	{
+		// Source end closes the last statement like a line end
+		const char c = (i < source.size()) ? source[i] : '\n';
+		if (in_literal)
+		{
+			statement += c;
+			if (c == '\\' && i + 1 < source.size())
+			{
+				// Escaped character never closes literal
+				statement += source[++i];
+				if (source[i] == '\n')
+					++line;
+			}
+			else if (c == '"')
+				in_literal = false;
+		}
+		else if (c == ';' || (c == '\n' && depth == 0))
+		{
+			if (!IsBlank(statement) && !CompileStatement(statement, statement_line, program))
+			{
+				program->instructions.push_back(Instruction{kEvaluate,
+					static_cast<unsigned int>(program->statements.size()), statement_line});
+				program->statements.push_back(statement);
+			}
+			statement.clear();
+		}
+		else
+		{
+			if (IsBlank(statement) && !isspace(static_cast<unsigned char>(c)))
+				statement_line = line;
+			statement += c;
+			if (c == '"')
+				in_literal = true;
+			else if (c == '(' || c == '[' || c == '{')
+				++depth;
+			else if ((c == ')' || c == ']' || c == '}') && depth != 0)
+				--depth;
+		}
+		if (c == '\n')
+			++line;
+	}
+	if (in_literal)
+	{
+		*error = scythe::string_format("line %u: unterminated string literal", statement_line);
+		return false;
+	}
+	if (depth != 0)
+	{
+		*error = scythe::string_format("line %u: unclosed bracket", statement_line);
+		return false;
+	}
+	return true;
+}
+bool ScriptRunner::Run(const Program& program, std::string * error)
+{
+	std::string result;
+	for (const auto& instruction : program.instructions)
+	{
+		if (instruction.command != kEvaluate)
+		{
+			commands_[instruction.command].function(program.args.data() + instruction.first);
+		}
+		else if (!parser_->Evaluate(program.statements[instruction.first], &result))
+		{
+			*error = scythe::string_format("line %u: %s", instruction.line, parser_->error().c_str());
+			return false;
+		}
+		if (output_->failed())
+		{
+			*error = scythe::string_format("line %u: %s", instruction.line, output_->error().c_str());
+			return false;
+		}
+	}
+	return true;
+}
+bool ScriptRunner::Execute(const std::string& filename, std::string * report)
+{
+	// File is read every time, modification time may not change between quick edits
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+	{
+		cache_.erase(filename);
+		*report = "can't open file " + filename;
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	const std::string source = buffer.str();
+
+	const Clock::time_point start = Clock::now();
+	const std::uint64_t source_hash = HashContents(source);
+	Program& program = cache_[filename];
+	const bool cached = !program.instructions.empty()
+		&& program.source_hash == source_hash && program.source_size == source.size();
+	double compile_time = 0.0;
+	if (!cached)
+	{
+		std::string error;
+		if (!Compile(source, &program, &error))
+		{
+			cache_.erase(filename);
+			*report = error;
+			return false;
+		}
+		program.source_hash = source_hash;
+		program.source_size = source.size();
+		compile_time = ElapsedMilliseconds(start);
+	}
+
+	const Clock::time_point run_start = Clock::now();
+	output_->Clear();
+	std::string error;
+	const bool succeeded = Run(program, &error);
+	const double run_time = ElapsedMilliseconds(run_start);
+	if (!succeeded)
+	{
+		*report = error;
+		return false;
+	}
+	*report = output_->text();
+	if (!report->empty() && report->back() != '\n')
+		*report += '\n';
+	*report += scythe::string_format("%u statements (%u evaluated by parser), run %.2f ms, ",
+		static_cast<unsigned int>(program.instructions.size()),
+		static_cast<unsigned int>(program.statements.size()), run_time);
+	*report += cached ? std::string("cached bytecode") : scythe::string_format("compiled in %.2f ms", compile_time);
+	return true;
+}
\ No newline at end of file
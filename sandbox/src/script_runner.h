@@ -0,0 +1,94 @@
+#ifndef __SCRIPT_RUNNER_H__
+#define __SCRIPT_RUNNER_H__
+
+#include "common/non_copyable.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+namespace console_script {
+	class Parser;
+}
+class CommandOutput;
+
+/**
+ * Runs script files with compiled bytecode caching.
+ * Statement ends with semicolon or with line end outside of brackets, so a call may
+ * span several lines. Both are ignored inside string literals.
+ * Statements of form Name(number, ...) with registered names are compiled into
+ * command calls with constant arguments. Any other statement is kept as text and
+ * evaluated by console parser. Compiled scripts are cached by path and are
+ * recompiled only when file contents change. Script stops at the first command
+ * that reports failure to the command output.
+ */
+class ScriptRunner final : public scythe::NonCopyable {
+public:
+	typedef std::function<void(const float * args)> Command;
+
+	ScriptRunner(console_script::Parser * parser, CommandOutput * output);
+
+	//! Command should take exactly num_args float arguments
+	void AddCommand(const char * name, unsigned int num_args, const Command& command);
+	//! Same signature as console parser uses, all function arguments should be floats
+	template <class Class, class... Args>
+	void AddClassCommand(const char * name, void (Class::*function)(Args...), Class * object);
+
+	/**
+	 * Executes script file.
+	 * @param[out] report  Output of commands followed by execution summary, or error message.
+	 */
+	bool Execute(const std::string& filename, std::string * report);
+
+	void ClearCache();
+
+private:
+	template <class Class, class Function, size_t... Indices>
+	static void Invoke(Class * object, Function function, const float * args, std::index_sequence<Indices...>)
+	{
+		(object->*function)(args[Indices]...);
+	}
+
+	struct Instruction {
+		unsigned int command; //!< kEvaluate for statements evaluated by parser
+		unsigned int first; //!< first argument or statement text index
+		unsigned int line;
+	};
+	struct Program {
+		std::vector<Instruction> instructions;
+		std::vector<float> args;
+		std::vector<std::string> statements; //!< statements that couldn't be compiled
+		std::uint64_t source_hash; //!< FNV-1a of file contents
+		size_t source_size;
+	};
+	struct CommandInfo {
+		Command function;
+		unsigned int num_args;
+	};
+
+	static const unsigned int kEvaluate = ~0u;
+
+	//! Fails on unterminated string literal or unclosed bracket
+	bool Compile(const std::string& source, Program * program, std::string * error) const;
+	bool CompileStatement(const std::string& statement, unsigned int line, Program * program) const;
+	bool Run(const Program& program, std::string * error);
+
+	console_script::Parser * parser_;
+	CommandOutput * output_;
+	std::vector<CommandInfo> commands_;
+	std::unordered_map<std::string, unsigned int> command_indices_;
+	std::unordered_map<std::string, Program> cache_;
+};
+
+template <class Class, class... Args>
+void ScriptRunner::AddClassCommand(const char * name, void (Class::*function)(Args...), Class * object)
+{
+	AddCommand(name, static_cast<unsigned int>(sizeof...(Args)), [function, object](const float * args) {
+		Invoke(object, function, args, std::index_sequence_for<Args...>());
+	});
+}
+
+#endif
\ No newline at end of file
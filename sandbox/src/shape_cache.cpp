@@ -0,0 +1,108 @@
+#include "shape_cache.h"
+
+#include "btBulletDynamicsCommon.h"
+
+#include <cstring>
+
+bool ShapeCache::Key::operator ==(const Key& other) const
+{
+	return type == other.type
+		&& source == other.source
+		&& memcmp(params, other.params, sizeof(params)) == 0;
+}
+size_t ShapeCache::KeyHasher::operator()(const Key& key) const
+{
+	// FNV-1a over key bits
+	const unsigned char * bytes[3] = {
+		reinterpret_cast<const unsigned char *>(&key.type),
+		reinterpret_cast<const unsigned char *>(&key.source),
+		reinterpret_cast<const unsigned char *>(key.params)
+	};
+	const size_t sizes[3] = {sizeof(key.type), sizeof(key.source), sizeof(key.params)};
+	size_t hash = static_cast<size_t>(2166136261u);
+	for (int n = 0; n < 3; ++n)
+		for (size_t i = 0; i < sizes[n]; ++i)
+		{
+			hash ^= bytes[n][i];
+			hash *= static_cast<size_t>(16777619u);
+		}
+	return hash;
+}
+ShapeCache::ShapeCache()
+: statistics_()
+{
+}
+ShapeCache::~ShapeCache()
+{
+	Clear();
+}
+void ShapeCache::Clear()
+{
+	for (auto& pair : entries_)
+		Destroy(pair.first, pair.second);
+	entries_.clear();
+	shapes_.clear();
+	statistics_.shapes = 0;
+	statistics_.references = 0;
+}
+btCollisionShape * ShapeCache::Find(const Key& key)
+{
+	auto it = shapes_.find(key);
+	if (it == shapes_.end())
+		return nullptr;
+	++entries_[it->second].references;
+	++statistics_.references;
+	++statistics_.hits;
+	return it->second;
+}
+void ShapeCache::Insert(const Key& key, btCollisionShape * shape)
+{
+	shapes_.emplace(key, shape);
+	entries_.emplace(shape, Entry{key, 1, nullptr});
+	++statistics_.shapes;
+	++statistics_.references;
+	++statistics_.misses;
+}
+void ShapeCache::Release(btCollisionShape * shape)
+{
+	auto it = entries_.find(shape);
+	if (it == entries_.end())
+		return;
+	--statistics_.references;
+	if (--it->second.references != 0)
+		return;
+	shapes_.erase(it->second.key);
+	Destroy(shape, it->second);
+	entries_.erase(it);
+	--statistics_.shapes;
+}
+void ShapeCache::AddReferences(btCollisionShape * shape, unsigned int count)
+{
+	auto it = entries_.find(shape);
+	if (it == entries_.end())
+		return;
+	it->second.references += count;
+	statistics_.references += count;
+}
+void ShapeCache::AttachMesh(btCollisionShape * shape, btTriangleMesh * mesh)
+{
+	entries_[shape].mesh = mesh;
+}
+bool ShapeCache::GetKey(const btCollisionShape * shape, Key * key) const
+{
+	auto it = entries_.find(const_cast<btCollisionShape *>(shape));
+	if (it == entries_.end())
+		return false;
+	*key = it->second.key;
+	return true;
+}
+void ShapeCache::Destroy(btCollisionShape * shape, const Entry& entry)
+{
+	delete shape;
+	if (entry.mesh)
+		delete entry.mesh;
+}
+const ShapeCacheStatistics& ShapeCache::statistics() const
+{
+	return statistics_;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef __SHAPE_CACHE_H__
+#define __SHAPE_CACHE_H__
+
+#include "common/non_copyable.h"
+
+#include <unordered_map>
+#include <cstddef>
+
+class btCollisionShape;
+class btTriangleMesh;
+
+struct ShapeCacheStatistics {
+	size_t shapes; //!< unique shapes alive
+	size_t references; //!< total references to alive shapes
+	size_t hits; //!< acquisitions that reused existing shape
+	size_t misses; //!< acquisitions that created new shape
+};
+
+/**
+ * Interning cache for collision shapes.
+ * Shapes with identical parameters are shared between bodies and reference counted.
+ * Parameters are compared exactly, so 1.0 and 1.0001 radii give different shapes.
+ */
+class ShapeCache final : public scythe::NonCopyable {
+public:
+	enum ShapeType : unsigned int {
+		kSphere,
+		kBox,
+		kConvexMesh,
+		kConvexHull
+	};
+
+	struct Key {
+		ShapeType type;
+		const void * source; //!< source mesh data for mesh shapes
+		float params[4]; //!< radius, half extents or scale and hull vertex limit
+
+		bool operator ==(const Key& other) const;
+	};
+
+	ShapeCache();
+	~ShapeCache();
+
+	//! Releases all shapes regardless of their reference counts
+	void Clear();
+
+	//! Returns cached shape for the key, factory is called only when there is no such shape yet
+	template <class Factory>
+	btCollisionShape * Acquire(const Key& key, Factory factory);
+	//! Adds references to already acquired shape, used for batches of bodies
+	void AddReferences(btCollisionShape * shape, unsigned int count);
+	//! Decreases reference count, shape is deleted when it's not referenced anymore
+	void Release(btCollisionShape * shape);
+
+	//! Attaches triangle data that should live as long as the shape
+	void AttachMesh(btCollisionShape * shape, btTriangleMesh * mesh);
+
+	//! Returns false if shape isn't owned by the cache
+	bool GetKey(const btCollisionShape * shape, Key * key) const;
+
+	const ShapeCacheStatistics& statistics() const;
+
+private:
+	struct KeyHasher {
+		size_t operator()(const Key& key) const;
+	};
+	struct Entry {
+		Key key;
+		unsigned int references;
+		btTriangleMesh * mesh;
+	};
+
+	btCollisionShape * Find(const Key& key);
+	void Insert(const Key& key, btCollisionShape * shape);
+	void Destroy(btCollisionShape * shape, const Entry& entry);
+
+	std::unordered_map<Key, btCollisionShape *, KeyHasher> shapes_;
+	std::unordered_map<btCollisionShape *, Entry> entries_;
+	ShapeCacheStatistics statistics_;
+};
+
+template <class Factory>
+btCollisionShape * ShapeCache::Acquire(const Key& key, Factory factory)
+{
+	btCollisionShape * shape = Find(key);
+	if (shape)
+		return shape;
+	shape = factory();
+	Insert(key, shape);
+	return shape;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef __SNAPSHOT_STORAGE_H__
+#define __SNAPSHOT_STORAGE_H__
+
+#include <string>
+
+/**
+ * World snapshot storage interface.
+ * Takes file names, so it's called by parser directly instead of console functions.
+ */
+class ISnapshotStorage {
+public:
+	virtual ~ISnapshotStorage() = default;
+
+	//! @param[out] result  Summary or error message.
+	virtual bool SaveSnapshot(const std::string& filename, std::string * result) = 0;
+	virtual bool LoadSnapshot(const std::string& filename, std::string * result) = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "world_snapshot.h"
+#include "object_pool.h"
+#include "physics_world.h"
+
+#include "common/string_format.h"
+
+#include "btBulletDynamicsCommon.h"
+
+#include <fstream>
+#include <unordered_map>
+#include <cstring>
+
+WorldSnapshot::WorldSnapshot()
+: size_(0)
+{
+}
+void WorldSnapshot::Capture(const ObjectPool& objects, const PhysicsWorld& world,
+	const MeshData * const * mesh_sources, size_t num_sources)
+{
+	// Shape table goes first, so gather unique shapes before layout is known
+	std::unordered_map<const btCollisionShape *, std::uint32_t> shape_indices;
+	std::vector<snapshot::ShapeRecord> shape_records;
+	std::vector<std::uint32_t> object_shapes;
+	std::vector<size_t> object_indices;
+	object_shapes.reserve(objects.size());
+	object_indices.reserve(objects.size());
+	const std::vector<btRigidBody *>& bodies = objects.bodies();
+	for (size_t i = 0; i < bodies.size(); ++i)
+	{
+		const btCollisionShape * shape = bodies[i]->getCollisionShape();
+		auto it = shape_indices.find(shape);
+		if (it == shape_indices.end())
+		{
+			ShapeCache::Key key;
+			if (!world.GetShapeKey(shape, &key))
+				continue; // shape isn't reproducible
+			snapshot::ShapeRecord record;
+			record.type = static_cast<std::uint32_t>(key.type);
+			record.source = 0;
+			for (size_t n = 0; n < num_sources; ++n)
+				if (key.source == mesh_sources[n])
+					record.source = static_cast<std::uint32_t>(n + 1);
+			if (key.source && record.source == 0)
+				continue; // unknown mesh data
+			memcpy(record.params, key.params, sizeof(record.params));
+			it = shape_indices.emplace(shape, static_cast<std::uint32_t>(shape_records.size())).first;
+			shape_records.push_back(record);
+		}
+		object_shapes.push_back(it->second);
+		object_indices.push_back(i);
+	}
+
+	const size_t shapes_offset = sizeof(snapshot::Header);
+	const size_t objects_offset = shapes_offset + shape_records.size() * sizeof(snapshot::ShapeRecord);
+	size_ = objects_offset + object_indices.size() * sizeof(snapshot::ObjectRecord);
+	image_.assign((size_ + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t), 0);
+	unsigned char * data = reinterpret_cast<unsigned char *>(image_.data());
+
+	snapshot::Header * header = reinterpret_cast<snapshot::Header *>(data);
+	header->magic = snapshot::kMagic;
+	header->version = snapshot::kVersion;
+	header->shape_record_size = sizeof(snapshot::ShapeRecord);
+	header->object_record_size = sizeof(snapshot::ObjectRecord);
+	header->num_shapes = static_cast<std::uint32_t>(shape_records.size());
+	header->num_objects = static_cast<std::uint32_t>(object_indices.size());
+	header->shapes_offset = shapes_offset;
+	header->objects_offset = objects_offset;
+	if (!shape_records.empty())
+		memcpy(data + shapes_offset, shape_records.data(), shape_records.size() * sizeof(snapshot::ShapeRecord));
+
+	snapshot::ObjectRecord * records = reinterpret_cast<snapshot::ObjectRecord *>(data + objects_offset);
+	for (size_t n = 0; n < object_indices.size(); ++n)
+	{
+		const size_t i = object_indices[n];
+		const btRigidBody * body = bodies[i];
+		const btTransform& transform = body->getWorldTransform();
+		const btVector3& origin = transform.getOrigin();
+		const btQuaternion rotation = transform.getRotation();
+		const btVector3& linear_velocity = body->getLinearVelocity();
+		const btVector3& angular_velocity = body->getAngularVelocity();
+		const scythe::Vector3& scale = objects.scales()[i];
+		const scythe::Vector3& color = objects.colors()[i];
+		snapshot::ObjectRecord& record = records[n];
+		for (int k = 0; k < 3; ++k)
+		{
+			record.position[k] = static_cast<float>(origin[k]);
+			record.linear_velocity[k] = static_cast<float>(linear_velocity[k]);
+			record.angular_velocity[k] = static_cast<float>(angular_velocity[k]);
+		}
+		record.rotation[0] = static_cast<float>(rotation.x());
+		record.rotation[1] = static_cast<float>(rotation.y());
+		record.rotation[2] = static_cast<float>(rotation.z());
+		record.rotation[3] = static_cast<float>(rotation.w());
+		record.scale[0] = scale.x;
+		record.scale[1] = scale.y;
+		record.scale[2] = scale.z;
+		record.color[0] = color.x;
+		record.color[1] = color.y;
+		record.color[2] = color.z;
+		record.mass = (body->getInvMass() != 0.0f) ? static_cast<float>(1.0f / body->getInvMass()) : 0.0f;
+		record.radius = objects.radii()[i];
+		record.deactivation_time = static_cast<float>(body->getDeactivationTime());
+		record.shape = object_shapes[n];
+		record.mesh_id = objects.mesh_ids()[i];
+		record.activation_state = static_cast<std::uint32_t>(body->getActivationState());
+	}
+}
+void WorldSnapshot::Restore(PhysicsWorld * world, ObjectPool * objects,
+	const MeshData * const * mesh_sources, size_t num_sources) const
+{
+	if (size_ == 0)
+		return;
+	const snapshot::Header * header = this->header();
+	const snapshot::ShapeRecord * shape_records = shapes();
+	const snapshot::ObjectRecord * records = this->objects();
+
+	// Each shape is acquired once and gets all its body references in one call
+	std::vector<unsigned int> references(header->num_shapes, 0);
+	for (std::uint32_t i = 0; i < header->num_objects; ++i)
+		++references[records[i].shape];
+	std::vector<btCollisionShape *> shapes(header->num_shapes, nullptr);
+	for (std::uint32_t i = 0; i < header->num_shapes; ++i)
+	{
+		const snapshot::ShapeRecord& record = shape_records[i];
+		ShapeCache::Key key;
+		key.type = static_cast<ShapeCache::ShapeType>(record.type);
+		key.source = (record.source != 0) ? mesh_sources[record.source - 1] : nullptr;
+		memcpy(key.params, record.params, sizeof(key.params));
+		shapes[i] = world->AcquireShape(key);
+		if (references[i] == 0)
+			world->ReleaseShape(shapes[i]);
+		else
+			world->AddShapeReferences(shapes[i], references[i] - 1);
+	}
+
+	world->ReserveBodies(header->num_objects);
+	objects->Reserve(objects->size() + header->num_objects);
+	for (std::uint32_t i = 0; i < header->num_objects; ++i)
+	{
+		const snapshot::ObjectRecord& record = records[i];
+		const btTransform transform(
+			btQuaternion(record.rotation[0], record.rotation[1], record.rotation[2], record.rotation[3]),
+			btVector3(record.position[0], record.position[1], record.position[2]));
+		btRigidBody * body = world->CreateRigidBody(shapes[record.shape], record.mass, transform);
+		body->setLinearVelocity(btVector3(record.linear_velocity[0], record.linear_velocity[1], record.linear_velocity[2]));
+		body->setAngularVelocity(btVector3(record.angular_velocity[0], record.angular_velocity[1], record.angular_velocity[2]));
+		// Sleeping bodies stay asleep, so settled scene doesn't wake up after restore
+		body->forceActivationState(static_cast<int>(record.activation_state));
+		body->setDeactivationTime(record.deactivation_time);
+		objects->Add(body,
+			scythe::Vector3(record.scale[0], record.scale[1], record.scale[2]),
+			scythe::Vector3(record.color[0], record.color[1], record.color[2]),
+			record.mesh_id, record.radius);
+	}
+}
+bool WorldSnapshot::Save(const std::string& filename, std::string * error) const
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		*error = scythe::string_format("can't open '%s' for writing", filename.c_str());
+		return false;
+	}
+	file.write(reinterpret_cast<const char *>(image_.data()), static_cast<std::streamsize>(size_));
+	if (!file)
+	{
+		*error = scythe::string_format("failed to write '%s'", filename.c_str());
+		return false;
+	}
+	return true;
+}
+bool WorldSnapshot::Load(const std::string& filename, size_t num_sources, std::string * error)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		*error = scythe::string_format("can't open '%s'", filename.c_str());
+		return false;
+	}
+	const std::streamoff file_size = file.tellg();
+	if (file_size < static_cast<std::streamoff>(sizeof(snapshot::Header)))
+	{
+		*error = scythe::string_format("'%s' is not a snapshot", filename.c_str());
+		return false;
+	}
+	const size_t size = static_cast<size_t>(file_size);
+	std::vector<std::uint64_t> image((size + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char *>(image.data()), static_cast<std::streamsize>(size));
+	if (!file)
+	{
+		*error = scythe::string_format("failed to read '%s'", filename.c_str());
+		return false;
+	}
+	if (!Validate(reinterpret_cast<const unsigned char *>(image.data()), size, num_sources, error))
+		return false;
+	image_.swap(image);
+	size_ = size;
+	return true;
+}
+bool WorldSnapshot::Validate(const unsigned char * data, size_t size, size_t num_sources, std::string * error)
+{
+	const snapshot::Header * header = reinterpret_cast<const snapshot::Header *>(data);
+	if (header->magic == snapshot::kSwappedMagic)
+	{
+		*error = "snapshot has different byte order";
+		return false;
+	}
+	if (header->magic != snapshot::kMagic)
+	{
+		*error = "not a snapshot file";
+		return false;
+	}
+	if (header->version != snapshot::kVersion
+		|| header->shape_record_size != sizeof(snapshot::ShapeRecord)
+		|| header->object_record_size != sizeof(snapshot::ObjectRecord))
+	{
+		*error = scythe::string_format("unsupported snapshot version %u", header->version);
+		return false;
+	}
+	// Ranges are checked without sums, so offsets near 2^64 can't wrap past the check
+	auto is_valid_range = [size](std::uint64_t offset, std::uint64_t count, std::uint64_t record_size) {
+		return offset >= sizeof(snapshot::Header) && offset <= size
+			&& count <= (size - offset) / record_size;
+	};
+	if (!is_valid_range(header->shapes_offset, header->num_shapes, sizeof(snapshot::ShapeRecord))
+		|| !is_valid_range(header->objects_offset, header->num_objects, sizeof(snapshot::ObjectRecord))
+		|| (header->shapes_offset % alignof(snapshot::ShapeRecord)) != 0
+		|| (header->objects_offset % alignof(snapshot::ObjectRecord)) != 0)
+	{
+		*error = "snapshot is truncated";
+		return false;
+	}
+	const snapshot::ShapeRecord * shape_records = reinterpret_cast<const snapshot::ShapeRecord *>(data + header->shapes_offset);
+	for (std::uint32_t i = 0; i < header->num_shapes; ++i)
+	{
+		const snapshot::ShapeRecord& record = shape_records[i];
+		const bool has_source = (record.type == ShapeCache::kConvexMesh || record.type == ShapeCache::kConvexHull);
+		if (record.type > ShapeCache::kConvexHull || record.source > num_sources
+			|| has_source != (record.source != 0))
+		{
+			*error = scythe::string_format("invalid shape record %u", i);
+			return false;
+		}
+	}
+	const snapshot::ObjectRecord * records = reinterpret_cast<const snapshot::ObjectRecord *>(data + header->objects_offset);
+	for (std::uint32_t i = 0; i < header->num_objects; ++i)
+		if (records[i].shape >= header->num_shapes)
+		{
+			*error = scythe::string_format("invalid object record %u", i);
+			return false;
+		}
+	return true;
+}
+size_t WorldSnapshot::num_objects() const
+{
+	return (size_ != 0) ? header()->num_objects : 0;
+}
+size_t WorldSnapshot::size() const
+{
+	return size_;
+}
+const snapshot::Header * WorldSnapshot::header() const
+{
+	return reinterpret_cast<const snapshot::Header *>(image_.data());
+}
+const snapshot::ShapeRecord * WorldSnapshot::shapes() const
+{
+	const unsigned char * data = reinterpret_cast<const unsigned char *>(image_.data());
+	return reinterpret_cast<const snapshot::ShapeRecord *>(data + header()->shapes_offset);
+}
+const snapshot::ObjectRecord * WorldSnapshot::objects() const
+{
+	const unsigned char * data = reinterpret_cast<const unsigned char *>(image_.data());
+	return reinterpret_cast<const snapshot::ObjectRecord *>(data + header()->objects_offset);
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef __WORLD_SNAPSHOT_H__
+#define __WORLD_SNAPSHOT_H__
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct MeshData;
+class ObjectPool;
+class PhysicsWorld;
+
+/**
+ * Snapshot file layout, all values are in byte order of the writing machine and naturally aligned,
+ * so the file can be mapped into memory and records used in place:
+ * header | shape records | object records.
+ * Files of the other byte order are recognized by the magic and rejected.
+ */
+namespace snapshot {
+
+	const std::uint32_t kMagic = 0x4E534253; //!< 'SBSN'
+	const std::uint32_t kSwappedMagic = 0x5342534E; //!< magic written in the other byte order
+	const std::uint32_t kVersion = 1;
+
+	struct Header {
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t shape_record_size; //!< guards against layout changes without version bump
+		std::uint32_t object_record_size;
+		std::uint32_t num_shapes;
+		std::uint32_t num_objects;
+		std::uint64_t shapes_offset; //!< in bytes from the beginning of file
+		std::uint64_t objects_offset;
+	};
+
+	struct ShapeRecord {
+		std::uint32_t type; //!< ShapeCache::ShapeType
+		std::uint32_t source; //!< mesh source index plus one, zero for primitive shapes
+		float params[4];
+	};
+
+	struct ObjectRecord {
+		float position[3];
+		float rotation[4]; //!< quaternion x, y, z, w
+		float linear_velocity[3];
+		float angular_velocity[3];
+		float scale[3];
+		float color[3];
+		float mass;
+		float radius;
+		float deactivation_time;
+		std::uint32_t shape; //!< index in shape records
+		std::uint32_t mesh_id;
+		std::uint32_t activation_state;
+	};
+
+	static_assert(sizeof(Header) == 40, "Snapshot header should have no padding");
+	static_assert(sizeof(ShapeRecord) == 24, "Shape record should have no padding");
+	static_assert(sizeof(ObjectRecord) == 100, "Object record should have no padding");
+
+} // namespace snapshot
+
+/**
+ * Binary image of all sandbox objects.
+ * Image is kept exactly as it is stored in file, so saving and loading are single writes and reads.
+ * Mesh shapes refer to mesh data by index in the sources list, which should be the same
+ * for capture and restore.
+ */
+class WorldSnapshot {
+public:
+	WorldSnapshot();
+
+	void Capture(const ObjectPool& objects, const PhysicsWorld& world,
+		const MeshData * const * mesh_sources, size_t num_sources);
+	/**
+	 * Creates snapshot objects in the world and the pool in the stored order,
+	 * so restored scene steps identically every time.
+	 */
+	void Restore(PhysicsWorld * world, ObjectPool * objects,
+		const MeshData * const * mesh_sources, size_t num_sources) const;
+
+	bool Save(const std::string& filename, std::string * error) const;
+	//! Image is validated, so restore may be called right after successful load
+	bool Load(const std::string& filename, size_t num_sources, std::string * error);
+
+	size_t num_objects() const;
+	size_t size() const; //!< image size in bytes
+
+private:
+	//! Checks image before it replaces the current one, so failed load keeps the previous snapshot
+	static bool Validate(const unsigned char * data, size_t size, size_t num_sources, std::string * error);
+
+	const snapshot::Header * header() const;
+	const snapshot::ShapeRecord * shapes() const;
+	const snapshot::ObjectRecord * objects() const;
+
+	std::vector<std::uint64_t> image_; //!< 8 byte elements keep records aligned
+	size_t size_; //!< in bytes
+};
+
+#endif
\ No newline at end of file
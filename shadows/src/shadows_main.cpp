@@ -1,3 +1,5 @@
+#include "instanced_mesh.h"
+
 #include "model/mesh.h"
 #include "graphics/text.h"
 #include "camera.h"
@@ -21,8 +23,6 @@ class APP_NAME : public scythe::OpenGlApplication
 public:
 	APP_NAME()
 	: quad_(nullptr)
-	, sphere_(nullptr)
-	, cube_(nullptr)
 	, font_(nullptr)
 	, fps_text_(nullptr)
 	, camera_manager_(nullptr)
@@ -76,14 +76,6 @@ public:
 			};
 			renderer_->AddVertexFormat(quad_vertex_format, attributes, _countof(attributes));
 		}
-		scythe::VertexFormat * object_vertex_format;
-		{
-			scythe::VertexAttribute attributes[] = {
-				scythe::VertexAttribute(scythe::VertexAttribute::kVertex, 3),
-				scythe::VertexAttribute(scythe::VertexAttribute::kNormal, 3)
-			};
-			renderer_->AddVertexFormat(object_vertex_format, attributes, _countof(attributes));
-		}
 
 		// Quad model
 		quad_ = new scythe::Mesh(renderer_);
@@ -91,31 +83,71 @@ public:
 		if (!quad_->MakeRenderable(quad_vertex_format))
 			return false;
 
-		// Sphere model
-		sphere_ = new scythe::Mesh(renderer_);
-		sphere_->CreateSphere(1.0f, 128, 64);
-		if (!sphere_->MakeRenderable(object_vertex_format))
+		// Sphere model with levels of detail, all instances of a level are drawn at once
+		if (!sphere_lod_.CreateSphere(1.0f, 128, 64, 4, InstancedMesh::kNormal))
 			return false;
 
 		// Cube model
-		cube_ = new scythe::Mesh(renderer_);
-		cube_->CreateCube();
-		if (!cube_->MakeRenderable(object_vertex_format))
-			return false;
+		{
+			MeshData cube_data;
+			cube_data.CreateCube();
+			OptimizeMesh(&cube_data);
+			if (!cube_.Create(cube_data, InstancedMesh::kNormal))
+				return false;
+		}
 		
 		// Load shaders
+		const char* object_shader_defines[] = {
+			"USE_INSTANCING"
+		};
 		if (!renderer_->AddShader(text_shader_, "data/shaders/text")) return false;
 		if (!renderer_->AddShader(quad_shader_, "data/shaders/quad")) return false;
 		if (is_vsm_)
 		{
-			if (!renderer_->AddShader(object_shader_, "data/shaders/shadows/object_vsm")) return false;
-			if (!renderer_->AddShader(object_shadow_shader_, "data/shaders/shadows/depth_vsm")) return false;
+			scythe::ShaderInfo object_shader_info(
+				"data/shaders/shadows/object_vsm", // base filename
+				nullptr, // no vertex filename
+				nullptr, // no fragment filename
+				nullptr, // array of attribs
+				0, // number of attribs
+				object_shader_defines, // array of defines
+				_countof(object_shader_defines) // number of defines
+				);
+			scythe::ShaderInfo object_shadow_shader_info(
+				"data/shaders/shadows/depth_vsm", // base filename
+				nullptr, // no vertex filename
+				nullptr, // no fragment filename
+				nullptr, // array of attribs
+				0, // number of attribs
+				object_shader_defines, // array of defines
+				_countof(object_shader_defines) // number of defines
+				);
+			if (!renderer_->AddShader(object_shader_, object_shader_info)) return false;
+			if (!renderer_->AddShader(object_shadow_shader_, object_shadow_shader_info)) return false;
 			if (!renderer_->AddShader(blur_shader_, "data/shaders/blur")) return false;
 		}
 		else
 		{
-			if (!renderer_->AddShader(object_shader_, "data/shaders/shadows/object")) return false;
-			if (!renderer_->AddShader(object_shadow_shader_, "data/shaders/shadows/object_shadow")) return false;
+			scythe::ShaderInfo object_shader_info(
+				"data/shaders/shadows/object", // base filename
+				nullptr, // no vertex filename
+				nullptr, // no fragment filename
+				nullptr, // array of attribs
+				0, // number of attribs
+				object_shader_defines, // array of defines
+				_countof(object_shader_defines) // number of defines
+				);
+			scythe::ShaderInfo object_shadow_shader_info(
+				"data/shaders/shadows/object_shadow", // base filename
+				nullptr, // no vertex filename
+				nullptr, // no fragment filename
+				nullptr, // array of attribs
+				0, // number of attribs
+				object_shader_defines, // array of defines
+				_countof(object_shader_defines) // number of defines
+				);
+			if (!renderer_->AddShader(object_shader_, object_shader_info)) return false;
+			if (!renderer_->AddShader(object_shadow_shader_, object_shadow_shader_info)) return false;
 		}
 
 		// Render targets
@@ -153,10 +185,8 @@ public:
 			delete fps_text_;
 		if (quad_)
 			delete quad_;
-		if (sphere_)
-			delete sphere_;
-		if (cube_)
-			delete cube_;
+		sphere_lod_.Release();
+		cube_.Release();
 	}
 	void Update() final
 	{
@@ -175,45 +205,37 @@ public:
 
 		BindShaderVariables();
 	}
-	void RenderObjects(scythe::Shader * shader)
+	void RenderObjects(const LodSelector& lod_selector)
 	{
-		// Render cube
-		renderer_->PushMatrix();
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		cube_->Render();
-		renderer_->PopMatrix();
+		const scythe::Vector3 kColor(1.0f); // not used by shadow shaders
 
+		// Render cubes
+		InstanceData cube_instances[2];
 		renderer_->PushMatrix();
+		MakeInstance(renderer_->model_matrix(), kColor, &cube_instances[0]);
 		renderer_->Translate(0.0f, -6.0f, 0.0f);
 		renderer_->Scale(5.0f);
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		cube_->Render();
+		MakeInstance(renderer_->model_matrix(), kColor, &cube_instances[1]);
 		renderer_->PopMatrix();
+		cube_.SetInstances(cube_instances, _countof(cube_instances));
+		cube_.Render();
 
 		// Render spheres
-		renderer_->PushMatrix();
-		renderer_->Translate(2.0f, 0.0f, 0.0f);
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		sphere_->Render();
-		renderer_->PopMatrix();
-
-		renderer_->PushMatrix();
-		renderer_->Translate(-2.0f, 0.0f, 0.0f);
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		sphere_->Render();
-		renderer_->PopMatrix();
-
-		renderer_->PushMatrix();
-		renderer_->Translate(0.0f, 0.0f, 2.0f);
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		sphere_->Render();
-		renderer_->PopMatrix();
-
-		renderer_->PushMatrix();
-		renderer_->Translate(0.0f, 0.0f, -2.0f);
-		shader->UniformMatrix4fv("u_model", renderer_->model_matrix());
-		sphere_->Render();
-		renderer_->PopMatrix();
+		const scythe::Vector3 kSpherePositions[] = {
+			scythe::Vector3( 2.0f, 0.0f,  0.0f),
+			scythe::Vector3(-2.0f, 0.0f,  0.0f),
+			scythe::Vector3( 0.0f, 0.0f,  2.0f),
+			scythe::Vector3( 0.0f, 0.0f, -2.0f)
+		};
+		sphere_lod_.BeginInstances();
+		for (const auto& position : kSpherePositions)
+		{
+			renderer_->PushMatrix();
+			renderer_->Translate(position);
+			sphere_lod_.AddInstance(lod_selector, position, 1.0f, renderer_->model_matrix(), kColor);
+			renderer_->PopMatrix();
+		}
+		sphere_lod_.Render();
 	}
 	void ShadowPass()
 	{
@@ -250,7 +272,9 @@ public:
 		object_shadow_shader_->Bind();
 		object_shadow_shader_->UniformMatrix4fv("u_projection_view", depth_projection_view);
 
-		RenderObjects(object_shadow_shader_);
+		LodSelector lod_selector;
+		lod_selector.SetPerspective(light_position_, 45.0f, static_cast<float>(kShadowMapSize));
+		RenderObjects(lod_selector);
 
 		object_shadow_shader_->Unbind();
 
@@ -324,7 +348,9 @@ public:
 			else
 				renderer_->ChangeTexture(shadow_depth_rt_, 0);
 
-			RenderObjects(object_shader_);
+			LodSelector lod_selector;
+			lod_selector.SetPerspective(*camera_manager_->position(), 45.0f, static_cast<float>(height_));
+			RenderObjects(lod_selector);
 
 			renderer_->ChangeTexture(nullptr, 0);
 
@@ -429,8 +455,8 @@ public:
 	
 private:
 	scythe::Mesh * quad_;
-	scythe::Mesh * sphere_;
-	scythe::Mesh * cube_;
+	InstancedMesh cube_;
+	InstancedMeshLod sphere_lod_;
 
 	scythe::Shader * text_shader_;
 	scythe::Shader * quad_shader_;
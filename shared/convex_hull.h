@@ -0,0 +1,490 @@
+#ifndef __CONVEX_HULL_H__
+#define __CONVEX_HULL_H__
+
+#include "mesh_data.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cfloat>
+#include <cstdint>
+#include <unordered_map>
+
+namespace convex_hull_detail {
+
+	struct Point {
+		float x, y, z;
+	};
+	inline Point Sub(const Point& a, const Point& b)
+	{
+		return Point{a.x - b.x, a.y - b.y, a.z - b.z};
+	}
+	inline Point Cross(const Point& a, const Point& b)
+	{
+		return Point{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	}
+	inline float Dot(const Point& a, const Point& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+	inline float LengthSquared(const Point& a)
+	{
+		return Dot(a, a);
+	}
+
+	struct Face {
+		unsigned int v[3];
+		unsigned int neighbors[3]; //!< face across edge v[e] -> v[e + 1]
+		Point normal;
+		float offset; //!< plane is dot(normal, p) = offset
+		std::vector<unsigned int> outside; //!< points above the face
+		unsigned int visit; //!< number of the last iteration that found the face visible
+		bool alive;
+	};
+
+} // namespace convex_hull_detail
+
+/**
+ * Convex hull of a point cloud built with quickhull.
+ * Vertices are indices into the source points, triangles are counter clockwise seen from outside.
+ * Coincident points are welded first, so seams and poles of parametric meshes don't slow it down.
+ * Degenerate (flat or smaller) inputs keep all distinct points and produce no triangles.
+ */
+class ConvexHull {
+public:
+	//! Points are read with the given stride in bytes
+	void Build(const float * points, size_t count, size_t stride)
+	{
+		using namespace convex_hull_detail;
+
+		points_.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float * p = reinterpret_cast<const float *>(reinterpret_cast<const char *>(points) + i * stride);
+			points_[i] = Point{p[0], p[1], p[2]};
+		}
+		faces_.clear();
+		vertices_.clear();
+		triangles_.clear();
+		if (count == 0)
+			return;
+
+		Point min = points_[0], max = points_[0];
+		for (const auto& p : points_)
+		{
+			min = Point{std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z)};
+			max = Point{std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z)};
+		}
+		// Tolerance follows float rounding of plane distances at the point cloud scale
+		const float scale = std::max(fabsf(min.x), fabsf(max.x)) + std::max(fabsf(min.y), fabsf(max.y))
+			+ std::max(fabsf(min.z), fabsf(max.z));
+		epsilon_ = 3.0f * FLT_EPSILON * std::max(scale, 1e-6f);
+		// Points closer than a small fraction of the cloud size are welded
+		const float extent = std::max(std::max(max.x - min.x, max.y - min.y), max.z - min.z);
+		WeldPoints(min, std::max(1e-5f * extent, epsilon_));
+		unsigned int simplex[4];
+		if (!BuildSimplex(simplex))
+		{
+			CollectDistinctPoints();
+			return;
+		}
+		for (unsigned int point : unique_)
+			AssignToFaces(point, 0);
+
+		std::vector<unsigned int> visible;
+		std::vector<unsigned int> horizon; //!< triples of edge start, edge end and the hidden face across it
+		std::vector<unsigned int> orphans;
+		std::vector<unsigned int> face_by_start(count), face_by_end(count);
+		unsigned int iteration = 0;
+		size_t f = 0;
+		while (f < faces_.size())
+		{
+			if (!faces_[f].alive || faces_[f].outside.empty())
+			{
+				++f;
+				continue;
+			}
+			++iteration;
+
+			// The farthest point of the face is guaranteed to be on the hull
+			unsigned int eye = faces_[f].outside[0];
+			float eye_distance = Distance(faces_[f], points_[eye]);
+			for (unsigned int point : faces_[f].outside)
+			{
+				const float distance = Distance(faces_[f], points_[point]);
+				if (distance > eye_distance)
+				{
+					eye = point;
+					eye_distance = distance;
+				}
+			}
+
+			// Visible faces are flood filled from the eye face, so they stay connected
+			// and their boundary is a single horizon loop. Neighbors the eye is barely above are visible too,
+			// keeping them would fold thin new faces inwards
+			visible.clear();
+			horizon.clear();
+			visible.push_back(static_cast<unsigned int>(f));
+			faces_[f].visit = iteration;
+			for (size_t i = 0; i < visible.size(); ++i)
+			{
+				const Face& face = faces_[visible[i]];
+				for (int e = 0; e < 3; ++e)
+				{
+					const unsigned int neighbor = face.neighbors[e];
+					Face& other = faces_[neighbor];
+					if (other.visit == iteration)
+						continue;
+					if (Distance(other, points_[eye]) > 0.0f)
+					{
+						other.visit = iteration;
+						visible.push_back(neighbor);
+					}
+					else
+					{
+						horizon.push_back(face.v[e]);
+						horizon.push_back(face.v[(e + 1) % 3]);
+						horizon.push_back(neighbor);
+					}
+				}
+			}
+
+			orphans.clear();
+			for (unsigned int g : visible)
+			{
+				Face& face = faces_[g];
+				orphans.insert(orphans.end(), face.outside.begin(), face.outside.end());
+				face.outside.clear();
+				face.outside.shrink_to_fit();
+				face.alive = false;
+			}
+			num_dead_faces_ += visible.size();
+
+			// New faces fan from the eye over the horizon, edges between them meet at horizon vertices
+			const size_t first_new_face = faces_.size();
+			for (size_t e = 0; e < horizon.size(); e += 3)
+			{
+				const unsigned int face_index = static_cast<unsigned int>(faces_.size());
+				AddFace(horizon[e], horizon[e + 1], eye);
+				face_by_start[horizon[e]] = face_index;
+				face_by_end[horizon[e + 1]] = face_index;
+				Face& hidden = faces_[horizon[e + 2]];
+				for (int k = 0; k < 3; ++k)
+					if (hidden.v[k] == horizon[e + 1] && hidden.v[(k + 1) % 3] == horizon[e])
+						hidden.neighbors[k] = face_index;
+				faces_[face_index].neighbors[0] = horizon[e + 2];
+			}
+			for (size_t g = first_new_face; g < faces_.size(); ++g)
+			{
+				Face& face = faces_[g];
+				face.neighbors[1] = face_by_start[face.v[1]]; // edge b -> eye
+				face.neighbors[2] = face_by_end[face.v[0]]; // edge eye -> a
+			}
+			for (unsigned int point : orphans)
+				if (point != eye)
+					AssignToFaces(point, first_new_face);
+
+			// Dead faces are dropped once they outnumber live ones, scan starts over then
+			if (num_dead_faces_ * 2 > faces_.size())
+			{
+				CompactFaces();
+				f = 0;
+			}
+			else
+				++f;
+		}
+
+		// Gather results
+		std::vector<bool> used(count, false);
+		for (const auto& face : faces_)
+		{
+			if (!face.alive)
+				continue;
+			for (int i = 0; i < 3; ++i)
+			{
+				triangles_.push_back(face.v[i]);
+				if (!used[face.v[i]])
+				{
+					used[face.v[i]] = true;
+					vertices_.push_back(face.v[i]);
+				}
+			}
+		}
+		faces_.clear();
+	}
+
+	/**
+	 * Keeps at most max_vertices hull vertices picked by farthest point sampling,
+	 * so the reduced hull covers the original one as evenly as possible.
+	 * Triangles are cleared since they may reference removed vertices.
+	 */
+	void ReduceVertices(size_t max_vertices)
+	{
+		using namespace convex_hull_detail;
+
+		if (vertices_.size() <= max_vertices || max_vertices == 0)
+			return;
+		std::vector<unsigned int> kept;
+		kept.reserve(max_vertices);
+		std::vector<float> nearest(vertices_.size(), 1e30f);
+
+		// Start from the vertex farthest from the centroid
+		Point center{0.0f, 0.0f, 0.0f};
+		for (unsigned int v : vertices_)
+			center = Point{center.x + points_[v].x, center.y + points_[v].y, center.z + points_[v].z};
+		const float inv_count = 1.0f / static_cast<float>(vertices_.size());
+		center = Point{center.x * inv_count, center.y * inv_count, center.z * inv_count};
+		size_t next = 0;
+		float next_distance = -1.0f;
+		for (size_t i = 0; i < vertices_.size(); ++i)
+		{
+			const float distance = LengthSquared(Sub(points_[vertices_[i]], center));
+			if (distance > next_distance)
+			{
+				next = i;
+				next_distance = distance;
+			}
+		}
+		while (kept.size() < max_vertices)
+		{
+			const Point& added = points_[vertices_[next]];
+			kept.push_back(vertices_[next]);
+			next_distance = -1.0f;
+			for (size_t i = 0; i < vertices_.size(); ++i)
+			{
+				nearest[i] = std::min(nearest[i], LengthSquared(Sub(points_[vertices_[i]], added)));
+				if (nearest[i] > next_distance)
+				{
+					next = i;
+					next_distance = nearest[i];
+				}
+			}
+		}
+		vertices_.swap(kept);
+		triangles_.clear();
+	}
+
+	//! Indices of hull vertices in the source points
+	const std::vector<unsigned int>& vertices() const
+	{
+		return vertices_;
+	}
+	const std::vector<unsigned int>& triangles() const
+	{
+		return triangles_;
+	}
+
+private:
+	typedef convex_hull_detail::Point Point;
+	typedef convex_hull_detail::Face Face;
+
+	float Distance(const Face& face, const Point& p) const
+	{
+		return convex_hull_detail::Dot(face.normal, p) - face.offset;
+	}
+	void AddFace(unsigned int a, unsigned int b, unsigned int c)
+	{
+		using namespace convex_hull_detail;
+		Face face;
+		face.v[0] = a;
+		face.v[1] = b;
+		face.v[2] = c;
+		face.neighbors[0] = face.neighbors[1] = face.neighbors[2] = 0;
+		face.visit = 0;
+		// Plane is computed in double, float cross products of thin faces tilt the normal noticeably
+		const Point& pa = points_[a];
+		const Point& pb = points_[b];
+		const Point& pc = points_[c];
+		const double ab[3] = {double(pb.x) - pa.x, double(pb.y) - pa.y, double(pb.z) - pa.z};
+		const double ac[3] = {double(pc.x) - pa.x, double(pc.y) - pa.y, double(pc.z) - pa.z};
+		double normal[3] = {ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0]};
+		const double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length > 0.0)
+			for (int k = 0; k < 3; ++k)
+				normal[k] /= length;
+		face.normal = Point{float(normal[0]), float(normal[1]), float(normal[2])};
+		face.offset = float(normal[0] * pa.x + normal[1] * pa.y + normal[2] * pa.z);
+		face.alive = true;
+		faces_.push_back(face);
+	}
+	//! Removes dead faces and renumbers neighbor links
+	void CompactFaces()
+	{
+		std::vector<unsigned int> remap(faces_.size());
+		size_t live = 0;
+		for (size_t f = 0; f < faces_.size(); ++f)
+		{
+			remap[f] = static_cast<unsigned int>(live);
+			if (!faces_[f].alive)
+				continue;
+			if (live != f)
+				faces_[live] = std::move(faces_[f]);
+			++live;
+		}
+		faces_.resize(live);
+		for (auto& face : faces_)
+			for (int e = 0; e < 3; ++e)
+				face.neighbors[e] = remap[face.neighbors[e]];
+		num_dead_faces_ = 0;
+	}
+	/**
+	 * Collects one point of every group closer than distance into unique points.
+	 * Points are hashed into cells of that size relative to origin, a point is compared with points of neighbouring cells.
+	 */
+	void WeldPoints(const Point& origin, float distance)
+	{
+		using namespace convex_hull_detail;
+		unique_.clear();
+		std::unordered_map<std::uint64_t, std::vector<unsigned int>> cells;
+		const float inv_cell = 1.0f / distance;
+		auto cell_key = [](std::int64_t x, std::int64_t y, std::int64_t z) {
+			// 21 bits per axis, collisions only merge candidate lists
+			const std::uint64_t kMask = (1u << 21) - 1;
+			return (static_cast<std::uint64_t>(x) & kMask) | ((static_cast<std::uint64_t>(y) & kMask) << 21)
+				| ((static_cast<std::uint64_t>(z) & kMask) << 42);
+		};
+		for (size_t i = 0; i < points_.size(); ++i)
+		{
+			const Point& p = points_[i];
+			const std::int64_t cx = static_cast<std::int64_t>(std::floor((p.x - origin.x) * inv_cell));
+			const std::int64_t cy = static_cast<std::int64_t>(std::floor((p.y - origin.y) * inv_cell));
+			const std::int64_t cz = static_cast<std::int64_t>(std::floor((p.z - origin.z) * inv_cell));
+			bool duplicate = false;
+			for (std::int64_t dz = -1; dz <= 1 && !duplicate; ++dz)
+				for (std::int64_t dy = -1; dy <= 1 && !duplicate; ++dy)
+					for (std::int64_t dx = -1; dx <= 1 && !duplicate; ++dx)
+					{
+						auto it = cells.find(cell_key(cx + dx, cy + dy, cz + dz));
+						if (it == cells.end())
+							continue;
+						for (unsigned int other : it->second)
+							if (LengthSquared(Sub(points_[other], p)) <= distance * distance)
+							{
+								duplicate = true;
+								break;
+							}
+					}
+			if (duplicate)
+				continue;
+			cells[cell_key(cx, cy, cz)].push_back(static_cast<unsigned int>(i));
+			unique_.push_back(static_cast<unsigned int>(i));
+		}
+	}
+	//! Adds point to outside set of the first face it is above, starting from the given face
+	void AssignToFaces(unsigned int point, size_t first_face)
+	{
+		for (size_t f = first_face; f < faces_.size(); ++f)
+		{
+			Face& face = faces_[f];
+			if (face.alive && Distance(face, points_[point]) > epsilon_)
+			{
+				face.outside.push_back(point);
+				return;
+			}
+		}
+	}
+	bool BuildSimplex(unsigned int * simplex)
+	{
+		using namespace convex_hull_detail;
+
+		// Farthest pair among axis extremes
+		const unsigned int first = unique_[0];
+		unsigned int extremes[6] = {first, first, first, first, first, first};
+		for (unsigned int i : unique_)
+		{
+			const Point& p = points_[i];
+			if (p.x < points_[extremes[0]].x) extremes[0] = i;
+			if (p.x > points_[extremes[1]].x) extremes[1] = i;
+			if (p.y < points_[extremes[2]].y) extremes[2] = i;
+			if (p.y > points_[extremes[3]].y) extremes[3] = i;
+			if (p.z < points_[extremes[4]].z) extremes[4] = i;
+			if (p.z > points_[extremes[5]].z) extremes[5] = i;
+		}
+		float best = -1.0f;
+		for (int i = 0; i < 6; ++i)
+			for (int j = i + 1; j < 6; ++j)
+			{
+				const float distance = LengthSquared(Sub(points_[extremes[i]], points_[extremes[j]]));
+				if (distance > best)
+				{
+					best = distance;
+					simplex[0] = extremes[i];
+					simplex[1] = extremes[j];
+				}
+			}
+		if (best <= epsilon_ * epsilon_)
+			return false;
+
+		// Farthest point from the line
+		const Point direction = Sub(points_[simplex[1]], points_[simplex[0]]);
+		best = -1.0f;
+		for (unsigned int i : unique_)
+		{
+			const float distance = LengthSquared(Cross(direction, Sub(points_[i], points_[simplex[0]])));
+			if (distance > best)
+			{
+				best = distance;
+				simplex[2] = i;
+			}
+		}
+		if (best <= epsilon_ * epsilon_ * LengthSquared(direction))
+			return false;
+
+		// Farthest point from the plane
+		Point normal = Cross(direction, Sub(points_[simplex[2]], points_[simplex[0]]));
+		const float normal_length = sqrtf(LengthSquared(normal));
+		normal = Point{normal.x / normal_length, normal.y / normal_length, normal.z / normal_length};
+		best = 0.0f;
+		float signed_best = 0.0f;
+		for (unsigned int i : unique_)
+		{
+			const float distance = Dot(normal, Sub(points_[i], points_[simplex[0]]));
+			if (fabsf(distance) > best)
+			{
+				best = fabsf(distance);
+				signed_best = distance;
+				simplex[3] = i;
+			}
+		}
+		if (best <= epsilon_)
+			return false;
+
+		// Orient faces outwards: the fourth point should be below the base face
+		if (signed_best > 0.0f)
+			std::swap(simplex[1], simplex[2]);
+		AddFace(simplex[0], simplex[1], simplex[2]);
+		AddFace(simplex[0], simplex[3], simplex[1]);
+		AddFace(simplex[1], simplex[3], simplex[2]);
+		AddFace(simplex[2], simplex[3], simplex[0]);
+		// Neighbors across edges, in the order of face edges
+		const unsigned int kNeighbors[4][3] = {{1, 2, 3}, {3, 2, 0}, {1, 3, 0}, {2, 1, 0}};
+		for (int f = 0; f < 4; ++f)
+			for (int e = 0; e < 3; ++e)
+				faces_[f].neighbors[e] = kNeighbors[f][e];
+		num_dead_faces_ = 0;
+		return true;
+	}
+	void CollectDistinctPoints()
+	{
+		vertices_ = unique_;
+	}
+
+	std::vector<Point> points_;
+	std::vector<Face> faces_;
+	std::vector<unsigned int> unique_; //!< indices of welded points
+	size_t num_dead_faces_;
+	std::vector<unsigned int> vertices_;
+	std::vector<unsigned int> triangles_;
+	float epsilon_;
+};
+
+//! Hull of mesh vertex positions, zero max vertices means no reduction
+inline void ComputeConvexHull(const MeshData& data, size_t max_vertices, ConvexHull * hull)
+{
+	hull->Build(data.vertices.empty() ? nullptr : data.vertices[0].position,
+		data.vertices.size(), sizeof(MeshVertex));
+	hull->ReduceVertices(max_vertices);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "mesh_data.h"
+#include "convex_hull.h"
+#include "vertex_cache_optimizer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+/*
+Headless checks of shared mesh utilities.
+Exits with non zero code when any check fails, so it can run without a GPU after build.
+*/
+
+namespace {
+
+	struct Options {
+		double time_limit; //!< maximal time of a single check in ms
+	};
+
+	void PrintUsage(const char * program)
+	{
+		printf("usage: %s [options]\n"
+			"      --time-limit <ms>  maximal time of a single check (default 1000)\n",
+			program);
+	}
+	bool ParseOptions(int argc, char ** argv, Options * options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char * name = argv[i];
+			if (i + 1 >= argc)
+				return false;
+			const char * value = argv[++i];
+			if (strcmp(name, "--time-limit") == 0)
+				options->time_limit = atof(value);
+			else
+				return false;
+		}
+		return options->time_limit > 0.0;
+	}
+
+	/**
+	 * Builds hull of mesh vertices and verifies every vertex is below every hull face.
+	 * @return True if the hull is convex and was built within the time limit.
+	 */
+	bool CheckConvexHull(const char * name, const MeshData& mesh, const Options& options)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		ConvexHull hull;
+		ComputeConvexHull(mesh, 0, &hull);
+		const auto end = std::chrono::steady_clock::now();
+		const double time = std::chrono::duration<double, std::milli>(end - start).count();
+
+		float extent = 0.0f;
+		for (const auto& vertex : mesh.vertices)
+			for (int k = 0; k < 3; ++k)
+				extent = std::max(extent, fabsf(vertex.position[k]));
+		const float tolerance = 1e-4f * extent;
+		const auto& triangles = hull.triangles();
+		size_t num_outside = 0;
+		for (size_t t = 0; t < triangles.size(); t += 3)
+		{
+			const float * a = mesh.vertices[triangles[t]].position;
+			const float * b = mesh.vertices[triangles[t + 1]].position;
+			const float * c = mesh.vertices[triangles[t + 2]].position;
+			const float ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			const float ac[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+			float normal[3] = {ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0]};
+			const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (length == 0.0f)
+				continue;
+			for (const auto& vertex : mesh.vertices)
+			{
+				const float * p = vertex.position;
+				const float distance = ((p[0] - a[0]) * normal[0] + (p[1] - a[1]) * normal[1] + (p[2] - a[2]) * normal[2]) / length;
+				if (distance > tolerance)
+					++num_outside;
+			}
+		}
+		const bool passed = !triangles.empty() && num_outside == 0 && time <= options.time_limit;
+		printf("%s hull of %s: %u vertices, %u hull vertices, %u triangles, %u points outside, %.2f ms\n",
+			passed ? "PASS" : "FAIL", name, static_cast<unsigned int>(mesh.vertices.size()),
+			static_cast<unsigned int>(hull.vertices().size()), static_cast<unsigned int>(triangles.size() / 3),
+			static_cast<unsigned int>(num_outside), time);
+		return passed;
+	}
+	bool CheckConvexHulls(const Options& options)
+	{
+		bool passed = true;
+		const unsigned int kSphereDetails[][2] = {{32, 16}, {80, 40}, {96, 48}, {112, 56}, {128, 64}};
+		for (const auto& detail : kSphereDetails)
+		{
+			MeshData mesh;
+			mesh.CreateSphere(1.0f, detail[0], detail[1]);
+			const std::string name = "sphere " + std::to_string(detail[0]) + "x" + std::to_string(detail[1]);
+			passed = CheckConvexHull(name.c_str(), mesh, options) && passed;
+		}
+		MeshData box;
+		box.CreatePhysicalBox(2.0f, 1.0f, 0.5f, 1.0f, 1.0f);
+		passed = CheckConvexHull("box", box, options) && passed;
+		MeshData tetrahedron;
+		tetrahedron.CreateTetrahedron();
+		passed = CheckConvexHull("tetrahedron", tetrahedron, options) && passed;
+		return passed;
+	}
+
+	/**
+	 * Optimizes mesh and verifies index buffer stays valid and cache misses don't grow.
+	 * @param[in] must_improve  Requires ACMR to drop, meshes with vertices of a single face can't improve.
+	 */
+	bool CheckVertexCache(const char * name, MeshData mesh, bool must_improve)
+	{
+		const size_t num_indices = mesh.indices.size();
+		const auto start = std::chrono::steady_clock::now();
+		const MeshOptimizationStatistics statistics = OptimizeMesh(&mesh);
+		const auto end = std::chrono::steady_clock::now();
+
+		bool is_valid = mesh.indices.size() == num_indices;
+		for (unsigned int index : mesh.indices)
+			is_valid = is_valid && index < mesh.vertices.size();
+		const bool passed = is_valid && (must_improve ? statistics.after.acmr < statistics.before.acmr
+			: statistics.after.acmr <= statistics.before.acmr);
+		printf("%s vertex cache of %s: %u triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %.2f ms\n",
+			passed ? "PASS" : "FAIL", name, static_cast<unsigned int>(mesh.num_triangles()),
+			statistics.before.acmr, statistics.after.acmr, statistics.before.atvr, statistics.after.atvr,
+			std::chrono::duration<double, std::milli>(end - start).count());
+		return passed;
+	}
+	bool CheckVertexCaches()
+	{
+		bool passed = true;
+		MeshData sphere;
+		sphere.CreateSphere(1.0f, 64, 32);
+		passed = CheckVertexCache("sphere 64x32", sphere, true) && passed;
+		MeshData box;
+		box.CreatePhysicalBox(2.0f, 1.0f, 0.5f, 1.0f, 1.0f);
+		passed = CheckVertexCache("box", box, false) && passed;
+		// Merged boxes like maze walls
+		MeshData boxes;
+		for (int i = 0; i < 16; ++i)
+		{
+			const float center[3] = {static_cast<float>(i), 0.0f, 0.0f};
+			boxes.CreatePhysicalBox(0.4f, 1.0f, 0.4f, 1.0f, 1.0f, center);
+		}
+		passed = CheckVertexCache("16 boxes", boxes, false) && passed;
+		return passed;
+	}
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+	Options options;
+	options.time_limit = 1000.0;
+	if (!ParseOptions(argc, argv, &options))
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	bool passed = true;
+	passed = CheckConvexHulls(options) && passed;
+	passed = CheckVertexCaches() && passed;
+	if (!passed)
+	{
+		fprintf(stderr, "some checks failed\n");
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,295 @@
+#ifndef __INSTANCED_MESH_H__
+#define __INSTANCED_MESH_H__
+
+#include "static_mesh.h"
+#include "mesh_lod.h"
+#include "vertex_cache_optimizer.h"
+
+#include "math/matrix4.h"
+#include "math/vector3.h"
+#include "common/non_copyable.h"
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+/**
+ * Per instance data, model matrix is stored in column major order.
+ */
+struct InstanceData {
+	float model[16];
+	float color[3];
+};
+
+inline void MakeInstance(const scythe::Matrix4& model, const scythe::Vector3& color, InstanceData * instance)
+{
+	static_assert(sizeof(scythe::Matrix4) == sizeof(instance->model), "Matrix4 should consist of 16 floats");
+	memcpy(instance->model, &model, sizeof(instance->model));
+	instance->color[0] = color.x;
+	instance->color[1] = color.y;
+	instance->color[2] = color.z;
+}
+
+/**
+ * Mesh that draws all its instances with a single draw call.
+ * Vertex attributes are the same as of StaticMesh. Instance model matrix takes locations 5-8
+ * and instance color takes location 9 (shaders with USE_INSTANCING define).
+ */
+class InstancedMesh final : public StaticMesh {
+public:
+	InstancedMesh()
+	: instance_buffer_(0)
+	, num_instances_(0)
+	, instance_capacity_(0)
+	{
+	}
+	~InstancedMesh()
+	{
+		Release();
+	}
+
+	/**
+	 * Uploads mesh data to GPU. Data is expected to be already optimized.
+	 * @param[in] attributes  Combination of Attributes flags.
+	 */
+	bool Create(const MeshData& data, unsigned int attributes)
+	{
+		Release();
+		if (!StaticMesh::Create(data, attributes))
+			return false;
+
+		// Instance attributes advance once per instance
+		glBindVertexArray(vertex_array_);
+		glGenBuffers(1, &instance_buffer_);
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+		const GLsizei kInstanceStride = sizeof(InstanceData);
+		for (GLuint column = 0; column < 4; ++column)
+		{
+			glEnableVertexAttribArray(5 + column);
+			glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, kInstanceStride,
+				reinterpret_cast<const void *>(offsetof(InstanceData, model) + column * 4 * sizeof(float)));
+			glVertexAttribDivisor(5 + column, 1);
+		}
+		glEnableVertexAttribArray(9);
+		glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, kInstanceStride,
+			reinterpret_cast<const void *>(offsetof(InstanceData, color)));
+		glVertexAttribDivisor(9, 1);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return true;
+	}
+	void Release()
+	{
+		if (instance_buffer_)
+			glDeleteBuffers(1, &instance_buffer_);
+		instance_buffer_ = 0;
+		num_instances_ = 0;
+		instance_capacity_ = 0;
+		StaticMesh::Release();
+	}
+	//! Uploads instances for the next draw, buffer is orphaned to avoid synchronization
+	void SetInstances(const InstanceData * instances, size_t count)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+		if (count > instance_capacity_)
+			instance_capacity_ = (count > 2 * instance_capacity_) ? count : 2 * instance_capacity_;
+		glBufferData(GL_ARRAY_BUFFER, instance_capacity_ * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+		if (count != 0)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		num_instances_ = count;
+	}
+	void SetInstances(const std::vector<InstanceData>& instances)
+	{
+		SetInstances(instances.data(), instances.size());
+	}
+	//! Updates range of already uploaded instances in place, instance count stays the same
+	void UpdateInstances(const InstanceData * instances, size_t first, size_t count)
+	{
+		if (count == 0 || first + count > num_instances_)
+			return;
+		glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(InstanceData), count * sizeof(InstanceData), instances + first);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	//! Draws all instances with one draw call
+	void Render() const
+	{
+		if (num_instances_ == 0)
+			return;
+		glBindVertexArray(vertex_array_);
+		glDrawElementsInstanced(GL_TRIANGLES, num_indices_, GL_UNSIGNED_INT, nullptr,
+			static_cast<GLsizei>(num_instances_));
+		glBindVertexArray(0);
+	}
+
+	size_t num_instances() const
+	{
+		return num_instances_;
+	}
+
+private:
+	GLuint instance_buffer_;
+	size_t num_instances_;
+	size_t instance_capacity_; //!< in instances
+};
+
+/**
+ * Chain of instanced sphere levels of detail with the same selection rules as MeshLod.
+ * Each level collects its own instances every frame.
+ */
+class InstancedMeshLod final : public scythe::NonCopyable {
+public:
+	InstancedMeshLod()
+	: max_edge_pixels_(8.0f)
+	{
+	}
+	~InstancedMeshLod()
+	{
+		Release();
+	}
+
+	bool CreateSphere(float radius, U32 slices, U32 loops, U32 max_levels, unsigned int attributes)
+	{
+		const U32 kMinSlices = 8;
+		const U32 kMinLoops = 4;
+
+		Release();
+		for (U32 i = 0; i < max_levels; ++i)
+		{
+			MeshData data;
+			data.CreateSphere(radius, slices, loops);
+			OptimizeMesh(&data);
+			InstancedMesh * mesh = new InstancedMesh();
+			if (!mesh->Create(data, attributes))
+			{
+				delete mesh;
+				return false;
+			}
+			levels_.push_back(mesh);
+			segments_.push_back(static_cast<float>(slices));
+			instances_.push_back(std::vector<InstanceData>());
+			dirty_ranges_.push_back(DirtyRange{0, 0});
+
+			slices /= 2;
+			loops /= 2;
+			if (slices < kMinSlices || loops < kMinLoops)
+				break;
+		}
+		return true;
+	}
+	void Release()
+	{
+		for (auto mesh : levels_)
+			delete mesh;
+		levels_.clear();
+		segments_.clear();
+		instances_.clear();
+		dirty_ranges_.clear();
+	}
+
+	U32 SelectLevel(float projected_size) const
+	{
+		return SelectLodLevel(segments_, projected_size, max_edge_pixels_);
+	}
+
+	//! Clears collected instances of all levels
+	void BeginInstances()
+	{
+		for (auto& instances : instances_)
+			instances.clear();
+	}
+	void AddInstance(U32 level, const InstanceData& instance)
+	{
+		instances_[level].push_back(instance);
+	}
+	void AddInstance(const LodSelector& selector, const scythe::Vector3& center, float radius,
+		const scythe::Matrix4& model, const scythe::Vector3& color)
+	{
+		InstanceData instance;
+		MakeInstance(model, color, &instance);
+		AddInstance(SelectLevel(selector.ProjectedSize(center, radius)), instance);
+	}
+	//! Replaces already collected instance, change is uploaded by UploadDirty
+	void SetInstance(U32 level, size_t index, const InstanceData& instance)
+	{
+		instances_[level][index] = instance;
+		DirtyRange& range = dirty_ranges_[level];
+		if (range.first == range.last)
+		{
+			range.first = index;
+			range.last = index + 1;
+		}
+		else
+		{
+			range.first = (index < range.first) ? index : range.first;
+			range.last = (index + 1 > range.last) ? index + 1 : range.last;
+		}
+	}
+	//! Uploads all collected instances
+	void Upload()
+	{
+		for (size_t i = 0; i < levels_.size(); ++i)
+		{
+			if (!instances_[i].empty())
+				levels_[i]->SetInstances(instances_[i]);
+			dirty_ranges_[i] = DirtyRange{0, 0};
+		}
+	}
+	//! Uploads only instances changed with SetInstance since the last upload
+	void UploadDirty()
+	{
+		for (size_t i = 0; i < levels_.size(); ++i)
+		{
+			const DirtyRange& range = dirty_ranges_[i];
+			if (range.first != range.last)
+				levels_[i]->UpdateInstances(instances_[i].data(), range.first, range.last - range.first);
+			dirty_ranges_[i] = DirtyRange{0, 0};
+		}
+	}
+	//! Draws each level with a single draw call
+	void Draw() const
+	{
+		for (size_t i = 0; i < levels_.size(); ++i)
+			if (!instances_[i].empty())
+				levels_[i]->Render();
+	}
+	//! Uploads collected instances and draws each level with a single draw call
+	void Render()
+	{
+		Upload();
+		Draw();
+	}
+
+	void set_max_edge_pixels(float pixels)
+	{
+		max_edge_pixels_ = pixels;
+	}
+	U32 num_levels() const
+	{
+		return static_cast<U32>(levels_.size());
+	}
+	size_t num_instances(U32 level) const
+	{
+		return instances_[level].size();
+	}
+	InstancedMesh * mesh(U32 level) const
+	{
+		return levels_[level];
+	}
+
+private:
+	struct DirtyRange {
+		size_t first;
+		size_t last; //!< past the end, equals to first for empty range
+	};
+
+	std::vector<InstancedMesh *> levels_;
+	std::vector<float> segments_; //!< number of silhouette segments for each level
+	std::vector<std::vector<InstanceData>> instances_; //!< instances collected for each level
+	std::vector<DirtyRange> dirty_ranges_;
+	float max_edge_pixels_;
+};
+
+#endif
\ No newline at end of file
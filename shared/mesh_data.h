@@ -0,0 +1,211 @@
+#ifndef __MESH_DATA_H__
+#define __MESH_DATA_H__
+
+#include <vector>
+#include <cmath>
+
+/**
+ * Vertex layout matching the full object vertex format of the demos:
+ * position, normal, texcoord, tangent, binormal.
+ */
+struct MeshVertex {
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+	float tangent[3];
+	float binormal[3];
+};
+
+/**
+ * CPU side indexed triangle list.
+ * Generators mirror the parametric shapes of scythe::Mesh, so the data
+ * can be processed on CPU (optimization, collision, ray tracing) before upload.
+ */
+class MeshData {
+public:
+	std::vector<MeshVertex> vertices;
+	std::vector<unsigned int> indices;
+
+	void Clear()
+	{
+		vertices.clear();
+		indices.clear();
+	}
+	size_t num_triangles() const
+	{
+		return indices.size() / 3;
+	}
+
+	//! Appends UV sphere, slices go around Y axis and loops go from top to bottom
+	void CreateSphere(float radius, unsigned int slices, unsigned int loops)
+	{
+		const float kPi = 3.14159265358979f;
+		const unsigned int base = static_cast<unsigned int>(vertices.size());
+		vertices.reserve(vertices.size() + (loops + 1) * (slices + 1));
+		for (unsigned int i = 0; i <= loops; ++i)
+		{
+			const float theta = kPi * static_cast<float>(i) / static_cast<float>(loops);
+			const float sin_theta = sinf(theta);
+			const float cos_theta = cosf(theta);
+			for (unsigned int j = 0; j <= slices; ++j)
+			{
+				const float phi = 2.0f * kPi * static_cast<float>(j) / static_cast<float>(slices);
+				const float sin_phi = sinf(phi);
+				const float cos_phi = cosf(phi);
+				MeshVertex vertex;
+				SetVector(vertex.normal, sin_theta * cos_phi, cos_theta, sin_theta * sin_phi);
+				SetVector(vertex.position, radius * vertex.normal[0], radius * vertex.normal[1], radius * vertex.normal[2]);
+				vertex.texcoord[0] = static_cast<float>(j) / static_cast<float>(slices);
+				vertex.texcoord[1] = static_cast<float>(i) / static_cast<float>(loops);
+				SetVector(vertex.tangent, -sin_phi, 0.0f, cos_phi);
+				// binormal = normal x tangent
+				SetVector(vertex.binormal,
+					vertex.normal[1] * vertex.tangent[2] - vertex.normal[2] * vertex.tangent[1],
+					vertex.normal[2] * vertex.tangent[0] - vertex.normal[0] * vertex.tangent[2],
+					vertex.normal[0] * vertex.tangent[1] - vertex.normal[1] * vertex.tangent[0]);
+				vertices.push_back(vertex);
+			}
+		}
+		indices.reserve(indices.size() + loops * slices * 6);
+		for (unsigned int i = 0; i < loops; ++i)
+		{
+			for (unsigned int j = 0; j < slices; ++j)
+			{
+				const unsigned int i0 = base + i * (slices + 1) + j;
+				const unsigned int i1 = i0 + 1;
+				const unsigned int i2 = i0 + (slices + 1);
+				const unsigned int i3 = i2 + 1;
+				if (i != 0) // skip degenerate triangles at the top pole
+					AddTriangle(i0, i1, i2);
+				if (i != loops - 1) // and at the bottom one
+					AddTriangle(i1, i3, i2);
+			}
+		}
+	}
+	//! Appends box with half sizes, texture coordinates are in material units
+	void CreatePhysicalBox(float size_x, float size_y, float size_z,
+		float material_size_u, float material_size_v, const float * center = nullptr)
+	{
+		const float kCenter[3] = {0.0f, 0.0f, 0.0f};
+		const float * c = center ? center : kCenter;
+		const float sizes[3] = {size_x, size_y, size_z};
+		// For each face: normal axis, tangent axis, binormal axis
+		const int kFaceAxes[3][3] = {
+			{0, 2, 1}, // +-X
+			{1, 0, 2}, // +-Y
+			{2, 0, 1}  // +-Z
+		};
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			for (int side = 0; side < 2; ++side)
+			{
+				const float sign = side ? -1.0f : 1.0f;
+				const int n = kFaceAxes[axis][0];
+				const int t = kFaceAxes[axis][1];
+				const int b = kFaceAxes[axis][2];
+				const unsigned int base = static_cast<unsigned int>(vertices.size());
+				const float kCorners[4][2] = {
+					{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}
+				};
+				for (int k = 0; k < 4; ++k)
+				{
+					MeshVertex vertex;
+					SetVector(vertex.normal, 0.0f, 0.0f, 0.0f);
+					SetVector(vertex.tangent, 0.0f, 0.0f, 0.0f);
+					SetVector(vertex.binormal, 0.0f, 0.0f, 0.0f);
+					vertex.normal[n] = sign;
+					vertex.tangent[t] = sign;
+					vertex.binormal[b] = 1.0f;
+					vertex.position[n] = c[n] + sign * sizes[n];
+					vertex.position[t] = c[t] + sign * kCorners[k][0] * sizes[t];
+					vertex.position[b] = c[b] + kCorners[k][1] * sizes[b];
+					vertex.texcoord[0] = (kCorners[k][0] + 1.0f) * sizes[t] / material_size_u;
+					vertex.texcoord[1] = (kCorners[k][1] + 1.0f) * sizes[b] / material_size_v;
+					vertices.push_back(vertex);
+				}
+				// Keep counter-clockwise winding looking from outside
+				if (axis != 2)
+				{
+					AddTriangle(base, base + 2, base + 1);
+					AddTriangle(base, base + 3, base + 2);
+				}
+				else
+				{
+					AddTriangle(base, base + 1, base + 2);
+					AddTriangle(base, base + 2, base + 3);
+				}
+			}
+		}
+	}
+	//! Appends cube with unit half size
+	void CreateCube()
+	{
+		CreatePhysicalBox(1.0f, 1.0f, 1.0f, 2.0f, 2.0f);
+	}
+	//! Appends regular tetrahedron inscribed into unit sphere, faces are flat shaded
+	void CreateTetrahedron()
+	{
+		const float k = 0.57735027f; // 1/sqrt(3)
+		const float kCorners[4][3] = {
+			{ k,  k,  k},
+			{ k, -k, -k},
+			{-k,  k, -k},
+			{-k, -k,  k}
+		};
+		const int kFaces[4][3] = {
+			{0, 1, 2},
+			{0, 3, 1},
+			{0, 2, 3},
+			{1, 3, 2}
+		};
+		for (int f = 0; f < 4; ++f)
+		{
+			const float * p0 = kCorners[kFaces[f][0]];
+			const float * p1 = kCorners[kFaces[f][1]];
+			const float * p2 = kCorners[kFaces[f][2]];
+			const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			float normal[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+			const float inv_length = 1.0f / sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			const float inv_edge = 1.0f / sqrtf(e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2]);
+			const unsigned int base = static_cast<unsigned int>(vertices.size());
+			const float kTexcoords[3][2] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {0.5f, 1.0f}};
+			for (int k = 0; k < 3; ++k)
+			{
+				const float * p = kCorners[kFaces[f][k]];
+				MeshVertex vertex;
+				SetVector(vertex.position, p[0], p[1], p[2]);
+				SetVector(vertex.normal, normal[0] * inv_length, normal[1] * inv_length, normal[2] * inv_length);
+				vertex.texcoord[0] = kTexcoords[k][0];
+				vertex.texcoord[1] = kTexcoords[k][1];
+				SetVector(vertex.tangent, e1[0] * inv_edge, e1[1] * inv_edge, e1[2] * inv_edge);
+				SetVector(vertex.binormal,
+					vertex.normal[1] * vertex.tangent[2] - vertex.normal[2] * vertex.tangent[1],
+					vertex.normal[2] * vertex.tangent[0] - vertex.normal[0] * vertex.tangent[2],
+					vertex.normal[0] * vertex.tangent[1] - vertex.normal[1] * vertex.tangent[0]);
+				vertices.push_back(vertex);
+			}
+			AddTriangle(base, base + 1, base + 2);
+		}
+	}
+
+private:
+	static void SetVector(float * v, float x, float y, float z)
+	{
+		v[0] = x;
+		v[1] = y;
+		v[2] = z;
+	}
+	void AddTriangle(unsigned int i0, unsigned int i1, unsigned int i2)
+	{
+		indices.push_back(i0);
+		indices.push_back(i1);
+		indices.push_back(i2);
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef __MESH_LOD_H__
+#define __MESH_LOD_H__
+
+#include "static_mesh.h"
+#include "vertex_cache_optimizer.h"
+
+#include "math/vector3.h"
+#include "math/constants.h"
+#include "common/types.h"
+#include "common/non_copyable.h"
+
+#include <vector>
+#include <cmath>
+
+/**
+ * Describes how object sizes map to pixels for a single render pass.
+ * Perspective mode is used for camera passes, orthographic one
+ * for shadow map cascades (texel density of the cascade).
+ */
+class LodSelector {
+public:
+	LodSelector()
+	: eye_(0.0f)
+	, pixels_per_unit_(1.0f)
+	, is_perspective_(true)
+	{
+	}
+
+	//! Perspective pass: projected size depends on distance to the eye
+	void SetPerspective(const scythe::Vector3& eye, float fov_degrees, float viewport_height)
+	{
+		const float kHalfFov = 0.5f * fov_degrees * scythe::kPi / 180.0f;
+		eye_ = eye;
+		pixels_per_unit_ = 0.5f * viewport_height / tanf(kHalfFov);
+		is_perspective_ = true;
+	}
+	//! Orthographic pass: constant texel density over the whole projection
+	void SetOrthographic(float ortho_height, float viewport_height)
+	{
+		pixels_per_unit_ = viewport_height / ortho_height;
+		is_perspective_ = false;
+	}
+	//! Returns projected diameter of bounding sphere in pixels
+	float ProjectedSize(const scythe::Vector3& center, float radius) const
+	{
+		if (!is_perspective_)
+			return 2.0f * radius * pixels_per_unit_;
+		const float dx = center.x - eye_.x;
+		const float dy = center.y - eye_.y;
+		const float dz = center.z - eye_.z;
+		const float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+		if (distance <= radius) // eye is inside the bounding sphere
+			return 1e6f;
+		return 2.0f * radius * pixels_per_unit_ / distance;
+	}
+
+private:
+	scythe::Vector3 eye_;
+	float pixels_per_unit_;
+	bool is_perspective_;
+};
+
+/**
+ * Selects the coarsest level whose silhouette edges fit into max edge length in pixels.
+ * @param[in] segments        Number of silhouette segments for each level.
+ * @param[in] projected_size  Diameter of object's bounding sphere in pixels.
+ */
+inline U32 SelectLodLevel(const std::vector<float>& segments, float projected_size, float max_edge_pixels)
+{
+	// Silhouette length on screen is roughly Pi * D
+	const float kSilhouette = scythe::kPi * projected_size;
+	U32 level = 0;
+	for (U32 i = 1; i < static_cast<U32>(segments.size()); ++i)
+	{
+		if (kSilhouette / segments[i] > max_edge_pixels)
+			break;
+		level = i;
+	}
+	return level;
+}
+
+/**
+ * Chain of mesh levels of detail.
+ * Level 0 is the most detailed one, each next level has half the tessellation.
+ * Levels are generated by parametric re-tessellation of the source shape
+ * and go through the vertex cache optimizer before upload.
+ */
+class MeshLod final : public scythe::NonCopyable {
+public:
+	MeshLod()
+	: max_edge_pixels_(8.0f)
+	{
+	}
+	~MeshLod()
+	{
+		Release();
+	}
+
+	/**
+	 * Creates sphere levels starting from (slices, loops) tessellation.
+	 * Tessellation is halved until it reaches minimum values or number of levels.
+	 * @param[in] attributes  Combination of StaticMesh::Attributes flags.
+	 */
+	bool CreateSphere(float radius, U32 slices, U32 loops, U32 max_levels, unsigned int attributes)
+	{
+		const U32 kMinSlices = 8;
+		const U32 kMinLoops = 4;
+
+		Release();
+		for (U32 i = 0; i < max_levels; ++i)
+		{
+			MeshData data;
+			data.CreateSphere(radius, slices, loops);
+			OptimizeMesh(&data);
+			StaticMesh * mesh = new StaticMesh();
+			if (!mesh->Create(data, attributes))
+			{
+				delete mesh;
+				return false;
+			}
+			levels_.push_back(mesh);
+			// Circumference of the sphere is divided into slices segments
+			segments_.push_back(static_cast<float>(slices));
+
+			slices /= 2;
+			loops /= 2;
+			if (slices < kMinSlices || loops < kMinLoops)
+				break;
+		}
+		return true;
+	}
+	void Release()
+	{
+		for (auto mesh : levels_)
+			delete mesh;
+		levels_.clear();
+		segments_.clear();
+	}
+
+	//! Selects level for projected diameter of object's bounding sphere in pixels
+	U32 SelectLevel(float projected_size) const
+	{
+		return SelectLodLevel(segments_, projected_size, max_edge_pixels_);
+	}
+	const StaticMesh * Select(const LodSelector& selector, const scythe::Vector3& center, float radius) const
+	{
+		return levels_[SelectLevel(selector.ProjectedSize(center, radius))];
+	}
+
+	void set_max_edge_pixels(float pixels)
+	{
+		max_edge_pixels_ = pixels;
+	}
+	U32 num_levels() const
+	{
+		return static_cast<U32>(levels_.size());
+	}
+	const StaticMesh * mesh(U32 level) const
+	{
+		return levels_[level];
+	}
+
+private:
+	std::vector<StaticMesh *> levels_;
+	std::vector<float> segments_; //!< number of silhouette segments for each level
+	float max_edge_pixels_;
+};
+
+#endif
\ No newline at end of file
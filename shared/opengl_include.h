@@ -0,0 +1,18 @@
+#ifndef __OPENGL_INCLUDE_H__
+#define __OPENGL_INCLUDE_H__
+
+// OpenGL 3.3 core functions for demo side rendering code.
+// Context creation and function loading are done by the engine.
+#if defined(_WIN32)
+# include <GL/glew.h>
+#elif defined(__APPLE__)
+# include <OpenGL/gl3.h>
+#else
+# ifndef GL_GLEXT_PROTOTYPES
+#  define GL_GLEXT_PROTOTYPES
+# endif
+# include <GL/gl.h>
+# include <GL/glext.h>
+#endif
+
+#endif
\ No newline at end of file
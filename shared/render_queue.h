@@ -0,0 +1,224 @@
+#ifndef __RENDER_QUEUE_H__
+#define __RENDER_QUEUE_H__
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+typedef std::uint64_t DrawKey;
+
+/**
+ * Draw key layout from the most significant bits:
+ * pass (4) | shader (8) | material (12) | mesh (16) | depth (24).
+ * Sorted keys go pass by pass and minimize state changes inside each pass,
+ * depth is the least significant part so equal states are drawn front to back.
+ */
+namespace draw_key {
+
+	const unsigned int kDepthBits = 24;
+	const unsigned int kMeshBits = 16;
+	const unsigned int kMaterialBits = 12;
+	const unsigned int kShaderBits = 8;
+	const unsigned int kPassBits = 4;
+
+	const unsigned int kDepthShift = 0;
+	const unsigned int kMeshShift = kDepthShift + kDepthBits;
+	const unsigned int kMaterialShift = kMeshShift + kMeshBits;
+	const unsigned int kShaderShift = kMaterialShift + kMaterialBits;
+	const unsigned int kPassShift = kShaderShift + kShaderBits;
+	static_assert(kPassShift + kPassBits == 64, "Draw key should use all 64 bits");
+
+	inline DrawKey Field(unsigned int value, unsigned int bits, unsigned int shift)
+	{
+		return (static_cast<DrawKey>(value) & ((DrawKey(1) << bits) - 1)) << shift;
+	}
+	inline unsigned int Extract(DrawKey key, unsigned int bits, unsigned int shift)
+	{
+		return static_cast<unsigned int>((key >> shift) & ((DrawKey(1) << bits) - 1));
+	}
+
+	inline DrawKey Make(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, unsigned int depth)
+	{
+		return Field(pass, kPassBits, kPassShift)
+			| Field(shader, kShaderBits, kShaderShift)
+			| Field(material, kMaterialBits, kMaterialShift)
+			| Field(mesh, kMeshBits, kMeshShift)
+			| Field(depth, kDepthBits, kDepthShift);
+	}
+	inline unsigned int Pass(DrawKey key)
+	{
+		return Extract(key, kPassBits, kPassShift);
+	}
+	inline unsigned int Shader(DrawKey key)
+	{
+		return Extract(key, kShaderBits, kShaderShift);
+	}
+	inline unsigned int Material(DrawKey key)
+	{
+		return Extract(key, kMaterialBits, kMaterialShift);
+	}
+	inline unsigned int Mesh(DrawKey key)
+	{
+		return Extract(key, kMeshBits, kMeshShift);
+	}
+
+	//! Quantizes view distance for front to back order, distances beyond far one are clamped
+	inline unsigned int QuantizeDepth(float distance, float far_distance)
+	{
+		const unsigned int kMaxDepth = (1u << kDepthBits) - 1;
+		float t = distance / far_distance;
+		if (t < 0.0f) t = 0.0f;
+		if (t > 1.0f) t = 1.0f;
+		return static_cast<unsigned int>(t * static_cast<float>(kMaxDepth));
+	}
+	//! Back to front order for transparent objects
+	inline unsigned int QuantizeDepthReversed(float distance, float far_distance)
+	{
+		const unsigned int kMaxDepth = (1u << kDepthBits) - 1;
+		return kMaxDepth - QuantizeDepth(distance, far_distance);
+	}
+
+} // namespace draw_key
+
+/**
+ * Render queue executor interface.
+ * Bind functions are called only when corresponding key field changes.
+ */
+class IRenderQueueExecutor {
+public:
+	virtual ~IRenderQueueExecutor() = default;
+
+	virtual void BindPass(unsigned int pass) = 0;
+	virtual void BindShader(unsigned int shader) = 0;
+	virtual void BindMaterial(unsigned int material) = 0;
+	virtual void BindMesh(unsigned int mesh) = 0;
+	virtual void Draw(unsigned int item) = 0;
+};
+
+struct RenderQueueStatistics {
+	unsigned int draws;
+	unsigned int pass_changes;
+	unsigned int shader_changes;
+	unsigned int material_changes;
+	unsigned int mesh_changes;
+};
+
+/**
+ * Queue of draws with packed keys.
+ * Draws are submitted as (key, item) pairs, where item is an index into caller's data.
+ */
+class RenderQueue {
+public:
+	void Reserve(size_t count)
+	{
+		entries_.reserve(count);
+		temp_.reserve(count);
+	}
+	void Clear()
+	{
+		entries_.clear();
+	}
+	void Submit(DrawKey key, unsigned int item)
+	{
+		entries_.push_back(Entry{key, item});
+	}
+
+	//! LSD radix sort by 8 bits, stable, passes with a single bucket are skipped
+	void Sort()
+	{
+		const size_t count = entries_.size();
+		if (count < 2)
+			return;
+		temp_.resize(count);
+
+		// All histograms are gathered in one pass over the keys
+		unsigned int histograms[8][256];
+		memset(histograms, 0, sizeof(histograms));
+		for (const auto& entry : entries_)
+			for (unsigned int byte = 0; byte < 8; ++byte)
+				++histograms[byte][(entry.key >> (byte * 8)) & 0xFF];
+
+		Entry * source = entries_.data();
+		Entry * destination = temp_.data();
+		for (unsigned int byte = 0; byte < 8; ++byte)
+		{
+			unsigned int * histogram = histograms[byte];
+			const unsigned int shift = byte * 8;
+			if (histogram[(source[0].key >> shift) & 0xFF] == count)
+				continue; // all keys have the same byte
+			unsigned int offset = 0;
+			for (unsigned int i = 0; i < 256; ++i)
+			{
+				const unsigned int bucket_size = histogram[i];
+				histogram[i] = offset;
+				offset += bucket_size;
+			}
+			for (size_t i = 0; i < count; ++i)
+				destination[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+			std::swap(source, destination);
+		}
+		if (source != entries_.data())
+			entries_.swap(temp_);
+	}
+
+	//! Executes draws in current order, sort should be called before
+	RenderQueueStatistics Execute(IRenderQueueExecutor * executor) const
+	{
+		RenderQueueStatistics statistics = {};
+		bool first = true;
+		DrawKey last_key = 0;
+		for (const auto& entry : entries_)
+		{
+			const DrawKey key = entry.key;
+			const bool pass_changed = first || draw_key::Pass(key) != draw_key::Pass(last_key);
+			const bool shader_changed = pass_changed || draw_key::Shader(key) != draw_key::Shader(last_key);
+			const bool material_changed = shader_changed || draw_key::Material(key) != draw_key::Material(last_key);
+			const bool mesh_changed = material_changed || draw_key::Mesh(key) != draw_key::Mesh(last_key);
+			if (pass_changed)
+			{
+				executor->BindPass(draw_key::Pass(key));
+				++statistics.pass_changes;
+			}
+			if (shader_changed)
+			{
+				executor->BindShader(draw_key::Shader(key));
+				++statistics.shader_changes;
+			}
+			if (material_changed)
+			{
+				executor->BindMaterial(draw_key::Material(key));
+				++statistics.material_changes;
+			}
+			if (mesh_changed)
+			{
+				executor->BindMesh(draw_key::Mesh(key));
+				++statistics.mesh_changes;
+			}
+			executor->Draw(entry.item);
+			++statistics.draws;
+			last_key = key;
+			first = false;
+		}
+		return statistics;
+	}
+
+	size_t size() const
+	{
+		return entries_.size();
+	}
+	DrawKey key(size_t index) const
+	{
+		return entries_[index].key;
+	}
+
+private:
+	struct Entry {
+		DrawKey key;
+		unsigned int item;
+	};
+	std::vector<Entry> entries_;
+	std::vector<Entry> temp_; //!< ping-pong buffer for radix sort
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef __STATIC_MESH_H__
+#define __STATIC_MESH_H__
+
+#include "opengl_include.h"
+#include "mesh_data.h"
+
+#include "common/non_copyable.h"
+
+#include <vector>
+
+/**
+ * Mesh uploaded from MeshData, so index order of the vertex cache optimizer reaches GPU as is.
+ * Vertex attribute locations follow the demo shaders: 0 - position, 1 - normal,
+ * 2 - texcoord, 3 - tangent, 4 - binormal.
+ */
+class StaticMesh : public scythe::NonCopyable {
+public:
+	//! Optional vertex attributes, position is always present
+	enum Attributes : unsigned int {
+		kNormal = 1,
+		kTexcoord = 2,
+		kTangentBasis = 4, //!< both tangent and binormal
+	};
+
+	StaticMesh()
+	: vertex_array_(0)
+	, vertex_buffer_(0)
+	, index_buffer_(0)
+	, num_indices_(0)
+	{
+	}
+	~StaticMesh()
+	{
+		Release();
+	}
+
+	/**
+	 * Uploads mesh data to GPU. Data is expected to be already optimized.
+	 * @param[in] attributes  Combination of Attributes flags.
+	 */
+	bool Create(const MeshData& data, unsigned int attributes)
+	{
+		Release();
+		if (data.indices.empty())
+			return false;
+
+		// Pack only requested attributes
+		GLsizei stride = 3;
+		if (attributes & kNormal) stride += 3;
+		if (attributes & kTexcoord) stride += 2;
+		if (attributes & kTangentBasis) stride += 6;
+		std::vector<float> vertices;
+		vertices.reserve(data.vertices.size() * stride);
+		for (const auto& vertex : data.vertices)
+		{
+			vertices.insert(vertices.end(), vertex.position, vertex.position + 3);
+			if (attributes & kNormal)
+				vertices.insert(vertices.end(), vertex.normal, vertex.normal + 3);
+			if (attributes & kTexcoord)
+				vertices.insert(vertices.end(), vertex.texcoord, vertex.texcoord + 2);
+			if (attributes & kTangentBasis)
+			{
+				vertices.insert(vertices.end(), vertex.tangent, vertex.tangent + 3);
+				vertices.insert(vertices.end(), vertex.binormal, vertex.binormal + 3);
+			}
+		}
+
+		glGenVertexArrays(1, &vertex_array_);
+		glBindVertexArray(vertex_array_);
+
+		glGenBuffers(1, &vertex_buffer_);
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+		const GLsizei stride_bytes = stride * sizeof(float);
+		size_t offset = 0;
+		SetVertexAttribute(0, 3, stride_bytes, &offset);
+		if (attributes & kNormal)
+			SetVertexAttribute(1, 3, stride_bytes, &offset);
+		if (attributes & kTexcoord)
+			SetVertexAttribute(2, 2, stride_bytes, &offset);
+		if (attributes & kTangentBasis)
+		{
+			SetVertexAttribute(3, 3, stride_bytes, &offset);
+			SetVertexAttribute(4, 3, stride_bytes, &offset);
+		}
+
+		glGenBuffers(1, &index_buffer_);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(unsigned int), data.indices.data(), GL_STATIC_DRAW);
+		num_indices_ = static_cast<GLsizei>(data.indices.size());
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		return true;
+	}
+	void Release()
+	{
+		if (index_buffer_)
+			glDeleteBuffers(1, &index_buffer_);
+		if (vertex_buffer_)
+			glDeleteBuffers(1, &vertex_buffer_);
+		if (vertex_array_)
+			glDeleteVertexArrays(1, &vertex_array_);
+		vertex_array_ = 0;
+		vertex_buffer_ = 0;
+		index_buffer_ = 0;
+		num_indices_ = 0;
+	}
+
+	void Render() const
+	{
+		glBindVertexArray(vertex_array_);
+		glDrawElements(GL_TRIANGLES, num_indices_, GL_UNSIGNED_INT, nullptr);
+		glBindVertexArray(0);
+	}
+
+protected:
+	GLuint vertex_array_;
+	GLuint vertex_buffer_;
+	GLuint index_buffer_;
+	GLsizei num_indices_;
+
+private:
+	static void SetVertexAttribute(GLuint location, GLint size, GLsizei stride, size_t * offset)
+	{
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void *>(*offset));
+		*offset += size * sizeof(float);
+	}
+};
+
+#endif
\ No newline at end of file
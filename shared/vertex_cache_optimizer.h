@@ -0,0 +1,382 @@
+#ifndef __VERTEX_CACHE_OPTIMIZER_H__
+#define __VERTEX_CACHE_OPTIMIZER_H__
+
+#include "mesh_data.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Post-transform vertex cache statistics.
+ * ACMR - average cache miss ratio (transformed vertices per triangle), 0.5 is ideal for big grids.
+ * ATVR - average transform to vertex ratio, 1.0 is ideal.
+ */
+struct VertexCacheStatistics {
+	unsigned int vertices_transformed;
+	float acmr;
+	float atvr;
+};
+struct MeshOptimizationStatistics {
+	VertexCacheStatistics before;
+	VertexCacheStatistics after;
+};
+
+/**
+ * Simulates FIFO post-transform cache of the given size.
+ */
+inline VertexCacheStatistics AnalyzeVertexCache(const unsigned int * indices, size_t index_count,
+	size_t vertex_count, unsigned int cache_size = 16)
+{
+	std::vector<unsigned int> timestamps(vertex_count, 0);
+	std::vector<bool> used(vertex_count, false);
+	unsigned int timestamp = cache_size + 1;
+	unsigned int misses = 0;
+	unsigned int unique_vertices = 0;
+	for (size_t i = 0; i < index_count; ++i)
+	{
+		const unsigned int index = indices[i];
+		if (!used[index])
+		{
+			used[index] = true;
+			++unique_vertices;
+		}
+		// Vertex is in the cache while less than cache size misses passed since its insertion
+		if (timestamp - timestamps[index] > cache_size)
+		{
+			timestamps[index] = timestamp++;
+			++misses;
+		}
+	}
+	VertexCacheStatistics statistics;
+	statistics.vertices_transformed = misses;
+	statistics.acmr = (index_count != 0) ? static_cast<float>(misses) / static_cast<float>(index_count / 3) : 0.0f;
+	statistics.atvr = (unique_vertices != 0) ? static_cast<float>(misses) / static_cast<float>(unique_vertices) : 0.0f;
+	return statistics;
+}
+
+namespace vertex_cache_detail {
+
+	const int kMaxCacheSize = 32;
+
+	// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation" scoring
+	inline float VertexScore(int cache_position, unsigned int live_triangles)
+	{
+		const float kCacheDecayPower = 1.5f;
+		const float kLastTriangleScore = 0.75f;
+		const float kValenceBoostScale = 2.0f;
+		const float kValenceBoostPower = 0.5f;
+
+		if (live_triangles == 0)
+			return -1.0f; // no triangles left, vertex is not needed anymore
+		float score = 0.0f;
+		if (cache_position >= 0)
+		{
+			if (cache_position < 3) // vertex was used by the last triangle
+				score = kLastTriangleScore;
+			else
+			{
+				const float kScaler = 1.0f / static_cast<float>(kMaxCacheSize - 3);
+				score = powf(1.0f - static_cast<float>(cache_position - 3) * kScaler, kCacheDecayPower);
+			}
+		}
+		// Boost vertices with few triangles left to get rid of lone triangles
+		score += kValenceBoostScale * powf(static_cast<float>(live_triangles), -kValenceBoostPower);
+		return score;
+	}
+
+} // namespace vertex_cache_detail
+
+/**
+ * Reorders triangles for post-transform vertex cache (Forsyth algorithm).
+ * Destination may point to the same memory as indices.
+ */
+inline void OptimizeVertexCache(unsigned int * destination, const unsigned int * indices,
+	size_t index_count, size_t vertex_count)
+{
+	using namespace vertex_cache_detail;
+
+	const size_t triangle_count = index_count / 3;
+	if (triangle_count == 0)
+		return;
+
+	// Build vertex to triangle adjacency
+	std::vector<unsigned int> live_triangles(vertex_count, 0);
+	for (size_t i = 0; i < index_count; ++i)
+		++live_triangles[indices[i]];
+	std::vector<unsigned int> offsets(vertex_count + 1, 0);
+	for (size_t v = 0; v < vertex_count; ++v)
+		offsets[v + 1] = offsets[v] + live_triangles[v];
+	std::vector<unsigned int> adjacency(index_count);
+	{
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0; t < triangle_count; ++t)
+			for (int k = 0; k < 3; ++k)
+				adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+	}
+
+	std::vector<int> cache_positions(vertex_count, -1);
+	std::vector<float> vertex_scores(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v)
+		vertex_scores[v] = VertexScore(-1, live_triangles[v]);
+
+	std::vector<float> triangle_scores(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+	for (size_t t = 0; t < triangle_count; ++t)
+		triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+
+	// Output may alias input, so keep a copy of source indices
+	std::vector<unsigned int> source(indices, indices + index_count);
+
+	unsigned int cache[kMaxCacheSize + 3];
+	int cache_count = 0;
+	size_t input_cursor = 0;
+	size_t best_triangle = 0;
+	for (size_t t = 1; t < triangle_count; ++t)
+		if (triangle_scores[t] > triangle_scores[best_triangle])
+			best_triangle = t;
+
+	for (size_t output_triangle = 0; output_triangle < triangle_count; ++output_triangle)
+	{
+		// Emit the best triangle
+		emitted[best_triangle] = true;
+		const unsigned int * tri = &source[best_triangle * 3];
+		destination[output_triangle * 3 + 0] = tri[0];
+		destination[output_triangle * 3 + 1] = tri[1];
+		destination[output_triangle * 3 + 2] = tri[2];
+
+		// Put its vertices to the front of LRU cache
+		unsigned int new_cache[kMaxCacheSize + 3];
+		int new_count = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			new_cache[new_count++] = tri[k];
+			--live_triangles[tri[k]];
+		}
+		for (int i = 0; i < cache_count; ++i)
+		{
+			const unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				new_cache[new_count++] = v;
+		}
+		// Update scores for all vertices that were in the cache
+		for (int i = 0; i < new_count; ++i)
+		{
+			const unsigned int v = new_cache[i];
+			cache_positions[v] = (i < kMaxCacheSize) ? i : -1;
+			const float score = VertexScore(cache_positions[v], live_triangles[v]);
+			const float delta = score - vertex_scores[v];
+			vertex_scores[v] = score;
+			for (unsigned int j = offsets[v]; j < offsets[v + 1]; ++j)
+				triangle_scores[adjacency[j]] += delta;
+		}
+		cache_count = std::min(new_count, kMaxCacheSize);
+		for (int i = 0; i < cache_count; ++i)
+			cache[i] = new_cache[i];
+
+		// Find the best triangle among ones using cached vertices
+		float best_score = -1.0f;
+		bool found = false;
+		for (int i = 0; i < cache_count; ++i)
+		{
+			const unsigned int v = cache[i];
+			for (unsigned int j = offsets[v]; j < offsets[v + 1]; ++j)
+			{
+				const unsigned int t = adjacency[j];
+				if (!emitted[t] && triangle_scores[t] > best_score)
+				{
+					best_score = triangle_scores[t];
+					best_triangle = t;
+					found = true;
+				}
+			}
+		}
+		// Cache has no live triangles: continue with the next one in input order
+		if (!found)
+		{
+			while (input_cursor < triangle_count && emitted[input_cursor])
+				++input_cursor;
+			best_triangle = input_cursor;
+		}
+	}
+}
+
+/**
+ * Reorders triangle clusters to reduce overdraw while keeping most of the cache efficiency.
+ * Clusters are split at cache restarts and where local ACMR is low enough (threshold <= 1),
+ * then sorted so that outward facing clusters on the hull are drawn first.
+ * Indices should be already optimized for vertex cache.
+ */
+inline void OptimizeOverdraw(unsigned int * destination, const unsigned int * indices,
+	size_t index_count, const MeshVertex * vertices, size_t vertex_count, float threshold = 1.05f)
+{
+	const unsigned int kCacheSize = 16;
+	const size_t triangle_count = index_count / 3;
+	if (triangle_count == 0)
+		return;
+
+	std::vector<unsigned int> source(indices, indices + index_count);
+
+	// Hard boundaries: triangles whose vertices all miss the cache
+	std::vector<size_t> hard_clusters;
+	{
+		std::vector<unsigned int> timestamps(vertex_count, 0);
+		unsigned int timestamp = kCacheSize + 1;
+		for (size_t t = 0; t < triangle_count; ++t)
+		{
+			unsigned int misses = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				const unsigned int v = source[t * 3 + k];
+				if (timestamp - timestamps[v] > kCacheSize)
+				{
+					timestamps[v] = timestamp++;
+					++misses;
+				}
+			}
+			if (t == 0 || misses == 3)
+				hard_clusters.push_back(t);
+		}
+	}
+	// Soft boundaries inside hard clusters
+	std::vector<size_t> clusters;
+	for (size_t c = 0; c < hard_clusters.size(); ++c)
+	{
+		const size_t start = hard_clusters[c];
+		const size_t end = (c + 1 < hard_clusters.size()) ? hard_clusters[c + 1] : triangle_count;
+		const float cluster_acmr = AnalyzeVertexCache(&source[start * 3], (end - start) * 3, vertex_count, kCacheSize).acmr;
+
+		std::vector<unsigned int> timestamps(vertex_count, 0);
+		unsigned int timestamp = kCacheSize + 1;
+		unsigned int misses = 0;
+		size_t cluster_start = start;
+		clusters.push_back(start);
+		for (size_t t = start; t < end; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				const unsigned int v = source[t * 3 + k];
+				if (timestamp - timestamps[v] > kCacheSize)
+				{
+					timestamps[v] = timestamp++;
+					++misses;
+				}
+			}
+			const size_t cluster_size = t + 1 - cluster_start;
+			if (t + 1 < end && static_cast<float>(misses) <= cluster_acmr * threshold * static_cast<float>(cluster_size)
+				&& cluster_size >= 8)
+			{
+				// Splitting here doesn't ruin cache efficiency
+				cluster_start = t + 1;
+				clusters.push_back(cluster_start);
+				misses = 0;
+				timestamp += kCacheSize + 1; // flush cache
+			}
+		}
+	}
+
+	// Mesh centroid
+	float mesh_centroid[3] = {0.0f, 0.0f, 0.0f};
+	for (size_t i = 0; i < index_count; ++i)
+		for (int k = 0; k < 3; ++k)
+			mesh_centroid[k] += vertices[source[i]].position[k];
+	for (int k = 0; k < 3; ++k)
+		mesh_centroid[k] /= static_cast<float>(index_count);
+
+	// Sort clusters by occlusion potential
+	struct ClusterInfo {
+		size_t start;
+		size_t end;
+		float sort_key;
+	};
+	std::vector<ClusterInfo> infos(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		ClusterInfo& info = infos[c];
+		info.start = clusters[c];
+		info.end = (c + 1 < clusters.size()) ? clusters[c + 1] : triangle_count;
+		float centroid[3] = {0.0f, 0.0f, 0.0f};
+		float normal[3] = {0.0f, 0.0f, 0.0f};
+		float area_sum = 0.0f;
+		for (size_t t = info.start; t < info.end; ++t)
+		{
+			const float * p0 = vertices[source[t * 3 + 0]].position;
+			const float * p1 = vertices[source[t * 3 + 1]].position;
+			const float * p2 = vertices[source[t * 3 + 2]].position;
+			const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+			const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+			// Cross product length is doubled area, so normal is area weighted
+			const float n[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+			const float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int k = 0; k < 3; ++k)
+			{
+				centroid[k] += (p0[k] + p1[k] + p2[k]) * (area / 3.0f);
+				normal[k] += n[k];
+			}
+			area_sum += area;
+		}
+		const float inv_area = (area_sum > 0.0f) ? 1.0f / area_sum : 0.0f;
+		const float normal_length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		const float inv_normal_length = (normal_length > 0.0f) ? 1.0f / normal_length : 0.0f;
+		info.sort_key = 0.0f;
+		for (int k = 0; k < 3; ++k)
+			info.sort_key += (centroid[k] * inv_area - mesh_centroid[k]) * normal[k] * inv_normal_length;
+	}
+	std::stable_sort(infos.begin(), infos.end(), [](const ClusterInfo& a, const ClusterInfo& b) {
+		return a.sort_key > b.sort_key;
+	});
+
+	size_t offset = 0;
+	for (const auto& info : infos)
+	{
+		const size_t count = (info.end - info.start) * 3;
+		std::copy(source.begin() + info.start * 3, source.begin() + info.start * 3 + count, destination + offset);
+		offset += count;
+	}
+}
+
+/**
+ * Reorders vertices in order of first use to improve pre-transform cache locality.
+ */
+inline void OptimizeVertexFetch(MeshData * data)
+{
+	const unsigned int kUnused = ~0u;
+	std::vector<unsigned int> remap(data->vertices.size(), kUnused);
+	std::vector<MeshVertex> vertices;
+	vertices.reserve(data->vertices.size());
+	for (auto& index : data->indices)
+	{
+		if (remap[index] == kUnused)
+		{
+			remap[index] = static_cast<unsigned int>(vertices.size());
+			vertices.push_back(data->vertices[index]);
+		}
+		index = remap[index];
+	}
+	data->vertices.swap(vertices);
+}
+
+/**
+ * Runs all optimization passes on mesh data. Should be done before making mesh renderable.
+ * @return Cache statistics before and after, callers report them if they need to.
+ */
+inline MeshOptimizationStatistics OptimizeMesh(MeshData * data, float overdraw_threshold = 1.05f)
+{
+	MeshOptimizationStatistics statistics;
+	unsigned int * indices = data->indices.data();
+	const size_t index_count = data->indices.size();
+	const size_t vertex_count = data->vertices.size();
+
+	statistics.before = AnalyzeVertexCache(indices, index_count, vertex_count);
+	OptimizeVertexCache(indices, indices, index_count, vertex_count);
+	OptimizeOverdraw(indices, indices, index_count, data->vertices.data(), vertex_count, overdraw_threshold);
+	OptimizeVertexFetch(data);
+	statistics.after = AnalyzeVertexCache(data->indices.data(), index_count, data->vertices.size());
+	return statistics;
+}
+
+#endif
\ No newline at end of file